@@ -17,7 +17,9 @@
 #ifndef LIBRILUTILS_H
 #define LIBRILUTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,6 +33,29 @@ extern "C" {
  */
 uint64_t ril_nano_time();
 
+/**
+ * Decodes the "hexLen" hex digits at "hex" (either case, not NUL
+ * terminated) into "out", which holds "outSize" bytes.
+ *
+ * Returns the number of bytes written, or -1 if "hexLen" is odd, "out" is
+ * too small or "hex" has a character that is not a hex digit. "out" may be
+ * partly written on error.
+ */
+ssize_t ril_hex_decode(const char *hex, size_t hexLen, uint8_t *out, size_t outSize);
+
+/**
+ * Returns 1 if "hex" is "hexLen" hex digits of whole bytes, else 0.
+ */
+int ril_hex_validate(const char *hex, size_t hexLen);
+
+/**
+ * Encodes "len" bytes at "in" into "out" as upper case hex digits, followed
+ * by a NUL; "out" must hold at least 2 * len + 1 chars.
+ *
+ * Returns the number of digits written (2 * len), or -1 if "out" is too small.
+ */
+ssize_t ril_hex_encode(const uint8_t *in, size_t len, char *out, size_t outSize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4044,6 +4044,11 @@ typedef struct {
  * (((AsyncResult)response.obj).exception) being an instance of
  * com.android.internal.telephony.gsm.CommandException
  *
+ * A "response" that does not fit in a oneway binder transaction (half the
+ * 1 MiB - 2 page buffer libhwbinder maps, less a page for the rest of the
+ * parcel) is not delivered; the request fails with NO_MEMORY instead.
+ * Return bulk data through RIL_UNSOL_OEM_HOOK_RAW.
+ *
  * Valid errors:
  *  All
  */
@@ -6750,6 +6755,20 @@ typedef struct {
  * This is for OEM specific use.
  *
  * "data" is a byte[]
+ *
+ * By default "data" is delivered as one indication, and one too large for a
+ * oneway binder transaction (see RIL_REQUEST_OEM_HOOK_RAW) is dropped.
+ *
+ * When rild is built with RILD_OEM_HOOK_RAW_FRAMING set, every "data" is
+ * instead sent as a transfer: one indication holding a
+ * RIL_OemHookRawFrameHeader, in host byte order, then "frames" indications
+ * of at most 64 KiB that hold "data" in order. Transfers don't interleave.
+ * The receiver must opt in as well: after a header, it appends the next
+ * indications until it holds totalLength bytes.
+ *
+ * Oneway indications aren't acknowledged, so rild can't pace a transfer to
+ * the receiver. A transfer that would not fit in the receiver's binder
+ * buffer for oneway calls all at once (a little under 512 KiB) is dropped.
  */
 #define RIL_UNSOL_OEM_HOOK_RAW 1028
 
@@ -7112,6 +7131,12 @@ typedef void (*RIL_Cancel)(RIL_Token t);
 
 typedef void (*RIL_TimedCallback) (void *param);
 
+/**
+ * Called once "fd" is readable, or with "timedOut" set if it didn't
+ * become readable in time; see RIL_requestFdCallback
+ */
+typedef void (*RIL_FdCallback) (int fd, int timedOut, void *param);
+
 /**
  * Return a version string for your RIL implementation
  */
@@ -7126,6 +7151,21 @@ typedef struct {
     RIL_GetVersion getVersion;
 } RIL_RadioFunctions;
 
+/*
+ * Vendor RIL capabilities, for RIL_setVendorCapabilities. They are
+ * independent of RIL_VERSION: the version says which structures and
+ * semantics the vendor RIL was written against, a capability only what
+ * libril may additionally rely on.
+ */
+
+/*
+ * The "data" passed to RIL_RequestFunc, and every buffer it points to, is
+ * strictly read-only: the vendor RIL never writes through any of these
+ * pointers. libril then hands it the strings received from the framework
+ * in place instead of copying them for each request.
+ */
+#define RIL_CAPABILITY_CONST_REQUEST_DATA (1 << 0)
+
 typedef struct {
     char *apn;                  /* the APN to connect to */
     char *protocol;             /* one of the PDP_type values in TS 27.007 section 10.1.1 used on
@@ -7212,6 +7252,16 @@ typedef struct {
     RIL_KeepaliveStatusCode code;
 } RIL_KeepaliveStatus;
 
+#define RIL_OEM_HOOK_RAW_FRAME_MAGIC 0x4652484fU /* "OHRF" little endian */
+
+/* Opens each RIL_UNSOL_OEM_HOOK_RAW transfer when rild frames them */
+typedef struct {
+    uint32_t magic;             /* RIL_OEM_HOOK_RAW_FRAME_MAGIC */
+    uint32_t transferId;        /* one more than the previous transfer's */
+    uint32_t frames;            /* number of data indications that follow */
+    uint32_t totalLength;       /* length of the whole "data", in bytes */
+} RIL_OemHookRawFrameHeader;
+
 #ifdef RIL_SHLIB
 struct RIL_Env {
     /**
@@ -7262,6 +7312,24 @@ struct RIL_Env {
     * by them and an ack needs to be sent back to java ril.
     */
     void (*OnRequestAck) (RIL_Token t);
+
+    /**
+     * Call user-specified "callback" once, on the same thread that
+     * RIL_RequestFunc is called, when "fd" becomes readable or when
+     * "timeout" has passed, whichever comes first (NULL waits for "fd"
+     * alone). The callback owns "fd" from then on; ask again to keep
+     * waiting. "fd" is made non-blocking.
+     *
+     * An "fd" that is already being waited on, or one more than libril
+     * can watch at once, is not waited on: "callback" is called with
+     * "timedOut" set straight away.
+     *
+     * This member was added last; a rild built before it passes a
+     * shorter RIL_Env. Check that libril exports RIL_requestFdCallback
+     * before reading it.
+     */
+    void (*RequestFdCallback) (int fd, RIL_FdCallback callback, void *param,
+                               const struct timeval *timeout);
 };
 
 
@@ -7369,8 +7437,33 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
 void RIL_requestTimedCallback (RIL_TimedCallback callback,
                                void *param, const struct timeval *relativeTime);
 
+/**
+ * Call user-specified "callback" once, on the same thread that
+ * RIL_RequestFunc is called, when "fd" becomes readable or when "timeout"
+ * has passed, whichever comes first. An "fd" already waited on, or one
+ * more than libril can watch, times out straight away
+ *
+ * @param fd file descriptor to wait on, made non-blocking
+ * @param callback user-specified callback function
+ * @param param parameter list
+ * @param timeout how long to wait for "fd", or NULL to wait for it alone
+ */
+
+void RIL_requestFdCallback (int fd, RIL_FdCallback callback, void *param,
+                            const struct timeval *timeout);
+
 #endif /* RIL_SHLIB */
 
+/**
+ * Tells libril which RIL_CAPABILITY_* the vendor RIL has; none are assumed
+ * until it is called. Call it from RIL_Init, before returning the
+ * RIL_RadioFunctions. A vendor RIL built as a shared library should look
+ * it up with dlsym, as an older libril doesn't have it.
+ *
+ * @param capabilities RIL_CAPABILITY_* flags or'ed together
+ */
+void RIL_setVendorCapabilities(uint32_t capabilities);
+
 #ifdef __cplusplus
 }
 #endif
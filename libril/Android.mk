@@ -38,6 +38,12 @@ ifneq ($(DISABLE_RILD_OEM_HOOK),)
     LOCAL_CFLAGS += -DOEM_HOOK_DISABLED
 endif
 
+# Frame RIL_UNSOL_OEM_HOOK_RAW payloads, see ril.h; the OEM client must
+# expect the frames
+ifneq ($(RILD_OEM_HOOK_RAW_FRAMING),)
+    LOCAL_CFLAGS += -DOEM_HOOK_RAW_FRAMING
+endif
+
 LOCAL_C_INCLUDES += external/nanopb-c
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/../include
@@ -49,3 +55,22 @@ LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
 LOCAL_SANITIZE := integer
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Host timings of the convertToHal() overloads in ril_convert.h, built
+# against the radio@1.0 stand-ins in tests/radio_types_mock.h
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= tests/ril_convert_benchmark.cpp
+
+LOCAL_STATIC_LIBRARIES := libgoogle-benchmark
+
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused-parameter -Werror
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
+
+LOCAL_MODULE:= libril_convert_benchmark
+LOCAL_LICENSE_KINDS:= SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS:= notice
+LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
+include $(BUILD_HOST_EXECUTABLE)
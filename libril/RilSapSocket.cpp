@@ -34,10 +34,16 @@ extern "C" void
 RIL_requestTimedCallback (RIL_TimedCallback callback, void *param,
         const struct timeval *relativeTime);
 
+extern "C" void
+RIL_requestFdCallback (int fd, RIL_FdCallback callback, void *param,
+        const struct timeval *timeout);
+
 struct RIL_Env RilSapSocket::uimRilEnv = {
         .OnRequestComplete = RilSapSocket::sOnRequestComplete,
         .OnUnsolicitedResponse = RilSapSocket::sOnUnsolicitedResponse,
-        .RequestTimedCallback = RIL_requestTimedCallback
+        .RequestTimedCallback = RIL_requestTimedCallback,
+        .OnRequestAck = NULL,
+        .RequestFdCallback = RIL_requestFdCallback
 };
 
 void RilSapSocket::sOnRequestComplete (RIL_Token t,
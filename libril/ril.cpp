@@ -83,11 +83,27 @@ namespace android {
 
 enum WakeType {DONT_WAKE, WAKE_PARTIAL};
 
+/**
+ * REPLAY_LATEST keeps the last payload of an indication that carries a
+ * whole state (not an event), so that a client that connects later gets it
+ * without polling. The payload must be flat: it is kept as a byte copy.
+ *
+ * REPLAY_WHILE_ON is the same for state that only holds while the radio is
+ * on (signal, serving cell, ...): it is dropped when the radio state
+ * changes, and not kept until libril has seen the new state is
+ * RADIO_STATE_ON.
+ */
+enum ReplayType {NO_REPLAY, REPLAY_LATEST, REPLAY_WHILE_ON};
+
+// Payloads larger than this are not kept for replay
+#define MAX_REPLAY_PAYLOAD 8192
+
 typedef struct {
     int requestNumber;
     int (*responseFunction) (int slotId, int responseType, int token,
             RIL_Errno e, void *response, size_t responselen);
     WakeType wakeType;
+    ReplayType replayType;
 } UnsolResponseInfo;
 
 typedef struct UserCallbackInfo {
@@ -189,10 +205,38 @@ static UnsolResponseInfo s_unsolResponses[] = {
 #include "ril_unsol_commands.h"
 };
 
+typedef struct {
+    void *data;         // NULL if nothing is kept
+    size_t datalen;
+    size_t capacity;
+} ReplayEntry;
+
+// Latest kept payload per slot and unsolicited response index
+static ReplayEntry s_replayCache[SIM_COUNT][NUM_ELEMS(s_unsolResponses)];
+static pthread_mutex_t s_replayCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Radio state per slot as far as the replay cache knows, guarded by
+// s_replayCacheMutex. The generation counts RADIO_STATE_CHANGED.
+static bool s_radioOn[SIM_COUNT];
+static unsigned s_radioStateGeneration[SIM_COUNT];
+
 char * RIL_getServiceName() {
     return ril_service_name;
 }
 
+// RIL_CAPABILITY_* flags set by the vendor RIL
+static uint32_t s_vendorCapabilities;
+
+extern "C" void
+RIL_setVendorCapabilities(uint32_t capabilities) {
+    RLOGI("RIL_setVendorCapabilities: 0x%x", capabilities);
+    s_vendorCapabilities = capabilities;
+}
+
+uint32_t RIL_getVendorCapabilities() {
+    return s_vendorCapabilities;
+}
+
 RequestInfo *
 addRequestToList(int serial, int slotId, int request) {
     RequestInfo *pRI;
@@ -283,12 +327,9 @@ static void resendLastNITZTimeData(RIL_SOCKET_ID socket_id) {
         int responseType = (s_callbacks.version >= 13)
                            ? RESPONSE_UNSOLICITED_ACK_EXP
                            : RESPONSE_UNSOLICITED;
-        // acquire read lock for the service before calling nitzTimeReceivedInd() since it reads
-        // nitzTimeReceived in ril_service
-        pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock(
-                (int) socket_id);
-        int rwlockRet = pthread_rwlock_rdlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        // acquire read lock for the service before calling nitzTimeReceivedInd() since it uses
+        // the service's indication callback
+        radio::lockRadioServiceForRead((int) socket_id);
 
         int ret = radio::nitzTimeReceivedInd(
             (int)socket_id, responseType, 0,
@@ -298,9 +339,113 @@ static void resendLastNITZTimeData(RIL_SOCKET_ID socket_id) {
             s_lastNITZTimeData = NULL;
         }
 
-        rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        radio::unlockRadioServiceForRead((int) socket_id);
+    }
+}
+
+/**
+ * Keeps a copy of "data" as the latest payload of an unsolicited response.
+ * The buffer is reused while it is large enough. A payload that is too
+ * large to keep drops the older one, so that it is never replayed as
+ * current. Called with s_replayCacheMutex held.
+ */
+static void storeReplayPayload_locked(RIL_SOCKET_ID socket_id, int unsolResponseIndex,
+                                      const void *data, size_t datalen) {
+    ReplayEntry *p_entry = &s_replayCache[socket_id][unsolResponseIndex];
+
+    if ((data == NULL && datalen != 0) || datalen > MAX_REPLAY_PAYLOAD) {
+        free(p_entry->data);
+        memset(p_entry, 0, sizeof(*p_entry));
+        return;
+    }
+
+    if (p_entry->data == NULL || datalen > p_entry->capacity) {
+        // keep at least one byte so that an empty payload is still kept
+        void *p_data = realloc(p_entry->data, datalen > 0 ? datalen : 1);
+        if (p_data == NULL) {
+            RLOGE("storeReplayPayload_locked: out of memory");
+            free(p_entry->data);
+            memset(p_entry, 0, sizeof(*p_entry));
+            return;
+        }
+        p_entry->data = p_data;
+        p_entry->capacity = datalen > 0 ? datalen : 1;
+    }
+    if (datalen > 0) {
+        memcpy(p_entry->data, data, datalen);
+    }
+    p_entry->datalen = datalen;
+}
+
+/**
+ * Drops every REPLAY_WHILE_ON payload kept for "socket_id", once the radio
+ * may have left RADIO_STATE_ON: a client that connects while it is off
+ * must not be told about a signal or a cell the radio no longer sees.
+ * Called with s_replayCacheMutex held.
+ */
+static void clearRadioOnReplayPayloads_locked(RIL_SOCKET_ID socket_id) {
+    for (int i = 0; i < (int) NUM_ELEMS(s_unsolResponses); i++) {
+        ReplayEntry *p_entry = &s_replayCache[socket_id][i];
+
+        if (s_unsolResponses[i].replayType != REPLAY_WHILE_ON || p_entry->data == NULL) {
+            continue;
+        }
+        free(p_entry->data);
+        memset(p_entry, 0, sizeof(*p_entry));
+    }
+}
+
+/**
+ * Asks the vendor RIL for the radio state after a RADIO_STATE_CHANGED.
+ * Runs on the event loop rather than in RIL_onUnsolicitedResponse, which
+ * the vendor RIL may call with its own locks held. The answer is dropped
+ * if the state has changed again since, as that change queued its own.
+ */
+static void refreshRadioState(void *param) {
+    RIL_SOCKET_ID socket_id = (RIL_SOCKET_ID)(intptr_t) param;
+    RIL_RadioState state;
+    unsigned generation;
+
+    pthread_mutex_lock(&s_replayCacheMutex);
+    generation = s_radioStateGeneration[socket_id];
+    pthread_mutex_unlock(&s_replayCacheMutex);
+
+#if defined(ANDROID_MULTI_SIM)
+    state = s_callbacks.onStateRequest(socket_id);
+#else
+    state = s_callbacks.onStateRequest();
+#endif
+
+    pthread_mutex_lock(&s_replayCacheMutex);
+    if (generation == s_radioStateGeneration[socket_id]) {
+        s_radioOn[socket_id] = (state == RADIO_STATE_ON);
     }
+    pthread_mutex_unlock(&s_replayCacheMutex);
+}
+
+/**
+ * Sends a newly connected client the latest kept payload of every
+ * unsolicited response, in table order. New unsolicited responses wait on
+ * the cache until the replay is done, so they can't be overtaken by an
+ * older replayed value.
+ */
+static void replayLatestUnsolicited(RIL_SOCKET_ID socket_id) {
+    pthread_mutex_lock(&s_replayCacheMutex);
+    radio::lockRadioServiceForRead((int) socket_id);
+
+    for (int i = 0; i < (int) NUM_ELEMS(s_unsolResponses); i++) {
+        ReplayEntry *p_entry = &s_replayCache[socket_id][i];
+
+        if (p_entry->data == NULL || s_unsolResponses[i].responseFunction == NULL) {
+            continue;
+        }
+        RLOGD("replaying %s", requestToString(s_unsolResponses[i].requestNumber));
+        s_unsolResponses[i].responseFunction((int) socket_id, RESPONSE_UNSOLICITED, 0,
+                RIL_E_SUCCESS, p_entry->datalen > 0 ? p_entry->data : NULL, p_entry->datalen);
+    }
+
+    radio::unlockRadioServiceForRead((int) socket_id);
+    pthread_mutex_unlock(&s_replayCacheMutex);
 }
 
 void onNewCommandConnect(RIL_SOCKET_ID socket_id) {
@@ -318,6 +463,9 @@ void onNewCommandConnect(RIL_SOCKET_ID socket_id) {
         resendLastNITZTimeData(socket_id);
     }
 
+    // and the latest state the client would otherwise have to poll for
+    replayLatestUnsolicited(socket_id);
+
     // Get version string
     if (s_callbacks.getVersion != NULL) {
         const char *version;
@@ -574,15 +722,11 @@ RIL_onRequestAck(RIL_Token t) {
     appendPrintBuf("Ack [%04d]< %s", pRI->token, requestToString(pRI->pCI->requestNumber));
 
     if (pRI->cancelled == 0) {
-        pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock(
-                (int) socket_id);
-        int rwlockRet = pthread_rwlock_rdlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        radio::lockRadioServiceForRead((int) socket_id);
 
         radio::acknowledgeRequest((int) socket_id, pRI->token);
 
-        rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        radio::unlockRadioServiceForRead((int) socket_id);
     }
 }
 extern "C" void
@@ -631,15 +775,12 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
         RLOGE ("Calling responseFunction() for token %d", pRI->token);
 #endif
 
-        pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock((int) socket_id);
-        int rwlockRet = pthread_rwlock_rdlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        radio::lockRadioServiceForRead((int) socket_id);
 
         ret = pRI->pCI->responseFunction((int) socket_id,
                 responseType, pRI->token, e, response, responselen);
 
-        rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
+        radio::unlockRadioServiceForRead((int) socket_id);
     }
     free(pRI);
 }
@@ -777,27 +918,53 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
         responseType = RESPONSE_UNSOLICITED;
     }
 
-    pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock((int) soc_id);
-    int rwlockRet;
-
     if (unsolResponse == RIL_UNSOL_NITZ_TIME_RECEIVED) {
-        // get a write lock in caes of NITZ since setNitzTimeReceived() is called
-        rwlockRet = pthread_rwlock_wrlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
         radio::setNitzTimeReceived((int) soc_id, android::elapsedRealtime());
-    } else {
-        rwlockRet = pthread_rwlock_rdlock(radioServiceRwlockPtr);
-        assert(rwlockRet == 0);
     }
 
+    // kept whether or not a client gets it now: a client that connects
+    // later has not seen it either
+    pthread_mutex_lock(&s_replayCacheMutex);
+
+    switch (s_unsolResponses[unsolResponseIndex].replayType) {
+        case REPLAY_LATEST:
+            storeReplayPayload_locked(soc_id, unsolResponseIndex, data, datalen);
+        break;
+
+        case REPLAY_WHILE_ON:
+            if (s_radioOn[soc_id]) {
+                storeReplayPayload_locked(soc_id, unsolResponseIndex, data, datalen);
+            }
+        break;
+
+        case NO_REPLAY:
+        default:
+            break;
+    }
+
+    // the indication doesn't say what the state is now: until the event
+    // loop has asked, assume it isn't on
+    if (unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED) {
+        s_radioOn[soc_id] = false;
+        s_radioStateGeneration[soc_id]++;
+        clearRadioOnReplayPayloads_locked(soc_id);
+    }
+
+    pthread_mutex_unlock(&s_replayCacheMutex);
+
+    if (unsolResponse == RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED) {
+        internalRequestTimedCallback(refreshRadioState, (void *)(intptr_t) soc_id, NULL);
+    }
+
+    radio::lockRadioServiceForRead((int) soc_id);
+
     if (s_unsolResponses[unsolResponseIndex].responseFunction) {
         ret = s_unsolResponses[unsolResponseIndex].responseFunction(
                 (int) soc_id, responseType, 0, RIL_E_SUCCESS, const_cast<void*>(data),
                 datalen);
     }
 
-    rwlockRet = pthread_rwlock_unlock(radioServiceRwlockPtr);
-    assert(rwlockRet == 0);
+    radio::unlockRadioServiceForRead((int) soc_id);
 
     if (s_callbacks.version < 13) {
         if (shouldScheduleTimeout) {
@@ -893,6 +1060,94 @@ RIL_requestTimedCallback (RIL_TimedCallback callback, void *param,
     internalRequestTimedCallback (callback, param, relativeTime);
 }
 
+/**
+ * An fd watch with a timeout. ril_event can't cancel a timer, so both
+ * events stay armed until each has fired or been taken off the watch
+ * list; whichever comes first calls the user back. Everything here runs
+ * on the event loop thread once RIL_requestFdCallback has returned.
+ */
+typedef struct UserFdCallbackInfo {
+    RIL_FdCallback p_callback;
+    void *userParam;
+    struct ril_event fdEvent;
+    struct ril_event timerEvent;
+    int done;           /* the user has been called back */
+    int refs;           /* events still to come */
+} UserFdCallbackInfo;
+
+static void releaseFdCallback(UserFdCallbackInfo *p_info) {
+    if (--p_info->refs == 0) {
+        free(p_info);
+    }
+}
+
+static void userFdReadyCallback(int fd, short flags, void *param) {
+    UserFdCallbackInfo *p_info = (UserFdCallbackInfo *)param;
+
+    if (!p_info->done) {
+        p_info->done = 1;
+        p_info->p_callback(fd, 0, p_info->userParam);
+    }
+
+    releaseFdCallback(p_info);
+}
+
+static void userFdTimeoutCallback(int fd, short flags, void *param) {
+    UserFdCallbackInfo *p_info = (UserFdCallbackInfo *)param;
+
+    if (!p_info->done) {
+        p_info->done = 1;
+
+        /* unless it's already queued to fire, the fd event never will */
+        if (p_info->fdEvent.index >= 0) {
+            ril_event_del(&p_info->fdEvent);
+            p_info->refs--;
+        }
+
+        p_info->p_callback(p_info->fdEvent.fd, 1, p_info->userParam);
+    }
+
+    releaseFdCallback(p_info);
+}
+
+extern "C" void
+RIL_requestFdCallback (int fd, RIL_FdCallback callback, void *param,
+                                const struct timeval *timeout) {
+    UserFdCallbackInfo *p_info;
+    struct timeval myTimeout;
+
+    p_info = (UserFdCallbackInfo *) calloc(1, sizeof(UserFdCallbackInfo));
+    if (p_info == NULL) {
+        RLOGE("Memory allocation failed in RIL_requestFdCallback");
+        /* still owed a callback; make it a timeout */
+        callback(fd, 1, param);
+        return;
+    }
+
+    p_info->p_callback = callback;
+    p_info->userParam = param;
+    p_info->refs = (timeout != NULL) ? 2 : 1;
+
+    ril_event_set(&p_info->fdEvent, fd, false, userFdReadyCallback, p_info);
+    ril_event_set(&p_info->timerEvent, -1, false, userFdTimeoutCallback, p_info);
+
+    /*
+     * the fd goes in first: the timer must never find it not yet added,
+     * and if the fd fires before the timer is in, the timer just tidies up
+     */
+    if (ril_event_add(&p_info->fdEvent) < 0) {
+        /* can't be watched: time out straight away, from the event loop */
+        p_info->refs = 1;
+        memset(&myTimeout, 0, sizeof(myTimeout));
+        ril_timer_add(&p_info->timerEvent, &myTimeout);
+    } else if (timeout != NULL) {
+        memcpy(&myTimeout, timeout, sizeof(myTimeout));
+        ril_timer_add(&p_info->timerEvent, &myTimeout);
+    }
+
+    triggerEvLoop();
+}
+
 const char *
 failCauseToString(RIL_Errno e) {
     switch(e) {
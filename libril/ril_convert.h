@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RIL_CONVERT_H
+#define RIL_CONVERT_H
+
+/*
+ * Field-by-field converters for the RIL structs that appear inside several
+ * responses and indications. Each RIL struct has one convertToHal()
+ * overload, and the composite types (cell info, signal strength) are built
+ * out of them, so a field is mapped in exactly one place.
+ *
+ * The radio@1.0 types must be declared before this is included; it does
+ * not include them itself so that tests/ril_convert_benchmark.cpp can build
+ * it on the host against tests/radio_types_mock.h. The overloads live in
+ * the HAL namespace so that calls find them by argument lookup.
+ */
+
+#include <climits>
+#include <string.h>
+
+#include <telephony/ril.h>
+#include <telephony/ril_mcc.h>
+#include <telephony/ril_mnc.h>
+
+namespace android {
+namespace hardware {
+namespace radio {
+namespace V1_0 {
+
+static inline void convertToHal(const RIL_CellIdentityGsm_v12& in, CellIdentityGsm& out) {
+    out.mcc = ::ril::util::mcc::decode(in.mcc);
+    out.mnc = ::ril::util::mnc::decode(in.mnc);
+    out.lac = in.lac;
+    out.cid = in.cid;
+    out.arfcn = in.arfcn;
+    out.bsic = in.bsic;
+}
+
+static inline void convertToHal(const RIL_CellIdentityWcdma_v12& in, CellIdentityWcdma& out) {
+    out.mcc = ::ril::util::mcc::decode(in.mcc);
+    out.mnc = ::ril::util::mnc::decode(in.mnc);
+    out.lac = in.lac;
+    out.cid = in.cid;
+    out.psc = in.psc;
+    out.uarfcn = in.uarfcn;
+}
+
+static inline void convertToHal(const RIL_CellIdentityCdma& in, CellIdentityCdma& out) {
+    out.networkId = in.networkId;
+    out.systemId = in.systemId;
+    out.baseStationId = in.basestationId;
+    out.longitude = in.longitude;
+    out.latitude = in.latitude;
+}
+
+static inline void convertToHal(const RIL_CellIdentityLte_v12& in, CellIdentityLte& out) {
+    out.mcc = ::ril::util::mcc::decode(in.mcc);
+    out.mnc = ::ril::util::mnc::decode(in.mnc);
+    out.ci = in.ci;
+    out.pci = in.pci;
+    out.tac = in.tac;
+    out.earfcn = in.earfcn;
+}
+
+static inline void convertToHal(const RIL_CellIdentityTdscdma& in, CellIdentityTdscdma& out) {
+    out.mcc = ::ril::util::mcc::decode(in.mcc);
+    out.mnc = ::ril::util::mnc::decode(in.mnc);
+    out.lac = in.lac;
+    out.cid = in.cid;
+    out.cpid = in.cpid;
+}
+
+static inline void convertToHal(const RIL_GSM_SignalStrength_v12& in, GsmSignalStrength& out) {
+    out.signalStrength = in.signalStrength;
+    out.bitErrorRate = in.bitErrorRate;
+    out.timingAdvance = in.timingAdvance;
+}
+
+static inline void convertToHal(const RIL_GW_SignalStrength& in, GsmSignalStrength& out) {
+    out.signalStrength = in.signalStrength;
+    out.bitErrorRate = in.bitErrorRate;
+    // RIL_GW_SignalStrength has no timing advance; INT_MAX means invalid
+    out.timingAdvance = INT_MAX;
+}
+
+static inline void convertToHal(const RIL_SignalStrengthWcdma& in, WcdmaSignalStrength& out) {
+    out.signalStrength = in.signalStrength;
+    out.bitErrorRate = in.bitErrorRate;
+}
+
+static inline void convertToHal(const RIL_CDMA_SignalStrength& in, CdmaSignalStrength& out) {
+    out.dbm = in.dbm;
+    out.ecio = in.ecio;
+}
+
+static inline void convertToHal(const RIL_EVDO_SignalStrength& in, EvdoSignalStrength& out) {
+    out.dbm = in.dbm;
+    out.ecio = in.ecio;
+    out.signalNoiseRatio = in.signalNoiseRatio;
+}
+
+static inline void convertToHal(const RIL_LTE_SignalStrength_v8& in, LteSignalStrength& out) {
+    out.signalStrength = in.signalStrength;
+    out.rsrp = in.rsrp;
+    out.rsrq = in.rsrq;
+    out.rssnr = in.rssnr;
+    out.cqi = in.cqi;
+    out.timingAdvance = in.timingAdvance;
+}
+
+static inline void convertToHal(const RIL_TD_SCDMA_SignalStrength& in, TdScdmaSignalStrength& out) {
+    out.rscp = in.rscp;
+}
+
+static inline void convertToHal(const RIL_CellInfoGsm_v12& in, CellInfoGsm& out) {
+    convertToHal(in.cellIdentityGsm, out.cellIdentityGsm);
+    convertToHal(in.signalStrengthGsm, out.signalStrengthGsm);
+}
+
+static inline void convertToHal(const RIL_CellInfoWcdma_v12& in, CellInfoWcdma& out) {
+    convertToHal(in.cellIdentityWcdma, out.cellIdentityWcdma);
+    convertToHal(in.signalStrengthWcdma, out.signalStrengthWcdma);
+}
+
+static inline void convertToHal(const RIL_CellInfoCdma& in, CellInfoCdma& out) {
+    convertToHal(in.cellIdentityCdma, out.cellIdentityCdma);
+    convertToHal(in.signalStrengthCdma, out.signalStrengthCdma);
+    convertToHal(in.signalStrengthEvdo, out.signalStrengthEvdo);
+}
+
+static inline void convertToHal(const RIL_CellInfoLte_v12& in, CellInfoLte& out) {
+    convertToHal(in.cellIdentityLte, out.cellIdentityLte);
+    convertToHal(in.signalStrengthLte, out.signalStrengthLte);
+}
+
+static inline void convertToHal(const RIL_CellInfoTdscdma& in, CellInfoTdscdma& out) {
+    convertToHal(in.cellIdentityTdscdma, out.cellIdentityTdscdma);
+    convertToHal(in.signalStrengthTdscdma, out.signalStrengthTdscdma);
+}
+
+/** Points "out" at "in" without copying it; NULL gives an empty string */
+static inline void convertToHal(const char *in, hidl_string& out) {
+    if (in != NULL) {
+        out.setToExternal(in, strlen(in));
+    } else {
+        out.setToExternal("", 0);
+    }
+}
+
+/** The strings in "out" point into "in", which must outlive it */
+static inline void convertToHal(const RIL_Data_Call_Response_v11& in, SetupDataCallResult& out) {
+    out.status = (DataCallFailCause) in.status;
+    out.suggestedRetryTime = in.suggestedRetryTime;
+    out.cid = in.cid;
+    out.active = in.active;
+    convertToHal(in.type, out.type);
+    convertToHal(in.ifname, out.ifname);
+    convertToHal(in.addresses, out.addresses);
+    convertToHal(in.dnses, out.dnses);
+    convertToHal(in.gateways, out.gateways);
+    convertToHal(in.pcscf, out.pcscf);
+    out.mtu = in.mtu;
+}
+
+}  // namespace V1_0
+}  // namespace radio
+}  // namespace hardware
+}  // namespace android
+
+#endif /* RIL_CONVERT_H */
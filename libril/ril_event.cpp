@@ -262,24 +262,36 @@ void ril_event_set(struct ril_event * ev, int fd, bool persist, ril_event_cb fun
 }
 
 // Add event to watch list
-void ril_event_add(struct ril_event * ev)
+int ril_event_add(struct ril_event * ev)
 {
+    int free_index = -1;
+
     dlog("~~~~ +ril_event_add ~~~~");
     MUTEX_ACQUIRE();
     for (int i = 0; i < MAX_FD_EVENTS; i++) {
         if (watch_table[i] == NULL) {
-            watch_table[i] = ev;
-            ev->index = i;
-            dlog("~~~~ added at %d ~~~~", i);
-            dump_event(ev);
-            FD_SET(ev->fd, &readFds);
-            if (ev->fd >= nfds) nfds = ev->fd+1;
-            dlog("~~~~ nfds = %d ~~~~", nfds);
-            break;
+            if (free_index < 0) free_index = i;
+        } else if (watch_table[i]->fd == ev->fd) {
+            // removing either watch would FD_CLR the other one's fd
+            RLOGE("ril_event_add: fd %d is already watched", ev->fd);
+            MUTEX_RELEASE();
+            return -1;
         }
     }
+    if (free_index < 0) {
+        RLOGE("ril_event_add: all %d watches are in use", MAX_FD_EVENTS);
+    } else {
+        watch_table[free_index] = ev;
+        ev->index = free_index;
+        dlog("~~~~ added at %d ~~~~", free_index);
+        dump_event(ev);
+        FD_SET(ev->fd, &readFds);
+        if (ev->fd >= nfds) nfds = ev->fd+1;
+        dlog("~~~~ nfds = %d ~~~~", nfds);
+    }
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_add ~~~~");
+    return free_index >= 0 ? 0 : -1;
 }
 
 // Add timer event
@@ -38,8 +38,9 @@ void ril_event_init();
 // Initialize an event
 void ril_event_set(struct ril_event * ev, int fd, bool persist, ril_event_cb func, void * param);
 
-// Add event to watch list
-void ril_event_add(struct ril_event * ev);
+// Add event to watch list. Returns -1, leaving the event out, if
+// MAX_FD_EVENTS are already watched or its fd already is
+int ril_event_add(struct ril_event * ev);
 
 // Add timer event
 void ril_timer_add(struct ril_event * ev, struct timeval * tv);
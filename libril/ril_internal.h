@@ -89,6 +89,8 @@ RequestInfo * addRequestToList(int serial, int slotId, int request);
 
 char * RIL_getServiceName();
 
+uint32_t RIL_getVendorCapabilities();
+
 void releaseWakeLock();
 
 void onNewCommandConnect(RIL_SOCKET_ID socket_id);
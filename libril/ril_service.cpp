@@ -28,12 +28,29 @@
 #include <telephony/ril.h>
 #include <telephony/ril_mnc.h>
 #include <telephony/ril_mcc.h>
+#include <telephony/librilutils.h>
 #include <ril_service.h>
+#include <ril_convert.h>
 #include <hidl/HidlTransportSupport.h>
 #include <utils/SystemClock.h>
+#include <assert.h>
 #include <inttypes.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <unistd.h>
 
-#define INVALID_HEX_CHAR 16
+// an SMSC address (12 octets) plus the longest TPDU (164 octets), rounded up
+#define MAX_SMS_PDU_BYTES 256
+
+// Largest data frame of a framed RIL_UNSOL_OEM_HOOK_RAW transfer
+#define OEM_HOOK_RAW_FRAME_BYTES (64 * 1024)
+
+// libhwbinder's per-process transaction buffer, as ProcessState maps it
+#define BINDER_VM_BYTES ((size_t) (1 * 1024 * 1024) - (size_t) sysconf(_SC_PAGE_SIZE) * 2)
+
+// Room left in a oneway transaction for the parcel around the raw bytes
+#define BINDER_PARCEL_OVERHEAD_BYTES ((size_t) sysconf(_SC_PAGE_SIZE))
 
 using namespace android::hardware::radio;
 using namespace android::hardware::radio::V1_0;
@@ -44,6 +61,7 @@ using ::android::hardware::Return;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_death_recipient;
 using ::android::hardware::Void;
 using android::CommandInfo;
 using android::RequestInfo;
@@ -69,38 +87,165 @@ constexpr bool kOemHookEnabled = false;
 constexpr bool kOemHookEnabled = true;
 #endif
 
+#ifdef OEM_HOOK_RAW_FRAMING
+constexpr bool kOemHookRawFraming = true;
+#else
+constexpr bool kOemHookRawFraming = false;
+#endif
+
+/**
+ * Largest raw payload one oneway call to the OEM hook client can carry.
+ * The kernel gives oneway transactions half of the receiver's buffer; the
+ * phone process maps the same libhwbinder default as rild. Larger payloads
+ * fail the transaction, and checkReturnStatus() then drops the client.
+ */
+static size_t oemHookRawMaxBytes() {
+    return BINDER_VM_BYTES / 2 - BINDER_PARCEL_OVERHEAD_BYTES;
+}
+
 RIL_RadioFunctions *s_vendorFunctions = NULL;
 static CommandInfo *s_commands;
 
 struct RadioImpl;
 struct OemHookImpl;
 
+/**
+ * Per-slot lock around the callbacks in radioService[] and oemHookService[].
+ *
+ * Every response and indication reads the callbacks, but they only change
+ * when a client connects or dies, so the lock is biased towards readers. A
+ * reader bumps a counter on a cache line it shares with few other threads
+ * and checks that no writer is active; readers never write a common line,
+ * and a NITZ or any other indication can't hold them up. A writer raises
+ * mWriterActive, sleeps on mDrained until the readers already inside have
+ * left and keeps new ones parked on mWriterLock until it is done. Only a
+ * reader that empties its counter while a writer is active wakes it.
+ *
+ * Neither side may be taken recursively.
+ */
+class RadioServiceLock {
+public:
+    RadioServiceLock() : mWriterActive(false) {
+        pthread_mutex_init(&mWriterLock, NULL);
+        pthread_mutex_init(&mDrainLock, NULL);
+        pthread_cond_init(&mDrained, NULL);
+        mHeldBit = 1u << (sNextHeldBit.fetch_add(1, std::memory_order_relaxed) % 32);
+    }
+
+    void readLock() {
+        std::atomic<int32_t>& readers = mReaders[readerIndex()].count;
+
+        for (;;) {
+            readers.fetch_add(1);
+            if (!mWriterActive.load()) {
+                tReadHeld |= mHeldBit;
+                return;
+            }
+            // back off and wait for the writer
+            leave(readers);
+            pthread_mutex_lock(&mWriterLock);
+            pthread_mutex_unlock(&mWriterLock);
+        }
+    }
+
+    void readUnlock() {
+        tReadHeld &= ~mHeldBit;
+        leave(mReaders[readerIndex()].count);
+    }
+
+    /** True if the calling thread holds the read lock */
+    bool heldForRead() const {
+        return (tReadHeld & mHeldBit) != 0;
+    }
+
+    void writeLock() {
+        pthread_mutex_lock(&mWriterLock);
+        mWriterActive.store(true);
+        pthread_mutex_lock(&mDrainLock);
+        while (!drained()) {
+            pthread_cond_wait(&mDrained, &mDrainLock);
+        }
+        pthread_mutex_unlock(&mDrainLock);
+    }
+
+    void writeUnlock() {
+        mWriterActive.store(false, std::memory_order_release);
+        pthread_mutex_unlock(&mWriterLock);
+    }
+
+private:
+    static const int kReaderCounts = 8;
+
+    /*
+     * Drops a reader from "readers". Both this and writeLock() go through
+     * sequentially consistent operations: either this sees mWriterActive,
+     * or the writer sees the count after it was dropped.
+     */
+    void leave(std::atomic<int32_t>& readers) {
+        if (readers.fetch_sub(1) == 1 && mWriterActive.load()) {
+            pthread_mutex_lock(&mDrainLock);
+            pthread_cond_signal(&mDrained);
+            pthread_mutex_unlock(&mDrainLock);
+        }
+    }
+
+    bool drained() const {
+        for (int i = 0; i < kReaderCounts; i++) {
+            if (mReaders[i].count.load() != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct alignas(64) ReaderCount {
+        std::atomic<int32_t> count;
+        ReaderCount() : count(0) {}
+    };
+
+    // Spreads threads over the counters; a thread always uses the same one
+    static int readerIndex() {
+        static std::atomic<int> sNextIndex(0);
+        static thread_local int tIndex = -1;
+        if (tIndex < 0) {
+            tIndex = sNextIndex.fetch_add(1, std::memory_order_relaxed) % kReaderCounts;
+        }
+        return tIndex;
+    }
+
+    // One bit per lock, set in tReadHeld while the thread holds it for read
+    static std::atomic<int> sNextHeldBit;
+    static thread_local uint32_t tReadHeld;
+
+    ReaderCount mReaders[kReaderCounts];
+    std::atomic<bool> mWriterActive;
+    pthread_mutex_t mWriterLock;
+    pthread_mutex_t mDrainLock;
+    pthread_cond_t mDrained;
+    uint32_t mHeldBit;
+};
+
+std::atomic<int> RadioServiceLock::sNextHeldBit(0);
+thread_local uint32_t RadioServiceLock::tReadHeld = 0;
+
 #if (SIM_COUNT >= 2)
 sp<RadioImpl> radioService[SIM_COUNT];
 sp<OemHookImpl> oemHookService[SIM_COUNT];
-int64_t nitzTimeReceived[SIM_COUNT];
+// written on every NITZ without taking the write lock
+std::atomic<int64_t> nitzTimeReceived[SIM_COUNT];
 // counter used for synchronization. It is incremented every time response callbacks are updated.
 volatile int32_t mCounterRadio[SIM_COUNT];
 volatile int32_t mCounterOemHook[SIM_COUNT];
+static RadioServiceLock radioServiceLock[SIM_COUNT];
 #else
 sp<RadioImpl> radioService[1];
 sp<OemHookImpl> oemHookService[1];
-int64_t nitzTimeReceived[1];
+// written on every NITZ without taking the write lock
+std::atomic<int64_t> nitzTimeReceived[1];
 // counter used for synchronization. It is incremented every time response callbacks are updated.
 volatile int32_t mCounterRadio[1];
 volatile int32_t mCounterOemHook[1];
-#endif
-
-static pthread_rwlock_t radioServiceRwlock = PTHREAD_RWLOCK_INITIALIZER;
-
-#if (SIM_COUNT >= 2)
-static pthread_rwlock_t radioServiceRwlock2 = PTHREAD_RWLOCK_INITIALIZER;
-#if (SIM_COUNT >= 3)
-static pthread_rwlock_t radioServiceRwlock3 = PTHREAD_RWLOCK_INITIALIZER;
-#if (SIM_COUNT >= 4)
-static pthread_rwlock_t radioServiceRwlock4 = PTHREAD_RWLOCK_INITIALIZER;
-#endif
-#endif
+static RadioServiceLock radioServiceLock[1];
 #endif
 
 void convertRilHardwareConfigListToHal(void *response, size_t responseLen,
@@ -113,20 +258,105 @@ void convertRilLceDataInfoToHal(void *response, size_t responseLen, LceDataInfo&
 void convertRilSignalStrengthToHal(void *response, size_t responseLen,
         SignalStrength& signalStrength);
 
-void convertRilDataCallToHal(RIL_Data_Call_Response_v11 *dcResponse,
-        SetupDataCallResult& dcResult);
+void convertRilDataCallListToHal(void *response, size_t count,
+        SetupDataCallResult *dcResultList);
+
+/**
+ * Per-slot storage for a list that is sent often (eg the current calls).
+ * hidl_vec::resize() reallocates every time, so the records live in a
+ * std::vector that keeps its capacity from one call to the next and the
+ * hidl_vec handed to the callback only points at them. Responses can be
+ * completed from any vendor thread, so the records stay locked from lock()
+ * until unlock(), which must follow the callback.
+ */
+template <typename T>
+class ResponseBuilder {
+public:
+    ResponseBuilder() { pthread_mutex_init(&mLock, NULL); }
+    ~ResponseBuilder() { pthread_mutex_destroy(&mLock); }
+
+    /** Returns "count" records to fill in; they hold whatever the last list left */
+    T *lock(size_t count) {
+        pthread_mutex_lock(&mLock);
+        mRecords.resize(count);
+        mList.setToExternal(mRecords.data(), count);
+        return mRecords.data();
+    }
+
+    const hidl_vec<T>& list() const { return mList; }
 
-void convertRilDataCallListToHal(void *response, size_t responseLen,
-        hidl_vec<SetupDataCallResult>& dcResultList);
+    void unlock() {
+        mList.setToExternal(NULL, 0);
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    pthread_mutex_t mLock;
+    std::vector<T> mRecords;
+    hidl_vec<T> mList;
+};
+
+/**
+ * ResponseBuilder for cell info lists. Each CellInfo carries one vector per
+ * RAT of which only the one matching cellInfoType is used; those entries
+ * come from per-RAT pools, so a list is built without allocating once the
+ * pools are large enough, and a record only has its arms reset when its RAT
+ * changes.
+ */
+class CellInfoListBuilder {
+public:
+    CellInfoListBuilder() { pthread_mutex_init(&mLock, NULL); }
+    ~CellInfoListBuilder() { pthread_mutex_destroy(&mLock); }
+
+    /** Converts "count" RIL_CellInfo_v12 records; unlock() once the list is sent */
+    const hidl_vec<CellInfo>& lock(const RIL_CellInfo_v12 *rilCellInfo, size_t count);
+
+    void unlock() {
+        mList.setToExternal(NULL, 0);
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    pthread_mutex_t mLock;
+    std::vector<CellInfo> mRecords;
+    std::vector<CellInfoGsm> mGsm;
+    std::vector<CellInfoWcdma> mWcdma;
+    std::vector<CellInfoCdma> mCdma;
+    std::vector<CellInfoLte> mLte;
+    std::vector<CellInfoTdscdma> mTdscdma;
+    hidl_vec<CellInfo> mList;
+};
+
+/**
+ * Clears a slot's response callbacks as soon as the client that set them
+ * dies, instead of waiting for the next failed transaction to notice. The
+ * cookie is the callback counter at registration, so a late notice for a
+ * client that has since been replaced is ignored.
+ */
+struct ClientDeathRecipient : public hidl_death_recipient {
+    ClientDeathRecipient(int32_t slotId, bool isRadioService)
+            : mSlotId(slotId), mIsRadioService(isRadioService) {}
 
-void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<CellInfo>& records);
+    void serviceDied(uint64_t cookie,
+            const ::android::wp<::android::hidl::base::V1_0::IBase>& who) override;
+
+private:
+    int32_t mSlotId;
+    bool mIsRadioService;
+};
 
 struct RadioImpl : public V1_1::IRadio {
     int32_t mSlotId;
     sp<IRadioResponse> mRadioResponse;
     sp<IRadioIndication> mRadioIndication;
+    // mRadioResponse and mRadioIndication cast to 1.1 by setResponseFunctions(); both NULL
+    // unless the client implements 1.1 for both
     sp<V1_1::IRadioResponse> mRadioResponseV1_1;
     sp<V1_1::IRadioIndication> mRadioIndicationV1_1;
+    sp<ClientDeathRecipient> mDeathRecipient;
+    ResponseBuilder<Call> mCallList;
+    ResponseBuilder<SetupDataCallResult> mDataCallList;
+    CellInfoListBuilder mCellInfoList;
 
     Return<void> setResponseFunctions(
             const ::android::sp<IRadioResponse>& radioResponse,
@@ -469,6 +699,7 @@ struct OemHookImpl : public IOemHook {
     int32_t mSlotId;
     sp<IOemHookResponse> mOemHookResponse;
     sp<IOemHookIndication> mOemHookIndication;
+    sp<ClientDeathRecipient> mDeathRecipient;
 
     Return<void> setResponseFunctions(
             const ::android::sp<IOemHookResponse>& oemHookResponse,
@@ -481,20 +712,77 @@ struct OemHookImpl : public IOemHook {
             const ::android::hardware::hidl_vec<::android::hardware::hidl_string>& data);
 };
 
-void memsetAndFreeStrings(int numPointers, ...) {
-    va_list ap;
-    va_start(ap, numPointers);
-    for (int i = 0; i < numPointers; i++) {
-        char *ptr = va_arg(ap, char *);
-        if (ptr) {
+#define DISPATCH_ARENA_INLINE_SIZE 1024
+#define DISPATCH_ARENA_CHUNK_SIZE 4096
+
+/**
+ * Bump allocator for the arguments of a single dispatch. The pointer arrays,
+ * structs and strings handed to onRequest are carved out of one block that
+ * lives on the caller's stack; only requests that outgrow it (eg a long list
+ * of data profiles) fall back to heap chunks. Everything is released at once
+ * when the arena goes out of scope, after being zeroed if MEMSET_FREED is set.
+ */
+class DispatchArena {
+public:
+    DispatchArena() : mCur(mInline), mEnd(mInline + sizeof(mInline)), mChunks(NULL) {}
+    ~DispatchArena();
+
+    /** Returns "size" zeroed bytes, or NULL if a heap chunk can't be allocated */
+    void *alloc(size_t size);
+
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    static const size_t kAlign = alignof(std::max_align_t);
+    // chunk data starts after the header, rounded up to kAlign
+    static const size_t kChunkHeader = (sizeof(Chunk) + kAlign - 1) & ~(kAlign - 1);
+
+    DispatchArena(const DispatchArena&) = delete;
+    DispatchArena& operator=(const DispatchArena&) = delete;
+
+    alignas(std::max_align_t) char mInline[DISPATCH_ARENA_INLINE_SIZE];
+    char *mCur;
+    char *mEnd;
+    Chunk *mChunks;
+};
+
+void *DispatchArena::alloc(size_t size) {
+    size = (size + kAlign - 1) & ~(kAlign - 1);
+
+    if ((size_t) (mEnd - mCur) < size) {
+        size_t chunkSize = size > DISPATCH_ARENA_CHUNK_SIZE ? size : DISPATCH_ARENA_CHUNK_SIZE;
+        Chunk *chunk = (Chunk *) malloc(kChunkHeader + chunkSize);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = mChunks;
+        chunk->size = chunkSize;
+        mChunks = chunk;
+        mCur = (char *) chunk + kChunkHeader;
+        mEnd = mCur + chunkSize;
+    }
+
+    void *ret = mCur;
+    mCur += size;
+    memset(ret, 0, size);
+    return ret;
+}
+
+DispatchArena::~DispatchArena() {
+    while (mChunks != NULL) {
+        Chunk *next = mChunks->next;
 #ifdef MEMSET_FREED
-#define MAX_STRING_LENGTH 4096
-            memset(ptr, 0, strnlen(ptr, MAX_STRING_LENGTH));
+        memset((char *) mChunks + kChunkHeader, 0, mChunks->size);
 #endif
-            free(ptr);
-        }
+        free(mChunks);
+        mChunks = next;
     }
-    va_end(ap);
+#ifdef MEMSET_FREED
+    memset(mInline, 0, sizeof(mInline));
+#endif
 }
 
 void sendErrorResponse(RequestInfo *pRI, RIL_Errno err) {
@@ -503,21 +791,39 @@ void sendErrorResponse(RequestInfo *pRI, RIL_Errno err) {
 }
 
 /**
- * Copies over src to dest. If memory allocation fails, responseFunction() is called for the
- * request with error RIL_E_NO_MEMORY. The size() method is used to determine the size of the
- * destination buffer into which the HIDL string is copied. If there is a discrepancy between
- * the string length reported by the size() method, and the length of the string returned by
- * the c_str() method, the function will return false indicating a failure.
+ * True if the vendor RIL never writes through the onRequest() data pointers
+ * (see RIL_CAPABILITY_CONST_REQUEST_DATA), so buffers that outlive the
+ * synchronous onRequest() call can be handed to it without a copy.
+ */
+static bool vendorTakesConstData() {
+    return (RIL_getVendorCapabilities() & RIL_CAPABILITY_CONST_REQUEST_DATA) != 0;
+}
+
+/**
+ * Copies over src to dest, allocating the copy from "arena"; it must not be freed. If memory
+ * allocation fails, responseFunction() is called for the request with error RIL_E_NO_MEMORY.
+ * The size() method is used to determine the size of the destination buffer into which the
+ * HIDL string is copied. If there is a discrepancy between the string length reported by the
+ * size() method, and the length of the string returned by the c_str() method, the function
+ * will return false indicating a failure.
+ *
+ * A vendor RIL that takes request data read-only gets the HIDL string's own buffer instead:
+ * it is NUL-terminated and stays valid until the dispatch returns, so no copy is needed.
  *
  * Returns true on success, and false on failure.
  */
-bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI, bool allowEmpty) {
+bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI, bool allowEmpty,
+                         DispatchArena &arena) {
     size_t len = src.size();
     if (len == 0 && !allowEmpty) {
         *dest = NULL;
         return true;
     }
-    *dest = (char *) calloc(len + 1, sizeof(char));
+    if (vendorTakesConstData()) {
+        *dest = const_cast<char *>(src.c_str());
+        return true;
+    }
+    *dest = (char *) arena.alloc(len + 1);
     if (*dest == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(pRI->pCI->requestNumber));
         sendErrorResponse(pRI, RIL_E_NO_MEMORY);
@@ -527,7 +833,6 @@ bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI,
         RLOGE("Copy of the HIDL string has been truncated, as "
               "the string length reported by size() does not "
               "match the length of string returned by c_str().");
-        free(*dest);
         *dest = NULL;
         sendErrorResponse(pRI, RIL_E_INTERNAL_ERR);
         return false;
@@ -535,8 +840,9 @@ bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI,
     return true;
 }
 
-bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI) {
-    return copyHidlStringToRil(dest, src, pRI, false);
+bool copyHidlStringToRil(char **dest, const hidl_string &src, RequestInfo *pRI,
+                         DispatchArena &arena) {
+    return copyHidlStringToRil(dest, src, pRI, false, arena);
 }
 
 hidl_string convertCharPtrToHidlString(const char *ptr) {
@@ -563,14 +869,27 @@ bool dispatchString(int serial, int slotId, int request, const char * str) {
         return false;
     }
 
-    char *pString;
-    if (!copyHidlStringToRil(&pString, str, pRI)) {
-        return false;
+    // "str" outlives this call, so a vendor RIL that takes request data
+    // read-only gets it in place
+    DispatchArena arena;
+    char *pString = NULL;
+    size_t len = str != NULL ? strlen(str) : 0;
+    if (len > 0) {
+        if (vendorTakesConstData()) {
+            pString = const_cast<char *>(str);
+        } else {
+            pString = (char *) arena.alloc(len + 1);
+            if (pString == NULL) {
+                RLOGE("Memory allocation failed for request %s", requestToString(request));
+                sendErrorResponse(pRI, RIL_E_NO_MEMORY);
+                return false;
+            }
+            memcpy(pString, str, len);
+        }
     }
 
     CALL_ONREQUEST(request, pString, sizeof(char *), pRI, slotId);
 
-    memsetAndFreeStrings(1, pString);
     return true;
 }
 
@@ -580,40 +899,45 @@ bool dispatchStrings(int serial, int slotId, int request, bool allowEmpty, int c
         return false;
     }
 
+    DispatchArena arena;
     char **pStrings;
-    pStrings = (char **)calloc(countStrings, sizeof(char *));
+    pStrings = (char **)arena.alloc(countStrings * sizeof(char *));
     if (pStrings == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(request));
         sendErrorResponse(pRI, RIL_E_NO_MEMORY);
         return false;
     }
+    bool passThrough = vendorTakesConstData();
     va_list ap;
     va_start(ap, countStrings);
     for (int i = 0; i < countStrings; i++) {
         const char* str = va_arg(ap, const char *);
-        if (!copyHidlStringToRil(&pStrings[i], hidl_string(str), pRI, allowEmpty)) {
+        // copied straight from the C string: a hidl_string temporary would
+        // allocate a copy of its own. The arguments outlive this call, so a
+        // vendor RIL that takes request data read-only gets them in place.
+        size_t len = str != NULL ? strlen(str) : 0;
+        if (len == 0 && !allowEmpty) {
+            continue;
+        }
+        if (passThrough && str != NULL) {
+            pStrings[i] = const_cast<char *>(str);
+            continue;
+        }
+        pStrings[i] = (char *) arena.alloc(len + 1);
+        if (pStrings[i] == NULL) {
             va_end(ap);
-            for (int j = 0; j < i; j++) {
-                memsetAndFreeStrings(1, pStrings[j]);
-            }
-            free(pStrings);
+            RLOGE("Memory allocation failed for request %s", requestToString(request));
+            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
             return false;
         }
+        if (len > 0) {
+            memcpy(pStrings[i], str, len);
+        }
     }
     va_end(ap);
 
     CALL_ONREQUEST(request, pStrings, countStrings * sizeof(char *), pRI, slotId);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-            memsetAndFreeStrings(1, pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, countStrings * sizeof(char *));
-#endif
-        free(pStrings);
-    }
     return true;
 }
 
@@ -623,9 +947,10 @@ bool dispatchStrings(int serial, int slotId, int request, const hidl_vec<hidl_st
         return false;
     }
 
+    DispatchArena arena;
     int countStrings = data.size();
     char **pStrings;
-    pStrings = (char **)calloc(countStrings, sizeof(char *));
+    pStrings = (char **)arena.alloc(countStrings * sizeof(char *));
     if (pStrings == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(request));
         sendErrorResponse(pRI, RIL_E_NO_MEMORY);
@@ -633,27 +958,13 @@ bool dispatchStrings(int serial, int slotId, int request, const hidl_vec<hidl_st
     }
 
     for (int i = 0; i < countStrings; i++) {
-        if (!copyHidlStringToRil(&pStrings[i], data[i], pRI)) {
-            for (int j = 0; j < i; j++) {
-                memsetAndFreeStrings(1, pStrings[j]);
-            }
-            free(pStrings);
+        if (!copyHidlStringToRil(&pStrings[i], data[i], pRI, arena)) {
             return false;
         }
     }
 
     CALL_ONREQUEST(request, pStrings, countStrings * sizeof(char *), pRI, slotId);
 
-    if (pStrings != NULL) {
-        for (int i = 0 ; i < countStrings ; i++) {
-            memsetAndFreeStrings(1, pStrings[i]);
-        }
-
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, countStrings * sizeof(char *));
-#endif
-        free(pStrings);
-    }
     return true;
 }
 
@@ -663,7 +974,8 @@ bool dispatchInts(int serial, int slotId, int request, int countInts, ...) {
         return false;
     }
 
-    int *pInts = (int *)calloc(countInts, sizeof(int));
+    DispatchArena arena;
+    int *pInts = (int *)arena.alloc(countInts * sizeof(int));
 
     if (pInts == NULL) {
         RLOGE("Memory allocation failed for request %s", requestToString(request));
@@ -679,12 +991,6 @@ bool dispatchInts(int serial, int slotId, int request, int countInts, ...) {
 
     CALL_ONREQUEST(request, pInts, countInts * sizeof(int), pRI, slotId);
 
-    if (pInts != NULL) {
-#ifdef MEMSET_FREED
-        memset(pInts, 0, countInts * sizeof(int));
-#endif
-        free(pInts);
-    }
     return true;
 }
 
@@ -702,14 +1008,13 @@ bool dispatchCallForwardStatus(int serial, int slotId, int request,
     cf.toa = callInfo.toa;
     cf.timeSeconds = callInfo.timeSeconds;
 
-    if (!copyHidlStringToRil(&cf.number, callInfo.number, pRI)) {
+    DispatchArena arena;
+    if (!copyHidlStringToRil(&cf.number, callInfo.number, pRI, arena)) {
         return false;
     }
 
     CALL_ONREQUEST(request, &cf, sizeof(cf), pRI, slotId);
 
-    memsetAndFreeStrings(1, cf.number);
-
     return true;
 }
 
@@ -741,60 +1046,103 @@ bool dispatchIccApdu(int serial, int slotId, int request, const SimApdu& message
     apdu.p2 = message.p2;
     apdu.p3 = message.p3;
 
-    if (!copyHidlStringToRil(&apdu.data, message.data, pRI)) {
+    DispatchArena arena;
+    if (!copyHidlStringToRil(&apdu.data, message.data, pRI, arena)) {
         return false;
     }
 
     CALL_ONREQUEST(request, &apdu, sizeof(apdu), pRI, slotId);
 
-    memsetAndFreeStrings(1, apdu.data);
-
     return true;
 }
 
+/**
+ * Resets a slot's callbacks after their client died, unless they were
+ * replaced after "counter" was read. Takes the write lock, so the caller must
+ * not hold the read lock.
+ */
+static void clearResponseFunctions(int32_t slotId, bool isRadioService, int32_t counter) {
+    radioServiceLock[slotId].writeLock();
+
+    // make sure the counter value has not changed
+    if (counter == (isRadioService ? mCounterRadio[slotId] : mCounterOemHook[slotId])) {
+        if (isRadioService) {
+            radioService[slotId]->mRadioResponse = NULL;
+            radioService[slotId]->mRadioIndication = NULL;
+            radioService[slotId]->mRadioResponseV1_1 = NULL;
+            radioService[slotId]->mRadioIndicationV1_1 = NULL;
+        } else {
+            oemHookService[slotId]->mOemHookResponse = NULL;
+            oemHookService[slotId]->mOemHookIndication = NULL;
+        }
+        isRadioService ? mCounterRadio[slotId]++ : mCounterOemHook[slotId]++;
+    } else {
+        RLOGE("clearResponseFunctions: not resetting responseFunctions as they likely "
+                "got updated on another thread");
+    }
+
+    radioServiceLock[slotId].writeUnlock();
+}
+
+void ClientDeathRecipient::serviceDied(uint64_t cookie,
+        const ::android::wp<::android::hidl::base::V1_0::IBase>& /* who */) {
+    RLOGE("serviceDied: %s client of slot %d died",
+            mIsRadioService ? "radio" : "oem hook", mSlotId);
+    clearResponseFunctions(mSlotId, mIsRadioService, (int32_t) cookie);
+}
+
+/**
+ * Watches "client" with the slot's death recipient. If it is already dead,
+ * the callbacks that were just set are cleared right away.
+ */
+template <typename T>
+static void linkClientToDeath(const sp<T>& client, const sp<ClientDeathRecipient>& recipient,
+        int32_t slotId, bool isRadioService, int32_t counter) {
+    if (client == NULL) {
+        return;
+    }
+    Return<bool> linked = client->linkToDeath(recipient, counter);
+    if (!linked.isOk() || !linked) {
+        RLOGE("linkClientToDeath: slot %d client is already gone", slotId);
+        clearResponseFunctions(slotId, isRadioService, counter);
+    }
+}
+
+template <typename T>
+static void unlinkClientFromDeath(const sp<T>& client, const sp<ClientDeathRecipient>& recipient) {
+    if (client == NULL) {
+        return;
+    }
+    Return<bool> unlinked = client->unlinkToDeath(recipient);
+    if (!unlinked.isOk()) {
+        RLOGD("unlinkClientFromDeath: previous client is already gone");
+    }
+}
+
 void checkReturnStatus(int32_t slotId, Return<void>& ret, bool isRadioService) {
     if (ret.isOk() == false) {
         RLOGE("checkReturnStatus: unable to call response/indication callback");
         // Remote process hosting the callbacks must be dead. Reset the callback objects;
         // there's no other recovery to be done here. When the client process is back up, it will
-        // call setResponseFunctions()
+        // call setResponseFunctions(). The death recipient normally gets there first; this
+        // catches a death that raced with the transaction.
 
-        // Caller should already hold rdlock, release that first
+        // Responses and indications hold the rdlock, release that first
         // note the current counter to avoid overwriting updates made by another thread before
         // write lock is acquired.
+        bool readLocked = radioServiceLock[slotId].heldForRead();
+        assert(readLocked);
         int counter = isRadioService ? mCounterRadio[slotId] : mCounterOemHook[slotId];
-        pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock(slotId);
-        int ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(ret == 0);
-
-        // acquire wrlock
-        ret = pthread_rwlock_wrlock(radioServiceRwlockPtr);
-        assert(ret == 0);
-
-        // make sure the counter value has not changed
-        if (counter == (isRadioService ? mCounterRadio[slotId] : mCounterOemHook[slotId])) {
-            if (isRadioService) {
-                radioService[slotId]->mRadioResponse = NULL;
-                radioService[slotId]->mRadioIndication = NULL;
-                radioService[slotId]->mRadioResponseV1_1 = NULL;
-                radioService[slotId]->mRadioIndicationV1_1 = NULL;
-            } else {
-                oemHookService[slotId]->mOemHookResponse = NULL;
-                oemHookService[slotId]->mOemHookIndication = NULL;
-            }
-            isRadioService ? mCounterRadio[slotId]++ : mCounterOemHook[slotId]++;
-        } else {
-            RLOGE("checkReturnStatus: not resetting responseFunctions as they likely "
-                    "got updated on another thread");
+        if (readLocked) {
+            radioServiceLock[slotId].readUnlock();
         }
 
-        // release wrlock
-        ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(ret == 0);
+        clearResponseFunctions(slotId, isRadioService, counter);
 
         // Reacquire rdlock
-        ret = pthread_rwlock_rdlock(radioServiceRwlockPtr);
-        assert(ret == 0);
+        if (readLocked) {
+            radioServiceLock[slotId].readLock();
+        }
     }
 }
 
@@ -807,23 +1155,32 @@ Return<void> RadioImpl::setResponseFunctions(
         const ::android::sp<IRadioIndication>& radioIndicationParam) {
     RLOGD("setResponseFunctions");
 
-    pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock(mSlotId);
-    int ret = pthread_rwlock_wrlock(radioServiceRwlockPtr);
-    assert(ret == 0);
+    // Resolve the versioned interfaces once, here, rather than per response or
+    // indication. Each castFrom() is a transaction to the client, so do them
+    // before blocking the readers.
+    sp<V1_1::IRadioResponse> radioResponseV1_1 =
+            V1_1::IRadioResponse::castFrom(radioResponseParam).withDefault(nullptr);
+    sp<V1_1::IRadioIndication> radioIndicationV1_1 =
+            V1_1::IRadioIndication::castFrom(radioIndicationParam).withDefault(nullptr);
+    if (radioResponseV1_1 == nullptr || radioIndicationV1_1 == nullptr) {
+        radioResponseV1_1 = nullptr;
+        radioIndicationV1_1 = nullptr;
+    }
+
+    radioServiceLock[mSlotId].writeLock();
 
+    sp<IRadioResponse> oldRadioResponse = mRadioResponse;
     mRadioResponse = radioResponseParam;
     mRadioIndication = radioIndicationParam;
-    mRadioResponseV1_1 = V1_1::IRadioResponse::castFrom(mRadioResponse).withDefault(nullptr);
-    mRadioIndicationV1_1 = V1_1::IRadioIndication::castFrom(mRadioIndication).withDefault(nullptr);
-    if (mRadioResponseV1_1 == nullptr || mRadioIndicationV1_1 == nullptr) {
-        mRadioResponseV1_1 = nullptr;
-        mRadioIndicationV1_1 = nullptr;
-    }
+    mRadioResponseV1_1 = radioResponseV1_1;
+    mRadioIndicationV1_1 = radioIndicationV1_1;
+
+    int32_t counter = ++mCounterRadio[mSlotId];
 
-    mCounterRadio[mSlotId]++;
+    radioServiceLock[mSlotId].writeUnlock();
 
-    ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
-    assert(ret == 0);
+    unlinkClientFromDeath(oldRadioResponse, mDeathRecipient);
+    linkClientToDeath(radioResponseParam, mDeathRecipient, mSlotId, true, counter);
 
     // client is connected. Send initial indications.
     android::onNewCommandConnect((RIL_SOCKET_ID) mSlotId);
@@ -925,11 +1282,12 @@ Return<void> RadioImpl::dial(int32_t serial, const Dial& dialInfo) {
     if (pRI == NULL) {
         return Void();
     }
+    DispatchArena arena;
     RIL_Dial dial = {};
     RIL_UUS_Info uusInfo = {};
     int32_t sizeOfDial = sizeof(dial);
 
-    if (!copyHidlStringToRil(&dial.address, dialInfo.address, pRI)) {
+    if (!copyHidlStringToRil(&dial.address, dialInfo.address, pRI, arena)) {
         return Void();
     }
     dial.clir = (int) dialInfo.clir;
@@ -942,8 +1300,8 @@ Return<void> RadioImpl::dial(int32_t serial, const Dial& dialInfo) {
             uusInfo.uusData = NULL;
             uusInfo.uusLength = 0;
         } else {
-            if (!copyHidlStringToRil(&uusInfo.uusData, dialInfo.uusInfo[0].uusData, pRI)) {
-                memsetAndFreeStrings(1, dial.address);
+            if (!copyHidlStringToRil(&uusInfo.uusData, dialInfo.uusInfo[0].uusData, pRI,
+                    arena)) {
                 return Void();
             }
             uusInfo.uusLength = dialInfo.uusInfo[0].uusData.size();
@@ -954,8 +1312,6 @@ Return<void> RadioImpl::dial(int32_t serial, const Dial& dialInfo) {
 
     CALL_ONREQUEST(RIL_REQUEST_DIAL, &dial, sizeOfDial, pRI, mSlotId);
 
-    memsetAndFreeStrings(2, dial.address, uusInfo.uusData);
-
     return Void();
 }
 
@@ -1114,16 +1470,23 @@ Return<void> RadioImpl::setupDataCall(int32_t serial, RadioTechnology radioTechn
     RLOGD("setupDataCall: serial %d", serial);
 #endif
 
+    // the numeric arguments are formatted on the stack; dispatchStrings() copies
+    // them into its arena along with the strings
+    char radioTech[12], profileId[12], authType[12];
+    snprintf(radioTech, sizeof(radioTech), "%d", (int) radioTechnology + 2);
+    snprintf(profileId, sizeof(profileId), "%d", (int) dataProfileInfo.profileId);
+    snprintf(authType, sizeof(authType), "%d", (int) dataProfileInfo.authType);
+
     if (s_vendorFunctions->version >= 4 && s_vendorFunctions->version <= 14) {
         const hidl_string &protocol =
                 (isRoaming ? dataProfileInfo.roamingProtocol : dataProfileInfo.protocol);
         dispatchStrings(serial, mSlotId, RIL_REQUEST_SETUP_DATA_CALL, true, 7,
-            std::to_string((int) radioTechnology + 2).c_str(),
-            std::to_string((int) dataProfileInfo.profileId).c_str(),
+            radioTech,
+            profileId,
             dataProfileInfo.apn.c_str(),
             dataProfileInfo.user.c_str(),
             dataProfileInfo.password.c_str(),
-            std::to_string((int) dataProfileInfo.authType).c_str(),
+            authType,
             protocol.c_str());
     } else if (s_vendorFunctions->version >= 15) {
         char *mvnoTypeStr = NULL;
@@ -1135,19 +1498,23 @@ Return<void> RadioImpl::setupDataCall(int32_t serial, RadioTechnology radioTechn
             }
             return Void();
         }
+        char apnTypes[12], bearers[12], mtu[12];
+        snprintf(apnTypes, sizeof(apnTypes), "%d", dataProfileInfo.supportedApnTypesBitmap);
+        snprintf(bearers, sizeof(bearers), "%d", dataProfileInfo.bearerBitmap);
+        snprintf(mtu, sizeof(mtu), "%d", dataProfileInfo.mtu);
         dispatchStrings(serial, mSlotId, RIL_REQUEST_SETUP_DATA_CALL, true, 15,
-            std::to_string((int) radioTechnology + 2).c_str(),
-            std::to_string((int) dataProfileInfo.profileId).c_str(),
+            radioTech,
+            profileId,
             dataProfileInfo.apn.c_str(),
             dataProfileInfo.user.c_str(),
             dataProfileInfo.password.c_str(),
-            std::to_string((int) dataProfileInfo.authType).c_str(),
+            authType,
             dataProfileInfo.protocol.c_str(),
             dataProfileInfo.roamingProtocol.c_str(),
-            std::to_string(dataProfileInfo.supportedApnTypesBitmap).c_str(),
-            std::to_string(dataProfileInfo.bearerBitmap).c_str(),
+            apnTypes,
+            bearers,
             modemCognitive ? "1" : "0",
-            std::to_string(dataProfileInfo.mtu).c_str(),
+            mtu,
             mvnoTypeStr,
             dataProfileInfo.mvnoMatchData.c_str(),
             roamingAllowed ? "1" : "0");
@@ -1171,10 +1538,11 @@ Return<void> RadioImpl::iccIOForApp(int32_t serial, const IccIo& iccIo) {
         return Void();
     }
 
+    DispatchArena arena;
     RIL_SIM_IO_v6 rilIccIo = {};
     rilIccIo.command = iccIo.command;
     rilIccIo.fileid = iccIo.fileId;
-    if (!copyHidlStringToRil(&rilIccIo.path, iccIo.path, pRI)) {
+    if (!copyHidlStringToRil(&rilIccIo.path, iccIo.path, pRI, arena)) {
         return Void();
     }
 
@@ -1182,25 +1550,20 @@ Return<void> RadioImpl::iccIOForApp(int32_t serial, const IccIo& iccIo) {
     rilIccIo.p2 = iccIo.p2;
     rilIccIo.p3 = iccIo.p3;
 
-    if (!copyHidlStringToRil(&rilIccIo.data, iccIo.data, pRI)) {
-        memsetAndFreeStrings(1, rilIccIo.path);
+    if (!copyHidlStringToRil(&rilIccIo.data, iccIo.data, pRI, arena)) {
         return Void();
     }
 
-    if (!copyHidlStringToRil(&rilIccIo.pin2, iccIo.pin2, pRI)) {
-        memsetAndFreeStrings(2, rilIccIo.path, rilIccIo.data);
+    if (!copyHidlStringToRil(&rilIccIo.pin2, iccIo.pin2, pRI, arena)) {
         return Void();
     }
 
-    if (!copyHidlStringToRil(&rilIccIo.aidPtr, iccIo.aid, pRI)) {
-        memsetAndFreeStrings(3, rilIccIo.path, rilIccIo.data, rilIccIo.pin2);
+    if (!copyHidlStringToRil(&rilIccIo.aidPtr, iccIo.aid, pRI, arena)) {
         return Void();
     }
 
     CALL_ONREQUEST(RIL_REQUEST_SIM_IO, &rilIccIo, sizeof(rilIccIo), pRI, mSlotId);
 
-    memsetAndFreeStrings(4, rilIccIo.path, rilIccIo.data, rilIccIo.pin2, rilIccIo.aidPtr);
-
     return Void();
 }
 
@@ -1525,22 +1888,20 @@ Return<void> RadioImpl::writeSmsToSim(int32_t serial, const SmsWriteArgs& smsWri
         return Void();
     }
 
+    DispatchArena arena;
     RIL_SMS_WriteArgs args;
     args.status = (int) smsWriteArgs.status;
 
-    if (!copyHidlStringToRil(&args.pdu, smsWriteArgs.pdu, pRI)) {
+    if (!copyHidlStringToRil(&args.pdu, smsWriteArgs.pdu, pRI, arena)) {
         return Void();
     }
 
-    if (!copyHidlStringToRil(&args.smsc, smsWriteArgs.smsc, pRI)) {
-        memsetAndFreeStrings(1, args.pdu);
+    if (!copyHidlStringToRil(&args.smsc, smsWriteArgs.smsc, pRI, arena)) {
         return Void();
     }
 
     CALL_ONREQUEST(RIL_REQUEST_WRITE_SMS_TO_SIM, &args, sizeof(args), pRI, mSlotId);
 
-    memsetAndFreeStrings(2, args.smsc, args.pdu);
-
     return Void();
 }
 
@@ -2048,55 +2409,49 @@ Return<void> RadioImpl::setInitialAttachApn(int32_t serial, const DataProfileInf
         return Void();
     }
 
+    DispatchArena arena;
+
     if (s_vendorFunctions->version <= 14) {
         RIL_InitialAttachApn iaa = {};
 
-        if (!copyHidlStringToRil(&iaa.apn, dataProfileInfo.apn, pRI, true)) {
+        if (!copyHidlStringToRil(&iaa.apn, dataProfileInfo.apn, pRI, true, arena)) {
             return Void();
         }
 
         const hidl_string &protocol =
                 (isRoaming ? dataProfileInfo.roamingProtocol : dataProfileInfo.protocol);
 
-        if (!copyHidlStringToRil(&iaa.protocol, protocol, pRI)) {
-            memsetAndFreeStrings(1, iaa.apn);
+        if (!copyHidlStringToRil(&iaa.protocol, protocol, pRI, arena)) {
             return Void();
         }
         iaa.authtype = (int) dataProfileInfo.authType;
-        if (!copyHidlStringToRil(&iaa.username, dataProfileInfo.user, pRI)) {
-            memsetAndFreeStrings(2, iaa.apn, iaa.protocol);
+        if (!copyHidlStringToRil(&iaa.username, dataProfileInfo.user, pRI, arena)) {
             return Void();
         }
-        if (!copyHidlStringToRil(&iaa.password, dataProfileInfo.password, pRI)) {
-            memsetAndFreeStrings(3, iaa.apn, iaa.protocol, iaa.username);
+        if (!copyHidlStringToRil(&iaa.password, dataProfileInfo.password, pRI, arena)) {
             return Void();
         }
 
         CALL_ONREQUEST(RIL_REQUEST_SET_INITIAL_ATTACH_APN, &iaa, sizeof(iaa), pRI, mSlotId);
-
-        memsetAndFreeStrings(4, iaa.apn, iaa.protocol, iaa.username, iaa.password);
     } else {
         RIL_InitialAttachApn_v15 iaa = {};
 
-        if (!copyHidlStringToRil(&iaa.apn, dataProfileInfo.apn, pRI, true)) {
+        if (!copyHidlStringToRil(&iaa.apn, dataProfileInfo.apn, pRI, true, arena)) {
             return Void();
         }
 
-        if (!copyHidlStringToRil(&iaa.protocol, dataProfileInfo.protocol, pRI)) {
-            memsetAndFreeStrings(1, iaa.apn);
+        if (!copyHidlStringToRil(&iaa.protocol, dataProfileInfo.protocol, pRI, arena)) {
             return Void();
         }
-        if (!copyHidlStringToRil(&iaa.roamingProtocol, dataProfileInfo.roamingProtocol, pRI)) {
-            memsetAndFreeStrings(2, iaa.apn, iaa.protocol);
+        if (!copyHidlStringToRil(&iaa.roamingProtocol, dataProfileInfo.roamingProtocol, pRI,
+                arena)) {
             return Void();
         }
         iaa.authtype = (int) dataProfileInfo.authType;
-        if (!copyHidlStringToRil(&iaa.username, dataProfileInfo.user, pRI)) {
-            memsetAndFreeStrings(3, iaa.apn, iaa.protocol, iaa.roamingProtocol);
+        if (!copyHidlStringToRil(&iaa.username, dataProfileInfo.user, pRI, arena)) {
             return Void();
         }
-        if (!copyHidlStringToRil(&iaa.password, dataProfileInfo.password, pRI)) {
-            memsetAndFreeStrings(4, iaa.apn, iaa.protocol, iaa.roamingProtocol, iaa.username);
+        if (!copyHidlStringToRil(&iaa.password, dataProfileInfo.password, pRI, arena)) {
             return Void();
         }
         iaa.supportedTypesBitmask = dataProfileInfo.supportedApnTypesBitmap;
@@ -2106,21 +2461,15 @@ Return<void> RadioImpl::setInitialAttachApn(int32_t serial, const DataProfileInf
 
         if (!convertMvnoTypeToString(dataProfileInfo.mvnoType, iaa.mvnoType)) {
             sendErrorResponse(pRI, RIL_E_INVALID_ARGUMENTS);
-            memsetAndFreeStrings(5, iaa.apn, iaa.protocol, iaa.roamingProtocol, iaa.username,
-                    iaa.password);
             return Void();
         }
 
-        if (!copyHidlStringToRil(&iaa.mvnoMatchData, dataProfileInfo.mvnoMatchData, pRI)) {
-            memsetAndFreeStrings(5, iaa.apn, iaa.protocol, iaa.roamingProtocol, iaa.username,
-                    iaa.password);
+        if (!copyHidlStringToRil(&iaa.mvnoMatchData, dataProfileInfo.mvnoMatchData, pRI,
+                arena)) {
             return Void();
         }
 
         CALL_ONREQUEST(RIL_REQUEST_SET_INITIAL_ATTACH_APN, &iaa, sizeof(iaa), pRI, mSlotId);
-
-        memsetAndFreeStrings(6, iaa.apn, iaa.protocol, iaa.roamingProtocol, iaa.username,
-                iaa.password, iaa.mvnoMatchData);
     }
 
     return Void();
@@ -2150,7 +2499,8 @@ bool dispatchImsGsmSms(const ImsSmsMessage& message, RequestInfo *pRI) {
         return false;
     }
 
-    pStrings = (char **)calloc(countStrings, sizeof(char *));
+    DispatchArena arena;
+    pStrings = (char **)arena.alloc(dataLen);
     if (pStrings == NULL) {
         RLOGE("dispatchImsGsmSms: Memory allocation failed for request %s",
                 requestToString(pRI->pCI->requestNumber));
@@ -2158,20 +2508,11 @@ bool dispatchImsGsmSms(const ImsSmsMessage& message, RequestInfo *pRI) {
         return false;
     }
 
-    if (!copyHidlStringToRil(&pStrings[0], message.gsmMessage[0].smscPdu, pRI)) {
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, dataLen);
-#endif
-        free(pStrings);
+    if (!copyHidlStringToRil(&pStrings[0], message.gsmMessage[0].smscPdu, pRI, arena)) {
         return false;
     }
 
-    if (!copyHidlStringToRil(&pStrings[1], message.gsmMessage[0].pdu, pRI)) {
-        memsetAndFreeStrings(1, pStrings[0]);
-#ifdef MEMSET_FREED
-        memset(pStrings, 0, dataLen);
-#endif
-        free(pStrings);
+    if (!copyHidlStringToRil(&pStrings[1], message.gsmMessage[0].pdu, pRI, arena)) {
         return false;
     }
 
@@ -2179,15 +2520,6 @@ bool dispatchImsGsmSms(const ImsSmsMessage& message, RequestInfo *pRI) {
     CALL_ONREQUEST(pRI->pCI->requestNumber, &rism, sizeof(RIL_RadioTechnologyFamily) +
             sizeof(uint8_t) + sizeof(int32_t) + dataLen, pRI, pRI->socket_id);
 
-    for (int i = 0 ; i < countStrings ; i++) {
-        memsetAndFreeStrings(1, pStrings[i]);
-    }
-
-#ifdef MEMSET_FREED
-    memset(pStrings, 0, dataLen);
-#endif
-    free(pStrings);
-
     return true;
 }
 
@@ -2264,17 +2596,16 @@ Return<void> RadioImpl::iccOpenLogicalChannel(int32_t serial, const hidl_string&
             return Void();
         }
 
+        DispatchArena arena;
         RIL_OpenChannelParams params = {};
 
         params.p2 = p2;
 
-        if (!copyHidlStringToRil(&params.aidPtr, aid, pRI)) {
+        if (!copyHidlStringToRil(&params.aidPtr, aid, pRI, arena)) {
             return Void();
         }
 
         CALL_ONREQUEST(pRI->pCI->requestNumber, &params, sizeof(params), pRI, mSlotId);
-
-        memsetAndFreeStrings(1, params.aidPtr);
     }
     return Void();
 }
@@ -2320,17 +2651,16 @@ Return<void> RadioImpl::nvWriteItem(int32_t serial, const NvWriteItem& item) {
         return Void();
     }
 
+    DispatchArena arena;
     RIL_NV_WriteItem nvwi = {};
 
     nvwi.itemID = (RIL_NV_Item) item.itemId;
 
-    if (!copyHidlStringToRil(&nvwi.value, item.value, pRI)) {
+    if (!copyHidlStringToRil(&nvwi.value, item.value, pRI, arena)) {
         return Void();
     }
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &nvwi, sizeof(nvwi), pRI, mSlotId);
-
-    memsetAndFreeStrings(1, nvwi.value);
     return Void();
 }
 
@@ -2415,59 +2745,23 @@ Return<void> RadioImpl::requestIccSimAuthentication(int32_t serial, int32_t auth
         return Void();
     }
 
+    DispatchArena arena;
     RIL_SimAuthentication pf = {};
 
     pf.authContext = authContext;
 
-    if (!copyHidlStringToRil(&pf.authData, authData, pRI)) {
+    if (!copyHidlStringToRil(&pf.authData, authData, pRI, arena)) {
         return Void();
     }
 
-    if (!copyHidlStringToRil(&pf.aid, aid, pRI)) {
-        memsetAndFreeStrings(1, pf.authData);
+    if (!copyHidlStringToRil(&pf.aid, aid, pRI, arena)) {
         return Void();
     }
 
     CALL_ONREQUEST(pRI->pCI->requestNumber, &pf, sizeof(pf), pRI, mSlotId);
-
-    memsetAndFreeStrings(2, pf.authData, pf.aid);
     return Void();
 }
 
-/**
- * @param numProfiles number of data profile
- * @param dataProfiles the pointer to the actual data profiles. The acceptable type is
-          RIL_DataProfileInfo or RIL_DataProfileInfo_v15.
- * @param dataProfilePtrs the pointer to the pointers that point to each data profile structure
- * @param numfields number of string-type member in the data profile structure
- * @param ... the variadic parameters are pointers to each string-type member
- **/
-template <typename T>
-void freeSetDataProfileData(int numProfiles, T *dataProfiles, T **dataProfilePtrs,
-                            int numfields, ...) {
-    va_list args;
-    va_start(args, numfields);
-
-    // Iterate through each string-type field that need to be free.
-    for (int i = 0; i < numfields; i++) {
-        // Iterate through each data profile and free that specific string-type field.
-        // The type 'char *T::*' is a type of pointer to a 'char *' member inside T structure.
-        char *T::*ptr = va_arg(args, char *T::*);
-        for (int j = 0; j < numProfiles; j++) {
-            memsetAndFreeStrings(1, dataProfiles[j].*ptr);
-        }
-    }
-
-    va_end(args);
-
-#ifdef MEMSET_FREED
-    memset(dataProfiles, 0, numProfiles * sizeof(T));
-    memset(dataProfilePtrs, 0, numProfiles * sizeof(T *));
-#endif
-    free(dataProfiles);
-    free(dataProfilePtrs);
-}
-
 Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfileInfo>& profiles,
                                        bool isRoaming) {
 #if VDBG
@@ -2478,27 +2772,19 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
         return Void();
     }
 
+    DispatchArena arena;
     size_t num = profiles.size();
     bool success = false;
 
     if (s_vendorFunctions->version <= 14) {
 
         RIL_DataProfileInfo *dataProfiles =
-            (RIL_DataProfileInfo *) calloc(num, sizeof(RIL_DataProfileInfo));
-
-        if (dataProfiles == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                    requestToString(pRI->pCI->requestNumber));
-            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
-            return Void();
-        }
-
+            (RIL_DataProfileInfo *) arena.alloc(num * sizeof(RIL_DataProfileInfo));
         RIL_DataProfileInfo **dataProfilePtrs =
-            (RIL_DataProfileInfo **) calloc(num, sizeof(RIL_DataProfileInfo *));
-        if (dataProfilePtrs == NULL) {
+            (RIL_DataProfileInfo **) arena.alloc(num * sizeof(RIL_DataProfileInfo *));
+        if (dataProfiles == NULL || dataProfilePtrs == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
-            free(dataProfiles);
             sendErrorResponse(pRI, RIL_E_NO_MEMORY);
             return Void();
         }
@@ -2506,28 +2792,27 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
         for (size_t i = 0; i < num; i++) {
             dataProfilePtrs[i] = &dataProfiles[i];
 
-            success = copyHidlStringToRil(&dataProfiles[i].apn, profiles[i].apn, pRI, true);
+            success = copyHidlStringToRil(&dataProfiles[i].apn, profiles[i].apn, pRI, true,
+                    arena);
 
             const hidl_string &protocol =
                     (isRoaming ? profiles[i].roamingProtocol : profiles[i].protocol);
 
-            if (success && !copyHidlStringToRil(&dataProfiles[i].protocol, protocol, pRI, true)) {
+            if (success && !copyHidlStringToRil(&dataProfiles[i].protocol, protocol, pRI, true,
+                    arena)) {
                 success = false;
             }
 
             if (success && !copyHidlStringToRil(&dataProfiles[i].user, profiles[i].user, pRI,
-                    true)) {
+                    true, arena)) {
                 success = false;
             }
             if (success && !copyHidlStringToRil(&dataProfiles[i].password, profiles[i].password,
-                    pRI, true)) {
+                    pRI, true, arena)) {
                 success = false;
             }
 
             if (!success) {
-                freeSetDataProfileData(num, dataProfiles, dataProfilePtrs, 4,
-                    &RIL_DataProfileInfo::apn, &RIL_DataProfileInfo::protocol,
-                    &RIL_DataProfileInfo::user, &RIL_DataProfileInfo::password);
                 return Void();
             }
 
@@ -2542,27 +2827,14 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
 
         CALL_ONREQUEST(RIL_REQUEST_SET_DATA_PROFILE, dataProfilePtrs,
                 num * sizeof(RIL_DataProfileInfo *), pRI, mSlotId);
-
-        freeSetDataProfileData(num, dataProfiles, dataProfilePtrs, 4,
-                &RIL_DataProfileInfo::apn, &RIL_DataProfileInfo::protocol,
-                &RIL_DataProfileInfo::user, &RIL_DataProfileInfo::password);
     } else {
         RIL_DataProfileInfo_v15 *dataProfiles =
-            (RIL_DataProfileInfo_v15 *) calloc(num, sizeof(RIL_DataProfileInfo_v15));
-
-        if (dataProfiles == NULL) {
-            RLOGE("Memory allocation failed for request %s",
-                    requestToString(pRI->pCI->requestNumber));
-            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
-            return Void();
-        }
-
+            (RIL_DataProfileInfo_v15 *) arena.alloc(num * sizeof(RIL_DataProfileInfo_v15));
         RIL_DataProfileInfo_v15 **dataProfilePtrs =
-            (RIL_DataProfileInfo_v15 **) calloc(num, sizeof(RIL_DataProfileInfo_v15 *));
-        if (dataProfilePtrs == NULL) {
+            (RIL_DataProfileInfo_v15 **) arena.alloc(num * sizeof(RIL_DataProfileInfo_v15 *));
+        if (dataProfiles == NULL || dataProfilePtrs == NULL) {
             RLOGE("Memory allocation failed for request %s",
                     requestToString(pRI->pCI->requestNumber));
-            free(dataProfiles);
             sendErrorResponse(pRI, RIL_E_NO_MEMORY);
             return Void();
         }
@@ -2570,25 +2842,26 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
         for (size_t i = 0; i < num; i++) {
             dataProfilePtrs[i] = &dataProfiles[i];
 
-            success = copyHidlStringToRil(&dataProfiles[i].apn, profiles[i].apn, pRI, true);
+            success = copyHidlStringToRil(&dataProfiles[i].apn, profiles[i].apn, pRI, true,
+                    arena);
             if (success && !copyHidlStringToRil(&dataProfiles[i].protocol, profiles[i].protocol,
-                    pRI)) {
+                    pRI, arena)) {
                 success = false;
             }
             if (success && !copyHidlStringToRil(&dataProfiles[i].roamingProtocol,
-                    profiles[i].roamingProtocol, pRI, true)) {
+                    profiles[i].roamingProtocol, pRI, true, arena)) {
                 success = false;
             }
             if (success && !copyHidlStringToRil(&dataProfiles[i].user, profiles[i].user, pRI,
-                    true)) {
+                    true, arena)) {
                 success = false;
             }
             if (success && !copyHidlStringToRil(&dataProfiles[i].password, profiles[i].password,
-                    pRI, true)) {
+                    pRI, true, arena)) {
                 success = false;
             }
             if (success && !copyHidlStringToRil(&dataProfiles[i].mvnoMatchData,
-                    profiles[i].mvnoMatchData, pRI, true)) {
+                    profiles[i].mvnoMatchData, pRI, true, arena)) {
                 success = false;
             }
 
@@ -2599,10 +2872,6 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
             }
 
             if (!success) {
-                freeSetDataProfileData(num, dataProfiles, dataProfilePtrs, 6,
-                    &RIL_DataProfileInfo_v15::apn, &RIL_DataProfileInfo_v15::protocol,
-                    &RIL_DataProfileInfo_v15::roamingProtocol, &RIL_DataProfileInfo_v15::user,
-                    &RIL_DataProfileInfo_v15::password, &RIL_DataProfileInfo_v15::mvnoMatchData);
                 return Void();
             }
 
@@ -2620,11 +2889,6 @@ Return<void> RadioImpl::setDataProfile(int32_t serial, const hidl_vec<DataProfil
 
         CALL_ONREQUEST(RIL_REQUEST_SET_DATA_PROFILE, dataProfilePtrs,
                 num * sizeof(RIL_DataProfileInfo_v15 *), pRI, mSlotId);
-
-        freeSetDataProfileData(num, dataProfiles, dataProfilePtrs, 6,
-                &RIL_DataProfileInfo_v15::apn, &RIL_DataProfileInfo_v15::protocol,
-                &RIL_DataProfileInfo_v15::roamingProtocol, &RIL_DataProfileInfo_v15::user,
-                &RIL_DataProfileInfo_v15::password, &RIL_DataProfileInfo_v15::mvnoMatchData);
     }
 
     return Void();
@@ -2837,26 +3101,35 @@ Return<void> RadioImpl::setCarrierInfoForImsiEncryption(int32_t serial,
         return Void();
     }
 
+    DispatchArena arena;
     RIL_CarrierInfoForImsiEncryption imsiEncryption = {};
 
-    if (!copyHidlStringToRil(&imsiEncryption.mnc, data.mnc, pRI)) {
+    if (!copyHidlStringToRil(&imsiEncryption.mnc, data.mnc, pRI, arena)) {
         return Void();
     }
-    if (!copyHidlStringToRil(&imsiEncryption.mcc, data.mcc, pRI)) {
-        memsetAndFreeStrings(1, imsiEncryption.mnc);
+    if (!copyHidlStringToRil(&imsiEncryption.mcc, data.mcc, pRI, arena)) {
         return Void();
     }
-    if (!copyHidlStringToRil(&imsiEncryption.keyIdentifier, data.keyIdentifier, pRI)) {
-        memsetAndFreeStrings(2, imsiEncryption.mnc, imsiEncryption.mcc);
+    if (!copyHidlStringToRil(&imsiEncryption.keyIdentifier, data.keyIdentifier, pRI, arena)) {
         return Void();
     }
     imsiEncryption.carrierKeyLength = data.carrierKey.size();
-    imsiEncryption.carrierKey = new uint8_t[imsiEncryption.carrierKeyLength];
-    memcpy(imsiEncryption.carrierKey, data.carrierKey.data(), imsiEncryption.carrierKeyLength);
+    if (vendorTakesConstData()) {
+        imsiEncryption.carrierKey = const_cast<uint8_t *>(data.carrierKey.data());
+    } else {
+        imsiEncryption.carrierKey = (uint8_t *) arena.alloc(imsiEncryption.carrierKeyLength);
+        if (imsiEncryption.carrierKey == NULL) {
+            RLOGE("Memory allocation failed for request %s",
+                    requestToString(pRI->pCI->requestNumber));
+            sendErrorResponse(pRI, RIL_E_NO_MEMORY);
+            return Void();
+        }
+        memcpy(imsiEncryption.carrierKey, data.carrierKey.data(),
+                imsiEncryption.carrierKeyLength);
+    }
     imsiEncryption.expirationTime = data.expirationTime;
     CALL_ONREQUEST(pRI->pCI->requestNumber, &imsiEncryption,
             sizeof(RIL_CarrierInfoForImsiEncryption), pRI, mSlotId);
-    delete(imsiEncryption.carrierKey);
     return Void();
 }
 
@@ -2934,16 +3207,17 @@ Return<void> OemHookImpl::setResponseFunctions(
     RLOGD("OemHookImpl::setResponseFunctions");
 #endif
 
-    pthread_rwlock_t *radioServiceRwlockPtr = radio::getRadioServiceRwlock(mSlotId);
-    int ret = pthread_rwlock_wrlock(radioServiceRwlockPtr);
-    assert(ret == 0);
+    radioServiceLock[mSlotId].writeLock();
 
+    sp<IOemHookResponse> oldOemHookResponse = mOemHookResponse;
     mOemHookResponse = oemHookResponseParam;
     mOemHookIndication = oemHookIndicationParam;
-    mCounterOemHook[mSlotId]++;
+    int32_t counter = ++mCounterOemHook[mSlotId];
 
-    ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
-    assert(ret == 0);
+    radioServiceLock[mSlotId].writeUnlock();
+
+    unlinkClientFromDeath(oldOemHookResponse, mDeathRecipient);
+    linkClientToDeath(oemHookResponseParam, mDeathRecipient, mSlotId, false, counter);
 
     return Void();
 }
@@ -3237,45 +3511,50 @@ int radio::getCurrentCallsResponse(int slotId,
         RadioResponseInfo responseInfo = {};
         populateResponseInfo(responseInfo, serial, responseType, e);
 
-        hidl_vec<Call> calls;
+        int num = 0;
         if ((response == NULL && responseLen != 0)
                 || (responseLen % sizeof(RIL_Call *)) != 0) {
             RLOGE("getCurrentCallsResponse: Invalid response");
             if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::INVALID_RESPONSE;
         } else {
-            int num = responseLen / sizeof(RIL_Call *);
-            calls.resize(num);
-
-            for (int i = 0 ; i < num ; i++) {
-                RIL_Call *p_cur = ((RIL_Call **) response)[i];
-                /* each call info */
-                calls[i].state = (CallState) p_cur->state;
-                calls[i].index = p_cur->index;
-                calls[i].toa = p_cur->toa;
-                calls[i].isMpty = p_cur->isMpty;
-                calls[i].isMT = p_cur->isMT;
-                calls[i].als = p_cur->als;
-                calls[i].isVoice = p_cur->isVoice;
-                calls[i].isVoicePrivacy = p_cur->isVoicePrivacy;
-                calls[i].number = convertCharPtrToHidlString(p_cur->number);
-                calls[i].numberPresentation = (CallPresentation) p_cur->numberPresentation;
-                calls[i].name = convertCharPtrToHidlString(p_cur->name);
-                calls[i].namePresentation = (CallPresentation) p_cur->namePresentation;
-                if (p_cur->uusInfo != NULL && p_cur->uusInfo->uusData != NULL) {
-                    RIL_UUS_Info *uusInfo = p_cur->uusInfo;
-                    calls[i].uusInfo.resize(1);
-                    calls[i].uusInfo[0].uusType = (UusType) uusInfo->uusType;
-                    calls[i].uusInfo[0].uusDcs = (UusDcs) uusInfo->uusDcs;
-                    // convert uusInfo->uusData to a null-terminated string
-                    char *nullTermStr = strndup(uusInfo->uusData, uusInfo->uusLength);
-                    calls[i].uusInfo[0].uusData = nullTermStr;
-                    free(nullTermStr);
-                }
+            num = responseLen / sizeof(RIL_Call *);
+        }
+
+        ResponseBuilder<Call>& callList = radioService[slotId]->mCallList;
+        Call *calls = callList.lock(num);
+        for (int i = 0 ; i < num ; i++) {
+            RIL_Call *p_cur = ((RIL_Call **) response)[i];
+            /* each call info */
+            calls[i].state = (CallState) p_cur->state;
+            calls[i].index = p_cur->index;
+            calls[i].toa = p_cur->toa;
+            calls[i].isMpty = p_cur->isMpty;
+            calls[i].isMT = p_cur->isMT;
+            calls[i].als = p_cur->als;
+            calls[i].isVoice = p_cur->isVoice;
+            calls[i].isVoicePrivacy = p_cur->isVoicePrivacy;
+            calls[i].number = convertCharPtrToHidlString(p_cur->number);
+            calls[i].numberPresentation = (CallPresentation) p_cur->numberPresentation;
+            calls[i].name = convertCharPtrToHidlString(p_cur->name);
+            calls[i].namePresentation = (CallPresentation) p_cur->namePresentation;
+            if (p_cur->uusInfo != NULL && p_cur->uusInfo->uusData != NULL) {
+                RIL_UUS_Info *uusInfo = p_cur->uusInfo;
+                calls[i].uusInfo.resize(1);
+                calls[i].uusInfo[0].uusType = (UusType) uusInfo->uusType;
+                calls[i].uusInfo[0].uusDcs = (UusDcs) uusInfo->uusDcs;
+                // convert uusInfo->uusData to a null-terminated string
+                char *nullTermStr = strndup(uusInfo->uusData, uusInfo->uusLength);
+                calls[i].uusInfo[0].uusData = nullTermStr;
+                free(nullTermStr);
+            } else if (calls[i].uusInfo.size() != 0) {
+                // left over from the call this record held last time
+                calls[i].uusInfo.resize(0);
             }
         }
 
         Return<void> retStatus = radioService[slotId]->mRadioResponse->
-                getCurrentCallsResponse(responseInfo, calls);
+                getCurrentCallsResponse(responseInfo, callList.list());
+        callList.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("getCurrentCallsResponse: radioService[%d]->mRadioResponse == NULL", slotId);
@@ -3570,6 +3849,24 @@ RIL_CellInfoType getCellInfoTypeRadioTechnology(char *rat) {
 
 }
 
+// Registration state reports an unknown MCC as "" rather than "-1"
+template <typename T>
+static void clearUnknownMcc(T& cellIdentity) {
+    if (cellIdentity.mcc == "-1") {
+        cellIdentity.mcc = "";
+    }
+}
+
+static void clearUnknownMcc(CellIdentityCdma& /* no MCC */) {}
+
+// Fills the one entry of "arm" from "in"
+template <typename RilT, typename HalT>
+static void fillCellIdentityArm(const RilT& in, hidl_vec<HalT>& arm) {
+    arm.resize(1);
+    convertToHal(in, arm[0]);
+    clearUnknownMcc(arm[0]);
+}
+
 void fillCellIdentityResponse(CellIdentity &cellIdentity, RIL_CellIdentity_v16 &rilCellIdentity) {
 
     cellIdentity.cellIdentityGsm.resize(0);
@@ -3579,92 +3876,24 @@ void fillCellIdentityResponse(CellIdentity &cellIdentity, RIL_CellIdentity_v16 &
     cellIdentity.cellIdentityLte.resize(0);
     cellIdentity.cellInfoType = (CellInfoType)rilCellIdentity.cellInfoType;
     switch(rilCellIdentity.cellInfoType) {
-
-        case RIL_CELL_INFO_TYPE_GSM: {
-            cellIdentity.cellIdentityGsm.resize(1);
-            cellIdentity.cellIdentityGsm[0].mcc =
-                    ril::util::mcc::decode(rilCellIdentity.cellIdentityGsm.mcc);
-            cellIdentity.cellIdentityGsm[0].mnc =
-                    ril::util::mnc::decode(rilCellIdentity.cellIdentityGsm.mnc);
-
-            if (cellIdentity.cellIdentityGsm[0].mcc == "-1") {
-                cellIdentity.cellIdentityGsm[0].mcc = "";
-            }
-
-            cellIdentity.cellIdentityGsm[0].lac = rilCellIdentity.cellIdentityGsm.lac;
-            cellIdentity.cellIdentityGsm[0].cid = rilCellIdentity.cellIdentityGsm.cid;
-            cellIdentity.cellIdentityGsm[0].arfcn = rilCellIdentity.cellIdentityGsm.arfcn;
-            cellIdentity.cellIdentityGsm[0].bsic = rilCellIdentity.cellIdentityGsm.bsic;
+        case RIL_CELL_INFO_TYPE_GSM:
+            fillCellIdentityArm(rilCellIdentity.cellIdentityGsm, cellIdentity.cellIdentityGsm);
             break;
-        }
-
-        case RIL_CELL_INFO_TYPE_WCDMA: {
-            cellIdentity.cellIdentityWcdma.resize(1);
-            cellIdentity.cellIdentityWcdma[0].mcc =
-                    ril::util::mcc::decode(rilCellIdentity.cellIdentityWcdma.mcc);
-            cellIdentity.cellIdentityWcdma[0].mnc =
-                    ril::util::mnc::decode(rilCellIdentity.cellIdentityWcdma.mnc);
-
-            if (cellIdentity.cellIdentityWcdma[0].mcc == "-1") {
-                cellIdentity.cellIdentityWcdma[0].mcc = "";
-            }
-
-            cellIdentity.cellIdentityWcdma[0].lac = rilCellIdentity.cellIdentityWcdma.lac;
-            cellIdentity.cellIdentityWcdma[0].cid = rilCellIdentity.cellIdentityWcdma.cid;
-            cellIdentity.cellIdentityWcdma[0].psc = rilCellIdentity.cellIdentityWcdma.psc;
-            cellIdentity.cellIdentityWcdma[0].uarfcn = rilCellIdentity.cellIdentityWcdma.uarfcn;
+        case RIL_CELL_INFO_TYPE_WCDMA:
+            fillCellIdentityArm(rilCellIdentity.cellIdentityWcdma, cellIdentity.cellIdentityWcdma);
             break;
-        }
-
-        case RIL_CELL_INFO_TYPE_CDMA: {
-            cellIdentity.cellIdentityCdma.resize(1);
-            cellIdentity.cellIdentityCdma[0].networkId = rilCellIdentity.cellIdentityCdma.networkId;
-            cellIdentity.cellIdentityCdma[0].systemId = rilCellIdentity.cellIdentityCdma.systemId;
-            cellIdentity.cellIdentityCdma[0].baseStationId =
-                    rilCellIdentity.cellIdentityCdma.basestationId;
-            cellIdentity.cellIdentityCdma[0].longitude = rilCellIdentity.cellIdentityCdma.longitude;
-            cellIdentity.cellIdentityCdma[0].latitude = rilCellIdentity.cellIdentityCdma.latitude;
+        case RIL_CELL_INFO_TYPE_CDMA:
+            fillCellIdentityArm(rilCellIdentity.cellIdentityCdma, cellIdentity.cellIdentityCdma);
             break;
-        }
-
-        case RIL_CELL_INFO_TYPE_LTE: {
-            cellIdentity.cellIdentityLte.resize(1);
-            cellIdentity.cellIdentityLte[0].mcc =
-                    ril::util::mcc::decode(rilCellIdentity.cellIdentityLte.mcc);
-            cellIdentity.cellIdentityLte[0].mnc =
-                    ril::util::mnc::decode(rilCellIdentity.cellIdentityLte.mnc);
-
-            if (cellIdentity.cellIdentityLte[0].mcc == "-1") {
-                cellIdentity.cellIdentityLte[0].mcc = "";
-            }
-
-            cellIdentity.cellIdentityLte[0].ci = rilCellIdentity.cellIdentityLte.ci;
-            cellIdentity.cellIdentityLte[0].pci = rilCellIdentity.cellIdentityLte.pci;
-            cellIdentity.cellIdentityLte[0].tac = rilCellIdentity.cellIdentityLte.tac;
-            cellIdentity.cellIdentityLte[0].earfcn = rilCellIdentity.cellIdentityLte.earfcn;
+        case RIL_CELL_INFO_TYPE_LTE:
+            fillCellIdentityArm(rilCellIdentity.cellIdentityLte, cellIdentity.cellIdentityLte);
             break;
-        }
-
-        case RIL_CELL_INFO_TYPE_TD_SCDMA: {
-            cellIdentity.cellIdentityTdscdma.resize(1);
-            cellIdentity.cellIdentityTdscdma[0].mcc =
-                    ril::util::mcc::decode(rilCellIdentity.cellIdentityTdscdma.mcc);
-            cellIdentity.cellIdentityTdscdma[0].mnc =
-                    ril::util::mnc::decode(rilCellIdentity.cellIdentityTdscdma.mnc);
-
-            if (cellIdentity.cellIdentityTdscdma[0].mcc == "-1") {
-                cellIdentity.cellIdentityTdscdma[0].mcc = "";
-            }
-
-            cellIdentity.cellIdentityTdscdma[0].lac = rilCellIdentity.cellIdentityTdscdma.lac;
-            cellIdentity.cellIdentityTdscdma[0].cid = rilCellIdentity.cellIdentityTdscdma.cid;
-            cellIdentity.cellIdentityTdscdma[0].cpid = rilCellIdentity.cellIdentityTdscdma.cpid;
+        case RIL_CELL_INFO_TYPE_TD_SCDMA:
+            fillCellIdentityArm(rilCellIdentity.cellIdentityTdscdma,
+                    cellIdentity.cellIdentityTdscdma);
             break;
-        }
-
-        default: {
+        default:
             break;
-        }
     }
 }
 
@@ -4142,7 +4371,7 @@ int radio::setupDataCallResponse(int slotId,
             result.gateways = hidl_string();
             result.pcscf = hidl_string();
         } else {
-            convertRilDataCallToHal((RIL_Data_Call_Response_v11 *) response, result);
+            convertToHal(*(RIL_Data_Call_Response_v11 *) response, result);
         }
 
         Return<void> retStatus = radioService[slotId]->mRadioResponse->setupDataCallResponse(
@@ -4820,17 +5049,20 @@ int radio::getDataCallListResponse(int slotId,
         RadioResponseInfo responseInfo = {};
         populateResponseInfo(responseInfo, serial, responseType, e);
 
-        hidl_vec<SetupDataCallResult> ret;
+        size_t num = 0;
         if ((response == NULL && responseLen != 0)
                 || responseLen % sizeof(RIL_Data_Call_Response_v11) != 0) {
             RLOGE("getDataCallListResponse: invalid response");
             if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::INVALID_RESPONSE;
         } else {
-            convertRilDataCallListToHal(response, responseLen, ret);
+            num = responseLen / sizeof(RIL_Data_Call_Response_v11);
         }
 
+        ResponseBuilder<SetupDataCallResult>& ret = radioService[slotId]->mDataCallList;
+        convertRilDataCallListToHal(response, num, ret.lock(num));
         Return<void> retStatus = radioService[slotId]->mRadioResponse->getDataCallListResponse(
-                responseInfo, ret);
+                responseInfo, ret.list());
+        ret.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("getDataCallListResponse: radioService[%d]->mRadioResponse == NULL", slotId);
@@ -5909,17 +6141,19 @@ int radio::getCellInfoListResponse(int slotId,
         RadioResponseInfo responseInfo = {};
         populateResponseInfo(responseInfo, serial, responseType, e);
 
-        hidl_vec<CellInfo> ret;
+        size_t num = 0;
         if ((response == NULL && responseLen != 0)
                 || responseLen % sizeof(RIL_CellInfo_v12) != 0) {
             RLOGE("getCellInfoListResponse: Invalid response");
             if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::INVALID_RESPONSE;
         } else {
-            convertRilCellInfoListToHal(response, responseLen, ret);
+            num = responseLen / sizeof(RIL_CellInfo_v12);
         }
 
+        CellInfoListBuilder& builder = radioService[slotId]->mCellInfoList;
         Return<void> retStatus = radioService[slotId]->mRadioResponse->getCellInfoListResponse(
-                responseInfo, ret);
+                responseInfo, builder.lock((RIL_CellInfo_v12 *) response, num));
+        builder.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("getCellInfoListResponse: radioService[%d]->mRadioResponse == NULL", slotId);
@@ -6817,6 +7051,11 @@ int radio::sendRequestRawResponse(int slotId,
         if (response == NULL) {
             RLOGE("sendRequestRawResponse: Invalid response");
             if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::INVALID_RESPONSE;
+        } else if (responseLen > oemHookRawMaxBytes()) {
+            // would fail the transaction and take the client's callbacks with it
+            RLOGE("sendRequestRawResponse: %zu bytes is over the %zu byte limit", responseLen,
+                    oemHookRawMaxBytes());
+            if (e == RIL_E_SUCCESS) responseInfo.error = RadioError::NO_MEMORY;
         } else {
             data.setToExternal((uint8_t *) response, responseLen);
         }
@@ -6931,37 +7170,30 @@ int radio::networkStateChangedInd(int slotId,
     return 0;
 }
 
-uint8_t hexCharToInt(uint8_t c) {
-    if (c >= '0' && c <= '9') return (c - '0');
-    if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
-    if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
-
-    return INVALID_HEX_CHAR;
-}
-
-uint8_t * convertHexStringToBytes(void *response, size_t responseLen) {
+/**
+ * Decodes the hex string "response" into "buf" if it fits in "bufSize" bytes
+ * (an SMS PDU always does), else into a heap buffer. Returns NULL on error;
+ * the caller frees the result if it is not "buf".
+ */
+uint8_t * convertHexStringToBytes(void *response, size_t responseLen,
+                                  uint8_t *buf, size_t bufSize) {
     if (responseLen % 2 != 0) {
         return NULL;
     }
 
-    uint8_t *bytes = (uint8_t *)calloc(responseLen/2, sizeof(uint8_t));
-    if (bytes == NULL) {
-        RLOGE("convertHexStringToBytes: cannot allocate memory for bytes string");
-        return NULL;
-    }
-    uint8_t *hexString = (uint8_t *)response;
-
-    for (size_t i = 0; i < responseLen; i += 2) {
-        uint8_t hexChar1 = hexCharToInt(hexString[i]);
-        uint8_t hexChar2 = hexCharToInt(hexString[i + 1]);
-
-        if (hexChar1 == INVALID_HEX_CHAR || hexChar2 == INVALID_HEX_CHAR) {
-            RLOGE("convertHexStringToBytes: invalid hex char %d %d",
-                    hexString[i], hexString[i + 1]);
-            free(bytes);
+    uint8_t *bytes = buf;
+    if (responseLen/2 > bufSize) {
+        bytes = (uint8_t *)calloc(responseLen/2, sizeof(uint8_t));
+        if (bytes == NULL) {
+            RLOGE("convertHexStringToBytes: cannot allocate memory for bytes string");
             return NULL;
         }
-        bytes[i/2] = ((hexChar1 << 4) | hexChar2);
+    }
+
+    if (ril_hex_decode((const char *)response, responseLen, bytes, responseLen/2) < 0) {
+        RLOGE("convertHexStringToBytes: invalid hex string");
+        if (bytes != buf) free(bytes);
+        return NULL;
     }
 
     return bytes;
@@ -6975,7 +7207,9 @@ int radio::newSmsInd(int slotId, int indicationType,
             return 0;
         }
 
-        uint8_t *bytes = convertHexStringToBytes(response, responseLen);
+        uint8_t pduBuf[MAX_SMS_PDU_BYTES];
+        uint8_t *bytes = convertHexStringToBytes(response, responseLen, pduBuf,
+                sizeof(pduBuf));
         if (bytes == NULL) {
             RLOGE("newSmsInd: convertHexStringToBytes failed");
             return 0;
@@ -6989,7 +7223,7 @@ int radio::newSmsInd(int slotId, int indicationType,
         Return<void> retStatus = radioService[slotId]->mRadioIndication->newSms(
                 convertIntToRadioIndicationType(indicationType), pdu);
         radioService[slotId]->checkReturnStatus(retStatus);
-        free(bytes);
+        if (bytes != pduBuf) free(bytes);
     } else {
         RLOGE("newSmsInd: radioService[%d]->mRadioIndication == NULL", slotId);
     }
@@ -7006,7 +7240,9 @@ int radio::newSmsStatusReportInd(int slotId,
             return 0;
         }
 
-        uint8_t *bytes = convertHexStringToBytes(response, responseLen);
+        uint8_t pduBuf[MAX_SMS_PDU_BYTES];
+        uint8_t *bytes = convertHexStringToBytes(response, responseLen, pduBuf,
+                sizeof(pduBuf));
         if (bytes == NULL) {
             RLOGE("newSmsStatusReportInd: convertHexStringToBytes failed");
             return 0;
@@ -7020,7 +7256,7 @@ int radio::newSmsStatusReportInd(int slotId,
         Return<void> retStatus = radioService[slotId]->mRadioIndication->newSmsStatusReport(
                 convertIntToRadioIndicationType(indicationType), pdu);
         radioService[slotId]->checkReturnStatus(retStatus);
-        free(bytes);
+        if (bytes != pduBuf) free(bytes);
     } else {
         RLOGE("newSmsStatusReportInd: radioService[%d]->mRadioIndication == NULL", slotId);
     }
@@ -7084,11 +7320,11 @@ int radio::nitzTimeReceivedInd(int slotId,
         hidl_string nitzTime = convertCharPtrToHidlString((char *) response);
 #if VDBG
         RLOGD("nitzTimeReceivedInd: nitzTime %s receivedTime %" PRId64, nitzTime.c_str(),
-                nitzTimeReceived[slotId]);
+                nitzTimeReceived[slotId].load(std::memory_order_relaxed));
 #endif
         Return<void> retStatus = radioService[slotId]->mRadioIndication->nitzTimeReceived(
                 convertIntToRadioIndicationType(indicationType), nitzTime,
-                nitzTimeReceived[slotId]);
+                nitzTimeReceived[slotId].load(std::memory_order_relaxed));
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("nitzTimeReceivedInd: radioService[%d]->mRadioIndication == NULL", slotId);
@@ -7124,25 +7360,11 @@ void convertRilSignalStrengthToHal(void *response, size_t responseLen,
         rilSignalStrength->LTE_SignalStrength.cqi = INT_MAX;
     }
 
-    signalStrength.gw.signalStrength = rilSignalStrength->GW_SignalStrength.signalStrength;
-    signalStrength.gw.bitErrorRate = rilSignalStrength->GW_SignalStrength.bitErrorRate;
-    // RIL_SignalStrength_v10 not support gw.timingAdvance. Set to INT_MAX as
-    // invalid value.
-    signalStrength.gw.timingAdvance = INT_MAX;
-
-    signalStrength.cdma.dbm = rilSignalStrength->CDMA_SignalStrength.dbm;
-    signalStrength.cdma.ecio = rilSignalStrength->CDMA_SignalStrength.ecio;
-    signalStrength.evdo.dbm = rilSignalStrength->EVDO_SignalStrength.dbm;
-    signalStrength.evdo.ecio = rilSignalStrength->EVDO_SignalStrength.ecio;
-    signalStrength.evdo.signalNoiseRatio =
-            rilSignalStrength->EVDO_SignalStrength.signalNoiseRatio;
-    signalStrength.lte.signalStrength = rilSignalStrength->LTE_SignalStrength.signalStrength;
-    signalStrength.lte.rsrp = rilSignalStrength->LTE_SignalStrength.rsrp;
-    signalStrength.lte.rsrq = rilSignalStrength->LTE_SignalStrength.rsrq;
-    signalStrength.lte.rssnr = rilSignalStrength->LTE_SignalStrength.rssnr;
-    signalStrength.lte.cqi = rilSignalStrength->LTE_SignalStrength.cqi;
-    signalStrength.lte.timingAdvance = rilSignalStrength->LTE_SignalStrength.timingAdvance;
-    signalStrength.tdScdma.rscp = rilSignalStrength->TD_SCDMA_SignalStrength.rscp;
+    convertToHal(rilSignalStrength->GW_SignalStrength, signalStrength.gw);
+    convertToHal(rilSignalStrength->CDMA_SignalStrength, signalStrength.cdma);
+    convertToHal(rilSignalStrength->EVDO_SignalStrength, signalStrength.evdo);
+    convertToHal(rilSignalStrength->LTE_SignalStrength, signalStrength.lte);
+    convertToHal(rilSignalStrength->TD_SCDMA_SignalStrength, signalStrength.tdScdma);
 }
 
 int radio::currentSignalStrengthInd(int slotId,
@@ -7171,29 +7393,11 @@ int radio::currentSignalStrengthInd(int slotId,
     return 0;
 }
 
-void convertRilDataCallToHal(RIL_Data_Call_Response_v11 *dcResponse,
-        SetupDataCallResult& dcResult) {
-    dcResult.status = (DataCallFailCause) dcResponse->status;
-    dcResult.suggestedRetryTime = dcResponse->suggestedRetryTime;
-    dcResult.cid = dcResponse->cid;
-    dcResult.active = dcResponse->active;
-    dcResult.type = convertCharPtrToHidlString(dcResponse->type);
-    dcResult.ifname = convertCharPtrToHidlString(dcResponse->ifname);
-    dcResult.addresses = convertCharPtrToHidlString(dcResponse->addresses);
-    dcResult.dnses = convertCharPtrToHidlString(dcResponse->dnses);
-    dcResult.gateways = convertCharPtrToHidlString(dcResponse->gateways);
-    dcResult.pcscf = convertCharPtrToHidlString(dcResponse->pcscf);
-    dcResult.mtu = dcResponse->mtu;
-}
-
-void convertRilDataCallListToHal(void *response, size_t responseLen,
-        hidl_vec<SetupDataCallResult>& dcResultList) {
-    int num = responseLen / sizeof(RIL_Data_Call_Response_v11);
-
+void convertRilDataCallListToHal(void *response, size_t count,
+        SetupDataCallResult *dcResultList) {
     RIL_Data_Call_Response_v11 *dcResponse = (RIL_Data_Call_Response_v11 *) response;
-    dcResultList.resize(num);
-    for (int i = 0; i < num; i++) {
-        convertRilDataCallToHal(&dcResponse[i], dcResultList[i]);
+    for (size_t i = 0; i < count; i++) {
+        convertToHal(dcResponse[i], dcResultList[i]);
     }
 }
 
@@ -7206,13 +7410,15 @@ int radio::dataCallListChangedInd(int slotId,
             RLOGE("dataCallListChangedInd: invalid response");
             return 0;
         }
-        hidl_vec<SetupDataCallResult> dcList;
-        convertRilDataCallListToHal(response, responseLen, dcList);
+        size_t num = responseLen / sizeof(RIL_Data_Call_Response_v11);
+        ResponseBuilder<SetupDataCallResult>& dcList = radioService[slotId]->mDataCallList;
+        convertRilDataCallListToHal(response, num, dcList.lock(num));
 #if VDBG
         RLOGD("dataCallListChangedInd");
 #endif
         Return<void> retStatus = radioService[slotId]->mRadioIndication->dataCallListChanged(
-                convertIntToRadioIndicationType(indicationType), dcList);
+                convertIntToRadioIndicationType(indicationType), dcList.list());
+        dcList.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("dataCallListChangedInd: radioService[%d]->mRadioIndication == NULL", slotId);
@@ -7936,151 +8142,90 @@ int radio::voiceRadioTechChangedInd(int slotId,
     return 0;
 }
 
-void convertRilCellInfoListToHal(void *response, size_t responseLen, hidl_vec<CellInfo>& records) {
-    int num = responseLen / sizeof(RIL_CellInfo_v12);
-    records.resize(num);
+// Converts "in" into the next entry of "pool" and points "arm" at it
+template <typename RilT, typename HalT>
+static void setCellInfoArm(const RilT& in, hidl_vec<HalT>& arm, std::vector<HalT>& pool,
+        size_t& used) {
+    HalT *entry = &pool[used++];
+    convertToHal(in, *entry);
+    arm.setToExternal(entry, 1);
+}
 
-    RIL_CellInfo_v12 *rillCellInfo = (RIL_CellInfo_v12 *) response;
-    for (int i = 0; i < num; i++) {
-        records[i].cellInfoType = (CellInfoType) rillCellInfo->cellInfoType;
-        records[i].registered = rillCellInfo->registered;
-        records[i].timeStampType = (TimeStampType) rillCellInfo->timeStampType;
-        records[i].timeStamp = rillCellInfo->timeStamp;
-        // All vectors should be size 0 except one which will be size 1. Set everything to
-        // size 0 initially.
-        records[i].gsm.resize(0);
-        records[i].wcdma.resize(0);
-        records[i].cdma.resize(0);
-        records[i].lte.resize(0);
-        records[i].tdscdma.resize(0);
-        switch(rillCellInfo->cellInfoType) {
-            case RIL_CELL_INFO_TYPE_GSM: {
-                records[i].gsm.resize(1);
-                CellInfoGsm *cellInfoGsm = &records[i].gsm[0];
-                cellInfoGsm->cellIdentityGsm.mcc =
-                        ril::util::mcc::decode(rillCellInfo->CellInfo.gsm.cellIdentityGsm.mcc);
-                cellInfoGsm->cellIdentityGsm.mnc =
-                        ril::util::mnc::decode(rillCellInfo->CellInfo.gsm.cellIdentityGsm.mnc);
-                cellInfoGsm->cellIdentityGsm.lac =
-                        rillCellInfo->CellInfo.gsm.cellIdentityGsm.lac;
-                cellInfoGsm->cellIdentityGsm.cid =
-                        rillCellInfo->CellInfo.gsm.cellIdentityGsm.cid;
-                cellInfoGsm->cellIdentityGsm.arfcn =
-                        rillCellInfo->CellInfo.gsm.cellIdentityGsm.arfcn;
-                cellInfoGsm->cellIdentityGsm.bsic =
-                        rillCellInfo->CellInfo.gsm.cellIdentityGsm.bsic;
-                cellInfoGsm->signalStrengthGsm.signalStrength =
-                        rillCellInfo->CellInfo.gsm.signalStrengthGsm.signalStrength;
-                cellInfoGsm->signalStrengthGsm.bitErrorRate =
-                        rillCellInfo->CellInfo.gsm.signalStrengthGsm.bitErrorRate;
-                cellInfoGsm->signalStrengthGsm.timingAdvance =
-                        rillCellInfo->CellInfo.gsm.signalStrengthGsm.timingAdvance;
+// Empties the arm a reused record held for "type"; the entry belongs to a pool
+static void clearCellInfoArm(CellInfo& record, CellInfoType type) {
+    switch (type) {
+        case CellInfoType::GSM: record.gsm.setToExternal(NULL, 0); break;
+        case CellInfoType::WCDMA: record.wcdma.setToExternal(NULL, 0); break;
+        case CellInfoType::CDMA: record.cdma.setToExternal(NULL, 0); break;
+        case CellInfoType::LTE: record.lte.setToExternal(NULL, 0); break;
+        case CellInfoType::TD_SCDMA: record.tdscdma.setToExternal(NULL, 0); break;
+        default: break;
+    }
+}
+
+const hidl_vec<CellInfo>& CellInfoListBuilder::lock(const RIL_CellInfo_v12 *rilCellInfo,
+        size_t count) {
+    size_t numGsm = 0, numWcdma = 0, numCdma = 0, numLte = 0, numTdscdma = 0;
+
+    pthread_mutex_lock(&mLock);
+
+    // Size the pools first so that the entries handed out below stay put
+    for (size_t i = 0; i < count; i++) {
+        switch (rilCellInfo[i].cellInfoType) {
+            case RIL_CELL_INFO_TYPE_GSM: numGsm++; break;
+            case RIL_CELL_INFO_TYPE_WCDMA: numWcdma++; break;
+            case RIL_CELL_INFO_TYPE_CDMA: numCdma++; break;
+            case RIL_CELL_INFO_TYPE_LTE: numLte++; break;
+            case RIL_CELL_INFO_TYPE_TD_SCDMA: numTdscdma++; break;
+            default: break;
+        }
+    }
+    mGsm.resize(numGsm);
+    mWcdma.resize(numWcdma);
+    mCdma.resize(numCdma);
+    mLte.resize(numLte);
+    mTdscdma.resize(numTdscdma);
+    mRecords.resize(count);
+
+    numGsm = numWcdma = numCdma = numLte = numTdscdma = 0;
+    for (size_t i = 0; i < count; i++) {
+        const RIL_CellInfo_v12& ril = rilCellInfo[i];
+        CellInfo& record = mRecords[i];
+        CellInfoType type = (CellInfoType) ril.cellInfoType;
+
+        // Records start out with every arm empty, and afterwards only the
+        // arm of their last RAT is set
+        if (record.cellInfoType != type) {
+            clearCellInfoArm(record, record.cellInfoType);
+        }
+        record.cellInfoType = type;
+        record.registered = ril.registered;
+        record.timeStampType = (TimeStampType) ril.timeStampType;
+        record.timeStamp = ril.timeStamp;
+
+        switch (ril.cellInfoType) {
+            case RIL_CELL_INFO_TYPE_GSM:
+                setCellInfoArm(ril.CellInfo.gsm, record.gsm, mGsm, numGsm);
                 break;
-            }
-
-            case RIL_CELL_INFO_TYPE_WCDMA: {
-                records[i].wcdma.resize(1);
-                CellInfoWcdma *cellInfoWcdma = &records[i].wcdma[0];
-                cellInfoWcdma->cellIdentityWcdma.mcc =
-                        ril::util::mcc::decode(rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mcc);
-                cellInfoWcdma->cellIdentityWcdma.mnc =
-                        ril::util::mnc::decode(rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.mnc);
-                cellInfoWcdma->cellIdentityWcdma.lac =
-                        rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.lac;
-                cellInfoWcdma->cellIdentityWcdma.cid =
-                        rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.cid;
-                cellInfoWcdma->cellIdentityWcdma.psc =
-                        rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.psc;
-                cellInfoWcdma->cellIdentityWcdma.uarfcn =
-                        rillCellInfo->CellInfo.wcdma.cellIdentityWcdma.uarfcn;
-                cellInfoWcdma->signalStrengthWcdma.signalStrength =
-                        rillCellInfo->CellInfo.wcdma.signalStrengthWcdma.signalStrength;
-                cellInfoWcdma->signalStrengthWcdma.bitErrorRate =
-                        rillCellInfo->CellInfo.wcdma.signalStrengthWcdma.bitErrorRate;
+            case RIL_CELL_INFO_TYPE_WCDMA:
+                setCellInfoArm(ril.CellInfo.wcdma, record.wcdma, mWcdma, numWcdma);
                 break;
-            }
-
-            case RIL_CELL_INFO_TYPE_CDMA: {
-                records[i].cdma.resize(1);
-                CellInfoCdma *cellInfoCdma = &records[i].cdma[0];
-                cellInfoCdma->cellIdentityCdma.networkId =
-                        rillCellInfo->CellInfo.cdma.cellIdentityCdma.networkId;
-                cellInfoCdma->cellIdentityCdma.systemId =
-                        rillCellInfo->CellInfo.cdma.cellIdentityCdma.systemId;
-                cellInfoCdma->cellIdentityCdma.baseStationId =
-                        rillCellInfo->CellInfo.cdma.cellIdentityCdma.basestationId;
-                cellInfoCdma->cellIdentityCdma.longitude =
-                        rillCellInfo->CellInfo.cdma.cellIdentityCdma.longitude;
-                cellInfoCdma->cellIdentityCdma.latitude =
-                        rillCellInfo->CellInfo.cdma.cellIdentityCdma.latitude;
-                cellInfoCdma->signalStrengthCdma.dbm =
-                        rillCellInfo->CellInfo.cdma.signalStrengthCdma.dbm;
-                cellInfoCdma->signalStrengthCdma.ecio =
-                        rillCellInfo->CellInfo.cdma.signalStrengthCdma.ecio;
-                cellInfoCdma->signalStrengthEvdo.dbm =
-                        rillCellInfo->CellInfo.cdma.signalStrengthEvdo.dbm;
-                cellInfoCdma->signalStrengthEvdo.ecio =
-                        rillCellInfo->CellInfo.cdma.signalStrengthEvdo.ecio;
-                cellInfoCdma->signalStrengthEvdo.signalNoiseRatio =
-                        rillCellInfo->CellInfo.cdma.signalStrengthEvdo.signalNoiseRatio;
+            case RIL_CELL_INFO_TYPE_CDMA:
+                setCellInfoArm(ril.CellInfo.cdma, record.cdma, mCdma, numCdma);
                 break;
-            }
-
-            case RIL_CELL_INFO_TYPE_LTE: {
-                records[i].lte.resize(1);
-                CellInfoLte *cellInfoLte = &records[i].lte[0];
-                cellInfoLte->cellIdentityLte.mcc =
-                        ril::util::mcc::decode(rillCellInfo->CellInfo.lte.cellIdentityLte.mcc);
-                cellInfoLte->cellIdentityLte.mnc =
-                        ril::util::mnc::decode(rillCellInfo->CellInfo.lte.cellIdentityLte.mnc);
-                cellInfoLte->cellIdentityLte.ci =
-                        rillCellInfo->CellInfo.lte.cellIdentityLte.ci;
-                cellInfoLte->cellIdentityLte.pci =
-                        rillCellInfo->CellInfo.lte.cellIdentityLte.pci;
-                cellInfoLte->cellIdentityLte.tac =
-                        rillCellInfo->CellInfo.lte.cellIdentityLte.tac;
-                cellInfoLte->cellIdentityLte.earfcn =
-                        rillCellInfo->CellInfo.lte.cellIdentityLte.earfcn;
-                cellInfoLte->signalStrengthLte.signalStrength =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.signalStrength;
-                cellInfoLte->signalStrengthLte.rsrp =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.rsrp;
-                cellInfoLte->signalStrengthLte.rsrq =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.rsrq;
-                cellInfoLte->signalStrengthLte.rssnr =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.rssnr;
-                cellInfoLte->signalStrengthLte.cqi =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.cqi;
-                cellInfoLte->signalStrengthLte.timingAdvance =
-                        rillCellInfo->CellInfo.lte.signalStrengthLte.timingAdvance;
+            case RIL_CELL_INFO_TYPE_LTE:
+                setCellInfoArm(ril.CellInfo.lte, record.lte, mLte, numLte);
                 break;
-            }
-
-            case RIL_CELL_INFO_TYPE_TD_SCDMA: {
-                records[i].tdscdma.resize(1);
-                CellInfoTdscdma *cellInfoTdscdma = &records[i].tdscdma[0];
-                cellInfoTdscdma->cellIdentityTdscdma.mcc =
-                        ril::util::mcc::decode(
-                                rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mcc);
-                cellInfoTdscdma->cellIdentityTdscdma.mnc =
-                        ril::util::mnc::decode(
-                                rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.mnc);
-                cellInfoTdscdma->cellIdentityTdscdma.lac =
-                        rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.lac;
-                cellInfoTdscdma->cellIdentityTdscdma.cid =
-                        rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.cid;
-                cellInfoTdscdma->cellIdentityTdscdma.cpid =
-                        rillCellInfo->CellInfo.tdscdma.cellIdentityTdscdma.cpid;
-                cellInfoTdscdma->signalStrengthTdscdma.rscp =
-                        rillCellInfo->CellInfo.tdscdma.signalStrengthTdscdma.rscp;
+            case RIL_CELL_INFO_TYPE_TD_SCDMA:
+                setCellInfoArm(ril.CellInfo.tdscdma, record.tdscdma, mTdscdma, numTdscdma);
                 break;
-            }
-            default: {
+            default:
                 break;
-            }
         }
-        rillCellInfo += 1;
     }
+
+    mList.setToExternal(mRecords.data(), count);
+    return mList;
 }
 
 int radio::cellInfoListInd(int slotId,
@@ -8092,14 +8237,15 @@ int radio::cellInfoListInd(int slotId,
             return 0;
         }
 
-        hidl_vec<CellInfo> records;
-        convertRilCellInfoListToHal(response, responseLen, records);
-
 #if VDBG
         RLOGD("cellInfoListInd");
 #endif
+        CellInfoListBuilder& builder = radioService[slotId]->mCellInfoList;
         Return<void> retStatus = radioService[slotId]->mRadioIndication->cellInfoList(
-                convertIntToRadioIndicationType(indicationType), records);
+                convertIntToRadioIndicationType(indicationType),
+                builder.lock((RIL_CellInfo_v12 *) response,
+                        responseLen / sizeof(RIL_CellInfo_v12)));
+        builder.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("cellInfoListInd: radioService[%d]->mRadioIndication == NULL", slotId);
@@ -8486,13 +8632,15 @@ int radio::networkScanResultInd(int slotId,
         V1_1::NetworkScanResult result;
         result.status = (V1_1::ScanStatus) networkScanResult->status;
         result.error = (RadioError) networkScanResult->error;
-        convertRilCellInfoListToHal(
-                networkScanResult->network_infos,
-                networkScanResult->network_infos_length * sizeof(RIL_CellInfo_v12),
-                result.networkInfos);
+        CellInfoListBuilder& builder = radioService[slotId]->mCellInfoList;
+        const hidl_vec<CellInfo>& networkInfos = builder.lock(
+                networkScanResult->network_infos, networkScanResult->network_infos_length);
+        result.networkInfos.setToExternal(const_cast<CellInfo *>(networkInfos.data()),
+                networkInfos.size());
 
         Return<void> retStatus = radioService[slotId]->mRadioIndicationV1_1->networkScanResult(
                 convertIntToRadioIndicationType(indicationType), result);
+        builder.unlock();
         radioService[slotId]->checkReturnStatus(retStatus);
     } else {
         RLOGE("networkScanResultInd: radioService[%d]->mRadioIndicationV1_1 == NULL", slotId);
@@ -8526,19 +8674,11 @@ int radio::keepaliveStatusInd(int slotId,
 #if VDBG
     RLOGD("%s(): token=%d", __FUNCTION__, token);
 #endif
-    if (radioService[slotId] == NULL || radioService[slotId]->mRadioIndication == NULL) {
-        RLOGE("%s: radioService[%d]->mRadioIndication == NULL", __FUNCTION__, slotId);
+    if (radioService[slotId] == NULL || radioService[slotId]->mRadioIndicationV1_1 == NULL) {
+        RLOGE("%s: radioService[%d]->mRadioIndicationV1_1 == NULL", __FUNCTION__, slotId);
         return 0;
     }
 
-    auto ret = V1_1::IRadioIndication::castFrom(
-        radioService[slotId]->mRadioIndication);
-    if (!ret.isOk()) {
-        RLOGE("%s: ret.isOk() == false for radioService[%d]", __FUNCTION__, slotId);
-        return 0;
-    }
-    sp<V1_1::IRadioIndication> radioIndicationV1_1 = ret;
-
     if (response == NULL || responseLen != sizeof(V1_1::KeepaliveStatus)) {
         RLOGE("%s: invalid response", __FUNCTION__);
         return 0;
@@ -8547,12 +8687,69 @@ int radio::keepaliveStatusInd(int slotId,
     V1_1::KeepaliveStatus ks;
     convertRilKeepaliveStatusToHal(static_cast<RIL_KeepaliveStatus*>(response), ks);
 
-    Return<void> retStatus = radioIndicationV1_1->keepaliveStatus(
+    Return<void> retStatus = radioService[slotId]->mRadioIndicationV1_1->keepaliveStatus(
             convertIntToRadioIndicationType(indicationType), ks);
     radioService[slotId]->checkReturnStatus(retStatus);
     return 0;
 }
 
+/**
+ * Sends "bytes" as a framed RIL_UNSOL_OEM_HOOK_RAW transfer, see ril.h: a
+ * RIL_OemHookRawFrameHeader, then frames of up to OEM_HOOK_RAW_FRAME_BYTES
+ * that point into "bytes". One transfer goes out at a time, so frames of
+ * two never interleave.
+ *
+ * Oneway calls aren't acknowledged and every frame of a transfer can be
+ * queued at the client at once, so a transfer that wouldn't fit its oneway
+ * buffer is dropped rather than left to fail part way and take the
+ * callbacks with it.
+ */
+static void sendOemHookRawFrames(int slotId, int indicationType, const uint8_t *bytes,
+                                 size_t len) {
+    static pthread_mutex_t s_transferLock = PTHREAD_MUTEX_INITIALIZER;
+    static uint32_t s_nextTransferId;
+    RIL_OemHookRawFrameHeader header = {};
+    size_t frames = len / OEM_HOOK_RAW_FRAME_BYTES + (len % OEM_HOOK_RAW_FRAME_BYTES != 0);
+
+    // the header and every frame each take a transaction at the client
+    if (len > BINDER_VM_BYTES / 2 || sizeof(header) + len
+            + (frames + 1) * BINDER_PARCEL_OVERHEAD_BYTES > BINDER_VM_BYTES / 2) {
+        RLOGE("oemHookRawInd: dropping %zu bytes, too many to queue at the client at once",
+                len);
+        return;
+    }
+
+    header.magic = RIL_OEM_HOOK_RAW_FRAME_MAGIC;
+    header.frames = (uint32_t) frames;
+    header.totalLength = (uint32_t) len;
+
+    pthread_mutex_lock(&s_transferLock);
+    header.transferId = s_nextTransferId++;
+
+    hidl_vec<uint8_t> data;
+    data.setToExternal((uint8_t *) &header, sizeof(header));
+    Return<void> retStatus = oemHookService[slotId]->mOemHookIndication->oemHookRaw(
+            convertIntToRadioIndicationType(indicationType), data);
+
+    size_t offset = 0;
+    while (retStatus.isOk() && offset < len) {
+        size_t chunkLen = len - offset;
+        if (chunkLen > OEM_HOOK_RAW_FRAME_BYTES) {
+            chunkLen = OEM_HOOK_RAW_FRAME_BYTES;
+        }
+
+        data.setToExternal(const_cast<uint8_t *>(bytes) + offset, chunkLen);
+        retStatus = oemHookService[slotId]->mOemHookIndication->oemHookRaw(
+                convertIntToRadioIndicationType(indicationType), data);
+        offset += chunkLen;
+    }
+
+    pthread_mutex_unlock(&s_transferLock);
+
+    // stops at the first failure, which drops the callbacks
+    checkReturnStatus(slotId, retStatus, false);
+}
+
 int radio::oemHookRawInd(int slotId,
                          int indicationType, int token, RIL_Errno e, void *response,
                          size_t responseLen) {
@@ -8564,11 +8761,24 @@ int radio::oemHookRawInd(int slotId,
             return 0;
         }
 
-        hidl_vec<uint8_t> data;
-        data.setToExternal((uint8_t *) response, responseLen);
 #if VDBG
         RLOGD("oemHookRawInd");
 #endif
+        if (kOemHookRawFraming) {
+            sendOemHookRawFrames(slotId, indicationType, (const uint8_t *) response,
+                    responseLen);
+            return 0;
+        }
+
+        if (responseLen > oemHookRawMaxBytes()) {
+            // would fail the transaction and take the client's callbacks with it
+            RLOGE("oemHookRawInd: dropping %zu bytes, over the %zu byte limit", responseLen,
+                    oemHookRawMaxBytes());
+            return 0;
+        }
+
+        hidl_vec<uint8_t> data;
+        data.setToExternal((uint8_t *) response, responseLen);
         Return<void> retStatus = oemHookService[slotId]->mOemHookIndication->oemHookRaw(
                 convertIntToRadioIndicationType(indicationType), data);
         checkReturnStatus(slotId, retStatus, false);
@@ -8604,12 +8814,11 @@ void radio::registerService(RIL_RadioFunctions *callbacks, CommandInfo *commands
 
     configureRpcThreadpool(1, true /* callerWillJoin */);
     for (int i = 0; i < simCount; i++) {
-        pthread_rwlock_t *radioServiceRwlockPtr = getRadioServiceRwlock(i);
-        int ret = pthread_rwlock_wrlock(radioServiceRwlockPtr);
-        assert(ret == 0);
+        radioServiceLock[i].writeLock();
 
         radioService[i] = new RadioImpl;
         radioService[i]->mSlotId = i;
+        radioService[i]->mDeathRecipient = new ClientDeathRecipient(i, true);
         RLOGD("registerService: starting android::hardware::radio::V1_1::IRadio %s",
                 serviceNames[i]);
         android::status_t status = radioService[i]->registerAsService(serviceNames[i]);
@@ -8617,11 +8826,11 @@ void radio::registerService(RIL_RadioFunctions *callbacks, CommandInfo *commands
         if (kOemHookEnabled) {
             oemHookService[i] = new OemHookImpl;
             oemHookService[i]->mSlotId = i;
+            oemHookService[i]->mDeathRecipient = new ClientDeathRecipient(i, false);
             status = oemHookService[i]->registerAsService(serviceNames[i]);
         }
 
-        ret = pthread_rwlock_unlock(radioServiceRwlockPtr);
-        assert(ret == 0);
+        radioServiceLock[i].writeUnlock();
     }
 }
 
@@ -8629,23 +8838,15 @@ void rilc_thread_pool() {
     joinRpcThreadpool();
 }
 
-pthread_rwlock_t * radio::getRadioServiceRwlock(int slotId) {
-    pthread_rwlock_t *radioServiceRwlockPtr = &radioServiceRwlock;
-
-    #if (SIM_COUNT >= 2)
-    if (slotId == 2) radioServiceRwlockPtr = &radioServiceRwlock2;
-    #if (SIM_COUNT >= 3)
-    if (slotId == 3) radioServiceRwlockPtr = &radioServiceRwlock3;
-    #if (SIM_COUNT >= 4)
-    if (slotId == 4) radioServiceRwlockPtr = &radioServiceRwlock4;
-    #endif
-    #endif
-    #endif
+void radio::lockRadioServiceForRead(int slotId) {
+    radioServiceLock[slotId].readLock();
+}
 
-    return radioServiceRwlockPtr;
+void radio::unlockRadioServiceForRead(int slotId) {
+    radioServiceLock[slotId].readUnlock();
 }
 
-// should acquire write lock for the corresponding service before calling this
+// may be called with or without the read lock held
 void radio::setNitzTimeReceived(int slotId, int64_t timeReceived) {
-    nitzTimeReceived[slotId] = timeReceived;
+    nitzTimeReceived[slotId].store(timeReceived, std::memory_order_relaxed);
 }
@@ -741,7 +741,11 @@ int carrierInfoForImsiEncryption(int slotId,
                         int responseType, int serial, RIL_Errno e,
                         void *response, size_t responseLen);
 
-pthread_rwlock_t * getRadioServiceRwlock(int slotId);
+// Held around every response and indication; blocks only while a client's
+// callbacks are being replaced
+void lockRadioServiceForRead(int slotId);
+
+void unlockRadioServiceForRead(int slotId);
 
 void setNitzTimeReceived(int slotId, int64_t timeReceived);
 
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RADIO_TYPES_MOCK_H
+#define RADIO_TYPES_MOCK_H
+
+/*
+ * Host stand-ins for the radio@1.0 types that ril_convert.h fills in, so
+ * the converters can be built and timed without libhidlbase. Field names
+ * and widths follow types.hal. hidl_string copies into a fresh heap buffer
+ * on every assignment, as the real one does, so string fields cost what
+ * they cost on the device.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+namespace android {
+namespace hardware {
+
+class hidl_string {
+public:
+    hidl_string() {}
+    hidl_string(const hidl_string& other) { copyFrom(other.mBuffer, other.mSize); }
+    ~hidl_string() { clear(); }
+
+    hidl_string& operator=(const hidl_string& other) {
+        if (this != &other) {
+            clear();
+            copyFrom(other.mBuffer, other.mSize);
+        }
+        return *this;
+    }
+
+    hidl_string& operator=(const std::string& s) {
+        clear();
+        copyFrom(s.data(), s.size());
+        return *this;
+    }
+
+    void setToExternal(const char* data, size_t size) {
+        clear();
+        mBuffer = data;
+        mSize = size;
+    }
+
+    const char* c_str() const { return mBuffer; }
+    size_t size() const { return mSize; }
+
+    bool operator==(const char* s) const { return strcmp(mBuffer, s) == 0; }
+
+private:
+    void copyFrom(const char* data, size_t size) {
+        char* buffer = static_cast<char*>(malloc(size + 1));
+
+        memcpy(buffer, data, size);
+        buffer[size] = '\0';
+        mBuffer = buffer;
+        mSize = size;
+        mOwnsBuffer = true;
+    }
+
+    void clear() {
+        if (mOwnsBuffer) {
+            free(const_cast<char*>(mBuffer));
+        }
+        mBuffer = "";
+        mSize = 0;
+        mOwnsBuffer = false;
+    }
+
+    const char* mBuffer = "";
+    size_t mSize = 0;
+    bool mOwnsBuffer = false;
+};
+
+namespace radio {
+namespace V1_0 {
+
+struct CellIdentityGsm {
+    hidl_string mcc;
+    hidl_string mnc;
+    int32_t lac;
+    int32_t cid;
+    int32_t arfcn;
+    uint8_t bsic;
+};
+
+struct CellIdentityWcdma {
+    hidl_string mcc;
+    hidl_string mnc;
+    int32_t lac;
+    int32_t cid;
+    int32_t psc;
+    int32_t uarfcn;
+};
+
+struct CellIdentityCdma {
+    int32_t networkId;
+    int32_t systemId;
+    int32_t baseStationId;
+    int32_t longitude;
+    int32_t latitude;
+};
+
+struct CellIdentityLte {
+    hidl_string mcc;
+    hidl_string mnc;
+    int32_t ci;
+    int32_t pci;
+    int32_t tac;
+    int32_t earfcn;
+};
+
+struct CellIdentityTdscdma {
+    hidl_string mcc;
+    hidl_string mnc;
+    int32_t lac;
+    int32_t cid;
+    int32_t cpid;
+};
+
+struct GsmSignalStrength {
+    uint32_t signalStrength;
+    uint32_t bitErrorRate;
+    int32_t timingAdvance;
+};
+
+struct WcdmaSignalStrength {
+    int32_t signalStrength;
+    int32_t bitErrorRate;
+};
+
+struct CdmaSignalStrength {
+    uint32_t dbm;
+    uint32_t ecio;
+};
+
+struct EvdoSignalStrength {
+    uint32_t dbm;
+    uint32_t ecio;
+    uint32_t signalNoiseRatio;
+};
+
+struct LteSignalStrength {
+    uint32_t signalStrength;
+    uint32_t rsrp;
+    uint32_t rsrq;
+    int32_t rssnr;
+    uint32_t cqi;
+    uint32_t timingAdvance;
+};
+
+struct TdScdmaSignalStrength {
+    uint32_t rscp;
+};
+
+struct CellInfoGsm {
+    CellIdentityGsm cellIdentityGsm;
+    GsmSignalStrength signalStrengthGsm;
+};
+
+struct CellInfoWcdma {
+    CellIdentityWcdma cellIdentityWcdma;
+    WcdmaSignalStrength signalStrengthWcdma;
+};
+
+struct CellInfoCdma {
+    CellIdentityCdma cellIdentityCdma;
+    CdmaSignalStrength signalStrengthCdma;
+    EvdoSignalStrength signalStrengthEvdo;
+};
+
+struct CellInfoLte {
+    CellIdentityLte cellIdentityLte;
+    LteSignalStrength signalStrengthLte;
+};
+
+struct CellInfoTdscdma {
+    CellIdentityTdscdma cellIdentityTdscdma;
+    TdScdmaSignalStrength signalStrengthTdscdma;
+};
+
+enum class DataCallFailCause : int32_t {};
+
+struct SetupDataCallResult {
+    DataCallFailCause status;
+    int32_t suggestedRetryTime;
+    int32_t cid;
+    int32_t active;
+    hidl_string type;
+    hidl_string ifname;
+    hidl_string addresses;
+    hidl_string dnses;
+    hidl_string gateways;
+    hidl_string pcscf;
+    int32_t mtu;
+};
+
+}  // namespace V1_0
+}  // namespace radio
+}  // namespace hardware
+}  // namespace android
+
+#endif /* RADIO_TYPES_MOCK_H */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times each convertToHal() overload in ril_convert.h, built on the host
+ * against radio_types_mock.h. The output struct is reused across
+ * iterations, as the response builders in ril_service.cpp reuse theirs.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "radio_types_mock.h"
+#include "ril_convert.h"
+
+using namespace android::hardware::radio::V1_0;
+
+namespace {
+
+void fill(RIL_CellIdentityGsm_v12& in) {
+    in = { 310, 260, 0x1c3, 0xa1b2, 512, 27 };
+}
+
+void fill(RIL_CellIdentityWcdma_v12& in) {
+    in = { 310, 260, 0x1c3, 0x0a1b2c3, 120, 10700 };
+}
+
+void fill(RIL_CellIdentityCdma& in) {
+    in = { 4, 310, 1234, -1755000, 539000 };
+}
+
+void fill(RIL_CellIdentityLte_v12& in) {
+    in = { 310, 260, 0x1a2b3c4, 301, 0x2b67, 5230 };
+}
+
+void fill(RIL_CellIdentityTdscdma& in) {
+    in = { 460, 0, 0x1c3, 0xa1b2, 64 };
+}
+
+void fill(RIL_GSM_SignalStrength_v12& in) {
+    in = { 20, 99, 3 };
+}
+
+void fill(RIL_GW_SignalStrength& in) {
+    in = { 20, 99 };
+}
+
+void fill(RIL_SignalStrengthWcdma& in) {
+    in = { 18, 99 };
+}
+
+void fill(RIL_CDMA_SignalStrength& in) {
+    in = { 75, 90 };
+}
+
+void fill(RIL_EVDO_SignalStrength& in) {
+    in = { 80, 100, 6 };
+}
+
+void fill(RIL_LTE_SignalStrength_v8& in) {
+    in = { 25, 95, 10, 120, 15, 4 };
+}
+
+void fill(RIL_TD_SCDMA_SignalStrength& in) {
+    in = { 60 };
+}
+
+void fill(RIL_CellInfoGsm_v12& in) {
+    fill(in.cellIdentityGsm);
+    fill(in.signalStrengthGsm);
+}
+
+void fill(RIL_CellInfoWcdma_v12& in) {
+    fill(in.cellIdentityWcdma);
+    fill(in.signalStrengthWcdma);
+}
+
+void fill(RIL_CellInfoCdma& in) {
+    fill(in.cellIdentityCdma);
+    fill(in.signalStrengthCdma);
+    fill(in.signalStrengthEvdo);
+}
+
+void fill(RIL_CellInfoLte_v12& in) {
+    fill(in.cellIdentityLte);
+    fill(in.signalStrengthLte);
+}
+
+void fill(RIL_CellInfoTdscdma& in) {
+    fill(in.cellIdentityTdscdma);
+    fill(in.signalStrengthTdscdma);
+}
+
+void fill(RIL_Data_Call_Response_v11& in) {
+    in = { 0, -1, 1, 2, (char *) "IPV4V6", (char *) "rmnet0",
+           (char *) "10.0.2.15/24 2001:db8::15/64", (char *) "10.0.2.3 2001:db8::3",
+           (char *) "10.0.2.2", (char *) "", 1500 };
+}
+
+template <typename RilT, typename HalT>
+void BM_convertToHal(benchmark::State& state) {
+    RilT in;
+    HalT out{};
+
+    fill(in);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&in);
+        convertToHal(in, out);
+        benchmark::ClobberMemory();
+    }
+}
+
+#define BENCHMARK_CONVERTER(RilT, HalT) \
+        BENCHMARK_TEMPLATE(BM_convertToHal, RilT, HalT)
+
+BENCHMARK_CONVERTER(RIL_CellIdentityGsm_v12, CellIdentityGsm);
+BENCHMARK_CONVERTER(RIL_CellIdentityWcdma_v12, CellIdentityWcdma);
+BENCHMARK_CONVERTER(RIL_CellIdentityCdma, CellIdentityCdma);
+BENCHMARK_CONVERTER(RIL_CellIdentityLte_v12, CellIdentityLte);
+BENCHMARK_CONVERTER(RIL_CellIdentityTdscdma, CellIdentityTdscdma);
+
+BENCHMARK_CONVERTER(RIL_GSM_SignalStrength_v12, GsmSignalStrength);
+BENCHMARK_CONVERTER(RIL_GW_SignalStrength, GsmSignalStrength);
+BENCHMARK_CONVERTER(RIL_SignalStrengthWcdma, WcdmaSignalStrength);
+BENCHMARK_CONVERTER(RIL_CDMA_SignalStrength, CdmaSignalStrength);
+BENCHMARK_CONVERTER(RIL_EVDO_SignalStrength, EvdoSignalStrength);
+BENCHMARK_CONVERTER(RIL_LTE_SignalStrength_v8, LteSignalStrength);
+BENCHMARK_CONVERTER(RIL_TD_SCDMA_SignalStrength, TdScdmaSignalStrength);
+
+BENCHMARK_CONVERTER(RIL_CellInfoGsm_v12, CellInfoGsm);
+BENCHMARK_CONVERTER(RIL_CellInfoWcdma_v12, CellInfoWcdma);
+BENCHMARK_CONVERTER(RIL_CellInfoCdma, CellInfoCdma);
+BENCHMARK_CONVERTER(RIL_CellInfoLte_v12, CellInfoLte);
+BENCHMARK_CONVERTER(RIL_CellInfoTdscdma, CellInfoTdscdma);
+
+BENCHMARK_CONVERTER(RIL_Data_Call_Response_v11, SetupDataCallResult);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hex codec for PDUs, APDUs and SIM IO payloads.
+ *
+ * The bulk of a string is handled 32 digits (16 bytes) at a time with SSE2
+ * or NEON where the target has them; the tail, and every target without
+ * them, goes through the scalar tables below.
+ */
+
+#include <telephony/librilutils.h>
+
+/* RIL_HEX_NO_SIMD builds the scalar code alone, for tests to compare with */
+#if defined(RIL_HEX_NO_SIMD)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HEX_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEX_SIMD_NEON 1
+#endif
+
+#define HEX_INVALID 0xff
+
+static const char s_hexDigits[] = "0123456789ABCDEF";
+
+static uint8_t hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return HEX_INVALID;
+}
+
+/*
+ * Decodes "count" bytes from "hex" into "out" (which may be NULL to only
+ * validate). Returns 0, or -1 on a character that is not a hex digit.
+ */
+static int decodeScalar(const char *hex, size_t count, uint8_t *out) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t hi = hexValue(hex[2 * i]);
+        uint8_t lo = hexValue(hex[2 * i + 1]);
+
+        if (hi == HEX_INVALID || lo == HEX_INVALID) {
+            return -1;
+        }
+        if (out != NULL) {
+            out[i] = (hi << 4) | lo;
+        }
+    }
+    return 0;
+}
+
+static void encodeScalar(const uint8_t *in, size_t count, char *out) {
+    for (size_t i = 0; i < count; i++) {
+        out[2 * i] = s_hexDigits[in[i] >> 4];
+        out[2 * i + 1] = s_hexDigits[in[i] & 0x0f];
+    }
+}
+
+#if defined(HEX_SIMD_SSE2)
+
+/* unsigned "v < limit" per byte, for limit <= 128 */
+static inline __m128i lessThanU8(__m128i v, int limit) {
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    return _mm_cmplt_epi8(_mm_xor_si128(v, bias), _mm_set1_epi8((char) (0x80 + limit)));
+}
+
+/*
+ * Converts 16 digits to their values; clears *p_valid if any of them is not
+ * a hex digit
+ */
+static inline __m128i digitValues(__m128i chars, int *p_valid) {
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)),
+                                  _mm_set1_epi8('a'));
+    __m128i isDigit = lessThanU8(digit, 10);
+    __m128i isLetter = lessThanU8(letter, 6);
+
+    if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xffff) {
+        *p_valid = 0;
+    }
+    return _mm_or_si128(_mm_and_si128(isDigit, digit),
+                        _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+/* packs 16 digit values, high nibble first, into 8 bytes in the low half */
+static inline __m128i packNibbles(__m128i values) {
+    __m128i hi = _mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00ff)), 4);
+    __m128i lo = _mm_srli_epi16(values, 8);
+    return _mm_or_si128(hi, lo);
+}
+
+static size_t decodeBlocks(const char *hex, size_t count, uint8_t *out, int *p_valid) {
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = digitValues(_mm_loadu_si128((const __m128i *) (hex + 2 * i)), p_valid);
+        __m128i b = digitValues(_mm_loadu_si128((const __m128i *) (hex + 2 * i + 16)), p_valid);
+
+        if (!*p_valid) {
+            break;
+        }
+        if (out != NULL) {
+            _mm_storeu_si128((__m128i *) (out + i),
+                             _mm_packus_epi16(packNibbles(a), packNibbles(b)));
+        }
+    }
+    return i;
+}
+
+static inline __m128i nibbleChars(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                                    _mm_set1_epi8('A' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+static size_t encodeBlocks(const uint8_t *in, size_t count, char *out) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i hi = nibbleChars(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        __m128i lo = nibbleChars(_mm_and_si128(bytes, mask));
+
+        _mm_storeu_si128((__m128i *) (out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+#elif defined(HEX_SIMD_NEON)
+
+static inline int allSet(uint8x16_t mask) {
+#if defined(__aarch64__)
+    return vminvq_u8(mask) == 0xff;
+#else
+    uint8x8_t half = vand_u8(vget_low_u8(mask), vget_high_u8(mask));
+    return vget_lane_u64(vreinterpret_u64_u8(half), 0) == ~0ULL;
+#endif
+}
+
+/*
+ * Converts 16 digits to their values; clears *p_valid if any of them is not
+ * a hex digit
+ */
+static inline uint8x16_t digitValues(uint8x16_t chars, int *p_valid) {
+    uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+    uint8x16_t letter = vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t isDigit = vcltq_u8(digit, vdupq_n_u8(10));
+    uint8x16_t isLetter = vcltq_u8(letter, vdupq_n_u8(6));
+
+    if (!allSet(vorrq_u8(isDigit, isLetter))) {
+        *p_valid = 0;
+    }
+    return vorrq_u8(vandq_u8(isDigit, digit),
+                    vandq_u8(isLetter, vaddq_u8(letter, vdupq_n_u8(10))));
+}
+
+static size_t decodeBlocks(const char *hex, size_t count, uint8_t *out, int *p_valid) {
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        /* val[0] holds the high digits, val[1] the low ones */
+        uint8x16x2_t chars = vld2q_u8((const uint8_t *) (hex + 2 * i));
+        uint8x16_t hi = digitValues(chars.val[0], p_valid);
+        uint8x16_t lo = digitValues(chars.val[1], p_valid);
+
+        if (!*p_valid) {
+            break;
+        }
+        if (out != NULL) {
+            vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+        }
+    }
+    return i;
+}
+
+static inline uint8x16_t nibbleChars(uint8x16_t nibbles) {
+    uint8x16_t letters = vandq_u8(vcgtq_u8(nibbles, vdupq_n_u8(9)),
+                                  vdupq_n_u8('A' - '0' - 10));
+    return vaddq_u8(vaddq_u8(nibbles, vdupq_n_u8('0')), letters);
+}
+
+static size_t encodeBlocks(const uint8_t *in, size_t count, char *out) {
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t bytes = vld1q_u8(in + i);
+        uint8x16x2_t chars;
+
+        chars.val[0] = nibbleChars(vshrq_n_u8(bytes, 4));
+        chars.val[1] = nibbleChars(vandq_u8(bytes, vdupq_n_u8(0x0f)));
+        vst2q_u8((uint8_t *) (out + 2 * i), chars);
+    }
+    return i;
+}
+
+#else
+
+static size_t decodeBlocks(const char *hex __attribute__((unused)),
+                           size_t count __attribute__((unused)),
+                           uint8_t *out __attribute__((unused)),
+                           int *p_valid __attribute__((unused))) {
+    return 0;
+}
+
+static size_t encodeBlocks(const uint8_t *in __attribute__((unused)),
+                           size_t count __attribute__((unused)),
+                           char *out __attribute__((unused))) {
+    return 0;
+}
+
+#endif
+
+static ssize_t decode(const char *hex, size_t hexLen, uint8_t *out) {
+    size_t count = hexLen / 2;
+    int valid = 1;
+    size_t done;
+
+    if (hexLen % 2 != 0) {
+        return -1;
+    }
+
+    done = decodeBlocks(hex, count, out, &valid);
+    if (!valid || decodeScalar(hex + 2 * done, count - done,
+                               out != NULL ? out + done : NULL) < 0) {
+        return -1;
+    }
+    return count;
+}
+
+ssize_t ril_hex_decode(const char *hex, size_t hexLen, uint8_t *out, size_t outSize) {
+    if (hex == NULL || out == NULL || hexLen / 2 > outSize) {
+        return -1;
+    }
+    return decode(hex, hexLen, out);
+}
+
+int ril_hex_validate(const char *hex, size_t hexLen) {
+    return hex != NULL && decode(hex, hexLen, NULL) >= 0;
+}
+
+ssize_t ril_hex_encode(const uint8_t *in, size_t len, char *out, size_t outSize) {
+    size_t done;
+
+    if ((in == NULL && len > 0) || out == NULL || outSize < 2 * len + 1) {
+        return -1;
+    }
+
+    done = encodeBlocks(in, len, out);
+    encodeScalar(in + done, len - done, out + 2 * done);
+    out[2 * len] = '\0';
+    return 2 * len;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <telephony/librilutils.h>
+
+#include <benchmark/benchmark.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "hex_scalar.h"
+
+namespace {
+
+// Byte counts of the payloads the RIL actually moves as hex: a short
+// SMS-DELIVER, a status report sized PDU, a full 160 character
+// SMS-SUBMIT, a maximal SIM IO record, and a large APDU response.
+void pduSizes(benchmark::internal::Benchmark* b) {
+    for (int len : { 23, 88, 176, 255, 1024 }) {
+        b->Arg(len);
+    }
+}
+
+std::vector<uint8_t> pattern(size_t len) {
+    std::vector<uint8_t> v(len);
+
+    for (size_t i = 0; i < len; i++) {
+        v[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    return v;
+}
+
+std::string hexOf(const std::vector<uint8_t>& in) {
+    std::vector<char> out(2 * in.size() + 1);
+
+    ril_hex_encode(in.data(), in.size(), out.data(), out.size());
+    return std::string(out.data(), 2 * in.size());
+}
+
+template <ssize_t (*Decode)(const char*, size_t, uint8_t*, size_t)>
+void BM_decode(benchmark::State& state) {
+    size_t len = state.range(0);
+    std::string hex = hexOf(pattern(len));
+    std::vector<uint8_t> out(len);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Decode(hex.data(), hex.size(), out.data(), len));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * hex.size());
+}
+
+template <ssize_t (*Encode)(const uint8_t*, size_t, char*, size_t)>
+void BM_encode(benchmark::State& state) {
+    size_t len = state.range(0);
+    std::vector<uint8_t> in = pattern(len);
+    std::vector<char> out(2 * len + 1);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Encode(in.data(), len, out.data(), out.size()));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+BENCHMARK_TEMPLATE(BM_decode, ril_hex_decode)->Apply(pduSizes);
+BENCHMARK_TEMPLATE(BM_decode, ril_hex_decode_scalar)->Apply(pduSizes);
+BENCHMARK_TEMPLATE(BM_encode, ril_hex_encode)->Apply(pduSizes);
+BENCHMARK_TEMPLATE(BM_encode, ril_hex_encode_scalar)->Apply(pduSizes);
+
+}  // namespace
+
+BENCHMARK_MAIN();
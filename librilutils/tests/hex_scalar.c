@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * hex.c again, without SSE2/NEON and under the names in hex_scalar.h, so
+ * the test and the benchmark can hold the vector code up against it.
+ */
+
+#define RIL_HEX_NO_SIMD 1
+
+#define ril_hex_decode ril_hex_decode_scalar
+#define ril_hex_validate ril_hex_validate_scalar
+#define ril_hex_encode ril_hex_encode_scalar
+
+#include "../hex.c"
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RIL_HEX_SCALAR_H
+#define RIL_HEX_SCALAR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the ril_hex_* functions built with RIL_HEX_NO_SIMD, see hex_scalar.c */
+ssize_t ril_hex_decode_scalar(const char *hex, size_t hexLen, uint8_t *out, size_t outSize);
+int ril_hex_validate_scalar(const char *hex, size_t hexLen);
+ssize_t ril_hex_encode_scalar(const uint8_t *in, size_t len, char *out, size_t outSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RIL_HEX_SCALAR_H */
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <telephony/librilutils.h>
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hex_scalar.h"
+
+namespace {
+
+// Long enough to cover every block/tail split of the 16 byte vector loops,
+// and a few of the largest PDUs (an SMS-SUBMIT tops out near 176 bytes).
+constexpr size_t kMaxBytes = 600;
+
+std::vector<uint8_t> randomBytes(std::mt19937& rng, size_t len) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> v(len);
+
+    for (auto& b : v) {
+        b = static_cast<uint8_t>(byte(rng));
+    }
+    return v;
+}
+
+std::string referenceEncode(const std::vector<uint8_t>& in) {
+    static const char kDigits[] = "0123456789ABCDEF";
+    std::string s;
+
+    for (uint8_t b : in) {
+        s += kDigits[b >> 4];
+        s += kDigits[b & 0xf];
+    }
+    return s;
+}
+
+// Flips the case of the letters in "hex" at random.
+std::string mixCase(std::mt19937& rng, std::string hex) {
+    for (auto& c : hex) {
+        if (c >= 'A' && c <= 'F' && (rng() & 1)) {
+            c = c - 'A' + 'a';
+        }
+    }
+    return hex;
+}
+
+TEST(HexTest, EncodeMatchesReference) {
+    std::mt19937 rng(1);
+
+    for (size_t len = 0; len <= kMaxBytes; len++) {
+        std::vector<uint8_t> in = randomBytes(rng, len);
+        std::string expected = referenceEncode(in);
+        std::vector<char> out(2 * len + 1, 'x');
+        std::vector<char> scalarOut(2 * len + 1, 'x');
+
+        ASSERT_EQ(static_cast<ssize_t>(2 * len),
+                  ril_hex_encode(in.data(), len, out.data(), out.size())) << len;
+        ASSERT_EQ(static_cast<ssize_t>(2 * len),
+                  ril_hex_encode_scalar(in.data(), len, scalarOut.data(),
+                                        scalarOut.size())) << len;
+        EXPECT_STREQ(expected.c_str(), out.data()) << len;
+        EXPECT_STREQ(expected.c_str(), scalarOut.data()) << len;
+    }
+}
+
+TEST(HexTest, RoundTrip) {
+    std::mt19937 rng(2);
+
+    for (size_t len = 0; len <= kMaxBytes; len++) {
+        std::vector<uint8_t> in = randomBytes(rng, len);
+        std::string hex = mixCase(rng, referenceEncode(in));
+        std::vector<uint8_t> out(len + 1, 0xa5);
+        std::vector<uint8_t> scalarOut(len + 1, 0xa5);
+
+        ASSERT_EQ(static_cast<ssize_t>(len),
+                  ril_hex_decode(hex.data(), hex.size(), out.data(), len)) << hex;
+        ASSERT_EQ(static_cast<ssize_t>(len),
+                  ril_hex_decode_scalar(hex.data(), hex.size(), scalarOut.data(), len))
+                << hex;
+        EXPECT_TRUE(std::equal(in.begin(), in.end(), out.begin())) << hex;
+        EXPECT_TRUE(std::equal(in.begin(), in.end(), scalarOut.begin())) << hex;
+        // nothing written past the decoded bytes
+        EXPECT_EQ(0xa5, out[len]);
+        EXPECT_EQ(1, ril_hex_validate(hex.data(), hex.size()));
+        EXPECT_EQ(1, ril_hex_validate_scalar(hex.data(), hex.size()));
+    }
+}
+
+TEST(HexTest, RejectsEveryBadCharacterAtEveryPosition) {
+    // neighbours of the digit and letter ranges, and high bit bytes
+    static const char kBad[] = { 'g', 'G', ':', '/', '@', '`', ' ', '\0',
+                                 static_cast<char>(0x80), static_cast<char>(0xb0),
+                                 static_cast<char>(0xff) };
+    std::mt19937 rng(3);
+
+    for (size_t len : { 1, 7, 15, 16, 17, 31, 32, 33, 88, 176 }) {
+        std::string good = referenceEncode(randomBytes(rng, len));
+        std::vector<uint8_t> out(len);
+
+        for (size_t pos = 0; pos < good.size(); pos++) {
+            for (char bad : kBad) {
+                std::string hex = good;
+
+                hex[pos] = bad;
+                EXPECT_EQ(-1, ril_hex_decode(hex.data(), hex.size(), out.data(), len))
+                        << len << " at " << pos;
+                EXPECT_EQ(-1, ril_hex_decode_scalar(hex.data(), hex.size(), out.data(),
+                                                    len))
+                        << len << " at " << pos;
+                EXPECT_EQ(0, ril_hex_validate(hex.data(), hex.size()))
+                        << len << " at " << pos;
+            }
+        }
+    }
+}
+
+TEST(HexTest, RejectsOddLength) {
+    std::string hex = referenceEncode(std::vector<uint8_t>(40, 0x5a));
+    uint8_t out[40];
+
+    for (size_t hexLen = 1; hexLen < hex.size(); hexLen += 2) {
+        EXPECT_EQ(-1, ril_hex_decode(hex.data(), hexLen, out, sizeof(out))) << hexLen;
+        EXPECT_EQ(0, ril_hex_validate(hex.data(), hexLen)) << hexLen;
+    }
+}
+
+TEST(HexTest, RejectsShortOutput) {
+    std::mt19937 rng(4);
+
+    for (size_t len : { 1, 16, 17, 176 }) {
+        std::vector<uint8_t> in = randomBytes(rng, len);
+        std::string hex = referenceEncode(in);
+        std::vector<uint8_t> bytes(len);
+        std::vector<char> digits(2 * len);
+
+        EXPECT_EQ(-1, ril_hex_decode(hex.data(), hex.size(), bytes.data(), len - 1));
+        // no room for the NUL
+        EXPECT_EQ(-1, ril_hex_encode(in.data(), len, digits.data(), digits.size()));
+    }
+}
+
+TEST(HexTest, EmptyInput) {
+    char out[1] = { 'x' };
+    uint8_t bytes[1];
+
+    EXPECT_EQ(0, ril_hex_decode("", 0, bytes, 0));
+    EXPECT_EQ(1, ril_hex_validate("", 0));
+    EXPECT_EQ(0, ril_hex_encode(NULL, 0, out, sizeof(out)));
+    EXPECT_EQ('\0', out[0]);
+}
+
+}  // namespace
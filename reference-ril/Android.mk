@@ -8,6 +8,8 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
     reference-ril.c \
     atchannel.c \
+    at_trace.c \
+    if_monitor.c \
     misc.c \
     at_tok.c
 
@@ -56,3 +58,72 @@ else
   LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
   include $(BUILD_EXECUTABLE)
 endif
+
+# Host tool replaying AT captures taken with "reference-ril -t <file>"
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    at_replay.c \
+    atchannel.c \
+    at_trace.c \
+    misc.c \
+    at_tok.c
+
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_HEADER_LIBRARIES := libutils_headers
+
+LOCAL_CFLAGS := -D_GNU_SOURCE '-D__unused=__attribute__((__unused__))'
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused-parameter -Werror
+
+LOCAL_MODULE:= at-replay
+LOCAL_LICENSE_KINDS:= SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS:= notice
+LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
+include $(BUILD_HOST_EXECUTABLE)
+
+# Simulated modem for host-side load testing, see modem_sim.c
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= modem_sim.c
+
+LOCAL_CFLAGS := -D_GNU_SOURCE
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused-parameter -Werror
+
+LOCAL_MODULE:= at-modem-sim
+LOCAL_LICENSE_KINDS:= SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS:= notice
+LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
+include $(BUILD_HOST_EXECUTABLE)
+
+# at_tok_scan corpus runner, run as "at-tok-fuzz $(LOCAL_PATH)/at_tok_corpus"
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    at_tok_fuzz.c \
+    at_tok.c
+
+LOCAL_CFLAGS := -D_GNU_SOURCE
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused-parameter -Werror
+LOCAL_SANITIZE := address undefined
+
+LOCAL_MODULE:= at-tok-fuzz
+LOCAL_LICENSE_KINDS:= SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS:= notice
+LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
+include $(BUILD_HOST_EXECUTABLE)
+
+# at_tok_scan against the at_tok_next* path it replaced
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    at_tok_bench.c \
+    at_tok.c
+
+LOCAL_CFLAGS := -D_GNU_SOURCE
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused-parameter -Werror
+
+LOCAL_MODULE:= at-tok-bench
+LOCAL_LICENSE_KINDS:= SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS:= notice
+LOCAL_NOTICE_FILE:= $(LOCAL_PATH)/NOTICE
+include $(BUILD_HOST_EXECUTABLE)
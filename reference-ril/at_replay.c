@@ -0,0 +1,546 @@
+/* //device/system/reference-ril/at_replay.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * at-replay: plays an at_trace capture (reference-ril -t <file>) back
+ * through atchannel over a socketpair, so AT channel throughput and
+ * latency can be measured on a host without a modem.
+ *
+ * Two threads take part:
+ *
+ *  - the "modem" thread owns one end of the socketpair. It walks the
+ *    capture in order, waits for each recorded TX command to arrive and
+ *    writes each recorded RX chunk, paced by the original inter-record
+ *    deltas divided by the speed factor.
+ *
+ *  - the command thread (main) re-issues every recorded TX command
+ *    through the public at_send_command* API, exactly as reference-ril
+ *    would, and measures the time until the final response.
+ *
+ * Commands that never got an answer in the capture (eg handshake retries)
+ * are skipped on both sides so the replay can't deadlock.
+ *
+ * A multi-modem capture interleaves the records of several AT channels;
+ * one channel is replayed at a time, picked with -c (by default the
+ * channel of the first record).
+ */
+
+#include "atchannel.h"
+#include "at_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "AT_REPLAY"
+#include <utils/Log.h>
+
+#define MAX_PREFIX_LEN 32
+
+/* how long the modem side lingers for the last reply to be consumed */
+#define DRAIN_TIMEOUT_SEC 1
+
+typedef struct {
+    const ATTraceRecordHeader *header;
+    const char *payload;
+    int skip;               /* TX command that was never answered */
+} ReplayRecord;
+
+static ReplayRecord *s_records;
+static size_t s_recordCount;
+static double s_speed = 1.0;
+static int s_channel = -1;      /* AT channel to replay, -1 for the first */
+
+static int s_modemFd = -1;
+static int s_hostFd = -1;
+
+static int s_unsolCount;
+static int s_mismatchCount;
+
+static pthread_mutex_t s_doneMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_doneCond = PTHREAD_COND_INITIALIZER;
+static int s_commandsDone;
+
+static uint64_t nowNs()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void sleepUntilNs(uint64_t deadline)
+{
+    struct timespec ts;
+    int err;
+
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    } while (err == EINTR);
+}
+
+static int isTxCommand(const ReplayRecord *rec)
+{
+    return rec->header->direction == AT_TRACE_TX
+            && rec->header->length > 0
+            && rec->payload[rec->header->length - 1] == '\r';
+}
+
+static int isTxPdu(const ReplayRecord *rec)
+{
+    return rec->header->direction == AT_TRACE_TX
+            && rec->header->length > 0
+            && rec->payload[rec->header->length - 1] == '\032';
+}
+
+/**
+ * returns the SMS PDU sent after the "> " prompt for command "index",
+ * or NULL if there is none
+ */
+static const ReplayRecord *pduFor(size_t index)
+{
+    size_t i;
+
+    for (i = index + 1; i < s_recordCount; i++) {
+        if (s_records[i].header->direction == AT_TRACE_TX) {
+            return isTxPdu(&s_records[i]) ? &s_records[i] : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Loads the whole capture into memory and indexes the records of the
+ * channel being replayed
+ * returns 0 on success, -1 on error
+ */
+static int loadCapture(const char *path)
+{
+    int fd;
+    struct stat st;
+    char *buf;
+    size_t off;
+    size_t i, j;
+    ssize_t count;
+    int otherChannels = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    buf = malloc(st.st_size);
+    if (buf == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    for (off = 0; off < (size_t)st.st_size; off += count) {
+        do {
+            count = read(fd, buf + off, st.st_size - off);
+        } while (count < 0 && errno == EINTR);
+
+        if (count <= 0) {
+            fprintf(stderr, "short read on %s\n", path);
+            close(fd);
+            goto error;
+        }
+    }
+    close(fd);
+
+    if ((size_t)st.st_size < AT_TRACE_MAGIC_LEN
+            || memcmp(buf, AT_TRACE_MAGIC, AT_TRACE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s is not an AT capture\n", path);
+        goto error;
+    }
+
+    /* first pass counts, second pass indexes */
+    for (j = 0; j < 2; j++) {
+        s_recordCount = 0;
+
+        for (off = AT_TRACE_MAGIC_LEN;
+                off + sizeof(ATTraceRecordHeader) <= (size_t)st.st_size; ) {
+            const ATTraceRecordHeader *header =
+                    (const ATTraceRecordHeader *)(buf + off);
+            size_t next = off + sizeof(*header) + header->length;
+
+            if (next > (size_t)st.st_size) {
+                /* capture was cut short while the RIL was running */
+                fprintf(stderr, "ignoring truncated trailing record\n");
+                break;
+            }
+
+            if (s_channel < 0) {
+                s_channel = header->channel;
+            }
+
+            if (header->channel != s_channel) {
+                otherChannels = 1;
+                off = next;
+                continue;
+            }
+
+            if (s_records != NULL) {
+                s_records[s_recordCount].header = header;
+                s_records[s_recordCount].payload = (const char *)(header + 1);
+                s_records[s_recordCount].skip = 0;
+            }
+
+            s_recordCount++;
+            off = next;
+        }
+
+        if (s_records == NULL) {
+            s_records = calloc(s_recordCount + 1, sizeof(ReplayRecord));
+            if (s_records == NULL) goto error;
+        }
+    }
+
+    if (otherChannels) {
+        fprintf(stderr, "replaying AT channel %d only\n", s_channel);
+    }
+
+    /* a command with no RX before the next command was never answered */
+    for (i = 0; i < s_recordCount; i++) {
+        if (!isTxCommand(&s_records[i])) continue;
+
+        for (j = i + 1; j < s_recordCount; j++) {
+            if (isTxCommand(&s_records[j])
+                    || s_records[j].header->direction == AT_TRACE_RX) {
+                break;
+            }
+        }
+
+        if (j == s_recordCount || isTxCommand(&s_records[j])) {
+            s_records[i].skip = 1;
+        }
+    }
+
+    /* "buf" stays allocated: the records point into it */
+    return 0;
+
+error:
+    free(buf);
+    return -1;
+}
+
+/**
+ * Consumes one command from the host side, up to and including
+ * "terminator". Bytes following it are kept in "pending".
+ * returns 0 on success, -1 if the host side went away
+ */
+static int readCommand(char *pending, size_t *pendingLen, size_t pendingMax,
+                       const ReplayRecord *expected)
+{
+    char terminator = expected->payload[expected->header->length - 1];
+    char *end;
+    ssize_t count;
+    size_t used;
+
+    for (;;) {
+        end = memchr(pending, terminator, *pendingLen);
+        if (end != NULL) break;
+
+        if (*pendingLen == pendingMax) {
+            /* overlong command, drop what we have */
+            *pendingLen = 0;
+        }
+
+        do {
+            count = read(s_modemFd, pending + *pendingLen,
+                         pendingMax - *pendingLen);
+        } while (count < 0 && errno == EINTR);
+
+        if (count <= 0) {
+            return -1;
+        }
+
+        *pendingLen += count;
+    }
+
+    used = end - pending + 1;
+
+    if (used != expected->header->length
+            || memcmp(pending, expected->payload, used) != 0) {
+        RLOGW("replay diverged: expected '%.*s' got '%.*s'",
+              (int)expected->header->length - 1, expected->payload,
+              (int)used - 1, pending);
+        s_mismatchCount++;
+    }
+
+    memmove(pending, pending + used, *pendingLen - used);
+    *pendingLen -= used;
+
+    return 0;
+}
+
+static void *modemLoop(void *arg __unused)
+{
+    static char pending[8 * 1024];
+    size_t pendingLen = 0;
+    uint64_t prevTs;
+    uint64_t prevWall;
+    struct timespec deadline;
+    size_t i;
+
+    if (s_recordCount == 0) goto done;
+
+    prevTs = s_records[0].header->timestampNs;
+    prevWall = nowNs();
+
+    for (i = 0; i < s_recordCount; i++) {
+        const ReplayRecord *rec = &s_records[i];
+
+        if (rec->skip) continue;
+
+        if (rec->header->direction == AT_TRACE_TX) {
+            if (readCommand(pending, &pendingLen, sizeof(pending), rec) < 0) {
+                break;
+            }
+        } else {
+            size_t off = 0;
+            ssize_t written;
+
+            if (s_speed > 0 && rec->header->timestampNs > prevTs) {
+                sleepUntilNs(prevWall + (uint64_t)
+                        ((rec->header->timestampNs - prevTs) / s_speed));
+            }
+
+            while (off < rec->header->length) {
+                do {
+                    written = write(s_modemFd, rec->payload + off,
+                                    rec->header->length - off);
+                } while (written < 0 && errno == EINTR);
+
+                if (written < 0) goto done;
+                off += written;
+            }
+        }
+
+        prevTs = rec->header->timestampNs;
+        prevWall = nowNs();
+    }
+
+done:
+    /*
+     * Closing right after the last reply would race the command thread
+     * picking it up, so wait for it (or give up if the replay diverged)
+     */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DRAIN_TIMEOUT_SEC;
+
+    pthread_mutex_lock(&s_doneMutex);
+    while (!s_commandsDone) {
+        if (pthread_cond_timedwait(&s_doneCond, &s_doneMutex, &deadline)
+                == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_doneMutex);
+
+    /* EOF makes atchannel's reader thread exit */
+    shutdown(s_modemFd, SHUT_RDWR);
+    return NULL;
+}
+
+/**
+ * "AT+COPS=3,0;+COPS?" -> "+COPS:"
+ * returns 0 if the command has no extended-command prefix
+ */
+static int responsePrefixFor(const char *cmd, char *prefix, size_t prefixLen)
+{
+    size_t len;
+
+    if (strncasecmp(cmd, "AT+", 3) != 0) {
+        return 0;
+    }
+
+    len = strcspn(cmd + 2, "=?;");
+    if (len + 2 > prefixLen) {
+        return 0;
+    }
+
+    memcpy(prefix, cmd + 2, len);
+    prefix[len] = ':';
+    prefix[len + 1] = '\0';
+
+    return 1;
+}
+
+static void onUnsolicited(const char *s __unused, const char *sms_pdu __unused)
+{
+    /* only ever called from the reader thread */
+    s_unsolCount++;
+}
+
+static void onReaderClosed()
+{
+    at_close();
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s <speed>] [-c <channel>] <capture file>\n", argv0);
+    fprintf(stderr, "  -s  1 replays at captured pace (default),"
+                    " 10 replays 10x faster, 0 as fast as possible\n");
+    fprintf(stderr, "  -c  AT channel to replay (default: that of the first record)\n");
+    exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+    int fds[2];
+    int opt;
+    size_t i;
+    pthread_t tid;
+    uint64_t start, elapsed;
+    uint64_t latency, totalLatency = 0, maxLatency = 0;
+    int commandCount = 0, errorCount = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "s:c:"))) {
+        switch (opt) {
+            case 's':
+                s_speed = atof(optarg);
+            break;
+
+            case 'c':
+                s_channel = atoi(optarg);
+                if (s_channel < 0 || s_channel > UINT8_MAX) {
+                    usage(argv[0]);
+                }
+            break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    if (loadCapture(argv[optind]) < 0) {
+        return 1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+    s_hostFd = fds[0];
+    s_modemFd = fds[1];
+
+    at_set_on_reader_closed(onReaderClosed);
+
+    if (at_open(s_hostFd, onUnsolicited) < 0) {
+        fprintf(stderr, "at_open failed\n");
+        return 1;
+    }
+
+    start = nowNs();
+
+    if (pthread_create(&tid, NULL, modemLoop, NULL) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    for (i = 0; i < s_recordCount; i++) {
+        const ReplayRecord *rec = &s_records[i];
+        const ReplayRecord *pduRec;
+        char prefix[MAX_PREFIX_LEN];
+        char *cmd;
+        char *pdu = NULL;
+        ATResponse *p_response = NULL;
+        uint64_t t0;
+        int err;
+
+        if (rec->skip || !isTxCommand(rec)) continue;
+
+        cmd = strndup(rec->payload, rec->header->length - 1);
+
+        pduRec = pduFor(i);
+        if (pduRec != NULL) {
+            pdu = strndup(pduRec->payload, pduRec->header->length - 1);
+        }
+
+        t0 = nowNs();
+
+        if (pdu != NULL) {
+            if (!responsePrefixFor(cmd, prefix, sizeof(prefix))) {
+                strcpy(prefix, "+CMGS:");
+            }
+            err = at_send_command_sms(cmd, pdu, prefix, &p_response);
+        } else if (responsePrefixFor(cmd, prefix, sizeof(prefix))) {
+            err = at_send_command_multiline(cmd, prefix, &p_response);
+        } else {
+            err = at_send_command(cmd, &p_response);
+        }
+
+        latency = nowNs() - t0;
+
+        free(cmd);
+        free(pdu);
+        at_response_free(p_response);
+
+        if (err == AT_ERROR_CHANNEL_CLOSED) {
+            fprintf(stderr, "channel closed before end of capture\n");
+            break;
+        }
+
+        commandCount++;
+        if (err < 0) errorCount++;
+        totalLatency += latency;
+        if (latency > maxLatency) maxLatency = latency;
+    }
+
+    elapsed = nowNs() - start;
+
+    pthread_mutex_lock(&s_doneMutex);
+    s_commandsDone = 1;
+    pthread_cond_signal(&s_doneCond);
+    pthread_mutex_unlock(&s_doneMutex);
+
+    pthread_join(tid, NULL);
+
+    printf("records:        %zu\n", s_recordCount);
+    printf("commands:       %d (%d errors, %d diverged)\n",
+           commandCount, errorCount, s_mismatchCount);
+    printf("unsolicited:    %d\n", s_unsolCount);
+    printf("elapsed:        %.3f ms\n", elapsed / 1e6);
+    if (commandCount > 0) {
+        printf("latency mean:   %.3f ms\n", totalLatency / 1e6 / commandCount);
+        printf("latency max:    %.3f ms\n", maxLatency / 1e6);
+        printf("throughput:     %.1f commands/s\n",
+               commandCount / (elapsed / 1e9));
+    }
+
+    return 0;
+}
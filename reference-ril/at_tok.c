@@ -18,6 +18,7 @@
 #include "at_tok.h"
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdlib.h>
 
 /**
@@ -188,3 +189,257 @@ int at_tok_hasmore(char **p_cur)
 }
 
 
+
+static const char *skipWhiteSpaceConst(const char *p)
+{
+    /* readline has already stripped the line ending */
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * Parses an integer field, which may be quoted
+ * returns 0 on success and -1 with *p_reason set on error;
+ * either way *p_cur is left where parsing stopped
+ */
+static int scanInt(const char **p_cur, int base, int *p_out,
+                   const char **p_reason)
+{
+    const char *p = *p_cur;
+    int quoted = (*p == '"');
+    int negative = 0;
+    unsigned long value = 0;
+    const char *end;
+
+    if (quoted) {
+        p++;
+    }
+
+    /* by hand rather than strtol: this is the hot path of every parser */
+    if (base == 10 && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    for (end = p ; ; end++) {
+        int digit;
+
+        if (*end >= '0' && *end <= '9') {
+            digit = *end - '0';
+        } else if (base == 16 && *end >= 'a' && *end <= 'f') {
+            digit = *end - 'a' + 10;
+        } else if (base == 16 && *end >= 'A' && *end <= 'F') {
+            digit = *end - 'A' + 10;
+        } else {
+            break;
+        }
+
+        value = value * base + digit;
+    }
+
+    if (end == p) {
+        *p_reason = "expected an integer";
+        return -1;
+    }
+
+    if (quoted) {
+        if (*end != '"') {
+            *p_cur = end;
+            *p_reason = "unterminated quoted integer";
+            return -1;
+        }
+        end++;
+    }
+
+    *p_out = negative ? -(int)value : (int)value;
+    *p_cur = end;
+
+    return 0;
+}
+
+static int scanString(const char **p_cur, ATTokSpan *p_out,
+                      const char **p_reason)
+{
+    const char *p = *p_cur;
+    const char *end;
+
+    if (*p == '"') {
+        p++;
+        end = strchr(p, '"');
+
+        if (end == NULL) {
+            *p_reason = "unterminated string";
+            return -1;
+        }
+
+        p_out->str = p;
+        p_out->len = end - p;
+        *p_cur = end + 1;
+
+        return 0;
+    }
+
+    end = p + strcspn(p, ",");
+    p_out->str = p;
+    p_out->len = end - p;
+    *p_cur = end;
+
+    return 0;
+}
+
+int at_tok_scan(const char *line, const char *format, ATTokError *p_error, ...)
+{
+    va_list ap;
+    const char *p = line;
+    const char *f = format;
+    const char *reason = NULL;
+    int field = 0;
+    int optional = 0;
+
+    va_start(ap, p_error);
+
+    if (p == NULL) {
+        reason = "no line";
+        goto error;
+    }
+
+    if (*f == '%') {
+        /* no prefix given, skip whatever the line has */
+        p = strchr(p, ':');
+
+        if (p == NULL) {
+            p = line;
+            reason = "missing ':'";
+            goto error;
+        }
+        p++;
+    }
+
+    while (*f != '\0') {
+        if (*f == '[') {
+            optional = 1;
+            f++;
+        } else if (*f == ']') {
+            f++;
+        } else if (*f == ' ') {
+            p = skipWhiteSpaceConst(p);
+            f++;
+        } else if (*f == ',') {
+            p = skipWhiteSpaceConst(p);
+
+            if (*p == '\0' && optional) {
+                break;
+            }
+
+            if (*p != ',') {
+                reason = (*p == '\0') ? "missing field" : "expected ','";
+                goto error;
+            }
+            p++;
+            f++;
+        } else if (*f != '%') {
+            if (*p != *f) {
+                reason = "prefix mismatch";
+                goto error;
+            }
+            p++;
+            f++;
+        } else {
+            int store = 1;
+            int value;
+            ATTokSpan span;
+            const char *fieldStart;
+
+            f++;
+            if (*f == '*') {
+                store = 0;
+                f++;
+            }
+
+            p = skipWhiteSpaceConst(p);
+            fieldStart = p;
+
+            switch (*f) {
+                case 'd':
+                case 'x':
+                    if (scanInt(&p, *f == 'x' ? 16 : 10, &value, &reason) < 0) {
+                        goto error;
+                    }
+                    if (store) {
+                        *va_arg(ap, int *) = value;
+                    }
+                break;
+
+                case 'b':
+                    if (scanInt(&p, 10, &value, &reason) < 0) {
+                        goto error;
+                    }
+                    if (value != 0 && value != 1) {
+                        p = fieldStart;
+                        reason = "expected 0 or 1";
+                        goto error;
+                    }
+                    if (store) {
+                        *va_arg(ap, char *) = (char)value;
+                    }
+                break;
+
+                case 's':
+                    if (scanString(&p, &span, &reason) < 0) {
+                        goto error;
+                    }
+                    if (store) {
+                        *va_arg(ap, ATTokSpan *) = span;
+                    }
+                break;
+
+                default:
+                    reason = "bad format";
+                    goto error;
+            }
+
+            f++;
+            field++;
+
+            if (*f == ',' || *f == '[' || *f == ']' || *f == '\0') {
+                /* the field must end here */
+                p = skipWhiteSpaceConst(p);
+
+                if (*p != ',' && *p != '\0') {
+                    reason = "unexpected character after field";
+                    goto error;
+                }
+            }
+        }
+    }
+
+    va_end(ap);
+
+    return field;
+
+error:
+    va_end(ap);
+
+    if (p_error != NULL) {
+        p_error->field = field;
+        p_error->offset = (line != NULL) ? (int)(p - line) : 0;
+        p_error->reason = reason;
+    }
+
+    return -1;
+}
+
+int at_tok_span_copy(const ATTokSpan *span, char *buf, size_t size)
+{
+    if (span->len >= size) {
+        return -1;
+    }
+
+    memcpy(buf, span->str, span->len);
+    buf[span->len] = '\0';
+
+    return 0;
+}
@@ -18,6 +18,8 @@
 #ifndef AT_TOK_H
 #define AT_TOK_H 1
 
+#include <stddef.h>
+
 int at_tok_start(char **p_cur);
 int at_tok_nextint(char **p_cur, int *p_out);
 int at_tok_nexthexint(char **p_cur, int *p_out);
@@ -27,4 +29,45 @@ int at_tok_nextstr(char **p_cur, char **out);
 
 int at_tok_hasmore(char **p_cur);
 
+/** a string field found by at_tok_scan, pointing into the scanned line */
+typedef struct {
+    const char *str;    /* not NUL terminated */
+    size_t len;
+} ATTokSpan;
+
+/** where and why at_tok_scan gave up */
+typedef struct {
+    int field;          /* index of the field being parsed, from 0 */
+    int offset;         /* offset into the line */
+    const char *reason;
+} ATTokError;
+
+/**
+ * Parses a whole response line in one pass, without modifying or copying it
+ *
+ * "format" describes the line:
+ *   %d     decimal integer, int *
+ *   %x     hex integer, int *
+ *   %b     0 or 1, char *
+ *   %s     string, quoted or not, ATTokSpan *
+ *   %*d    (or %*x, %*b, %*s) field that is checked but not stored
+ *   ,      field separator
+ *   [      the fields from here on may be missing, eg "%d[,%s,%d]"
+ *   ' '    any amount of whitespace
+ * anything else (normally the "+XXX:" prefix) must appear literally. If
+ * the format doesn't start with a prefix, parsing starts after the line's
+ * first ':' as with at_tok_start. Integers may be quoted, and fields after
+ * the end of "format" are ignored.
+ *
+ * returns the number of fields parsed, or -1 on error, in which case
+ * *p_error (if non-NULL) says where
+ */
+int at_tok_scan(const char *line, const char *format, ATTokError *p_error, ...);
+
+/**
+ * Copies "span" into "buf" as a NUL terminated string
+ * returns 0 on success and -1 if it doesn't fit
+ */
+int at_tok_span_copy(const ATTokSpan *span, char *buf, size_t size);
+
 #endif /*AT_TOK_H */
@@ -0,0 +1,309 @@
+/* //device/system/reference-ril/at_tok_bench.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * at-tok-bench: times at_tok_scan against the at_tok_start /
+ * at_tok_next* sequence it replaced, on the lines reference-ril parses
+ * most often.
+ *
+ *   at-tok-bench [-n iterations] [-r repeats]
+ *
+ * The old path tokenizes in place, so every iteration first copies the
+ * line; that copy is timed on its own and taken off the old path's
+ * figure. Each case is run "repeats" times and the best run is reported.
+ */
+
+#include "at_tok.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LINE 256
+
+typedef struct {
+    const char *name;
+    const char *line;
+    int (*scan)(const char *line);
+    int (*legacy)(char *line);
+} BenchCase;
+
+static volatile int s_sink;
+
+static int scanCreg(const char *line)
+{
+    int stat, lac, cid, act;
+
+    if (at_tok_scan(line, "%*d,%d,%x,%x,%x", NULL,
+                    &stat, &lac, &cid, &act) < 0) {
+        return -1;
+    }
+
+    return stat + lac + cid + act;
+}
+
+static int legacyCreg(char *line)
+{
+    int skip, stat, lac, cid, act;
+
+    if (at_tok_start(&line) < 0
+        || at_tok_nextint(&line, &skip) < 0
+        || at_tok_nextint(&line, &stat) < 0
+        || at_tok_nexthexint(&line, &lac) < 0
+        || at_tok_nexthexint(&line, &cid) < 0
+        || at_tok_nextint(&line, &act) < 0
+    ) {
+        return -1;
+    }
+
+    return stat + lac + cid + act;
+}
+
+static int scanClcc(const char *line)
+{
+    int index, state, mode, toa;
+    char isMT, isMpty;
+    ATTokSpan number;
+    int fields;
+
+    fields = at_tok_scan(line, "+CLCC: %d,%b,%d,%d,%b[,%s,%d]", NULL,
+                         &index, &isMT, &state, &mode, &isMpty,
+                         &number, &toa);
+    if (fields < 0) {
+        return -1;
+    }
+
+    if (fields > 5) {
+        return index + isMT + state + mode + isMpty + (int)number.len + toa;
+    }
+
+    return index + isMT + state + mode + isMpty;
+}
+
+static int legacyClcc(char *line)
+{
+    int index, state, mode, toa;
+    char isMT, isMpty;
+    char *number;
+
+    if (at_tok_start(&line) < 0
+        || at_tok_nextint(&line, &index) < 0
+        || at_tok_nextbool(&line, &isMT) < 0
+        || at_tok_nextint(&line, &state) < 0
+        || at_tok_nextint(&line, &mode) < 0
+        || at_tok_nextbool(&line, &isMpty) < 0
+    ) {
+        return -1;
+    }
+
+    if (at_tok_hasmore(&line)) {
+        if (at_tok_nextstr(&line, &number) < 0
+            || at_tok_nextint(&line, &toa) < 0
+        ) {
+            return -1;
+        }
+        return index + isMT + state + mode + isMpty + (int)strlen(number) + toa;
+    }
+
+    return index + isMT + state + mode + isMpty;
+}
+
+static int scanCsq(const char *line)
+{
+    int rssi, ber;
+
+    if (at_tok_scan(line, "+CSQ: %d,%d", NULL, &rssi, &ber) < 0) {
+        return -1;
+    }
+
+    return rssi + ber;
+}
+
+static int legacyCsq(char *line)
+{
+    int rssi, ber;
+
+    if (at_tok_start(&line) < 0
+        || at_tok_nextint(&line, &rssi) < 0
+        || at_tok_nextint(&line, &ber) < 0
+    ) {
+        return -1;
+    }
+
+    return rssi + ber;
+}
+
+static int scanCops(const char *line)
+{
+    int mode, format;
+    ATTokSpan name;
+
+    if (at_tok_scan(line, "+COPS: %d,%d,%s", NULL, &mode, &format, &name) < 0) {
+        return -1;
+    }
+
+    return mode + format + (int)name.len;
+}
+
+static int legacyCops(char *line)
+{
+    int mode, format;
+    char *name;
+
+    if (at_tok_start(&line) < 0
+        || at_tok_nextint(&line, &mode) < 0
+        || at_tok_nextint(&line, &format) < 0
+        || at_tok_nextstr(&line, &name) < 0
+    ) {
+        return -1;
+    }
+
+    return mode + format + (int)strlen(name);
+}
+
+static const BenchCase s_cases[] = {
+    { "CREG", "+CREG: 2,1,\"00C3\",\"0000A1B2\",7", scanCreg, legacyCreg },
+    { "CLCC", "+CLCC: 1,0,0,0,0,\"+15551212\",145", scanClcc, legacyClcc },
+    { "CLCC short", "+CLCC: 1,0,2,0,1", scanClcc, legacyClcc },
+    { "CSQ", "+CSQ: 20,99", scanCsq, legacyCsq },
+    { "COPS", "+COPS: 0,0,\"Android Virtual Operator\"", scanCops, legacyCops },
+};
+
+#define NUM_ELEMS(x) (sizeof(x)/sizeof(x[0]))
+
+static long long nowNsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* "which": 0 copy only, 1 old path (with the copy), 2 at_tok_scan */
+static double timeCase(const BenchCase *c, int which, long iterations)
+{
+    char buf[MAX_LINE];
+    size_t len = strlen(c->line) + 1;
+    long long start;
+    long i;
+    int sum = 0;
+
+    start = nowNsec();
+
+    for (i = 0 ; i < iterations ; i++) {
+        switch (which) {
+            case 0:
+                memcpy(buf, c->line, len);
+                sum += buf[i % len];
+            break;
+
+            case 1:
+                memcpy(buf, c->line, len);
+                sum += c->legacy(buf);
+            break;
+
+            case 2:
+                sum += c->scan(c->line);
+            break;
+        }
+    }
+
+    s_sink = sum;
+
+    return (double)(nowNsec() - start) / iterations;
+}
+
+static double bestOf(const BenchCase *c, int which, long iterations,
+                     int repeats)
+{
+    double best = 0;
+    int r;
+
+    for (r = 0 ; r < repeats ; r++) {
+        double t = timeCase(c, which, iterations);
+
+        if (r == 0 || t < best) {
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-n iterations] [-r repeats]\n"
+            "  -n  parses per timed run (default 1000000)\n"
+            "  -r  timed runs per case, the best is kept (default 5)\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = 1000000;
+    int repeats = 5;
+    size_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atol(optarg);
+            break;
+
+            case 'r':
+                repeats = atoi(optarg);
+            break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (iterations <= 0 || repeats <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("%-12s %12s %12s %8s\n", "line", "at_tok ns", "scan ns", "speedup");
+
+    for (i = 0 ; i < NUM_ELEMS(s_cases) ; i++) {
+        const BenchCase *c = &s_cases[i];
+        char buf[MAX_LINE];
+        double copy, legacy, scan;
+
+        /* both paths must read the line the same way for this to mean much */
+        strcpy(buf, c->line);
+        if (c->legacy(buf) != c->scan(c->line)) {
+            fprintf(stderr, "%s: at_tok and at_tok_scan disagree\n", c->name);
+            return 1;
+        }
+
+        copy = bestOf(c, 0, iterations, repeats);
+        legacy = bestOf(c, 1, iterations, repeats) - copy;
+        scan = bestOf(c, 2, iterations, repeats);
+
+        printf("%-12s %12.1f %12.1f %7.2fx\n", c->name, legacy, scan,
+               scan > 0 ? legacy / scan : 0.0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,515 @@
+/* //device/system/reference-ril/at_tok_fuzz.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * at-tok-fuzz: runs a corpus of response lines (at_tok_corpus/) through
+ * at_tok_scan with the formats reference-ril uses, along with every
+ * truncation of each line and a number of random mutations of it.
+ *
+ * Each input is copied into a buffer of exactly its own size, so with the
+ * address sanitizer any read past the terminator is caught. Where the old
+ * at_tok_start / at_tok_next* path also accepts an input, both must agree
+ * on every field; a disagreement is printed and fails the run.
+ *
+ *   at-tok-fuzz [-i mutations per line] [-s seed] [-v] <file|dir>...
+ *
+ * Corpus files hold one line each; blank lines and lines starting with
+ * '#' are ignored.
+ */
+
+#include "at_tok.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MAX_LINE        1024
+#define MAX_FIELDS      8
+
+/* longest digit run the old strtol path and at_tok_scan agree on */
+#define MAX_COMPARABLE_DIGITS 8
+
+typedef union {
+    int i;
+    char b;
+    ATTokSpan s;
+} Field;
+
+typedef struct {
+    const char *format;
+    const char *kinds;      /* one of d, x, b, s per stored field */
+    int (*scan)(const char *line, Field *out);
+} ScanCase;
+
+static int scanD(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d", NULL, &f[0].i);
+}
+
+static int scanDD(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d,%d", NULL, &f[0].i, &f[1].i);
+}
+
+static int scanDXX(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d,%x,%x", NULL, &f[0].i, &f[1].i, &f[2].i);
+}
+
+static int scanDDXX(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%*d,%d,%x,%x", NULL,
+                       &f[0].i, &f[1].i, &f[2].i);
+}
+
+static int scanDDXXX(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%*d,%d,%x,%x,%x", NULL,
+                       &f[0].i, &f[1].i, &f[2].i, &f[3].i);
+}
+
+static int scanClcc(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d,%b,%d,%d,%b,%s,%d", NULL,
+                       &f[0].i, &f[1].b, &f[2].i, &f[3].i, &f[4].b,
+                       &f[5].s, &f[6].i);
+}
+
+static int scanCops(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d,%d,%s", NULL, &f[0].i, &f[1].i, &f[2].s);
+}
+
+static int scanStrings(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%s,%s,%s", NULL, &f[0].s, &f[1].s, &f[2].s);
+}
+
+static int scanOptional(const char *line, Field *f)
+{
+    return at_tok_scan(line, "%d,%b,%d,%d,%b[,%s,%d]", NULL,
+                       &f[0].i, &f[1].b, &f[2].i, &f[3].i, &f[4].b,
+                       &f[5].s, &f[6].i);
+}
+
+static int scanPrefixed(const char *line, Field *f)
+{
+    return at_tok_scan(line, "+CREG: %d,%x,%x", NULL,
+                       &f[0].i, &f[1].i, &f[2].i);
+}
+
+/*
+ * kinds == NULL: no comparison against the old path, which has no
+ * notion of optional fields or of a required prefix
+ */
+static const ScanCase s_cases[] = {
+    { "%d", "d", scanD },
+    { "%d,%d", "dd", scanDD },
+    { "%d,%x,%x", "dxx", scanDXX },
+    { "%*d,%d,%x,%x", "*ddxx", scanDDXX },
+    { "%*d,%d,%x,%x,%x", "*ddxxx", scanDDXXX },
+    { "%d,%b,%d,%d,%b,%s,%d", "dbddbsd", scanClcc },
+    { "%d,%d,%s", "dds", scanCops },
+    { "%s,%s,%s", "sss", scanStrings },
+    { "%d,%b,%d,%d,%b[,%s,%d]", NULL, scanOptional },
+    { "+CREG: %d,%x,%x", NULL, scanPrefixed },
+};
+
+#define NUM_ELEMS(x) (sizeof(x)/sizeof(x[0]))
+
+static unsigned long long s_rand = 1;
+static int s_verbose;
+static long s_inputs;
+static long s_accepted;
+static long s_compared;
+static int s_failures;
+
+static unsigned int nextRand(void)
+{
+    /* xorshift64, so a seed always gives the same run */
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 7;
+    s_rand ^= s_rand << 17;
+
+    return (unsigned int)(s_rand >> 32);
+}
+
+/* parses a copy of "line" the old way into "out", returns fields parsed */
+static int scanLegacy(const char *line, const char *kinds, Field *out,
+                      char *copy)
+{
+    char *cur = copy;
+    int stored = 0;
+    const char *k;
+
+    strcpy(copy, line);
+
+    if (at_tok_start(&cur) < 0) {
+        return -1;
+    }
+
+    for (k = kinds ; *k != '\0' ; k++) {
+        int skip = (*k == '*');
+        int value;
+        char *str;
+
+        if (skip) {
+            k++;
+        }
+
+        switch (*k) {
+            case 'd':
+                if (at_tok_nextint(&cur, &value) < 0) return -1;
+                if (!skip) out[stored].i = value;
+            break;
+
+            case 'x':
+                if (at_tok_nexthexint(&cur, &value) < 0) return -1;
+                if (!skip) out[stored].i = value;
+            break;
+
+            case 'b':
+                if (at_tok_nextbool(&cur, &out[stored].b) < 0) return -1;
+            break;
+
+            case 's':
+                if (at_tok_nextstr(&cur, &str) < 0 || str == NULL) return -1;
+                if (!skip) {
+                    out[stored].s.str = str;
+                    out[stored].s.len = strlen(str);
+                }
+            break;
+        }
+
+        if (!skip) {
+            stored++;
+        }
+    }
+
+    return stored;
+}
+
+/* only plain printable lines with short numbers mean the same to both */
+static int isComparable(const char *line)
+{
+    const char *p;
+    int run = 0;
+
+    for (p = line ; *p != '\0' ; p++) {
+        if (*p < ' ' || *p > '~') {
+            return 0;
+        }
+
+        if ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f')
+            || (*p >= 'A' && *p <= 'F')
+        ) {
+            if (++run > MAX_COMPARABLE_DIGITS) {
+                return 0;
+            }
+        } else {
+            run = 0;
+        }
+    }
+
+    return 1;
+}
+
+static void report(const char *what, const ScanCase *c, const char *line,
+                   int field)
+{
+    fprintf(stderr, "MISMATCH %s, format \"%s\" field %d: \"%s\"\n",
+            what, c->format, field, line);
+    s_failures++;
+}
+
+static void compare(const ScanCase *c, const char *line, const Field *scanned,
+                    int count)
+{
+    char copy[MAX_LINE + 1];
+    Field legacy[MAX_FIELDS];
+    const char *k;
+    int stored = 0;
+
+    if (c->kinds == NULL || !isComparable(line)
+        || scanLegacy(line, c->kinds, legacy, copy) < 0
+    ) {
+        return;
+    }
+
+    s_compared++;
+
+    for (k = c->kinds ; *k != '\0' && stored < count ; k++) {
+        if (*k == '*') {
+            k++;
+            continue;
+        }
+
+        switch (*k) {
+            case 'd':
+            case 'x':
+                if (scanned[stored].i != legacy[stored].i) {
+                    report("int", c, line, stored);
+                }
+            break;
+
+            case 'b':
+                if (scanned[stored].b != legacy[stored].b) {
+                    report("bool", c, line, stored);
+                }
+            break;
+
+            case 's':
+                if (scanned[stored].s.len != legacy[stored].s.len
+                    || memcmp(scanned[stored].s.str, legacy[stored].s.str,
+                              legacy[stored].s.len) != 0
+                ) {
+                    report("string", c, line, stored);
+                }
+            break;
+        }
+
+        stored++;
+    }
+}
+
+/* runs every case over "data", which need not be NUL terminated */
+static void runInput(const char *data, size_t len)
+{
+    char *line;
+    size_t i;
+
+    /* exactly sized, so an overread is a heap overflow */
+    line = malloc(len + 1);
+    if (line == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(line, data, len);
+    line[len] = '\0';
+
+    s_inputs++;
+
+    for (i = 0 ; i < NUM_ELEMS(s_cases) ; i++) {
+        Field fields[MAX_FIELDS];
+        int count;
+
+        memset(fields, 0, sizeof(fields));
+        count = s_cases[i].scan(line, fields);
+
+        if (count >= 0) {
+            s_accepted++;
+            compare(&s_cases[i], line, fields, count);
+        }
+    }
+
+    free(line);
+}
+
+static void mutate(char *buf, size_t *p_len)
+{
+    static const char dictionary[] = ",,\"\"0123456789-+ :aAfFxX\t";
+    int edits = 1 + nextRand() % 4;
+
+    while (edits-- > 0) {
+        size_t len = *p_len;
+        size_t pos = len > 0 ? nextRand() % len : 0;
+        char c;
+
+        if (nextRand() % 4 == 0) {
+            c = (char)(1 + nextRand() % 255);
+        } else {
+            c = dictionary[nextRand() % (sizeof(dictionary) - 1)];
+        }
+
+        switch (nextRand() % 3) {
+            case 0:
+                if (len > 0) {
+                    buf[pos] = c;
+                }
+            break;
+
+            case 1:
+                if (len > 0) {
+                    memmove(buf + pos, buf + pos + 1, len - pos - 1);
+                    (*p_len)--;
+                }
+            break;
+
+            case 2:
+                if (len < MAX_LINE) {
+                    memmove(buf + pos + 1, buf + pos, len - pos);
+                    buf[pos] = c;
+                    (*p_len)++;
+                }
+            break;
+        }
+    }
+}
+
+static void runLine(const char *line, int mutations)
+{
+    char buf[MAX_LINE];
+    size_t len = strlen(line);
+    size_t i;
+    int n;
+
+    if (len > MAX_LINE) {
+        fprintf(stderr, "skipping line longer than %d\n", MAX_LINE);
+        return;
+    }
+
+    if (s_verbose) {
+        printf("%s\n", line);
+    }
+
+    for (i = 0 ; i <= len ; i++) {
+        runInput(line, i);
+    }
+
+    for (n = 0 ; n < mutations ; n++) {
+        size_t mutatedLen = len;
+
+        memcpy(buf, line, len);
+        mutate(buf, &mutatedLen);
+        runInput(buf, mutatedLen);
+    }
+}
+
+static int runFile(const char *path, int mutations)
+{
+    char line[MAX_LINE + 2];
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        runLine(line, mutations);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int runPath(const char *path, int mutations)
+{
+    struct stat st;
+    struct dirent **entries;
+    int count;
+    int i;
+    int ret = 0;
+
+    if (stat(path, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        return runFile(path, mutations);
+    }
+
+    count = scandir(path, &entries, NULL, alphasort);
+    if (count < 0) {
+        perror(path);
+        return -1;
+    }
+
+    for (i = 0 ; i < count ; i++) {
+        char child[PATH_MAX];
+
+        if (entries[i]->d_name[0] != '.') {
+            snprintf(child, sizeof(child), "%s/%s", path, entries[i]->d_name);
+            if (runPath(child, mutations) < 0) {
+                ret = -1;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    return ret;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-i mutations] [-s seed] [-v] <file|dir>...\n"
+            "  -i  random mutations of each corpus line (default 1000)\n"
+            "  -s  random seed (default 1)\n"
+            "  -v  print each corpus line as it runs\n",
+            argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    int mutations = 1000;
+    int opt;
+    int i;
+    int err = 0;
+
+    while ((opt = getopt(argc, argv, "i:s:v")) != -1) {
+        switch (opt) {
+            case 'i':
+                mutations = atoi(optarg);
+            break;
+
+            case 's':
+                s_rand = strtoull(optarg, NULL, 0);
+                if (s_rand == 0) {
+                    s_rand = 1;
+                }
+            break;
+
+            case 'v':
+                s_verbose = 1;
+            break;
+
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc || mutations < 0) {
+        usage(argv[0]);
+    }
+
+    for (i = optind ; i < argc ; i++) {
+        if (runPath(argv[i], mutations) < 0) {
+            err = 1;
+        }
+    }
+
+    printf("%ld inputs, %ld accepted parses, %ld compared, %d mismatches\n",
+           s_inputs, s_accepted, s_compared, s_failures);
+
+    return (err || s_failures > 0) ? 1 : 0;
+}
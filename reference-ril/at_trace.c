@@ -0,0 +1,190 @@
+/* //device/system/reference-ril/at_trace.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include "at_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "AT"
+#include <utils/Log.h>
+
+/*
+ * |s_traceMutex| keeps records from the reader thread and the command
+ * threads from interleaving in the capture file.
+ */
+static pthread_mutex_t s_traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static int s_traceFd = -1;
+
+static uint64_t monotonicNs()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/** writes all of iov, returns 0 on success and -1 on error */
+static int writeFully(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t written;
+
+    while (iovcnt > 0) {
+        do {
+            written = writev(fd, iov, iovcnt);
+        } while (written < 0 && errno == EINTR);
+
+        if (written < 0) {
+            return -1;
+        }
+
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+int at_trace_open(const char *path)
+{
+    int fd;
+    struct iovec iov;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    if (fd < 0) {
+        RLOGE("at_trace: unable to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    iov.iov_base = (void *)AT_TRACE_MAGIC;
+    iov.iov_len = AT_TRACE_MAGIC_LEN;
+
+    if (writeFully(fd, &iov, 1) < 0) {
+        RLOGE("at_trace: unable to write %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_traceMutex);
+
+    if (s_traceFd >= 0) {
+        close(s_traceFd);
+    }
+    s_traceFd = fd;
+
+    pthread_mutex_unlock(&s_traceMutex);
+
+    RLOGI("at_trace: capturing AT traffic to %s", path);
+
+    return 0;
+}
+
+void at_trace_close()
+{
+    pthread_mutex_lock(&s_traceMutex);
+
+    if (s_traceFd >= 0) {
+        close(s_traceFd);
+    }
+    s_traceFd = -1;
+
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+int at_trace_enabled()
+{
+    return s_traceFd >= 0;
+}
+
+static void writeRecord(uint8_t channel, ATTraceDirection direction,
+                        struct iovec *payload, int payloadcnt)
+{
+    ATTraceRecordHeader header;
+    struct iovec iov[3];
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < payloadcnt; i++) {
+        len += payload[i].iov_len;
+        iov[i + 1] = payload[i];
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.timestampNs = monotonicNs();
+    header.length = (uint32_t)len;
+    header.direction = (uint8_t)direction;
+    header.channel = channel;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+
+    pthread_mutex_lock(&s_traceMutex);
+
+    if (s_traceFd >= 0 && writeFully(s_traceFd, iov, payloadcnt + 1) < 0) {
+        /* don't let a full disk take down the AT channel */
+        RLOGE("at_trace: write failed (%s), stopping capture", strerror(errno));
+        close(s_traceFd);
+        s_traceFd = -1;
+    }
+
+    pthread_mutex_unlock(&s_traceMutex);
+}
+
+void at_trace_record(uint8_t channel, ATTraceDirection direction,
+                     const char *buf, size_t len)
+{
+    struct iovec payload;
+
+    if (s_traceFd < 0) {
+        return;
+    }
+
+    payload.iov_base = (void *)buf;
+    payload.iov_len = len;
+
+    writeRecord(channel, direction, &payload, 1);
+}
+
+void at_trace_command(uint8_t channel, const char *s, char terminator)
+{
+    struct iovec payload[2];
+
+    if (s_traceFd < 0) {
+        return;
+    }
+
+    payload[0].iov_base = (void *)s;
+    payload[0].iov_len = strlen(s);
+    payload[1].iov_base = &terminator;
+    payload[1].iov_len = 1;
+
+    writeRecord(channel, AT_TRACE_TX, payload, 2);
+}
@@ -0,0 +1,91 @@
+/* //device/system/reference-ril/at_trace.h
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef AT_TRACE_H
+#define AT_TRACE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary capture of the raw AT channel traffic.
+ *
+ * A capture file starts with AT_TRACE_MAGIC and is followed by a sequence
+ * of records, each an ATTraceRecordHeader immediately followed by
+ * "length" payload bytes. All fields are in host byte order.
+ *
+ * RX records hold exactly the bytes returned by each read() on the
+ * channel. TX records hold exactly the bytes written for one command,
+ * including the trailing \r (or ^Z for an SMS PDU).
+ *
+ * Timestamps are CLOCK_MONOTONIC nanoseconds, so only the deltas
+ * between records are meaningful.
+ *
+ * "channel" tells apart the AT channels of a multi-modem RIL, whose
+ * records interleave in one capture: 0 is the default channel, the
+ * channels from at_channel_new() are numbered from 1 in creation order.
+ */
+
+#define AT_TRACE_MAGIC      "ATTRACE1"
+#define AT_TRACE_MAGIC_LEN  8
+
+typedef enum {
+    AT_TRACE_RX = 0,    /* modem -> host */
+    AT_TRACE_TX = 1     /* host -> modem */
+} ATTraceDirection;
+
+typedef struct {
+    uint64_t timestampNs;
+    uint32_t length;
+    uint8_t direction;      /* ATTraceDirection */
+    uint8_t channel;        /* AT channel the bytes went through */
+    uint8_t reserved[2];
+} ATTraceRecordHeader;
+
+/**
+ * Starts capturing to the file at "path", truncating it
+ * returns 0 on success, -1 on error
+ */
+int at_trace_open(const char *path);
+
+void at_trace_close();
+
+/** returns 1 if a capture is in progress */
+int at_trace_enabled();
+
+/**
+ * Appends one record for AT channel "channel" to the capture, if any
+ * May be called from the reader thread and from command threads
+ */
+void at_trace_record(uint8_t channel, ATTraceDirection direction,
+                     const char *buf, size_t len);
+
+/**
+ * Appends a TX record for command "s" followed by "terminator"
+ * (\r for commands, ^Z for SMS PDUs)
+ */
+void at_trace_command(uint8_t channel, const char *s, char terminator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*AT_TRACE_H*/
@@ -17,6 +17,7 @@
 
 #include "atchannel.h"
 #include "at_tok.h"
+#include "at_trace.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -41,15 +42,8 @@
 #define MAX_AT_RESPONSE (8 * 1024)
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 250
-
-static pthread_t s_tid_reader;
-static int s_fd = -1;    /* fd of the AT channel */
-static ATUnsolHandler s_unsolHandler;
-
-/* for input buffering */
-
-static char s_ATBuffer[MAX_AT_RESPONSE+1];
-static char *s_ATBufferCur = s_ATBuffer;
+/* V.250 only promises 40, but modems take at least this much on one line */
+#define MAX_BATCH_LINE 256
 
 #if AT_DEBUG
 void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
@@ -61,30 +55,74 @@ void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
 #endif
 
 /*
- * There is one reader thread |s_tid_reader| and potentially multiple writer
- * threads. |s_commandmutex| and |s_commandcond| are used to maintain the
- * condition that the writer thread will not read from |sp_response| until the
- * reader thread has signaled itself is finished, etc. |s_writeMutex| is used to
- * prevent multiple writer threads from calling at_send_command_full_nolock
- * function at the same time.
+ * Everything about one modem connection. There is one reader thread
+ * |tid_reader| and potentially multiple writer threads. |commandmutex| and
+ * |commandcond| are used to maintain the condition that the writer thread
+ * will not read from |p_response| until the reader thread has signaled
+ * itself is finished, etc. |writeMutex| is used to prevent multiple writer
+ * threads from calling at_send_command_full_nolock function at the same
+ * time.
  */
+struct ATChannel {
+    pthread_t tid_reader;
+    int fd;    /* fd of the AT channel */
+    uint8_t traceChannel;    /* tags this channel's records in an AT capture */
+    ATUnsolHandler unsolHandler;
+    void *user;
+
+    /* for input buffering */
+    char ATBuffer[MAX_AT_RESPONSE+1];
+    char *ATBufferCur;
+
+    /* first line of a two-line SMS unsolicited, while the PDU is read */
+    char smsLine[MAX_AT_RESPONSE+1];
+
+    pthread_mutex_t commandmutex;
+    pthread_cond_t commandcond;
+    pthread_mutex_t writeMutex;
+
+    ATCommandType type;
+    const char *responsePrefix;
+    const char *smsPDU;
+    ATResponse *p_response;
+
+    void (*onTimeout)(void);
+    void (*onReaderClosed)(void);
+    int readerClosed;
+
+    /*
+     * Set when a command timed out: its response may still arrive, so the
+     * channel has to be brought back in step before the next command is
+     * sent
+     */
+    int needResync;
 
-static pthread_mutex_t s_commandmutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t s_commandcond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t s_writeMutex = PTHREAD_MUTEX_INITIALIZER;
+    /*
+     * Set once the modem rejected a concatenated line whose commands all
+     * succeed on their own; at_send_command_batch then sends serially
+     */
+    int batchUnsupported;
+};
+
+/* the channel of threads that never selected one */
+static ATChannel s_defaultChannel = {
+    .fd = -1,
+    .ATBufferCur = s_defaultChannel.ATBuffer,
+    .commandmutex = PTHREAD_MUTEX_INITIALIZER,
+    .commandcond = PTHREAD_COND_INITIALIZER,
+    .writeMutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
-static ATCommandType s_type;
-static const char *s_responsePrefix = NULL;
-static const char *s_smsPDU = NULL;
-static ATResponse *sp_response = NULL;
+/* trace channel of the next at_channel_new(); the default channel is 0 */
+static pthread_mutex_t s_traceChannelMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t s_nextTraceChannel = 1;
 
-static void (*s_onTimeout)(void) = NULL;
-static void (*s_onReaderClosed)(void) = NULL;
-static int s_readerClosed;
+static pthread_once_t s_channelKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t s_channelKey;
 
-static void onReaderClosed();
-static int writeCtrlZ (const char *s);
-static int writeline (const char *s);
+static void onReaderClosed(ATChannel *p_channel);
+static int writeCtrlZ (ATChannel *p_channel, const char *s);
+static int writeline (ATChannel *p_channel, const char *s);
 
 #define NS_PER_S 1000000000
 static void setTimespecRelative(struct timespec *p_ts, long long msec)
@@ -102,23 +140,74 @@ static void setTimespecRelative(struct timespec *p_ts, long long msec)
     }
 }
 
-static void sleepMsec(long long msec)
+/*
+ * Default duration of each ATTimeoutClass, in milliseconds
+ * (0 means no timeout); at_set_timeout_class() may change these from any
+ * thread, so they're only touched under s_timeoutClassMutex
+ */
+static pthread_mutex_t s_timeoutClassMutex = PTHREAD_MUTEX_INITIALIZER;
+static long long s_timeoutClassMsec[AT_TIMEOUT_NUM_CLASSES] = {
+    5 * 1000,       /* AT_TIMEOUT_SHORT */
+    30 * 1000,      /* AT_TIMEOUT_NORMAL */
+    180 * 1000,     /* AT_TIMEOUT_LONG */
+};
+
+/*
+ * Commands are matched by prefix, first match wins; anything not listed
+ * here is AT_TIMEOUT_NORMAL
+ */
+static const struct {
+    const char *prefix;
+    ATTimeoutClass timeoutClass;
+} s_commandTimeouts[] = {
+    /* these wait on the network, a scan can take minutes */
+    { "AT+COPS=?", AT_TIMEOUT_LONG },
+    { "AT+COPS=", AT_TIMEOUT_LONG },
+    { "AT+CFUN=", AT_TIMEOUT_LONG },
+    { "AT+CGACT=", AT_TIMEOUT_LONG },
+    { "AT+CMGS=", AT_TIMEOUT_LONG },
+    { "AT+CUSD=", AT_TIMEOUT_LONG },
+    { "ATD", AT_TIMEOUT_LONG },
+    /* these are answered from state the modem already has */
+    { "AT+CSQ", AT_TIMEOUT_SHORT },
+    { "AT+CREG?", AT_TIMEOUT_SHORT },
+    { "AT+CGREG?", AT_TIMEOUT_SHORT },
+    { "AT+COPS?", AT_TIMEOUT_SHORT },
+    { "AT+CLCC", AT_TIMEOUT_SHORT },
+    { "AT+CPIN?", AT_TIMEOUT_SHORT },
+    { "AT+CFUN?", AT_TIMEOUT_SHORT },
+    { "AT+CTEC?", AT_TIMEOUT_SHORT },
+    { "AT+CMEE?", AT_TIMEOUT_SHORT },
+};
+
+static long long timeoutForClass(ATTimeoutClass timeoutClass)
 {
-    struct timespec ts;
-    int err;
+    long long timeoutMsec;
 
-    ts.tv_sec = (msec / 1000);
-    ts.tv_nsec = (msec % 1000) * 1000 * 1000;
+    pthread_mutex_lock(&s_timeoutClassMutex);
+    timeoutMsec = s_timeoutClassMsec[timeoutClass];
+    pthread_mutex_unlock(&s_timeoutClassMutex);
 
-    do {
-        err = nanosleep (&ts, &ts);
-    } while (err < 0 && errno == EINTR);
+    return timeoutMsec;
+}
+
+static long long timeoutForCommand(const char *command)
+{
+    size_t i;
+
+    for (i = 0 ; i < NUM_ELEMS(s_commandTimeouts) ; i++) {
+        if (strStartsWith(command, s_commandTimeouts[i].prefix)) {
+            return timeoutForClass(s_commandTimeouts[i].timeoutClass);
+        }
+    }
+
+    return timeoutForClass(AT_TIMEOUT_NORMAL);
 }
 
 
 
-/** add an intermediate response to sp_response*/
-static void addIntermediate(const char *line)
+/** add an intermediate response to p_channel->p_response */
+static void addIntermediate(ATChannel *p_channel, const char *line)
 {
     ATLine *p_new;
 
@@ -129,8 +218,8 @@ static void addIntermediate(const char *line)
     /* note: this adds to the head of the list, so the list
        will be in reverse order of lines received. the order is flipped
        again before passing on to the command issuer */
-    p_new->p_next = sp_response->p_intermediates;
-    sp_response->p_intermediates = p_new;
+    p_new->p_next = p_channel->p_response->p_intermediates;
+    p_channel->p_response->p_intermediates = p_new;
 }
 
 
@@ -182,16 +271,6 @@ static int isFinalResponseSuccess(const char *line)
     return 0;
 }
 
-/**
- * returns 1 if line is a final response, either  error or success
- * See 27.007 annex B
- * WARNING: NO CARRIER and others are sometimes unsolicited
- */
-static int isFinalResponse(const char *line)
-{
-    return isFinalResponseSuccess(line) || isFinalResponseError(line);
-}
-
 
 /**
  * returns 1 if line is the first line in (what will be) a two-line
@@ -216,79 +295,79 @@ static int isSMSUnsolicited(const char *line)
 }
 
 
-/** assumes s_commandmutex is held */
-static void handleFinalResponse(const char *line)
+/** assumes p_channel->commandmutex is held */
+static void handleFinalResponse(ATChannel *p_channel, const char *line)
 {
-    sp_response->finalResponse = strdup(line);
+    p_channel->p_response->finalResponse = strdup(line);
 
-    pthread_cond_signal(&s_commandcond);
+    pthread_cond_signal(&p_channel->commandcond);
 }
 
-static void handleUnsolicited(const char *line)
+static void handleUnsolicited(ATChannel *p_channel, const char *line)
 {
-    if (s_unsolHandler != NULL) {
-        s_unsolHandler(line, NULL);
+    if (p_channel->unsolHandler != NULL) {
+        p_channel->unsolHandler(line, NULL);
     }
 }
 
-static void processLine(const char *line)
+static void processLine(ATChannel *p_channel, const char *line)
 {
-    pthread_mutex_lock(&s_commandmutex);
+    pthread_mutex_lock(&p_channel->commandmutex);
 
-    if (sp_response == NULL) {
+    if (p_channel->p_response == NULL) {
         /* no command pending */
-        handleUnsolicited(line);
+        handleUnsolicited(p_channel, line);
     } else if (isFinalResponseSuccess(line)) {
-        sp_response->success = 1;
-        handleFinalResponse(line);
+        p_channel->p_response->success = 1;
+        handleFinalResponse(p_channel, line);
     } else if (isFinalResponseError(line)) {
-        sp_response->success = 0;
-        handleFinalResponse(line);
-    } else if (s_smsPDU != NULL && 0 == strcmp(line, "> ")) {
+        p_channel->p_response->success = 0;
+        handleFinalResponse(p_channel, line);
+    } else if (p_channel->smsPDU != NULL && 0 == strcmp(line, "> ")) {
         // See eg. TS 27.005 4.3
         // Commands like AT+CMGS have a "> " prompt
-        writeCtrlZ(s_smsPDU);
-        s_smsPDU = NULL;
-    } else switch (s_type) {
+        writeCtrlZ(p_channel, p_channel->smsPDU);
+        p_channel->smsPDU = NULL;
+    } else switch (p_channel->type) {
         case NO_RESULT:
-            handleUnsolicited(line);
+            handleUnsolicited(p_channel, line);
             break;
         case NUMERIC:
-            if (sp_response->p_intermediates == NULL
+            if (p_channel->p_response->p_intermediates == NULL
                 && isdigit(line[0])
             ) {
-                addIntermediate(line);
+                addIntermediate(p_channel, line);
             } else {
                 /* either we already have an intermediate response or
                    the line doesn't begin with a digit */
-                handleUnsolicited(line);
+                handleUnsolicited(p_channel, line);
             }
             break;
         case SINGLELINE:
-            if (sp_response->p_intermediates == NULL
-                && strStartsWith (line, s_responsePrefix)
+            if (p_channel->p_response->p_intermediates == NULL
+                && strStartsWith (line, p_channel->responsePrefix)
             ) {
-                addIntermediate(line);
+                addIntermediate(p_channel, line);
             } else {
                 /* we already have an intermediate response */
-                handleUnsolicited(line);
+                handleUnsolicited(p_channel, line);
             }
             break;
         case MULTILINE:
-            if (strStartsWith (line, s_responsePrefix)) {
-                addIntermediate(line);
+            if (strStartsWith (line, p_channel->responsePrefix)) {
+                addIntermediate(p_channel, line);
             } else {
-                handleUnsolicited(line);
+                handleUnsolicited(p_channel, line);
             }
         break;
 
         default: /* this should never be reached */
-            RLOGE("Unsupported AT command type %d\n", s_type);
-            handleUnsolicited(line);
+            RLOGE("Unsupported AT command type %d\n", p_channel->type);
+            handleUnsolicited(p_channel, line);
         break;
     }
 
-    pthread_mutex_unlock(&s_commandmutex);
+    pthread_mutex_unlock(&p_channel->commandmutex);
 }
 
 
@@ -322,7 +401,7 @@ static char * findNextEOL(char *cur)
  * have buffered stdio.
  */
 
-static const char *readline()
+static const char *readline(ATChannel *p_channel)
 {
     ssize_t count;
 
@@ -330,62 +409,65 @@ static const char *readline()
     char *p_eol = NULL;
     char *ret;
 
-    /* this is a little odd. I use *s_ATBufferCur == 0 to
+    /* this is a little odd. I use *ATBufferCur == 0 to
      * mean "buffer consumed completely". If it points to a character, than
      * the buffer continues until a \0
      */
-    if (*s_ATBufferCur == '\0') {
+    if (*p_channel->ATBufferCur == '\0') {
         /* empty buffer */
-        s_ATBufferCur = s_ATBuffer;
-        *s_ATBufferCur = '\0';
-        p_read = s_ATBuffer;
-    } else {   /* *s_ATBufferCur != '\0' */
+        p_channel->ATBufferCur = p_channel->ATBuffer;
+        *p_channel->ATBufferCur = '\0';
+        p_read = p_channel->ATBuffer;
+    } else {   /* *ATBufferCur != '\0' */
         /* there's data in the buffer from the last read */
 
         // skip over leading newlines
-        while (*s_ATBufferCur == '\r' || *s_ATBufferCur == '\n')
-            s_ATBufferCur++;
+        while (*p_channel->ATBufferCur == '\r'
+                || *p_channel->ATBufferCur == '\n')
+            p_channel->ATBufferCur++;
 
-        p_eol = findNextEOL(s_ATBufferCur);
+        p_eol = findNextEOL(p_channel->ATBufferCur);
 
         if (p_eol == NULL) {
             /* a partial line. move it up and prepare to read more */
             size_t len;
 
-            len = strlen(s_ATBufferCur);
+            len = strlen(p_channel->ATBufferCur);
 
-            memmove(s_ATBuffer, s_ATBufferCur, len + 1);
-            p_read = s_ATBuffer + len;
-            s_ATBufferCur = s_ATBuffer;
+            memmove(p_channel->ATBuffer, p_channel->ATBufferCur, len + 1);
+            p_read = p_channel->ATBuffer + len;
+            p_channel->ATBufferCur = p_channel->ATBuffer;
         }
         /* Otherwise, (p_eol !- NULL) there is a complete line  */
         /* that will be returned the while () loop below        */
     }
 
     while (p_eol == NULL) {
-        if (0 == MAX_AT_RESPONSE - (p_read - s_ATBuffer)) {
+        if (0 == MAX_AT_RESPONSE - (p_read - p_channel->ATBuffer)) {
             RLOGE("ERROR: Input line exceeded buffer\n");
             /* ditch buffer and start over again */
-            s_ATBufferCur = s_ATBuffer;
-            *s_ATBufferCur = '\0';
-            p_read = s_ATBuffer;
+            p_channel->ATBufferCur = p_channel->ATBuffer;
+            *p_channel->ATBufferCur = '\0';
+            p_read = p_channel->ATBuffer;
         }
 
         do {
-            count = read(s_fd, p_read,
-                            MAX_AT_RESPONSE - (p_read - s_ATBuffer));
+            count = read(p_channel->fd, p_read,
+                            MAX_AT_RESPONSE - (p_read - p_channel->ATBuffer));
         } while (count < 0 && errno == EINTR);
 
         if (count > 0) {
             AT_DUMP( "<< ", p_read, count );
+            at_trace_record(p_channel->traceChannel, AT_TRACE_RX, p_read, count);
 
             p_read[count] = '\0';
 
             // skip over leading newlines
-            while (*s_ATBufferCur == '\r' || *s_ATBufferCur == '\n')
-                s_ATBufferCur++;
+            while (*p_channel->ATBufferCur == '\r'
+                    || *p_channel->ATBufferCur == '\n')
+                p_channel->ATBufferCur++;
 
-            p_eol = findNextEOL(s_ATBufferCur);
+            p_eol = findNextEOL(p_channel->ATBufferCur);
             p_read += count;
         } else if (count <= 0) {
             /* read error encountered or EOF reached */
@@ -400,9 +482,9 @@ static const char *readline()
 
     /* a full line in the buffer. Place a \0 over the \r and return */
 
-    ret = s_ATBufferCur;
+    ret = p_channel->ATBufferCur;
     *p_eol = '\0';
-    s_ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
+    p_channel->ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
                               /* and there will be a \0 at *p_read */
 
     RLOGD("AT< %s\n", ret);
@@ -410,59 +492,62 @@ static const char *readline()
 }
 
 
-static void onReaderClosed()
+static void onReaderClosed(ATChannel *p_channel)
 {
-    if (s_onReaderClosed != NULL && s_readerClosed == 0) {
+    if (p_channel->onReaderClosed != NULL && p_channel->readerClosed == 0) {
 
-        pthread_mutex_lock(&s_commandmutex);
+        pthread_mutex_lock(&p_channel->commandmutex);
 
-        s_readerClosed = 1;
+        p_channel->readerClosed = 1;
 
-        pthread_cond_signal(&s_commandcond);
+        pthread_cond_signal(&p_channel->commandcond);
 
-        pthread_mutex_unlock(&s_commandmutex);
+        pthread_mutex_unlock(&p_channel->commandmutex);
 
-        s_onReaderClosed();
+        p_channel->onReaderClosed();
     }
 }
 
 
-static void *readerLoop(void *arg __unused)
+static void *readerLoop(void *arg)
 {
+    ATChannel *p_channel = (ATChannel *) arg;
+
+    at_channel_select(p_channel);
+
     for (;;) {
         const char * line;
 
-        line = readline();
+        line = readline(p_channel);
 
         if (line == NULL) {
             break;
         }
 
         if(isSMSUnsolicited(line)) {
-            char *line1;
             const char *line2;
 
             // The scope of string returned by 'readline()' is valid only
-            // till next call to 'readline()' hence making a copy of line
-            // before calling readline again.
-            line1 = strdup(line);
-            line2 = readline();
+            // till next call to 'readline()', which may move a partial
+            // line over it, hence copying the (short) first line before
+            // calling readline again. The PDU line is handed on in place,
+            // so a burst of messages allocates nothing here.
+            memcpy(p_channel->smsLine, line, strlen(line) + 1);
+            line2 = readline(p_channel);
 
             if (line2 == NULL) {
-                free(line1);
                 break;
             }
 
-            if (s_unsolHandler != NULL) {
-                s_unsolHandler (line1, line2);
+            if (p_channel->unsolHandler != NULL) {
+                p_channel->unsolHandler (p_channel->smsLine, line2);
             }
-            free(line1);
         } else {
-            processLine(line);
+            processLine(p_channel, line);
         }
     }
 
-    onReaderClosed();
+    onReaderClosed(p_channel);
 
     return NULL;
 }
@@ -474,13 +559,13 @@ static void *readerLoop(void *arg __unused)
  * This function exists because as of writing, android libc does not
  * have buffered stdio.
  */
-static int writeline (const char *s)
+static int writeline (ATChannel *p_channel, const char *s)
 {
     size_t cur = 0;
     size_t len = strlen(s);
     ssize_t written;
 
-    if (s_fd < 0 || s_readerClosed > 0) {
+    if (p_channel->fd < 0 || p_channel->readerClosed > 0) {
         return AT_ERROR_CHANNEL_CLOSED;
     }
 
@@ -488,10 +573,13 @@ static int writeline (const char *s)
 
     AT_DUMP( ">> ", s, strlen(s) );
 
+    /* trace before writing so the reply can't be captured ahead of it */
+    at_trace_command(p_channel->traceChannel, s, '\r');
+
     /* the main string */
     while (cur < len) {
         do {
-            written = write (s_fd, s + cur, len - cur);
+            written = write (p_channel->fd, s + cur, len - cur);
         } while (written < 0 && errno == EINTR);
 
         if (written < 0) {
@@ -504,7 +592,7 @@ static int writeline (const char *s)
     /* the \r  */
 
     do {
-        written = write (s_fd, "\r" , 1);
+        written = write (p_channel->fd, "\r" , 1);
     } while ((written < 0 && errno == EINTR) || (written == 0));
 
     if (written < 0) {
@@ -513,13 +601,13 @@ static int writeline (const char *s)
 
     return 0;
 }
-static int writeCtrlZ (const char *s)
+static int writeCtrlZ (ATChannel *p_channel, const char *s)
 {
     size_t cur = 0;
     size_t len = strlen(s);
     ssize_t written;
 
-    if (s_fd < 0 || s_readerClosed > 0) {
+    if (p_channel->fd < 0 || p_channel->readerClosed > 0) {
         return AT_ERROR_CHANNEL_CLOSED;
     }
 
@@ -527,10 +615,12 @@ static int writeCtrlZ (const char *s)
 
     AT_DUMP( ">* ", s, strlen(s) );
 
+    at_trace_command(p_channel->traceChannel, s, '\032');
+
     /* the main string */
     while (cur < len) {
         do {
-            written = write (s_fd, s + cur, len - cur);
+            written = write (p_channel->fd, s + cur, len - cur);
         } while (written < 0 && errno == EINTR);
 
         if (written < 0) {
@@ -543,7 +633,7 @@ static int writeCtrlZ (const char *s)
     /* the ^Z  */
 
     do {
-        written = write (s_fd, "\032" , 1);
+        written = write (p_channel->fd, "\032" , 1);
     } while ((written < 0 && errno == EINTR) || (written == 0));
 
     if (written < 0) {
@@ -553,17 +643,68 @@ static int writeCtrlZ (const char *s)
     return 0;
 }
 
-static void clearPendingCommand()
+static void clearPendingCommand(ATChannel *p_channel)
+{
+    if (p_channel->p_response != NULL) {
+        at_response_free(p_channel->p_response);
+    }
+
+    p_channel->p_response = NULL;
+    p_channel->responsePrefix = NULL;
+    p_channel->smsPDU = NULL;
+}
+
+
+static void makeChannelKey()
+{
+    pthread_key_create(&s_channelKey, NULL);
+}
+
+ATChannel *at_channel_new(void *user)
 {
-    if (sp_response != NULL) {
-        at_response_free(sp_response);
+    ATChannel *p_channel;
+
+    p_channel = (ATChannel *) calloc(1, sizeof(ATChannel));
+
+    if (p_channel == NULL) {
+        return NULL;
     }
 
-    sp_response = NULL;
-    s_responsePrefix = NULL;
-    s_smsPDU = NULL;
+    p_channel->fd = -1;
+    p_channel->user = user;
+
+    pthread_mutex_lock(&s_traceChannelMutex);
+    p_channel->traceChannel = s_nextTraceChannel++;
+    pthread_mutex_unlock(&s_traceChannelMutex);
+    p_channel->ATBufferCur = p_channel->ATBuffer;
+
+    pthread_mutex_init(&p_channel->commandmutex, NULL);
+    pthread_cond_init(&p_channel->commandcond, NULL);
+    pthread_mutex_init(&p_channel->writeMutex, NULL);
+
+    return p_channel;
+}
+
+void at_channel_select(ATChannel *p_channel)
+{
+    pthread_once(&s_channelKeyOnce, makeChannelKey);
+    pthread_setspecific(s_channelKey, p_channel);
 }
 
+ATChannel *at_channel_current()
+{
+    ATChannel *p_channel;
+
+    pthread_once(&s_channelKeyOnce, makeChannelKey);
+    p_channel = (ATChannel *) pthread_getspecific(s_channelKey);
+
+    return p_channel != NULL ? p_channel : &s_defaultChannel;
+}
+
+void *at_channel_user(ATChannel *p_channel)
+{
+    return p_channel->user;
+}
 
 /**
  * Starts AT handler on stream "fd'
@@ -571,22 +712,24 @@ static void clearPendingCommand()
  */
 int at_open(int fd, ATUnsolHandler h)
 {
+    ATChannel *p_channel = at_channel_current();
     int ret;
-    pthread_t tid;
     pthread_attr_t attr;
 
-    s_fd = fd;
-    s_unsolHandler = h;
-    s_readerClosed = 0;
+    p_channel->fd = fd;
+    p_channel->unsolHandler = h;
+    p_channel->readerClosed = 0;
+    p_channel->needResync = 0;
+    p_channel->batchUnsupported = 0;
 
-    s_responsePrefix = NULL;
-    s_smsPDU = NULL;
-    sp_response = NULL;
+    p_channel->responsePrefix = NULL;
+    p_channel->smsPDU = NULL;
+    p_channel->p_response = NULL;
 
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
-    ret = pthread_create(&s_tid_reader, &attr, readerLoop, &attr);
+    ret = pthread_create(&p_channel->tid_reader, &attr, readerLoop, p_channel);
 
     if (ret < 0) {
         perror ("pthread_create");
@@ -600,18 +743,20 @@ int at_open(int fd, ATUnsolHandler h)
 /* FIXME is it ok to call this from the reader and the command thread? */
 void at_close()
 {
-    if (s_fd >= 0) {
-        close(s_fd);
+    ATChannel *p_channel = at_channel_current();
+
+    if (p_channel->fd >= 0) {
+        close(p_channel->fd);
     }
-    s_fd = -1;
+    p_channel->fd = -1;
 
-    pthread_mutex_lock(&s_commandmutex);
+    pthread_mutex_lock(&p_channel->commandmutex);
 
-    s_readerClosed = 1;
+    p_channel->readerClosed = 1;
 
-    pthread_cond_signal(&s_commandcond);
+    pthread_cond_signal(&p_channel->commandcond);
 
-    pthread_mutex_unlock(&s_commandmutex);
+    pthread_mutex_unlock(&p_channel->commandmutex);
 
     /* the reader thread should eventually die */
 }
@@ -643,6 +788,33 @@ void at_response_free(ATResponse *p_response)
     free (p_response);
 }
 
+ATResponse *at_response_dup(const ATResponse *p_response)
+{
+    ATResponse *p_copy;
+    ATLine *p_line;
+    ATLine **pp_tail;
+
+    p_copy = at_response_new();
+    p_copy->success = p_response->success;
+
+    if (p_response->finalResponse != NULL) {
+        p_copy->finalResponse = strdup(p_response->finalResponse);
+    }
+
+    pp_tail = &p_copy->p_intermediates;
+
+    for (p_line = p_response->p_intermediates
+            ; p_line != NULL
+            ; p_line = p_line->p_next
+    ) {
+        *pp_tail = (ATLine *) calloc(1, sizeof(ATLine));
+        (*pp_tail)->line = strdup(p_line->line);
+        pp_tail = &(*pp_tail)->p_next;
+    }
+
+    return p_copy;
+}
+
 /**
  * The line reader places the intermediate responses in reverse order
  * here we flip them back
@@ -666,41 +838,41 @@ static void reverseIntermediates(ATResponse *p_response)
  * Internal send_command implementation
  * Doesn't lock or call the timeout callback
  *
- * timeoutMsec == 0 means infinite timeout
+ * p_deadline == NULL means infinite timeout
  */
 
-static int at_send_command_full_nolock (const char *command, ATCommandType type,
+static int at_send_command_full_nolock (ATChannel *p_channel,
+                    const char *command, ATCommandType type,
                     const char *responsePrefix, const char *smspdu,
-                    long long timeoutMsec, ATResponse **pp_outResponse)
+                    const struct timespec *p_deadline,
+                    ATResponse **pp_outResponse)
 {
     int err = 0;
-    struct timespec ts;
 
-    if(sp_response != NULL) {
+    if(p_channel->p_response != NULL) {
         err = AT_ERROR_COMMAND_PENDING;
         goto error;
     }
 
-    err = writeline (command);
+    err = writeline (p_channel, command);
 
     if (err < 0) {
         goto error;
     }
 
-    s_type = type;
-    s_responsePrefix = responsePrefix;
-    s_smsPDU = smspdu;
-    sp_response = at_response_new();
-
-    if (timeoutMsec != 0) {
-        setTimespecRelative(&ts, timeoutMsec);
-    }
+    p_channel->type = type;
+    p_channel->responsePrefix = responsePrefix;
+    p_channel->smsPDU = smspdu;
+    p_channel->p_response = at_response_new();
 
-    while (sp_response->finalResponse == NULL && s_readerClosed == 0) {
-        if (timeoutMsec != 0) {
-            err = pthread_cond_timedwait(&s_commandcond, &s_commandmutex, &ts);
+    while (p_channel->p_response->finalResponse == NULL
+            && p_channel->readerClosed == 0) {
+        if (p_deadline != NULL) {
+            err = pthread_cond_timedwait(&p_channel->commandcond,
+                                         &p_channel->commandmutex, p_deadline);
         } else {
-            err = pthread_cond_wait(&s_commandcond, &s_commandmutex);
+            err = pthread_cond_wait(&p_channel->commandcond,
+                                    &p_channel->commandmutex);
         }
 
         if (err == ETIMEDOUT) {
@@ -710,23 +882,71 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
     }
 
     if (pp_outResponse == NULL) {
-        at_response_free(sp_response);
+        at_response_free(p_channel->p_response);
     } else {
         /* line reader stores intermediate responses in reverse order */
-        reverseIntermediates(sp_response);
-        *pp_outResponse = sp_response;
+        reverseIntermediates(p_channel->p_response);
+        *pp_outResponse = p_channel->p_response;
     }
 
-    sp_response = NULL;
+    p_channel->p_response = NULL;
 
-    if(s_readerClosed > 0) {
+    if(p_channel->readerClosed > 0) {
         err = AT_ERROR_CHANNEL_CLOSED;
         goto error;
     }
 
     err = 0;
 error:
-    clearPendingCommand();
+    clearPendingCommand(p_channel);
+
+    return err;
+}
+
+/**
+ * Waits out the rest of "msec" with the channel's commandmutex released, so
+ * the reader thread can pass any unmatched lines to the unsolicited handler.
+ * Called with both writeMutex and commandmutex held.
+ */
+static void drainUnmatched_nolock(ATChannel *p_channel, long long msec)
+{
+    struct timespec ts;
+
+    setTimespecRelative(&ts, msec);
+
+    while (p_channel->readerClosed == 0
+        && pthread_cond_timedwait(&p_channel->commandcond,
+                                  &p_channel->commandmutex, &ts)
+            != ETIMEDOUT
+    ) {
+        /* nothing to do: p_response is NULL, lines go to unsolHandler */
+    }
+}
+
+static int handshake_nolock(ATChannel *p_channel)
+{
+    int i;
+    int err = 0;
+    struct timespec ts;
+
+    for (i = 0 ; i < HANDSHAKE_RETRY_COUNT ; i++) {
+        /* some stacks start with verbose off */
+        setTimespecRelative(&ts, HANDSHAKE_TIMEOUT_MSEC);
+        err = at_send_command_full_nolock (p_channel, "ATE0Q0V1", NO_RESULT,
+                    NULL, NULL, &ts, NULL);
+
+        if (err == 0) {
+            break;
+        }
+    }
+
+    if (err == 0) {
+        /* pause for a bit to let the input buffer drain any unmatched OK's
+           (they will appear as extraneous unsolicited responses) */
+
+        drainUnmatched_nolock(p_channel, HANDSHAKE_TIMEOUT_MSEC);
+        p_channel->needResync = 0;
+    }
 
     return err;
 }
@@ -735,27 +955,98 @@ error:
  * Internal send_command implementation
  *
  * timeoutMsec == 0 means infinite timeout
+ *
+ * The deadline starts once the channel is ours, so time spent queued behind
+ * other command threads doesn't count against it. Queueing has its own
+ * bound instead: every holder gives the channel up within its own deadline,
+ * so waiting longer than the longest class (plus a resync handshake) means
+ * the channel is wedged, and the command is failed with AT_ERROR_TIMEOUT
+ * without being sent.
+ *
+ * A command that times out is abandoned, but the channel stays open: the
+ * next command handshakes first so that the abandoned command's late
+ * response can't be taken for its own. Only if that handshake fails is the
+ * timeout callback invoked.
  */
-static int at_send_command_full (const char *command, ATCommandType type,
+static int at_send_command_full (ATChannel *p_channel,
+                    const char *command, ATCommandType type,
                     const char *responsePrefix, const char *smspdu,
                     long long timeoutMsec, ATResponse **pp_outResponse)
 {
     int err;
+    int unresponsive = 0;
+    long long queueMsec;
+    struct timespec deadline;
+    const struct timespec *p_deadline = NULL;
 
-    if (0 != pthread_equal(s_tid_reader, pthread_self())) {
+    if (0 != pthread_equal(p_channel->tid_reader, pthread_self())) {
         /* cannot be called from reader thread */
         return AT_ERROR_INVALID_THREAD;
     }
-    pthread_mutex_lock(&s_commandmutex);
 
-    err = at_send_command_full_nolock(command, type,
+    queueMsec = timeoutForClass(AT_TIMEOUT_LONG);
+
+    if (timeoutMsec != 0 && queueMsec != 0) {
+        queueMsec += 2 * HANDSHAKE_TIMEOUT_MSEC;
+        setTimespecRelative(&deadline, queueMsec);
+
+        if (pthread_mutex_timedlock(&p_channel->writeMutex, &deadline) != 0) {
+            RLOGW("AT channel busy for %lld ms, command not sent", queueMsec);
+            return AT_ERROR_TIMEOUT;
+        }
+    } else {
+        pthread_mutex_lock(&p_channel->writeMutex);
+    }
+
+    if (timeoutMsec != 0) {
+        setTimespecRelative(&deadline, timeoutMsec);
+        p_deadline = &deadline;
+    }
+
+    pthread_mutex_lock(&p_channel->commandmutex);
+
+    if (p_channel->needResync && p_channel->readerClosed == 0) {
+        RLOGI("AT channel resync after timeout");
+
+        if (handshake_nolock(p_channel) < 0) {
+            unresponsive = 1;
+            err = AT_ERROR_TIMEOUT;
+            goto done;
+        }
+    }
+
+    err = at_send_command_full_nolock(p_channel, command, type,
                     responsePrefix, smspdu,
-                    timeoutMsec, pp_outResponse);
+                    p_deadline, pp_outResponse);
 
-    pthread_mutex_unlock(&s_commandmutex);
+    if (err == AT_ERROR_TIMEOUT) {
+        RLOGW("AT command timed out after %lld ms", timeoutMsec);
+        p_channel->needResync = 1;
+    }
 
-    if (err == AT_ERROR_TIMEOUT && s_onTimeout != NULL) {
-        s_onTimeout();
+done:
+    pthread_mutex_unlock(&p_channel->commandmutex);
+    pthread_mutex_unlock(&p_channel->writeMutex);
+
+    if (unresponsive && p_channel->onTimeout != NULL) {
+        p_channel->onTimeout();
+    }
+
+    return err;
+}
+
+/** returns AT_ERROR_INVALID_RESPONSE if a successful command lacked its
+    intermediate response, err otherwise */
+static int checkIntermediate(int err, ATResponse **pp_outResponse)
+{
+    if (err == 0 && pp_outResponse != NULL
+        && (*pp_outResponse)->success > 0
+        && (*pp_outResponse)->p_intermediates == NULL
+    ) {
+        /* successful command must have an intermediate response */
+        at_response_free(*pp_outResponse);
+        *pp_outResponse = NULL;
+        return AT_ERROR_INVALID_RESPONSE;
     }
 
     return err;
@@ -775,8 +1066,9 @@ int at_send_command (const char *command, ATResponse **pp_outResponse)
 {
     int err;
 
-    err = at_send_command_full (command, NO_RESULT, NULL,
-                                    NULL, 0, pp_outResponse);
+    err = at_send_command_full (at_channel_current(), command,
+                                    NO_RESULT, NULL, NULL,
+                                    timeoutForCommand(command), pp_outResponse);
 
     return err;
 }
@@ -788,20 +1080,11 @@ int at_send_command_singleline (const char *command,
 {
     int err;
 
-    err = at_send_command_full (command, SINGLELINE, responsePrefix,
-                                    NULL, 0, pp_outResponse);
-
-    if (err == 0 && pp_outResponse != NULL
-        && (*pp_outResponse)->success > 0
-        && (*pp_outResponse)->p_intermediates == NULL
-    ) {
-        /* successful command must have an intermediate response */
-        at_response_free(*pp_outResponse);
-        *pp_outResponse = NULL;
-        return AT_ERROR_INVALID_RESPONSE;
-    }
+    err = at_send_command_full (at_channel_current(), command,
+                                    SINGLELINE, responsePrefix, NULL,
+                                    timeoutForCommand(command), pp_outResponse);
 
-    return err;
+    return checkIntermediate(err, pp_outResponse);
 }
 
 
@@ -810,20 +1093,11 @@ int at_send_command_numeric (const char *command,
 {
     int err;
 
-    err = at_send_command_full (command, NUMERIC, NULL,
-                                    NULL, 0, pp_outResponse);
-
-    if (err == 0 && pp_outResponse != NULL
-        && (*pp_outResponse)->success > 0
-        && (*pp_outResponse)->p_intermediates == NULL
-    ) {
-        /* successful command must have an intermediate response */
-        at_response_free(*pp_outResponse);
-        *pp_outResponse = NULL;
-        return AT_ERROR_INVALID_RESPONSE;
-    }
+    err = at_send_command_full (at_channel_current(), command,
+                                    NUMERIC, NULL, NULL,
+                                    timeoutForCommand(command), pp_outResponse);
 
-    return err;
+    return checkIntermediate(err, pp_outResponse);
 }
 
 
@@ -834,20 +1108,11 @@ int at_send_command_sms (const char *command,
 {
     int err;
 
-    err = at_send_command_full (command, SINGLELINE, responsePrefix,
-                                    pdu, 0, pp_outResponse);
-
-    if (err == 0 && pp_outResponse != NULL
-        && (*pp_outResponse)->success > 0
-        && (*pp_outResponse)->p_intermediates == NULL
-    ) {
-        /* successful command must have an intermediate response */
-        at_response_free(*pp_outResponse);
-        *pp_outResponse = NULL;
-        return AT_ERROR_INVALID_RESPONSE;
-    }
+    err = at_send_command_full (at_channel_current(), command,
+                                    SINGLELINE, responsePrefix, pdu,
+                                    timeoutForCommand(command), pp_outResponse);
 
-    return err;
+    return checkIntermediate(err, pp_outResponse);
 }
 
 
@@ -857,17 +1122,246 @@ int at_send_command_multiline (const char *command,
 {
     int err;
 
-    err = at_send_command_full (command, MULTILINE, responsePrefix,
-                                    NULL, 0, pp_outResponse);
+    err = at_send_command_full (at_channel_current(), command,
+                                    MULTILINE, responsePrefix, NULL,
+                                    timeoutForCommand(command), pp_outResponse);
+
+    return err;
+}
+
+
+int at_send_command_timeout (const char *command, ATCommandType type,
+                                const char *responsePrefix,
+                                long long timeoutMsec,
+                                ATResponse **pp_outResponse)
+{
+    int err;
+
+    err = at_send_command_full (at_channel_current(), command,
+                                    type, responsePrefix, NULL,
+                                    timeoutMsec, pp_outResponse);
+
+    if (type == SINGLELINE || type == NUMERIC) {
+        return checkIntermediate(err, pp_outResponse);
+    }
 
     return err;
 }
 
 
-/** This callback is invoked on the command thread */
+/** returns 1 if "body" (the command less "AT") is an extended command */
+static int isExtendedCommand(const char *body)
+{
+    return !isalpha((unsigned char)body[0]) && body[0] != '&';
+}
+
+/**
+ * returns 1 if "command" may be concatenated with others: not a dial,
+ * answer, hangup or online command, which end the command line, and not a
+ * reset, which would discard whatever else is on it
+ */
+static int isBatchable(const char *command)
+{
+    const char *body;
+
+    if (!strStartsWith(command, "AT") || command[2] == '\0') {
+        return 0;
+    }
+
+    body = command + 2;
+
+    if (strchr("AaDdHhOoZz", body[0]) != NULL
+        || strStartsWith(body, "&F") || strStartsWith(body, "&f")
+    ) {
+        return 0;
+    }
+
+    return 1;
+}
+
+static void setBatchResults(int *p_results, size_t from, size_t to, int result)
+{
+    if (p_results != NULL) {
+        for ( ; from < to ; from++) {
+            p_results[from] = result;
+        }
+    }
+}
+
+/** issues commands[from..to) one at a time */
+static int sendSerial(const char * const *commands, size_t from, size_t to,
+                      int *p_results, int *p_allSucceeded)
+{
+    ATResponse *p_response = NULL;
+    size_t i;
+    int err;
+
+    *p_allSucceeded = 1;
+
+    for (i = from ; i < to ; i++) {
+        err = at_send_command(commands[i], &p_response);
+
+        if (err < 0) {
+            setBatchResults(p_results, i, to, err);
+            return err;
+        }
+
+        setBatchResults(p_results, i, i + 1, p_response->success);
+        if (p_response->success == 0) {
+            *p_allSucceeded = 0;
+        }
+
+        at_response_free(p_response);
+        p_response = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Concatenates as many of commands[start..] as fit on one command line
+ * into "line", returns the index after the last one taken. Basic commands
+ * are simply appended, extended ones are separated by ';'. A basic command
+ * after an extended one starts a new line, as not every modem accepts it.
+ */
+static size_t buildBatchLine(const char * const *commands, size_t start,
+                             size_t count, char *line, long long *p_timeoutMsec)
+{
+    size_t end;
+    size_t len = 2;
+    long long timeoutMsec = 0;
+    int infinite = 0;
+
+    memcpy(line, "AT", 3);
+
+    for (end = start ; end < count && isBatchable(commands[end]) ; end++) {
+        const char *body = commands[end] + 2;
+        size_t bodyLen = strlen(body);
+        int extended = isExtendedCommand(body);
+        int separate = 0;
+        long long commandTimeout;
+
+        if (end > start && isExtendedCommand(commands[end - 1] + 2)) {
+            if (!extended) {
+                break;
+            }
+            separate = 1;
+        }
+
+        if (len + separate + bodyLen > MAX_BATCH_LINE) {
+            break;
+        }
+
+        if (separate) {
+            line[len++] = ';';
+        }
+        memcpy(line + len, body, bodyLen + 1);
+        len += bodyLen;
+
+        /* the modem runs them back to back, so allow for all of them */
+        commandTimeout = timeoutForCommand(commands[end]);
+        if (commandTimeout == 0) {
+            infinite = 1;
+        }
+        timeoutMsec += commandTimeout;
+    }
+
+    *p_timeoutMsec = infinite ? 0 : timeoutMsec;
+
+    return end;
+}
+
+int at_send_command_batch (const char * const *commands, size_t count,
+                           int *p_results)
+{
+    ATChannel *p_channel = at_channel_current();
+    ATResponse *p_response = NULL;
+    char line[MAX_BATCH_LINE + 1];
+    long long timeoutMsec;
+    size_t start;
+    size_t end;
+    int allSucceeded;
+    int err;
+
+    for (start = 0 ; start < count ; start = end) {
+        end = p_channel->batchUnsupported ? start
+                : buildBatchLine(commands, start, count, line, &timeoutMsec);
+
+        if (end - start < 2) {
+            /* nothing to combine this one with */
+            end = start + 1;
+            err = sendSerial(commands, start, end, p_results, &allSucceeded);
+        } else {
+            err = at_send_command_full(p_channel, line, NO_RESULT, NULL, NULL,
+                                       timeoutMsec, &p_response);
+
+            if (err == 0 && p_response->success > 0) {
+                setBatchResults(p_results, start, end, 1);
+            } else if (err == 0) {
+                /*
+                 * The modem stops at the first command that fails and
+                 * doesn't say which one it was, so find out the slow way.
+                 * The commands before it have already run; callers only
+                 * batch settings, which are safe to apply twice.
+                 */
+                err = sendSerial(commands, start, end, p_results,
+                                 &allSucceeded);
+
+                if (err == 0 && allSucceeded) {
+                    RLOGI("modem rejects concatenated commands, "
+                          "sending them one at a time");
+                    p_channel->batchUnsupported = 1;
+                }
+            } else {
+                /*
+                 * Some modems never answer a line they can't parse rather
+                 * than rejecting it. Don't let that cost the rest of the
+                 * batch: resend these one at a time, and the rest too.
+                 */
+                RLOGW("concatenated commands failed (%d), "
+                      "sending them one at a time", err);
+                p_channel->batchUnsupported = 1;
+                err = sendSerial(commands, start, end, p_results,
+                                 &allSucceeded);
+            }
+
+            at_response_free(p_response);
+            p_response = NULL;
+        }
+
+        if (err < 0) {
+            setBatchResults(p_results, end, count, err);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+
+void at_set_timeout_class(ATTimeoutClass timeoutClass, long long timeoutMsec)
+{
+    if (timeoutClass < 0 || timeoutClass >= AT_TIMEOUT_NUM_CLASSES
+        || timeoutMsec < 0
+    ) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_timeoutClassMutex);
+    s_timeoutClassMsec[timeoutClass] = timeoutMsec;
+    pthread_mutex_unlock(&s_timeoutClassMutex);
+}
+
+
+/**
+ * This callback is invoked on the command thread, when the channel has
+ * stopped answering altogether (not for a single timed out command)
+ */
 void at_set_on_timeout(void (*onTimeout)(void))
 {
-    s_onTimeout = onTimeout;
+    ATChannel *p_channel = at_channel_current();
+
+    p_channel->onTimeout = onTimeout;
 }
 
 /**
@@ -879,7 +1373,9 @@ void at_set_on_timeout(void (*onTimeout)(void))
 
 void at_set_on_reader_closed(void (*onClose)(void))
 {
-    s_onReaderClosed = onClose;
+    ATChannel *p_channel = at_channel_current();
+
+    p_channel->onReaderClosed = onClose;
 }
 
 
@@ -890,33 +1386,20 @@ void at_set_on_reader_closed(void (*onClose)(void))
 
 int at_handshake()
 {
-    int i;
-    int err = 0;
+    ATChannel *p_channel = at_channel_current();
+    int err;
 
-    if (0 != pthread_equal(s_tid_reader, pthread_self())) {
+    if (0 != pthread_equal(p_channel->tid_reader, pthread_self())) {
         /* cannot be called from reader thread */
         return AT_ERROR_INVALID_THREAD;
     }
-    pthread_mutex_lock(&s_commandmutex);
+    pthread_mutex_lock(&p_channel->writeMutex);
+    pthread_mutex_lock(&p_channel->commandmutex);
 
-    for (i = 0 ; i < HANDSHAKE_RETRY_COUNT ; i++) {
-        /* some stacks start with verbose off */
-        err = at_send_command_full_nolock ("ATE0Q0V1", NO_RESULT,
-                    NULL, NULL, HANDSHAKE_TIMEOUT_MSEC, NULL);
-
-        if (err == 0) {
-            break;
-        }
-    }
-
-    if (err == 0) {
-        /* pause for a bit to let the input buffer drain any unmatched OK's
-           (they will appear as extraneous unsolicited responses) */
-
-        sleepMsec(HANDSHAKE_TIMEOUT_MSEC);
-    }
+    err = handshake_nolock(p_channel);
 
-    pthread_mutex_unlock(&s_commandmutex);
+    pthread_mutex_unlock(&p_channel->commandmutex);
+    pthread_mutex_unlock(&p_channel->writeMutex);
 
     return err;
 }
@@ -18,11 +18,15 @@
 #ifndef ATCHANNEL_H
 #define ATCHANNEL_H 1
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /* define AT_DEBUG to send AT traffic to /tmp/radio-at.log" */
+/* (for a timestamped binary capture that at-replay can play back,
+    see at_trace.h) */
 #define AT_DEBUG  0
 
 #if AT_DEBUG
@@ -70,14 +74,36 @@ typedef struct {
  * this will be called from the reader thread, so do not block
  * "s" is the line, and "sms_pdu" is either NULL or the PDU response
  * for multi-line TS 27.005 SMS PDU responses (eg +CMT:)
+ * both point into the channel's buffers and are valid only during the call
  */
 typedef void (*ATUnsolHandler)(const char *s, const char *sms_pdu);
 
+/**
+ * One AT channel: its fd, reader thread, pending command and callbacks
+ *
+ * Every at_* function below works on the calling thread's current
+ * channel. A thread that never selected one uses a built-in default
+ * channel, so a single modem needs none of this. The reader thread of a
+ * channel has it selected, so the unsolicited handler and the callbacks
+ * can issue commands on the right channel without being told.
+ */
+typedef struct ATChannel ATChannel;
+
+/** "user" is returned by at_channel_user(), NULL on allocation failure */
+ATChannel *at_channel_new(void *user);
+/** makes "p_channel" the calling thread's current channel */
+void at_channel_select(ATChannel *p_channel);
+ATChannel *at_channel_current();
+void *at_channel_user(ATChannel *p_channel);
+
 int at_open(int fd, ATUnsolHandler h);
 void at_close();
 
-/* This callback is invoked on the command thread.
-   You should reset or handshake here to avoid getting out of sync */
+/* This callback is invoked on the command thread when the channel has
+   stopped answering: a command timed out and the handshake sent before
+   the next command failed too. A single timed out command only fails
+   that command.
+   You should reset the channel here */
 void at_set_on_timeout(void (*onTimeout)(void));
 /* This callback is invoked on the reader thread (like ATUnsolHandler)
    when the input stream closes before you call at_close
@@ -107,8 +133,60 @@ int at_send_command_sms (const char *command, const char *pdu,
                             const char *responsePrefix,
                             ATResponse **pp_outResponse);
 
+/**
+ * The calls above pick a timeout for each command by its prefix: queries
+ * the modem answers from its own state (eg +CSQ, +CREG?) are
+ * AT_TIMEOUT_SHORT, commands that wait on the network (eg +COPS=?, D)
+ * are AT_TIMEOUT_LONG and everything else is AT_TIMEOUT_NORMAL.
+ */
+typedef enum {
+    AT_TIMEOUT_SHORT,
+    AT_TIMEOUT_NORMAL,
+    AT_TIMEOUT_LONG,
+    AT_TIMEOUT_NUM_CLASSES
+} ATTimeoutClass;
+
+/* Changes the duration of a timeout class; 0 means no timeout */
+void at_set_timeout_class(ATTimeoutClass timeoutClass, long long timeoutMsec);
+
+/**
+ * Issues "command" with an explicit timeout instead of its class default
+ * (timeoutMsec == 0 means no timeout). The deadline includes any time
+ * spent waiting for commands from other threads to complete; a command
+ * that times out before it is sent is not sent at all.
+ *
+ * Returns AT_ERROR_TIMEOUT on expiry; the channel stays open.
+ */
+int at_send_command_timeout (const char *command, ATCommandType type,
+                            const char *responsePrefix, long long timeoutMsec,
+                            ATResponse **pp_outResponse);
+
+/**
+ * Issues "count" commands that expect no intermediate response, in order,
+ * concatenating them onto as few command lines as possible
+ * (eg "ATE0S0=0+CMEE=1;+CREG=2") to save a round trip per command.
+ *
+ * If a concatenated line fails, its commands are reissued one at a time,
+ * so commands that already ran may run twice: only batch settings that
+ * are safe to repeat. A line that gets no answer at all (or an error) also
+ * makes the rest of the batch, and later batches, go one at a time. Dial, answer, hangup and reset are always sent on
+ * their own.
+ *
+ * If "p_results" is non-NULL, p_results[i] is set to the "success" of
+ * commands[i]'s final response (1 or 0), or to an AT_ERROR_* value if it
+ * could not be completed.
+ *
+ * returns 0 if every command got a final response, or the AT_ERROR_*
+ * that stopped the batch
+ */
+int at_send_command_batch (const char * const *commands, size_t count,
+                           int *p_results);
+
 void at_response_free(ATResponse *p_response);
 
+/** returns a deep copy of a completed response, free it with at_response_free */
+ATResponse *at_response_dup(const ATResponse *p_response);
+
 typedef enum {
     CME_ERROR_NON_CME = -1,
     CME_SUCCESS = 0,
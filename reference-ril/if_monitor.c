@@ -0,0 +1,637 @@
+/* //device/system/reference-ril/if_monitor.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include "if_monitor.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "RIL"
+#include <utils/Log.h>
+
+#define MAX_INTERFACES      16
+#define MAX_IF_ADDRS        4
+#define IF_ADDR_MAX         (INET6_ADDRSTRLEN + 4)  /* "address/prefix" */
+
+#define RECV_BUFFER_SIZE    8192
+#define ACK_TIMEOUT_MSEC    2000
+#define SYNC_TIMEOUT_MSEC   2000
+
+typedef struct {
+    int index;          /* 0 for a free slot */
+    char name[IFNAMSIZ];
+    unsigned flags;
+    int mtu;
+    int numAddrs;
+    char addrs[MAX_IF_ADDRS][IF_ADDR_MAX];
+} Interface;
+
+/*
+ * |s_mutex| guards everything below. The listener thread is the only
+ * reader of |s_fd|; requests are written to it from any thread, and the
+ * listener hands their acknowledgements back through |s_cond|.
+ */
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+
+/* one request at a time, so acks can't cross */
+static pthread_mutex_t s_requestMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static Interface s_interfaces[MAX_INTERFACES];
+static int s_fd = -1;
+static IFMonitorChangedCallback s_onChanged;
+static int s_synced = 0;        /* table holds a full dump */
+
+static uint32_t s_seq = 0;
+static uint32_t s_dumpSeq = 0;  /* dump in progress, or 0 */
+static int s_dumpType;          /* RTM_GETLINK or RTM_GETADDR */
+static uint32_t s_ackSeq = 0;   /* request waiting for its ack, or 0 */
+static int s_ackError;
+
+static pthread_t s_tid_listener;
+
+static void deadlineAfter(struct timespec *p_ts, long long msec)
+{
+    clock_gettime(CLOCK_REALTIME, p_ts);
+
+    p_ts->tv_sec += msec / 1000;
+    p_ts->tv_nsec += (msec % 1000) * 1000000;
+
+    if (p_ts->tv_nsec >= 1000000000) {
+        p_ts->tv_sec++;
+        p_ts->tv_nsec -= 1000000000;
+    }
+}
+
+static Interface *findByIndex_locked(int index)
+{
+    int i;
+
+    for (i = 0; i < MAX_INTERFACES; i++) {
+        if (s_interfaces[i].index == index) {
+            return &s_interfaces[i];
+        }
+    }
+
+    return NULL;
+}
+
+static Interface *findByName_locked(const char *name)
+{
+    int i;
+
+    for (i = 0; i < MAX_INTERFACES; i++) {
+        if (s_interfaces[i].index != 0
+            && strcmp(s_interfaces[i].name, name) == 0
+        ) {
+            return &s_interfaces[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** called with s_mutex held */
+static int sendRequest_locked(struct nlmsghdr *p_nh)
+{
+    struct sockaddr_nl kernel;
+    ssize_t written;
+
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    p_nh->nlmsg_seq = ++s_seq;
+
+    /* 0 marks "none" in s_dumpSeq and s_ackSeq */
+    if (p_nh->nlmsg_seq == 0) {
+        p_nh->nlmsg_seq = ++s_seq;
+    }
+
+    do {
+        written = sendto(s_fd, p_nh, p_nh->nlmsg_len, 0,
+                         (struct sockaddr *)&kernel, sizeof(kernel));
+    } while (written < 0 && errno == EINTR);
+
+    if (written < 0) {
+        RLOGE("if_monitor: netlink send failed: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/** called with s_mutex held */
+static int requestDump_locked(int type)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct rtgenmsg gen;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.gen));
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.gen.rtgen_family = AF_UNSPEC;
+
+    if (sendRequest_locked(&req.nh) < 0) {
+        return -1;
+    }
+
+    s_dumpSeq = req.nh.nlmsg_seq;
+    s_dumpType = type;
+
+    return 0;
+}
+
+/**
+ * Throws the table away and reads it again, links first so that
+ * addresses have somewhere to go
+ * called with s_mutex held
+ */
+static void resync_locked()
+{
+    memset(s_interfaces, 0, sizeof(s_interfaces));
+    s_synced = 0;
+
+    if (requestDump_locked(RTM_GETLINK) < 0) {
+        s_dumpSeq = 0;
+    }
+}
+
+/** returns 1 if the table changed */
+static int handleLink_locked(const struct nlmsghdr *p_nh, char *changed)
+{
+    const struct ifinfomsg *ifi = NLMSG_DATA(p_nh);
+    const struct rtattr *rta;
+    int rtalen = IFLA_PAYLOAD(p_nh);
+    const char *name = NULL;
+    int mtu = 0;
+    Interface *p_if;
+
+    for (rta = IFLA_RTA(ifi); RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            name = RTA_DATA(rta);
+        } else if (rta->rta_type == IFLA_MTU) {
+            mtu = *(const uint32_t *)RTA_DATA(rta);
+        }
+    }
+
+    p_if = findByIndex_locked(ifi->ifi_index);
+
+    if (p_nh->nlmsg_type == RTM_DELLINK) {
+        if (p_if == NULL) {
+            return 0;
+        }
+
+        strlcpy(changed, p_if->name, IFNAMSIZ);
+        memset(p_if, 0, sizeof(*p_if));
+
+        return 1;
+    }
+
+    if (p_if == NULL) {
+        p_if = findByIndex_locked(0);
+
+        if (p_if == NULL) {
+            RLOGE("if_monitor: too many interfaces, ignoring %s",
+                  name ? name : "?");
+            return 0;
+        }
+
+        p_if->index = ifi->ifi_index;
+    } else if ((name == NULL || strcmp(name, p_if->name) == 0)
+               && ifi->ifi_flags == p_if->flags
+               && (mtu == 0 || mtu == p_if->mtu)
+    ) {
+        return 0;
+    }
+
+    if (name != NULL) {
+        strlcpy(p_if->name, name, sizeof(p_if->name));
+    }
+    p_if->flags = ifi->ifi_flags;
+    if (mtu != 0) {
+        p_if->mtu = mtu;
+    }
+
+    strlcpy(changed, p_if->name, IFNAMSIZ);
+
+    return 1;
+}
+
+/** returns 1 if the table changed */
+static int handleAddr_locked(const struct nlmsghdr *p_nh, char *changed)
+{
+    const struct ifaddrmsg *ifa = NLMSG_DATA(p_nh);
+    const struct rtattr *rta;
+    int rtalen = IFA_PAYLOAD(p_nh);
+    const void *addr = NULL;
+    char str[INET6_ADDRSTRLEN];
+    char entry[IF_ADDR_MAX];
+    Interface *p_if;
+    int i;
+
+    p_if = findByIndex_locked(ifa->ifa_index);
+
+    /* link-local (and host) addresses aren't anything a data call has */
+    if (p_if == NULL || ifa->ifa_scope >= RT_SCOPE_LINK) {
+        return 0;
+    }
+
+    for (rta = IFA_RTA(ifa); RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+        /* for point-to-point links IFA_ADDRESS is the peer */
+        if (rta->rta_type == IFA_LOCAL
+            || (rta->rta_type == IFA_ADDRESS && addr == NULL)
+        ) {
+            addr = RTA_DATA(rta);
+        }
+    }
+
+    if (addr == NULL
+        || inet_ntop(ifa->ifa_family, addr, str, sizeof(str)) == NULL
+    ) {
+        return 0;
+    }
+
+    /* IPv4 link-local is often configured with global scope */
+    if (ifa->ifa_family == AF_INET && strncmp(str, "169.254.", 8) == 0) {
+        return 0;
+    }
+
+    snprintf(entry, sizeof(entry), "%s/%d", str, ifa->ifa_prefixlen);
+
+    for (i = 0; i < p_if->numAddrs && strcmp(p_if->addrs[i], entry); i++);
+
+    if (p_nh->nlmsg_type == RTM_DELADDR) {
+        if (i == p_if->numAddrs) {
+            return 0;
+        }
+
+        p_if->numAddrs--;
+        memmove(p_if->addrs[i], p_if->addrs[i + 1],
+                (p_if->numAddrs - i) * sizeof(p_if->addrs[0]));
+    } else {
+        if (i < p_if->numAddrs) {
+            return 0;
+        }
+
+        if (p_if->numAddrs == MAX_IF_ADDRS) {
+            RLOGE("if_monitor: too many addresses on %s, ignoring %s",
+                  p_if->name, entry);
+            return 0;
+        }
+
+        strlcpy(p_if->addrs[p_if->numAddrs++], entry, IF_ADDR_MAX);
+    }
+
+    strlcpy(changed, p_if->name, IFNAMSIZ);
+
+    return 1;
+}
+
+/** called with s_mutex held, when dump s_dumpSeq has finished */
+static void dumpDone_locked()
+{
+    s_dumpSeq = 0;
+
+    if (s_dumpType == RTM_GETLINK && requestDump_locked(RTM_GETADDR) == 0) {
+        return;
+    }
+
+    s_synced = 1;
+    pthread_cond_broadcast(&s_cond);
+}
+
+/**
+ * Applies one netlink message to the table
+ * returns 1 if the listener should report a change, with the interface
+ * name in "changed" (empty after a resync)
+ */
+static int handleMessage_locked(const struct nlmsghdr *p_nh, char *changed)
+{
+    changed[0] = '\0';
+
+    switch (p_nh->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            return handleLink_locked(p_nh, changed);
+
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            return handleAddr_locked(p_nh, changed);
+
+        case NLMSG_ERROR:
+            if (p_nh->nlmsg_seq == s_ackSeq && s_ackSeq != 0) {
+                const struct nlmsgerr *err = NLMSG_DATA(p_nh);
+
+                s_ackError = err->error;
+                s_ackSeq = 0;
+                pthread_cond_broadcast(&s_cond);
+                return 0;
+            }
+            /* a failed dump ends there */
+            /* fall through */
+        case NLMSG_DONE:
+            if (p_nh->nlmsg_seq == s_dumpSeq && s_dumpSeq != 0) {
+                dumpDone_locked();
+                /* once the table is whole again, say so */
+                return s_synced && s_onChanged != NULL;
+            }
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+static void *listenerLoop(void *arg __unused)
+{
+    char buf[RECV_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+    char changed[IFNAMSIZ];
+    struct sockaddr_nl from;
+    socklen_t fromLen;
+    const struct nlmsghdr *p_nh;
+    IFMonitorChangedCallback onChanged;
+    ssize_t len;
+    int remaining;
+    int report;
+
+    for (;;) {
+        fromLen = sizeof(from);
+
+        do {
+            len = recvfrom(s_fd, buf, sizeof(buf), 0,
+                           (struct sockaddr *)&from, &fromLen);
+        } while (len < 0 && errno == EINTR);
+
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                /* the kernel dropped events, so the table can't be trusted */
+                RLOGW("if_monitor: netlink overrun, rereading interfaces");
+
+                pthread_mutex_lock(&s_mutex);
+                resync_locked();
+                pthread_mutex_unlock(&s_mutex);
+                continue;
+            }
+
+            RLOGE("if_monitor: netlink receive failed: %s", strerror(errno));
+            break;
+        }
+
+        if (from.nl_pid != 0) {
+            /* only the kernel gets to change the table */
+            continue;
+        }
+
+        remaining = (int)len;
+
+        for (p_nh = (const struct nlmsghdr *)buf
+                ; NLMSG_OK(p_nh, remaining)
+                ; p_nh = NLMSG_NEXT(p_nh, remaining)
+        ) {
+            pthread_mutex_lock(&s_mutex);
+
+            report = handleMessage_locked(p_nh, changed);
+            onChanged = s_onChanged;
+
+            pthread_mutex_unlock(&s_mutex);
+
+            if (report && onChanged != NULL) {
+                onChanged(changed[0] != '\0' ? changed : NULL);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&s_mutex);
+
+    close(s_fd);
+    s_fd = -1;
+    s_ackSeq = 0;
+    s_ackError = -EIO;
+    pthread_cond_broadcast(&s_cond);
+
+    pthread_mutex_unlock(&s_mutex);
+
+    return NULL;
+}
+
+int if_monitor_start(IFMonitorChangedCallback onChanged)
+{
+    struct sockaddr_nl local;
+    struct timespec deadline;
+    pthread_attr_t attr;
+    int fd;
+    int ret;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (fd < 0) {
+        RLOGE("if_monitor: unable to open netlink socket: %s",
+              strerror(errno));
+        return -1;
+    }
+
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        RLOGE("if_monitor: unable to bind netlink socket: %s",
+              strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_fd >= 0) {
+        pthread_mutex_unlock(&s_mutex);
+        close(fd);
+        return -1;
+    }
+
+    s_fd = fd;
+    resync_locked();
+
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    ret = pthread_create(&s_tid_listener, &attr, listenerLoop, NULL);
+
+    if (ret != 0) {
+        RLOGE("if_monitor: unable to start listener: %s", strerror(ret));
+        close(s_fd);
+        s_fd = -1;
+        pthread_mutex_unlock(&s_mutex);
+        return -1;
+    }
+
+    /* callers expect the table to be filled in once this returns */
+    deadlineAfter(&deadline, SYNC_TIMEOUT_MSEC);
+
+    while (!s_synced && s_fd >= 0) {
+        if (pthread_cond_timedwait(&s_cond, &s_mutex, &deadline) == ETIMEDOUT) {
+            RLOGW("if_monitor: interface table still incomplete");
+            break;
+        }
+    }
+
+    s_onChanged = onChanged;
+
+    pthread_mutex_unlock(&s_mutex);
+
+    return 0;
+}
+
+int if_monitor_running()
+{
+    return s_fd >= 0;
+}
+
+int if_monitor_get(const char *ifname, unsigned *p_flags, int *p_mtu,
+                   char *addresses, size_t size)
+{
+    Interface *p_if;
+    size_t len = 0;
+    int i;
+
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_fd < 0) {
+        pthread_mutex_unlock(&s_mutex);
+        return IF_MONITOR_ERROR_NOT_RUNNING;
+    }
+
+    p_if = findByName_locked(ifname);
+
+    if (p_if == NULL) {
+        pthread_mutex_unlock(&s_mutex);
+        return IF_MONITOR_ERROR_NO_INTERFACE;
+    }
+
+    if (p_flags != NULL) {
+        *p_flags = p_if->flags;
+    }
+
+    if (p_mtu != NULL) {
+        *p_mtu = p_if->mtu;
+    }
+
+    if (addresses != NULL && size > 0) {
+        addresses[0] = '\0';
+
+        for (i = 0; i < p_if->numAddrs; i++) {
+            int n = snprintf(addresses + len, size - len, "%s%s",
+                             i > 0 ? " " : "", p_if->addrs[i]);
+
+            if (n < 0 || (size_t)n >= size - len) {
+                /* don't leave half an address behind */
+                addresses[len] = '\0';
+                break;
+            }
+
+            len += n;
+        }
+    }
+
+    pthread_mutex_unlock(&s_mutex);
+
+    return 0;
+}
+
+int if_monitor_set_up(const char *ifname, int up)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } req;
+    struct timespec deadline;
+    Interface *p_if;
+    uint32_t seq;
+    int ret = 0;
+
+    pthread_mutex_lock(&s_requestMutex);
+    pthread_mutex_lock(&s_mutex);
+
+    if (s_fd < 0) {
+        ret = IF_MONITOR_ERROR_NOT_RUNNING;
+        goto done;
+    }
+
+    p_if = findByName_locked(ifname);
+
+    if (p_if == NULL) {
+        ret = IF_MONITOR_ERROR_NO_INTERFACE;
+        goto done;
+    }
+
+    if (!(p_if->flags & IFF_UP) == !up) {
+        // Interface already in desired state
+        goto done;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nh.nlmsg_type = RTM_NEWLINK;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req.ifi.ifi_family = AF_UNSPEC;
+    req.ifi.ifi_index = p_if->index;
+    req.ifi.ifi_flags = up ? IFF_UP : 0;
+    req.ifi.ifi_change = IFF_UP;
+
+    if (sendRequest_locked(&req.nh) < 0) {
+        ret = IF_MONITOR_ERROR_GENERIC;
+        goto done;
+    }
+
+    seq = s_ackSeq = req.nh.nlmsg_seq;
+    deadlineAfter(&deadline, ACK_TIMEOUT_MSEC);
+
+    while (s_ackSeq == seq) {
+        if (pthread_cond_timedwait(&s_cond, &s_mutex, &deadline) == ETIMEDOUT) {
+            RLOGE("if_monitor: no answer setting %s %s", ifname,
+                  up ? "up" : "down");
+            s_ackSeq = 0;
+            ret = IF_MONITOR_ERROR_GENERIC;
+            goto done;
+        }
+    }
+
+    if (s_ackError != 0) {
+        RLOGE("if_monitor: failed to set %s %s: %s", ifname,
+              up ? "up" : "down", strerror(-s_ackError));
+        ret = IF_MONITOR_ERROR_GENERIC;
+    }
+
+done:
+    pthread_mutex_unlock(&s_mutex);
+    pthread_mutex_unlock(&s_requestMutex);
+    return ret;
+}
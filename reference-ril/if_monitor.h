@@ -0,0 +1,78 @@
+/* //device/system/reference-ril/if_monitor.h
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef IF_MONITOR_H
+#define IF_MONITOR_H 1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * In-memory table of the network interfaces, kept current by an rtnetlink
+ * listener thread.
+ *
+ * The table holds each interface's flags, MTU and global addresses
+ * (link-local ones are left out), so callers can look them up without a
+ * syscall. Interface up/down requests go out
+ * over the same netlink socket.
+ */
+
+#define IF_MONITOR_ERROR_GENERIC        -1
+#define IF_MONITOR_ERROR_NO_INTERFACE   -2
+#define IF_MONITOR_ERROR_NOT_RUNNING    -3
+
+/**
+ * Called on the listener thread when an interface appears, disappears or
+ * changes flags, MTU or addresses
+ */
+typedef void (*IFMonitorChangedCallback)(const char *ifname);
+
+/**
+ * Reads the current interfaces and starts listening for changes
+ * returns 0 on success, -1 on error
+ */
+int if_monitor_start(IFMonitorChangedCallback onChanged);
+
+/** returns 1 if the listener is running */
+int if_monitor_running();
+
+/**
+ * Looks up "ifname"; any of the out parameters may be NULL
+ *
+ * The addresses are written to "addresses" as a space separated list of
+ * "address/prefix" entries, truncated to fit "size"
+ *
+ * returns 0 on success or IF_MONITOR_ERROR_*
+ */
+int if_monitor_get(const char *ifname, unsigned *p_flags, int *p_mtu,
+                   char *addresses, size_t size);
+
+/**
+ * Brings "ifname" up (up != 0) or down, and waits for the kernel to
+ * acknowledge it
+ * returns 0 on success or IF_MONITOR_ERROR_*
+ */
+int if_monitor_set_up(const char *ifname, int up);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*IF_MONITOR_H*/
@@ -14,9 +14,8 @@
 ** See the License for the specific language governing permissions and
 ** limitations under the License.
 */
-#include <sys/system_properties.h>
-
 #include "misc.h"
+
 /** returns 1 if line starts with prefix, 0 if it does not */
 int strStartsWith(const char *line, const char *prefix)
 {
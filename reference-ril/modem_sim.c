@@ -0,0 +1,1104 @@
+/* //device/system/reference-ril/modem_sim.c
+**
+** Copyright 2026, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * at-modem-sim: a simulated 27.007 modem for host-side load testing of
+ * reference-ril. It listens on a TCP port on localhost, which is what
+ * "reference-ril -p <port>" connects to, and answers the AT commands that
+ * reference-ril issues (call control, registration, signal, PDP contexts,
+ * SIM, +CTEC and PDU mode SMS).
+ *
+ * Load shaping:
+ *   -l/-j  fixed and random extra latency before every reply
+ *   -e     percentage of commands that fail with +CME ERROR
+ *   -u/-U  unsolicited storm rate (lines per second) and kinds
+ *   -r     random seed, so a given configuration is reproducible
+ *
+ * A script (-f) may override replies and schedule unsolicited lines:
+ *
+ *   # comment
+ *   reply AT+CSQ +CSQ: 20,99|OK      reply lines, separated by '|'
+ *   at 5000 +CREG: 1,"00C3","0000A1B2"  unsolicited line 5s after connect
+ *   at 8000 incoming 5551212          incoming call (sends RING)
+ *
+ * The server handles one client at a time and accepts a new one when the
+ * RIL reconnects.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LINE            (8 * 1024)
+#define MAX_CALLS           7
+#define MAX_CONTEXTS        4
+#define MAX_RULES           64
+#define MAX_EVENTS          256
+
+/* time for an MO call to go dialing -> alerting -> active */
+#define DIAL_ALERT_MSEC     1000
+#define DIAL_ANSWER_MSEC    3000
+
+/* TS 23.040 SMS-DELIVER, SMSC address included */
+#define SAMPLE_DELIVER_PDU \
+    "07911326040000F0040B911346610089F60000208062917314080CC8F71D14969741F977FD07"
+#define SAMPLE_DELIVER_TPDU_LEN 30
+
+typedef enum {
+    STORM_CREG  = 1 << 0,
+    STORM_CGREG = 1 << 1,
+    STORM_CGEV  = 1 << 2,
+    STORM_RING  = 1 << 3,
+    STORM_CMT   = 1 << 4,
+    STORM_CBM   = 1 << 5,
+    STORM_CSQ   = 1 << 6,
+} StormKind;
+
+static const struct {
+    const char *name;
+    StormKind kind;
+} s_stormNames[] = {
+    { "creg",  STORM_CREG },
+    { "cgreg", STORM_CGREG },
+    { "cgev",  STORM_CGEV },
+    { "ring",  STORM_RING },
+    { "cmt",   STORM_CMT },
+    { "cbm",   STORM_CBM },
+    { "csq",   STORM_CSQ },
+};
+
+typedef struct {
+    int index;          /* 0 if unused */
+    int isMT;
+    int state;          /* +CLCC <stat> */
+    char number[32];
+    long long changeAt; /* when a dialing call next changes state */
+} SimCall;
+
+typedef struct {
+    int defined;
+    int active;
+    char type[16];
+    char apn[64];
+} SimContext;
+
+typedef struct {
+    char *prefix;
+    char *reply;        /* '|' separated */
+} ScriptRule;
+
+typedef struct {
+    long long at;       /* msec after connect */
+    char *line;         /* NULL for an incoming call */
+    char *number;
+    int fired;
+} ScriptEvent;
+
+/* configuration */
+static int s_port = -1;
+static int s_latencyMs;
+static int s_jitterMs;
+static int s_errorPercent;
+static double s_stormRate;
+static int s_stormKinds = STORM_CREG;
+static unsigned int s_seed = 1;
+static const char *s_simState = "READY";
+
+static ScriptRule s_rules[MAX_RULES];
+static int s_ruleCount;
+static ScriptEvent s_events[MAX_EVENTS];
+static int s_eventCount;
+
+/* modem state, reset for each client */
+static int s_fd = -1;
+static int s_cfun;
+static int s_cmeeMode;
+static int s_cregMode;
+static int s_cgregMode;
+static int s_copsFormat;
+static int s_currentTech;
+static int s_preferredTech;
+static int s_messageRef;
+static int s_smsPending;    /* expecting a PDU terminated by ^Z */
+static int s_smsIsWrite;
+static SimCall s_calls[MAX_CALLS];
+static SimContext s_contexts[MAX_CONTEXTS + 1];
+static long long s_connectTime;
+static long long s_nextStorm;
+static int s_stormCounter;
+
+static unsigned long s_commandCount;
+static unsigned long s_unsolCount;
+static unsigned long s_errorCount;
+
+static long long nowMs()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static void sleepMs(int msec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000L;
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+static void writeAll(const char *buf, size_t len)
+{
+    ssize_t written;
+
+    while (len > 0 && s_fd >= 0) {
+        do {
+            written = write(s_fd, buf, len);
+        } while (written < 0 && errno == EINTR);
+
+        if (written <= 0) {
+            return;
+        }
+
+        buf += written;
+        len -= written;
+    }
+}
+
+/** sends "\r\n<line>\r\n" */
+static void sendLine(const char *fmt, ...)
+{
+    char buf[MAX_LINE];
+    va_list ap;
+    int len;
+
+    buf[0] = '\r';
+    buf[1] = '\n';
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf + 2, sizeof(buf) - 4, fmt, ap);
+    va_end(ap);
+
+    if (len < 0) return;
+    if (len > (int)sizeof(buf) - 5) len = sizeof(buf) - 5;
+
+    buf[len + 2] = '\r';
+    buf[len + 3] = '\n';
+
+    writeAll(buf, len + 4);
+}
+
+static void sendUnsolicited(const char *line)
+{
+    s_unsolCount++;
+    sendLine("%s", line);
+}
+
+/*** calls ***/
+
+static SimCall *addCall(int isMT, int state, const char *number)
+{
+    int i;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        if (s_calls[i].index == 0) {
+            s_calls[i].index = i + 1;
+            s_calls[i].isMT = isMT;
+            s_calls[i].state = state;
+            snprintf(s_calls[i].number, sizeof(s_calls[i].number), "%s", number);
+            s_calls[i].changeAt = nowMs() + DIAL_ALERT_MSEC;
+            return &s_calls[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int countCallsInState(int state)
+{
+    int i;
+    int count = 0;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        if (s_calls[i].index != 0 && s_calls[i].state == state) count++;
+    }
+
+    return count;
+}
+
+static int hasCallInState(int state)
+{
+    return countCallsInState(state) > 0;
+}
+
+static void releaseCallsInState(int state)
+{
+    int i;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        if (s_calls[i].index != 0 && s_calls[i].state == state) {
+            s_calls[i].index = 0;
+        }
+    }
+}
+
+static void setCallsState(int from, int to)
+{
+    int i;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        if (s_calls[i].index != 0 && s_calls[i].state == from) {
+            s_calls[i].state = to;
+        }
+    }
+}
+
+/** advances MO calls through dialing -> alerting -> active */
+static void advanceCalls(long long now)
+{
+    int i;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        SimCall *call = &s_calls[i];
+
+        if (call->index == 0 || call->isMT || now < call->changeAt) continue;
+
+        if (call->state == 2) {
+            call->state = 3;
+            call->changeAt = now + (DIAL_ANSWER_MSEC - DIAL_ALERT_MSEC);
+        } else if (call->state == 3) {
+            call->state = 0;
+        }
+    }
+}
+
+/** +CHLD, 22.030 6.5.5 */
+static int doChld(const char *arg)
+{
+    int n = atoi(arg);
+
+    if (arg[0] == '0') {
+        if (hasCallInState(5)) releaseCallsInState(5);
+        else releaseCallsInState(1);
+    } else if (arg[0] == '1' && arg[1] == '\0') {
+        releaseCallsInState(0);
+        if (hasCallInState(5)) setCallsState(5, 0);
+        else setCallsState(1, 0);
+    } else if (arg[0] == '1') {
+        if (n % 10 < 1 || n % 10 > MAX_CALLS) return -1;
+        s_calls[n % 10 - 1].index = 0;
+    } else if (arg[0] == '2' && arg[1] == '\0') {
+        setCallsState(0, 9);
+        if (hasCallInState(5)) setCallsState(5, 0);
+        else setCallsState(1, 0);
+        setCallsState(9, 1);
+    } else if (arg[0] == '2') {
+        /* split one call out of a conference: it stays active, rest held */
+        setCallsState(0, 1);
+        if (n % 10 < 1 || n % 10 > MAX_CALLS || s_calls[n % 10 - 1].index == 0) {
+            return -1;
+        }
+        s_calls[n % 10 - 1].state = 0;
+    } else if (arg[0] == '3') {
+        setCallsState(1, 0);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*** command handlers ***/
+
+static int fail(int cme)
+{
+    return -cme;
+}
+
+static const char *skipTo(const char *cmd, char c)
+{
+    const char *p = strchr(cmd, c);
+    return p == NULL ? "" : p + 1;
+}
+
+static void copyUnquoted(char *out, size_t outLen, const char *in)
+{
+    size_t i = 0;
+
+    if (*in == '"') in++;
+    while (*in != '\0' && *in != '"' && *in != ',' && i + 1 < outLen) {
+        out[i++] = *in++;
+    }
+    out[i] = '\0';
+}
+
+static int doCgdcont(const char *arg)
+{
+    int cid = atoi(arg);
+    const char *p;
+
+    if (cid < 1 || cid > MAX_CONTEXTS) return fail(50);
+
+    p = skipTo(arg, ',');
+    if (*p == '\0') {
+        s_contexts[cid].defined = 0;
+        return 0;
+    }
+
+    s_contexts[cid].defined = 1;
+    copyUnquoted(s_contexts[cid].type, sizeof(s_contexts[cid].type), p);
+    copyUnquoted(s_contexts[cid].apn, sizeof(s_contexts[cid].apn), skipTo(p, ','));
+
+    return 0;
+}
+
+static int doCgact(const char *arg)
+{
+    int state = atoi(arg);
+    const char *p = skipTo(arg, ',');
+    int cid;
+
+    for (cid = 1; cid <= MAX_CONTEXTS; cid++) {
+        if (*p != '\0' && atoi(p) != cid) continue;
+        if (!s_contexts[cid].defined) continue;
+
+        if (s_contexts[cid].active != state) {
+            s_contexts[cid].active = state;
+            sendUnsolicited(state ? "+CGEV: ME PDN ACT 1" : "+CGEV: ME PDN DEACT 1");
+        }
+    }
+
+    return 0;
+}
+
+static void sendCsq()
+{
+    /* RIL_SignalStrength_v10 as 14 ints, GW part first */
+    sendLine("+CSQ: %d,99,-1,-1,-1,-1,-1,99,-1,-1,-1,2147483647,2147483647,-1",
+             10 + rand_r(&s_seed) % 20);
+}
+
+static void sendRegistration(const char *name, int mode)
+{
+    if (mode == 2) {
+        sendLine("%s %d,1,\"00C3\",\"0000A1B2\"", name, mode);
+    } else {
+        sendLine("%s %d,1", name, mode);
+    }
+}
+
+/**
+ * Handles a single extended command such as "+CSQ" or "+CREG=2"
+ * returns 0 for OK, 1 if the reply is deferred (SMS prompt),
+ * -1 for ERROR and -n for +CME ERROR: n
+ */
+static int handleExtended(const char *cmd)
+{
+    const char *arg = skipTo(cmd, '=');
+    int i;
+
+    if (!strcmp(cmd, "+CSQ")) {
+        sendCsq();
+    } else if (!strcmp(cmd, "+CPIN?")) {
+        if (!strcmp(s_simState, "ABSENT")) return fail(10);
+        sendLine("+CPIN: %s", s_simState);
+    } else if (!strncmp(cmd, "+CPIN=", 6)) {
+        s_simState = "READY";
+    } else if (!strcmp(cmd, "+CFUN?")) {
+        sendLine("+CFUN: %d", s_cfun);
+    } else if (!strncmp(cmd, "+CFUN=", 6)) {
+        s_cfun = atoi(arg);
+    } else if (!strcmp(cmd, "+CMEE?")) {
+        sendLine("+CMEE: %d", s_cmeeMode);
+    } else if (!strncmp(cmd, "+CMEE=", 6)) {
+        s_cmeeMode = atoi(arg);
+    } else if (!strcmp(cmd, "+CREG?")) {
+        sendRegistration("+CREG:", s_cregMode);
+    } else if (!strncmp(cmd, "+CREG=", 6)) {
+        s_cregMode = atoi(arg);
+    } else if (!strcmp(cmd, "+CGREG?")) {
+        sendRegistration("+CGREG:", s_cgregMode);
+    } else if (!strncmp(cmd, "+CGREG=", 7)) {
+        s_cgregMode = atoi(arg);
+    } else if (!strcmp(cmd, "+COPS?")) {
+        static const char *names[] = { "Android Sim", "Android", "310260" };
+        sendLine("+COPS: 0,%d,\"%s\"", s_copsFormat, names[s_copsFormat % 3]);
+    } else if (!strncmp(cmd, "+COPS=", 6)) {
+        if (arg[0] == '3') s_copsFormat = atoi(skipTo(arg, ','));
+    } else if (!strcmp(cmd, "+CLCC")) {
+        for (i = 0; i < MAX_CALLS; i++) {
+            if (s_calls[i].index == 0) continue;
+            sendLine("+CLCC: %d,%d,%d,0,%d,\"%s\",129", s_calls[i].index,
+                     s_calls[i].isMT, s_calls[i].state,
+                     s_calls[i].state == 0 && countCallsInState(0) > 1,
+                     s_calls[i].number);
+        }
+    } else if (!strncmp(cmd, "+CHLD=", 6)) {
+        return doChld(arg);
+    } else if (!strcmp(cmd, "+CGACT?")) {
+        for (i = 1; i <= MAX_CONTEXTS; i++) {
+            if (s_contexts[i].defined) {
+                sendLine("+CGACT: %d,%d", i, s_contexts[i].active);
+            }
+        }
+    } else if (!strncmp(cmd, "+CGACT=", 7)) {
+        return doCgact(arg);
+    } else if (!strcmp(cmd, "+CGDCONT?")) {
+        for (i = 1; i <= MAX_CONTEXTS; i++) {
+            if (s_contexts[i].defined) {
+                sendLine("+CGDCONT: %d,\"%s\",\"%s\",\"10.0.2.%d/24\",0,0", i,
+                         s_contexts[i].type, s_contexts[i].apn, 14 + i);
+            }
+        }
+    } else if (!strncmp(cmd, "+CGDCONT=", 9)) {
+        return doCgdcont(arg);
+    } else if (!strcmp(cmd, "+CTEC?")) {
+        sendLine("+CTEC: %d,\"%x\"", s_currentTech, s_preferredTech);
+    } else if (!strcmp(cmd, "+CTEC=?")) {
+        sendLine("+CTEC: 0,1,2,3,4");
+    } else if (!strncmp(cmd, "+CTEC=", 6)) {
+        s_currentTech = atoi(arg);
+        s_preferredTech = (int)strtol(skipTo(arg, '"'), NULL, 16);
+        sendLine("+CTEC: DONE");
+    } else if (!strcmp(cmd, "+CGSN")) {
+        sendLine("000000000000000");
+    } else if (!strcmp(cmd, "+CIMI")) {
+        sendLine("310260000000000");
+    } else if (!strncmp(cmd, "+CRSM=", 6)) {
+        sendLine("+CRSM: 144,0,\"\"");
+    } else if (!strncmp(cmd, "+CSMS=", 6)) {
+        sendLine("+CSMS: 1,1,1");
+    } else if (!strncmp(cmd, "+CMGS=", 6) || !strncmp(cmd, "+CMGW=", 6)) {
+        s_smsPending = 1;
+        s_smsIsWrite = !strncmp(cmd, "+CMGW=", 6);
+        writeAll("> ", 2);
+        return 1;
+    } else if (!strcmp(cmd, "+WNAM")) {
+        /* we are a GSM modem */
+        return -1;
+    } else if (cmd[0] != '+' && cmd[0] != '%') {
+        return -1;
+    }
+
+    /* everything else that looks like a setting is accepted */
+    return 0;
+}
+
+/** handles the basic (non '+') part of a command line */
+static int handleBasic(const char *body)
+{
+    switch (toupper(body[0])) {
+        case 'D': {
+            char number[32];
+            size_t len = strcspn(body + 1, ";");
+
+            if (!strncmp(body + 1, "*99", 3)) {
+                /* packet data on context 1 */
+                if (!s_contexts[1].defined) return fail(50);
+                return doCgact("1,1");
+            }
+
+            if (len >= sizeof(number)) len = sizeof(number) - 1;
+            memcpy(number, body + 1, len);
+            number[len] = '\0';
+
+            return addCall(0, 2, number) == NULL ? -1 : 0;
+        }
+
+        case 'A':
+            if (!hasCallInState(4)) return -1;
+            setCallsState(0, 1);
+            setCallsState(4, 0);
+            return 0;
+
+        case 'H':
+            releaseCallsInState(4);
+            releaseCallsInState(5);
+            return 0;
+
+        default:
+            /* E0Q0V1, S0=0 and friends */
+            return 0;
+    }
+}
+
+static void sendFinal(int result)
+{
+    if (result == 0) {
+        sendLine("OK");
+    } else if (result == -1) {
+        s_errorCount++;
+        sendLine("ERROR");
+    } else {
+        s_errorCount++;
+        sendLine("+CME ERROR: %d", -result);
+    }
+}
+
+static int applyScript(const char *line)
+{
+    int i;
+    char *copy, *p, *next;
+
+    for (i = 0; i < s_ruleCount; i++) {
+        if (strncasecmp(line, s_rules[i].prefix, strlen(s_rules[i].prefix))) {
+            continue;
+        }
+
+        copy = strdup(s_rules[i].reply);
+        for (p = copy; p != NULL; p = next) {
+            next = strchr(p, '|');
+            if (next != NULL) *next++ = '\0';
+            sendLine("%s", p);
+        }
+        free(copy);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static void handleSmsPdu(const char *pdu)
+{
+    s_smsPending = 0;
+
+    if (*pdu == '\0' || strspn(pdu, "0123456789abcdefABCDEF") != strlen(pdu)) {
+        sendFinal(fail(304));
+        return;
+    }
+
+    if (s_smsIsWrite) {
+        sendLine("+CMGW: %d", ++s_messageRef);
+    } else {
+        sendLine("+CMGS: %d", ++s_messageRef);
+    }
+    sendFinal(0);
+}
+
+static void handleCommandLine(char *line)
+{
+    char *body, *cmd, *next;
+    int result = 0;
+
+    s_commandCount++;
+
+    if (s_latencyMs > 0 || s_jitterMs > 0) {
+        sleepMs(s_latencyMs + (s_jitterMs > 0 ? rand_r(&s_seed) % s_jitterMs : 0));
+    }
+
+    if (strncasecmp(line, "AT", 2) != 0) {
+        /* eg a stray \n. Real modems ignore these */
+        return;
+    }
+
+    if (applyScript(line)) {
+        return;
+    }
+
+    if (s_errorPercent > 0 && (int)(rand_r(&s_seed) % 100) < s_errorPercent) {
+        sendFinal(fail(100));
+        return;
+    }
+
+    body = line + 2;
+
+    /* a dial string may itself end in ';' */
+    if (toupper(body[0]) == 'D') {
+        sendFinal(handleBasic(body));
+        return;
+    }
+
+    if (body[0] != '+' && body[0] != '%' && body[0] != '\0') {
+        result = handleBasic(body);
+        body += strcspn(body, "+;");
+        if (*body == ';') body++;
+    }
+
+    /* "+COPS=3,0;+COPS?;+COPS=3,1" */
+    for (cmd = body; result == 0 && cmd != NULL && *cmd != '\0'; cmd = next) {
+        next = strchr(cmd, ';');
+        if (next != NULL) *next++ = '\0';
+        if (*cmd != '+' && *cmd != '%') {
+            /* concatenated commands may omit the leading '+' */
+            result = -1;
+            break;
+        }
+        result = handleExtended(cmd);
+    }
+
+    if (result != 1) {
+        sendFinal(result);
+    }
+}
+
+/*** unsolicited generators ***/
+
+static void sendStormLine()
+{
+    int kinds[sizeof(s_stormNames) / sizeof(s_stormNames[0])];
+    int count = 0;
+    size_t i;
+    char buf[256];
+
+    for (i = 0; i < sizeof(s_stormNames) / sizeof(s_stormNames[0]); i++) {
+        if (s_stormKinds & s_stormNames[i].kind) kinds[count++] = s_stormNames[i].kind;
+    }
+
+    if (count == 0) return;
+
+    switch (kinds[s_stormCounter++ % count]) {
+        case STORM_CREG:
+            snprintf(buf, sizeof(buf), "+CREG: 1,\"00C3\",\"%08X\"",
+                     0xA1B2 + (s_stormCounter & 0xff));
+            sendUnsolicited(buf);
+            break;
+        case STORM_CGREG:
+            sendUnsolicited("+CGREG: 1");
+            break;
+        case STORM_CGEV:
+            sendUnsolicited("+CGEV: NW MODIFY 1,0");
+            break;
+        case STORM_RING:
+            sendUnsolicited("RING");
+            break;
+        case STORM_CSQ:
+            sendCsq();
+            s_unsolCount++;
+            break;
+        case STORM_CMT:
+            s_unsolCount++;
+            sendLine("+CMT: ,%d", SAMPLE_DELIVER_TPDU_LEN);
+            sendLine("%s", SAMPLE_DELIVER_PDU);
+            break;
+        case STORM_CBM: {
+            /* 88 octet GSM cell broadcast page, serial number varies */
+            char pdu[88 * 2 + 1];
+
+            snprintf(pdu, sizeof(pdu), "%04X1112011154741914AFA7C76B9058FEBEBB41E637",
+                     s_stormCounter & 0xffff);
+            memset(pdu + strlen(pdu), '0', sizeof(pdu) - 1 - strlen(pdu));
+            pdu[sizeof(pdu) - 1] = '\0';
+
+            s_unsolCount++;
+            sendLine("+CBM: 88");
+            sendLine("%s", pdu);
+            break;
+        }
+    }
+}
+
+static void runTimers(long long now)
+{
+    int i;
+
+    advanceCalls(now);
+
+    for (i = 0; i < s_eventCount; i++) {
+        ScriptEvent *ev = &s_events[i];
+
+        if (ev->fired || now - s_connectTime < ev->at) continue;
+        ev->fired = 1;
+
+        if (ev->line != NULL) {
+            sendUnsolicited(ev->line);
+        } else if (addCall(1, hasCallInState(0) ? 5 : 4, ev->number) != NULL) {
+            sendUnsolicited(hasCallInState(0) ? "+CCWA: \"\",129" : "RING");
+        }
+    }
+
+    if (s_stormRate > 0) {
+        while (now >= s_nextStorm) {
+            sendStormLine();
+            s_nextStorm += (long long)(1000 / s_stormRate) > 0
+                    ? (long long)(1000 / s_stormRate) : 1;
+            if (s_fd < 0) break;
+        }
+    }
+}
+
+static int nextTimerMs(long long now)
+{
+    long long next = now + 1000;
+    int i;
+
+    for (i = 0; i < MAX_CALLS; i++) {
+        if (s_calls[i].index != 0 && !s_calls[i].isMT
+                && (s_calls[i].state == 2 || s_calls[i].state == 3)
+                && s_calls[i].changeAt < next) {
+            next = s_calls[i].changeAt;
+        }
+    }
+
+    for (i = 0; i < s_eventCount; i++) {
+        if (!s_events[i].fired && s_connectTime + s_events[i].at < next) {
+            next = s_connectTime + s_events[i].at;
+        }
+    }
+
+    if (s_stormRate > 0 && s_nextStorm < next) {
+        next = s_nextStorm;
+    }
+
+    return next > now ? (int)(next - now) : 0;
+}
+
+/*** connection handling ***/
+
+static void resetModem()
+{
+    int i;
+
+    s_cfun = 0;
+    s_cmeeMode = 0;
+    s_cregMode = 0;
+    s_cgregMode = 0;
+    s_copsFormat = 0;
+    s_currentTech = 0;
+    s_preferredTech = 0x0f;
+    s_smsPending = 0;
+    s_smsIsWrite = 0;
+    memset(s_calls, 0, sizeof(s_calls));
+    memset(s_contexts, 0, sizeof(s_contexts));
+
+    s_connectTime = nowMs();
+    s_nextStorm = s_connectTime;
+
+    for (i = 0; i < s_eventCount; i++) {
+        s_events[i].fired = 0;
+    }
+}
+
+static void serveClient()
+{
+    static char buf[MAX_LINE + 1];
+    size_t len = 0;
+    ssize_t count;
+    struct pollfd pfd;
+    char *start, *end;
+
+    resetModem();
+
+    while (s_fd >= 0) {
+        pfd.fd = s_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, nextTimerMs(nowMs())) < 0 && errno != EINTR) {
+            break;
+        }
+
+        runTimers(nowMs());
+
+        if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+        do {
+            count = read(s_fd, buf + len, MAX_LINE - len);
+        } while (count < 0 && errno == EINTR);
+
+        if (count <= 0) break;
+
+        len += count;
+        buf[len] = '\0';
+
+        /* commands end in \r, SMS PDUs in ^Z */
+        start = buf;
+        for (;;) {
+            end = start + strcspn(start, s_smsPending ? "\032" : "\r\n");
+            if (*end == '\0') break;
+
+            *end = '\0';
+            if (s_smsPending) {
+                handleSmsPdu(start);
+            } else if (*start != '\0') {
+                handleCommandLine(start);
+            }
+            start = end + 1;
+        }
+
+        len = strlen(start);
+        memmove(buf, start, len + 1);
+
+        if (len == MAX_LINE) {
+            fprintf(stderr, "overlong line, discarding\n");
+            len = 0;
+        }
+    }
+
+    close(s_fd);
+    s_fd = -1;
+
+    fprintf(stderr, "client gone: %lu commands, %lu errors, %lu unsolicited\n",
+            s_commandCount, s_errorCount, s_unsolCount);
+}
+
+/*** self check ***/
+
+/*
+ * Canned sessions and the exact bytes the simulator must answer them
+ * with, so replies reference-ril parses (eg the +CMGW index) can't
+ * silently regress
+ */
+static const struct {
+    const char *name;
+    const char *input;
+    const char *expected;
+} s_selfChecks[] = {
+    { "send SMS",
+      "AT+CMGS=30\r" SAMPLE_DELIVER_PDU "\032",
+      "> \r\n+CMGS: 1\r\n\r\nOK\r\n" },
+    { "write SMS to SIM",
+      "AT+CMGW=30\r" SAMPLE_DELIVER_PDU "\032",
+      "> \r\n+CMGW: 1\r\n\r\nOK\r\n" },
+    { "send then write",
+      "AT+CMGS=30\r" SAMPLE_DELIVER_PDU "\032AT+CMGW=30\r" SAMPLE_DELIVER_PDU "\032",
+      "> \r\n+CMGS: 1\r\n\r\nOK\r\n> \r\n+CMGW: 2\r\n\r\nOK\r\n" },
+    { "bad PDU",
+      "AT+CMGW=30\rXYZ\032",
+      "> \r\n+CME ERROR: 304\r\n" },
+};
+
+/**
+ * Runs each canned session through serveClient() over a socketpair
+ * returns the number of sessions whose reply differed
+ */
+static int runSelfChecks()
+{
+    static char reply[MAX_LINE];
+    size_t i;
+    int failures = 0;
+
+    for (i = 0; i < sizeof(s_selfChecks) / sizeof(s_selfChecks[0]); i++) {
+        int fds[2];
+        size_t len = 0;
+        ssize_t count;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            perror("socketpair");
+            return -1;
+        }
+
+        /* the RIL's end; all of it fits in the socket buffers */
+        s_fd = fds[1];
+        writeAll(s_selfChecks[i].input, strlen(s_selfChecks[i].input));
+        shutdown(fds[1], SHUT_WR);
+
+        /* the EOF that follows ends serveClient() */
+        s_messageRef = 0;
+        s_fd = fds[0];
+        serveClient();
+
+        do {
+            count = read(fds[1], reply + len, sizeof(reply) - 1 - len);
+            if (count > 0) len += count;
+        } while (count > 0 || (count < 0 && errno == EINTR));
+        reply[len] = '\0';
+        close(fds[1]);
+
+        if (strcmp(reply, s_selfChecks[i].expected)) {
+            fprintf(stderr, "FAIL %s: got \"%s\"\n", s_selfChecks[i].name, reply);
+            failures++;
+        } else {
+            fprintf(stderr, "ok   %s\n", s_selfChecks[i].name);
+        }
+    }
+
+    return failures;
+}
+
+/*** configuration ***/
+
+static int parseStormKinds(const char *list)
+{
+    char *copy = strdup(list);
+    char *tok, *save = NULL;
+    size_t i;
+    int kinds = 0;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        for (i = 0; i < sizeof(s_stormNames) / sizeof(s_stormNames[0]); i++) {
+            if (!strcasecmp(tok, s_stormNames[i].name)) break;
+        }
+
+        if (i == sizeof(s_stormNames) / sizeof(s_stormNames[0])) {
+            fprintf(stderr, "unknown unsolicited kind '%s'\n", tok);
+            free(copy);
+            return -1;
+        }
+
+        kinds |= s_stormNames[i].kind;
+    }
+
+    free(copy);
+    return kinds;
+}
+
+static int loadScript(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    int lineno = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "unable to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *p, *arg;
+
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        for (p = line; isspace(*p); p++);
+
+        if (*p == '\0' || *p == '#') continue;
+
+        arg = p + strcspn(p, " \t");
+        if (*arg != '\0') *arg++ = '\0';
+        while (isspace(*arg)) arg++;
+
+        if (!strcmp(p, "reply") && s_ruleCount < MAX_RULES) {
+            char *reply = arg + strcspn(arg, " \t");
+
+            if (*reply == '\0') goto bad;
+            *reply++ = '\0';
+            s_rules[s_ruleCount].prefix = strdup(arg);
+            s_rules[s_ruleCount].reply = strdup(reply);
+            s_ruleCount++;
+        } else if (!strcmp(p, "at") && s_eventCount < MAX_EVENTS) {
+            ScriptEvent *ev = &s_events[s_eventCount];
+            char *what;
+
+            ev->at = strtoll(arg, &what, 10);
+            if (what == arg) goto bad;
+            while (isspace(*what)) what++;
+
+            if (!strncmp(what, "incoming ", 9)) {
+                ev->number = strdup(what + 9);
+            } else {
+                ev->line = strdup(what);
+            }
+            s_eventCount++;
+        } else {
+            goto bad;
+        }
+    }
+
+    fclose(fp);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: can't parse script line\n", path, lineno);
+    fclose(fp);
+    return -1;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s -p <tcp port> [-l <latency ms>] [-j <jitter ms>]\n"
+            "          [-e <error %%>] [-u <unsolicited/s>] [-U <kinds>]\n"
+            "          [-s READY|SIM PIN|ABSENT] [-f <script>] [-r <seed>]\n"
+            "       %s -T\n"
+            "  kinds: comma separated list of"
+            " creg,cgreg,cgev,ring,cmt,cbm,csq\n"
+            "  -T  check the replies to canned sessions and exit\n", argv0, argv0);
+    exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    int listenFd;
+    int one = 1;
+    struct sockaddr_in addr;
+
+    while (-1 != (opt = getopt(argc, argv, "p:l:j:e:u:U:s:f:r:T"))) {
+        switch (opt) {
+            case 'T': return runSelfChecks() == 0 ? 0 : 1;
+            case 'p': s_port = atoi(optarg); break;
+            case 'l': s_latencyMs = atoi(optarg); break;
+            case 'j': s_jitterMs = atoi(optarg); break;
+            case 'e': s_errorPercent = atoi(optarg); break;
+            case 'u': s_stormRate = atof(optarg); break;
+            case 'U':
+                s_stormKinds = parseStormKinds(optarg);
+                if (s_stormKinds < 0) usage(argv[0]);
+            break;
+            case 's': s_simState = optarg; break;
+            case 'f':
+                if (loadScript(optarg) < 0) return 1;
+            break;
+            case 'r': s_seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (s_port <= 0) {
+        usage(argv[0]);
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(listenFd, 1) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
+
+    fprintf(stderr, "simulated modem listening on localhost:%d\n", s_port);
+
+    for (;;) {
+        do {
+            s_fd = accept(listenFd, NULL, NULL);
+        } while (s_fd < 0 && errno == EINTR);
+
+        if (s_fd < 0) {
+            perror("accept");
+            return 1;
+        }
+
+        setsockopt(s_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        serveClient();
+    }
+
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -29,8 +30,11 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <alloca.h>
+#include <dlfcn.h>
 #include "atchannel.h"
 #include "at_tok.h"
+#include "at_trace.h"
+#include "if_monitor.h"
 #include "misc.h"
 #include <getopt.h>
 #include <sys/socket.h>
@@ -52,6 +56,8 @@ static void *noopRemoveWarning( void *a ) { return a; }
 
 #define MAX_AT_RESPONSE 0x1000
 
+#define NUM_ELEMS(x) (sizeof(x)/sizeof((x)[0]))
+
 /* pathname returned from RIL_REQUEST_SETUP_DATA_CALL / RIL_REQUEST_SETUP_DEFAULT_PDP */
 // This is used if Wifi is not supported, plain old eth0
 #define PPP_TTY_PATH_ETH0 "eth0"
@@ -102,7 +108,6 @@ typedef struct {
 
 } ModemInfo;
 
-static ModemInfo *sMdmInfo;
 // TECH returns the current technology in the format used by the modem.
 // It can be used as an l-value
 #define TECH(mdminfo)                 ((mdminfo)->currentTech)
@@ -180,8 +185,14 @@ typedef enum {
     ISIM_NETWORK_PERSONALIZATION = 17,
 } SIM_Status;
 
+#if defined(ANDROID_MULTI_SIM)
+static void onRequest (int request, void *data, size_t datalen, RIL_Token t,
+                       RIL_SOCKET_ID socket_id);
+static RIL_RadioState currentState(RIL_SOCKET_ID socket_id);
+#else
 static void onRequest (int request, void *data, size_t datalen, RIL_Token t);
 static RIL_RadioState currentState();
+#endif
 static int onSupports (int requestCode);
 static void onCancel (RIL_Token t);
 static const char *getVersion();
@@ -207,59 +218,41 @@ static const RIL_RadioFunctions s_callbacks = {
 static const struct RIL_Env *s_rilenv;
 
 #define RIL_onRequestComplete(t, e, response, responselen) s_rilenv->OnRequestComplete(t,e, response, responselen)
+#if defined(ANDROID_MULTI_SIM)
+#define RIL_onUnsolicitedResponse(a,b,c) s_rilenv->OnUnsolicitedResponse(a,b,c, currentModem()->socketId)
+#else
 #define RIL_onUnsolicitedResponse(a,b,c) s_rilenv->OnUnsolicitedResponse(a,b,c)
-#define RIL_requestTimedCallback(a,b,c) s_rilenv->RequestTimedCallback(a,b,c)
 #endif
+#define RIL_requestTimedCallback(a,b,c) s_rilenv->RequestTimedCallback(a,b,c)
+#define RIL_requestFdCallback(a,b,c,d) s_rilenv->RequestFdCallback(a,b,c,d)
 
-static RIL_RadioState sState = RADIO_STATE_UNAVAILABLE;
-
-static pthread_mutex_t s_state_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t s_state_cond = PTHREAD_COND_INITIALIZER;
-
-static int s_port = -1;
-static const char * s_device_path = NULL;
-static int          s_device_socket = 0;
-
-/* trigger change to this with s_state_cond */
-static int s_closed = 0;
-
-static int sFD;     /* file desc of AT channel */
-static char sATBuffer[MAX_AT_RESPONSE+1];
-static char *sATBufferCur = NULL;
+/*
+ * RequestFdCallback is the last member of RIL_Env, and a rild built
+ * before it was added passes a shorter one. RIL_Init only reads it once
+ * the libril we run with is known to have RIL_requestFdCallback.
+ */
+static int s_hasFdCallback;
+#else
+static const int s_hasFdCallback = 1;
+#if defined(ANDROID_MULTI_SIM)
+#define RIL_onUnsolicitedResponse(a,b,c) RIL_onUnsolicitedResponse(a,b,c, currentModem()->socketId)
+#endif
+#endif
 
-static const struct timeval TIMEVAL_SIMPOLL = {1,0};
 static const struct timeval TIMEVAL_CALLSTATEPOLL = {0,500000};
 static const struct timeval TIMEVAL_0 = {0,0};
 
-static int s_ims_registered  = 0;        // 0==unregistered
-static int s_ims_services    = 1;        // & 0x1 == sms over ims supported
-static int s_ims_format    = 1;          // FORMAT_3GPP(1) vs FORMAT_3GPP2(2);
-static int s_ims_cause_retry = 0;        // 1==causes sms over ims to temp fail
-static int s_ims_cause_perm_failure = 0; // 1==causes sms over ims to permanent fail
-static int s_ims_gsm_retry   = 0;        // 1==causes sms over gsm to temp fail
-static int s_ims_gsm_fail    = 0;        // 1==causes sms over gsm to permanent fail
-
 #ifdef WORKAROUND_ERRONEOUS_ANSWER
 // Max number of times we'll try to repoll when we think
 // we have a AT+CLCC race condition
 #define REPOLL_CALLS_COUNT_MAX 4
-
-// Line index that was incoming or waiting at last poll, or -1 for none
-static int s_incomingOrWaitingLine = -1;
-// Number of times we've asked for a repoll of AT+CLCC
-static int s_repollCallsCount = 0;
-// Should we expect a call to be answered in the next CLCC?
-static int s_expectAnswer = 0;
 #endif /* WORKAROUND_ERRONEOUS_ANSWER */
 
-
-static int s_cell_info_rate_ms = INT_MAX;
-static int s_mcc = 0;
-static int s_mnc = 0;
-static int s_lac = 0;
-static int s_cid = 0;
-
 static void pollSIMState (void *param);
+static void checkCellInfo(void *param);
+static void checkCellInfoChange(void *param);
+static void restartSIMState(int forget);
+static void invalidateSIMState();
 static void setRadioState(RIL_RadioState newState);
 static void setRadioTechnology(ModemInfo *mdm, int newtech);
 static int query_ctec(ModemInfo *mdm, int *current, int32_t *preferred);
@@ -280,58 +273,440 @@ static int clccStateToRILState(int state, RIL_CallState *p_state)
     }
 }
 
+/*
+ * Modem state cache
+ *
+ * The framework follows every state change notification with a burst of
+ * queries, so the answers to those queries are kept here. Unsolicited
+ * lines keep them current (or throw them away when they can't), and an
+ * answer is only taken from the modem again once it has aged past
+ * maxAgeMsec.
+ */
+typedef enum {
+    CACHE_CREG,
+    CACHE_CGREG,
+    CACHE_COPS,
+    CACHE_CSQ,
+    CACHE_CLCC,
+    CACHE_NUM_ENTRIES
+} CacheEntryId;
+
+static const struct {
+    const char *command;
+    const char *prefix;
+    ATCommandType type;
+    long long maxAgeMsec;
+} s_cacheQueries[CACHE_NUM_ENTRIES] = {
+    /* registration changes are reported, see AT+CREG=2 and AT+CGREG=1 */
+    [CACHE_CREG] = { "AT+CREG?", "+CREG:", SINGLELINE, 60 * 1000 },
+    [CACHE_CGREG] = { "AT+CGREG?", "+CGREG:", SINGLELINE, 60 * 1000 },
+    /* the operator only changes along with the registration */
+    [CACHE_COPS] = { "AT+COPS=3,0;+COPS?;+COPS=3,1;+COPS?;+COPS=3,2;+COPS?",
+                     "+COPS:", MULTILINE, 60 * 1000 },
+    /* most modems don't report signal strength on their own */
+    [CACHE_CSQ] = { "AT+CSQ", "+CSQ:", SINGLELINE, 2 * 1000 },
+    /* only cached while no call is changing state, see requestGetCurrentCalls */
+    [CACHE_CLCC] = { "AT+CLCC", "+CLCC:", MULTILINE, 2 * 1000 },
+};
+
+typedef struct {
+    ATResponse *p_response;     /* NULL if nothing cached */
+    uint64_t updatedNs;         /* ril_nano_time() */
+    unsigned generation;        /* bumped on every update and invalidation */
+} CacheEntry;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    CacheEntry entries[CACHE_NUM_ENTRIES];
+} ModemCache;
+
+/*
+ * Per-modem state
+ *
+ * One process drives a modem for each SIM slot, each on its own AT
+ * channel. Everything that belongs to one modem lives in its RILModem,
+ * which is found through the AT channel the calling thread has selected:
+ * request handlers, timed callbacks and the channel's reader thread all
+ * run with their modem's channel selected, so code below only ever looks
+ * at currentModem().
+ */
+typedef struct CallTracker CallTracker;
+typedef struct CellInfoState CellInfoState;
+typedef struct SIMState SIMState;
+
+typedef struct RILModem {
+    RIL_SOCKET_ID socketId;
+    ATChannel *channel;
+    pthread_t tid_mainloop;
+
+    /* where the modem is, from the command line */
+    int port;
+    const char *devicePath;
+    int deviceSocket;
+
+    RIL_RadioState radioState;
+    pthread_mutex_t stateMutex;
+    pthread_cond_t stateCond;
+    /* bit n set while PDP context n + 1 has a data call, under stateMutex */
+    unsigned dataCids;
+    /* bumped whenever the radio takes every data call down */
+    unsigned dataCidEpoch;
+    /* trigger change to this with stateCond */
+    int closed;
+    /* bumped on every at_open, under stateMutex */
+    unsigned connection;
+
+    ModemInfo *mdmInfo;
+    /* mdmInfo holds what probeForModemMode found, reconnects reuse it */
+    int mdmInfoProbed;
+    ModemCache cache;
+    CallTracker *callTracker;
+    CellInfoState *cellInfo;
+    SIMState *simState;
+
+    int imsRegistered;          // 0==unregistered
+    int imsServices;            // & 0x1 == sms over ims supported
+    int imsFormat;              // FORMAT_3GPP(1) vs FORMAT_3GPP2(2);
+    int imsCauseRetry;          // 1==causes sms over ims to temp fail
+    int imsCausePermFailure;    // 1==causes sms over ims to permanent fail
+    int imsGsmRetry;            // 1==causes sms over gsm to temp fail
+    int imsGsmFail;             // 1==causes sms over gsm to permanent fail
+
+#ifdef WORKAROUND_ERRONEOUS_ANSWER
+    // Line index that was incoming or waiting at last poll, or -1 for none
+    int incomingOrWaitingLine;
+    // Number of times we've asked for a repoll of AT+CLCC
+    int repollCallsCount;
+    // Should we expect a call to be answered in the next CLCC?
+    int expectAnswer;
+#endif /* WORKAROUND_ERRONEOUS_ANSWER */
+
+    /* AT+CREG=2 took, so +CREG: lines carry the location */
+    int cregLocation;
+
+    int mcc;
+    int mnc;
+    int lac;
+    int cid;
+} RILModem;
+
+static RILModem s_modems[SIM_COUNT];
+/* slots with a modem given on the command line */
+static int s_modemCount;
+
+/* threads that never selected a modem get the first one */
+static RILModem *currentModem()
+{
+    RILModem *p_modem = (RILModem *) at_channel_user(at_channel_current());
+
+    return p_modem != NULL ? p_modem : &s_modems[0];
+}
+
+static void selectModem(RILModem *p_modem)
+{
+    at_channel_select(p_modem->channel);
+}
+
+typedef struct {
+    RILModem *p_modem;
+    RIL_TimedCallback callback;
+    void *param;
+} ModemCallback;
+
+static void runModemCallback(void *param)
+{
+    ModemCallback *p_callback = (ModemCallback *) param;
+
+    selectModem(p_callback->p_modem);
+    p_callback->callback(p_callback->param);
+    free(p_callback);
+}
+
 /**
- * Note: directly modified line and has *p_call point directly into
- * modified line
+ * RIL_requestTimedCallback, with "p_modem" selected while "callback" runs
+ * on the main thread
  */
-static int callFromCLCCLine(char *line, RIL_Call *p_call)
+static void requestModemCallback(RILModem *p_modem, RIL_TimedCallback callback,
+                                 void *param, const struct timeval *relativeTime)
 {
-        //+CLCC: 1,0,2,0,0,\"+18005551212\",145
-        //     index,isMT,state,mode,isMpty(,number,TOA)?
+    ModemCallback *p_callback;
 
-    int err;
-    int state;
-    int mode;
+    p_callback = (ModemCallback *) malloc(sizeof(ModemCallback));
+    if (p_callback == NULL) {
+        RLOGE("Unable to allocate a timed callback");
+        return;
+    }
 
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
+    p_callback->p_modem = p_modem;
+    p_callback->callback = callback;
+    p_callback->param = param;
 
-    err = at_tok_nextint(&line, &(p_call->index));
-    if (err < 0) goto error;
+    RIL_requestTimedCallback(runModemCallback, p_callback, relativeTime);
+}
 
-    err = at_tok_nextbool(&line, &(p_call->isMT));
-    if (err < 0) goto error;
+typedef struct {
+    RILModem *p_modem;
+    RIL_FdCallback callback;
+    void *param;
+} ModemFdCallback;
 
-    err = at_tok_nextint(&line, &state);
-    if (err < 0) goto error;
+static void runModemFdCallback(int fd, int timedOut, void *param)
+{
+    ModemFdCallback *p_callback = (ModemFdCallback *) param;
 
-    err = clccStateToRILState(state, &(p_call->state));
-    if (err < 0) goto error;
+    selectModem(p_callback->p_modem);
+    p_callback->callback(fd, timedOut, p_callback->param);
+    free(p_callback);
+}
 
-    err = at_tok_nextint(&line, &mode);
-    if (err < 0) goto error;
+/**
+ * RIL_requestFdCallback, with "p_modem" selected while "callback" runs
+ * on the main thread
+ */
+static void requestModemFdCallback(RILModem *p_modem, int fd,
+                                   RIL_FdCallback callback, void *param,
+                                   const struct timeval *timeout)
+{
+    ModemFdCallback *p_callback;
 
-    p_call->isVoice = (mode == 0);
+    p_callback = (ModemFdCallback *) malloc(sizeof(ModemFdCallback));
+    if (p_callback == NULL) {
+        RLOGE("Unable to allocate an fd callback");
+        /* still owed a callback; make it a timeout */
+        callback(fd, 1, param);
+        return;
+    }
 
-    err = at_tok_nextbool(&line, &(p_call->isMpty));
-    if (err < 0) goto error;
+    p_callback->p_modem = p_modem;
+    p_callback->callback = callback;
+    p_callback->param = param;
 
-    if (at_tok_hasmore(&line)) {
-        err = at_tok_nextstr(&line, &(p_call->number));
+    RIL_requestFdCallback(fd, runModemFdCallback, p_callback, timeout);
+}
 
-        /* tolerate null here */
-        if (err < 0) return 0;
+/** RIL_requestTimedCallback for the current modem */
+static void requestTimedCallback(RIL_TimedCallback callback, void *param,
+                                 const struct timeval *relativeTime)
+{
+    requestModemCallback(currentModem(), callback, param, relativeTime);
+}
 
-        // Some lame implementations return strings
-        // like "NOT AVAILABLE" in the CLCC line
-        if (p_call->number != NULL
-            && 0 == strspn(p_call->number, "+0123456789")
-        ) {
-            p_call->number = NULL;
+/** called with ModemCache.mutex held */
+static void cacheSet_locked(CacheEntryId id, const ATResponse *p_response)
+{
+    ModemCache *p_cache = &currentModem()->cache;
+    CacheEntry *p_entry = &p_cache->entries[id];
+
+    at_response_free(p_entry->p_response);
+    p_entry->p_response = p_response ? at_response_dup(p_response) : NULL;
+    p_entry->updatedNs = ril_nano_time();
+    p_entry->generation++;
+}
+
+static void cacheInvalidate(CacheEntryId id)
+{
+    ModemCache *p_cache = &currentModem()->cache;
+
+    pthread_mutex_lock(&p_cache->mutex);
+    cacheSet_locked(id, NULL);
+    pthread_mutex_unlock(&p_cache->mutex);
+}
+
+static void cacheInvalidateAll()
+{
+    ModemCache *p_cache = &currentModem()->cache;
+    int id;
+
+    pthread_mutex_lock(&p_cache->mutex);
+    for (id = 0; id < CACHE_NUM_ENTRIES; id++) {
+        cacheSet_locked(id, NULL);
+    }
+    pthread_mutex_unlock(&p_cache->mutex);
+}
+
+/** stores "line" as if it were the single line answer to entry "id" */
+static void cacheSetLine(CacheEntryId id, const char *line)
+{
+    ModemCache *p_cache = &currentModem()->cache;
+    ATLine intermediate = { NULL, (char *)line };
+    ATResponse response = { 1, "OK", &intermediate };
+
+    pthread_mutex_lock(&p_cache->mutex);
+    cacheSet_locked(id, &response);
+    pthread_mutex_unlock(&p_cache->mutex);
+}
+
+/**
+ * Like at_send_command_singleline/multiline for the query behind "id", but
+ * answers from the cache while it is younger than "maxAgeMsec" (0 always
+ * asks the modem). Only successful answers are cached, and only if
+ * nothing updated the entry while the query was out.
+ */
+static int sendCachedQueryMaxAge(CacheEntryId id, long long maxAgeMsec,
+                                 ATResponse **pp_outResponse)
+{
+    ModemCache *p_cache = &currentModem()->cache;
+    CacheEntry *p_entry = &p_cache->entries[id];
+    unsigned generation;
+    int err;
+
+    pthread_mutex_lock(&p_cache->mutex);
+
+    if (p_entry->p_response != NULL
+        && ril_nano_time() - p_entry->updatedNs
+            < (uint64_t)maxAgeMsec * 1000000
+    ) {
+        *pp_outResponse = at_response_dup(p_entry->p_response);
+        pthread_mutex_unlock(&p_cache->mutex);
+        return 0;
+    }
+
+    generation = p_entry->generation;
+
+    pthread_mutex_unlock(&p_cache->mutex);
+
+    if (s_cacheQueries[id].type == MULTILINE) {
+        err = at_send_command_multiline(s_cacheQueries[id].command,
+                                        s_cacheQueries[id].prefix,
+                                        pp_outResponse);
+    } else {
+        err = at_send_command_singleline(s_cacheQueries[id].command,
+                                         s_cacheQueries[id].prefix,
+                                         pp_outResponse);
+    }
+
+    if (err == 0 && (*pp_outResponse)->success > 0) {
+        pthread_mutex_lock(&p_cache->mutex);
+        if (p_entry->generation == generation) {
+            cacheSet_locked(id, *pp_outResponse);
         }
+        pthread_mutex_unlock(&p_cache->mutex);
+    }
 
-        err = at_tok_nextint(&line, &p_call->toa);
-        if (err < 0) goto error;
+    return err;
+}
+
+/** sendCachedQueryMaxAge, with the entry's usual max age */
+static int sendCachedQuery(CacheEntryId id, ATResponse **pp_outResponse)
+{
+    return sendCachedQueryMaxAge(id, s_cacheQueries[id].maxAgeMsec,
+                                 pp_outResponse);
+}
+
+/**
+ * Updates the +CREG:/+CGREG: entry from an unsolicited line. These leave
+ * out the leading <n> of the solicited answer, so one is put back to make
+ * the cached line parse the way a real answer would.
+ */
+static void cacheUpdateRegistration(CacheEntryId id, const char *s)
+{
+    const char *prefix = s_cacheQueries[id].prefix;
+    const char *p;
+    char line[128];
+    int commas = 0;
+    int stat;
+
+    for (p = s; *p != '\0'; p++) {
+        if (*p == ',') commas++;
+    }
+
+    /* <stat>[,<lac>,<ci>[,<AcT>]] */
+    if (!strStartsWith(s, prefix) || commas == 1 || commas > 3
+        || at_tok_scan(s, "%d", NULL, &stat) < 0
+    ) {
+        cacheInvalidate(id);
+        return;
+    }
+
+    /* a registered +CGREG? answer also carries the access technology */
+    if (id == CACHE_CGREG && commas < 3 && (stat == 1 || stat == 5)) {
+        cacheInvalidate(id);
+        return;
+    }
+
+    /* parseRegistrationState skips <n>, so its value doesn't matter */
+    if (snprintf(line, sizeof(line), "%s 2,%s", prefix,
+                 s + strlen(prefix)) >= (int)sizeof(line)) {
+        cacheInvalidate(id);
+        return;
+    }
+
+    cacheSetLine(id, line);
+}
+
+/** drops whatever request "request" is about to change */
+static void cacheInvalidateForRequest(int request)
+{
+    switch (request) {
+        case RIL_REQUEST_DIAL:
+        case RIL_REQUEST_HANGUP:
+        case RIL_REQUEST_HANGUP_WAITING_OR_BACKGROUND:
+        case RIL_REQUEST_HANGUP_FOREGROUND_RESUME_BACKGROUND:
+        case RIL_REQUEST_SWITCH_WAITING_OR_HOLDING_AND_ACTIVE:
+        case RIL_REQUEST_CONFERENCE:
+        case RIL_REQUEST_UDUB:
+        case RIL_REQUEST_ANSWER:
+        case RIL_REQUEST_SEPARATE_CONNECTION:
+        case RIL_REQUEST_EXPLICIT_CALL_TRANSFER:
+            cacheInvalidate(CACHE_CLCC);
+            break;
+
+        case RIL_REQUEST_RADIO_POWER:
+        case RIL_REQUEST_SET_NETWORK_SELECTION_AUTOMATIC:
+        case RIL_REQUEST_SET_NETWORK_SELECTION_MANUAL:
+        case RIL_REQUEST_SET_PREFERRED_NETWORK_TYPE:
+        case RIL_REQUEST_SET_BAND_MODE:
+            cacheInvalidateAll();
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* room for a dial string, including a leading '+' and the NUL */
+#define CLCC_NUMBER_MAX 64
+
+/**
+ * Note: p_call->number points to "number", which must hold
+ * CLCC_NUMBER_MAX chars
+ */
+static int callFromCLCCLine(const char *line, RIL_Call *p_call, char *number)
+{
+        //+CLCC: 1,0,2,0,0,\"+18005551212\",145
+        //     index,isMT,state,mode,isMpty(,number,TOA)?
+
+    ATTokError scanError;
+    ATTokSpan numberSpan;
+    int fields;
+    int state;
+    int mode;
+
+    fields = at_tok_scan(line, "+CLCC: %d,%b,%d,%d,%b[,%s,%d]", &scanError,
+                         &p_call->index, &p_call->isMT, &state, &mode,
+                         &p_call->isMpty, &numberSpan, &p_call->toa);
+    if (fields < 0) {
+        RLOGE("invalid CLCC line: %s at field %d, offset %d\n",
+              scanError.reason, scanError.field, scanError.offset);
+        return -1;
+    }
+
+    /* a number must come with its type */
+    if (fields == 6) goto error;
+
+    if (clccStateToRILState(state, &(p_call->state)) < 0) goto error;
+
+    p_call->isVoice = (mode == 0);
+
+    // Some lame implementations return strings
+    // like "NOT AVAILABLE" in the CLCC line
+    p_call->number = NULL;
+    if (fields == 7
+        && numberSpan.len > 0
+        && strchr("+0123456789", numberSpan.str[0]) != NULL
+        && at_tok_span_copy(&numberSpan, number, CLCC_NUMBER_MAX) == 0
+    ) {
+        p_call->number = number;
     }
 
     p_call->uusInfo = NULL;
@@ -356,6 +731,11 @@ static int parseSimResponseLine(char* line, RIL_SIM_IO_Response* response) {
     if (at_tok_hasmore(&line)) {
         err = at_tok_nextstr(&line, &response->simResponse);
         if (err < 0) return err;
+        /* passed on to the framework, which expects whole hex bytes */
+        if (!ril_hex_validate(response->simResponse,
+                              strlen(response->simResponse))) {
+            return -1;
+        }
     }
     return 0;
 }
@@ -369,6 +749,26 @@ static RIL_Errno setInterfaceState(const char* interfaceName,
                                    enum InterfaceState state) {
     struct ifreq request;
     int status = 0;
+
+    if (if_monitor_running()) {
+        switch (if_monitor_set_up(interfaceName, state == kInterfaceUp)) {
+            case 0:
+                return RIL_E_SUCCESS;
+
+            case IF_MONITOR_ERROR_NO_INTERFACE:
+                RLOGE("Failed to get interface flags for %s: no such interface",
+                      interfaceName);
+                return RIL_E_RADIO_NOT_AVAILABLE;
+
+            case IF_MONITOR_ERROR_NOT_RUNNING:
+                // the listener went away, fall back to ioctl
+                break;
+
+            default:
+                return RIL_E_GENERIC_FAILURE;
+        }
+    }
+
     int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
     if (sock == -1) {
         RLOGE("Failed to open interface socket: %s (%d)",
@@ -423,7 +823,7 @@ static void onRadioPowerOn()
     at_send_command("AT%CTZV=1", NULL);
 #endif
 
-    pollSIMState(NULL);
+    restartSIMState(1);
 }
 
 /** do post- SIM ready initialization */
@@ -453,11 +853,11 @@ static void requestRadioPower(void *data, size_t datalen __unused, RIL_Token t)
     assert (datalen >= sizeof(int *));
     onOff = ((int *)data)[0];
 
-    if (onOff == 0 && sState != RADIO_STATE_OFF) {
+    if (onOff == 0 && currentModem()->radioState != RADIO_STATE_OFF) {
         err = at_send_command("AT+CFUN=0", &p_response);
         if (err < 0 || p_response->success == 0) goto error;
         setRadioState(RADIO_STATE_OFF);
-    } else if (onOff > 0 && sState == RADIO_STATE_OFF) {
+    } else if (onOff > 0 && currentModem()->radioState == RADIO_STATE_OFF) {
         err = at_send_command("AT+CFUN=1", &p_response);
         if (err < 0|| p_response->success == 0) {
             // Some stacks return an error when there is no SIM,
@@ -487,7 +887,7 @@ static void requestShutdown(RIL_Token t)
     int err;
     ATResponse *p_response = NULL;
 
-    if (sState != RADIO_STATE_OFF) {
+    if (currentModem()->radioState != RADIO_STATE_OFF) {
         err = at_send_command("AT+CFUN=0", &p_response);
         setRadioState(RADIO_STATE_UNAVAILABLE);
     }
@@ -543,7 +943,7 @@ static void requestCallSelection(
             //  the other (held or waiting) call."
             atCommand = switchWaiting;
 #ifdef WORKAROUND_ERRONEOUS_ANSWER
-            s_expectAnswer = 1;
+            currentModem()->expectAnswer = 1;
 #endif /* WORKAROUND_ERRONEOUS_ANSWER */
             break;
         case RIL_REQUEST_CONFERENCE:
@@ -575,6 +975,44 @@ static const char* getRadioInterfaceName(bool hasWifi)
     return hasWifi ? PPP_TTY_PATH_RADIO0 : PPP_TTY_PATH_ETH0;
 }
 
+/*
+ * What the device offers, read once before any request is handled.
+ * It all comes from read-only properties, so it can't change later and
+ * handlers use this instead of asking again.
+ */
+static struct {
+    bool hasWifi;
+    const char *radioInterfaceName;
+} s_deviceCaps;
+
+static void initDeviceCapabilities()
+{
+    s_deviceCaps.hasWifi = hasWifiCapability();
+    s_deviceCaps.radioInterfaceName =
+            getRadioInterfaceName(s_deviceCaps.hasWifi);
+
+    RLOGI("radio interface %s", s_deviceCaps.radioInterfaceName);
+}
+
+/* Called on the if_monitor listener thread */
+static void onInterfaceChanged(const char *ifname)
+{
+    int i;
+
+    if (ifname != NULL && strcmp(ifname, s_deviceCaps.radioInterfaceName)) {
+        return;
+    }
+
+    /* the modems share the radio interface, so any of them may be using it */
+    for (i = 0 ; i < s_modemCount ; i++) {
+        if (s_modems[i].radioState == RADIO_STATE_ON) {
+            /* can't issue AT commands here -- call on main thread */
+            requestModemCallback(&s_modems[i], onDataCallListChanged, NULL,
+                                 NULL);
+        }
+    }
+}
+
 static void requestOrSendDataCallList(RIL_Token *t)
 {
     ATResponse *p_response;
@@ -582,9 +1020,14 @@ static void requestOrSendDataCallList(RIL_Token *t)
     int err;
     int n = 0;
     char *out;
-    char propValue[PROP_VALUE_MAX];
-    bool hasWifi = hasWifiCapability();
-    const char* radioInterfaceName = getRadioInterfaceName(hasWifi);
+    const char* radioInterfaceName = s_deviceCaps.radioInterfaceName;
+    char ifAddresses[256] = "";
+    int ifMtu = 0;
+    int ifCid = -1;
+
+    /* from the interface table, so no syscalls */
+    if_monitor_get(radioInterfaceName, NULL, &ifMtu, ifAddresses,
+                   sizeof(ifAddresses));
 
     err = at_send_command_multiline ("AT+CGACT?", "+CGACT:", &p_response);
     if (err != 0 || p_response->success == 0) {
@@ -621,25 +1064,33 @@ static void requestOrSendDataCallList(RIL_Token *t)
     RIL_Data_Call_Response_v11 *response = responses;
     for (p_cur = p_response->p_intermediates; p_cur != NULL;
          p_cur = p_cur->p_next) {
-        char *line = p_cur->line;
-
-        err = at_tok_start(&line);
-        if (err < 0)
-            goto error;
+        ATTokError scanError;
 
-        err = at_tok_nextint(&line, &response->cid);
-        if (err < 0)
-            goto error;
-
-        err = at_tok_nextint(&line, &response->active);
-        if (err < 0)
+        err = at_tok_scan(p_cur->line, "+CGACT: %d,%d", &scanError,
+                          &response->cid, &response->active);
+        if (err < 0) {
+            RLOGE("invalid CGACT line: %s at field %d, offset %d",
+                  scanError.reason, scanError.field, scanError.offset);
             goto error;
+        }
 
         response++;
     }
 
     at_response_free(p_response);
 
+    /*
+     * There's the one interface, and it carries the lowest active context;
+     * the interface's address and MTU say nothing about any other
+     */
+    for (i = 0; i < n; i++) {
+        if (responses[i].active > 0
+            && (ifCid < 0 || responses[i].cid < ifCid)
+        ) {
+            ifCid = responses[i].cid;
+        }
+    }
+
     err = at_send_command_multiline ("AT+CGDCONT?", "+CGDCONT:", &p_response);
     if (err != 0 || p_response->success == 0) {
         if (t != NULL)
@@ -698,10 +1149,19 @@ static void requestOrSendDataCallList(RIL_Token *t)
         if (err < 0)
             goto error;
 
+        // the modem may not know the address the interface was given
+        if (out[0] == '\0' && cid == ifCid) {
+            out = ifAddresses;
+        }
+
         int addresses_size = strlen(out) + 1;
         responses[i].addresses = alloca(addresses_size);
         strlcpy(responses[i].addresses, out, addresses_size);
 
+        if (cid == ifCid) {
+            responses[i].mtu = ifMtu;
+        }
+
         /* I don't know where we are, so use the public Google DNS
             * servers by default and no gateway.
             */
@@ -759,24 +1219,278 @@ static void requestQueryNetworkSelectionMode(
         goto error;
     }
 
-    RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(int));
-    at_response_free(p_response);
-    return;
-error:
-    at_response_free(p_response);
-    RLOGE("requestQueryNetworkSelectionMode must never return error when radio is on");
-    RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-}
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, &response, sizeof(int));
+    at_response_free(p_response);
+    return;
+error:
+    at_response_free(p_response);
+    RLOGE("requestQueryNetworkSelectionMode must never return error when radio is on");
+    RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+}
+
+static void sendCallStateChanged(void *param __unused)
+{
+    RIL_onUnsolicitedResponse (
+        RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
+        NULL, 0);
+}
+
+/*
+ * Call state tracking
+ *
+ * The modem doesn't report every call state transition, so calls that are
+ * changing state have to be polled for. Each poll is compared with the
+ * list the framework last fetched and the framework is only told when
+ * there is a difference; while nothing changes, polls back off.
+ */
+#define MAX_TRACKED_CALLS 16
+/* while a call is dialing, alerting, incoming or waiting */
+#define CALL_POLL_MAX_MSEC 2000
+/* POLL_CALL_STATE: only to catch the end of active and held calls */
+#define CALL_POLL_STABLE_MAX_MSEC 8000
+
+typedef struct {
+    int index;
+    RIL_CallState state;
+    char isMT;
+    char isMpty;
+    char isVoice;
+    int toa;
+    char number[CLCC_NUMBER_MAX];
+} TrackedCall;
+
+struct CallTracker {
+    pthread_mutex_t mutex;
+    TrackedCall calls[MAX_TRACKED_CALLS];
+    int count;          /* -1 until the framework has fetched a list */
+    int pollMsec;       /* delay before the next poll */
+    int pollPending;
+};
+
+static void pollCallState(void *param);
+
+static void trackCall(TrackedCall *p_tracked, const RIL_Call *p_call)
+{
+    /* diffCalls compares whole entries, padding and all */
+    memset(p_tracked, 0, sizeof(*p_tracked));
+
+    p_tracked->index = p_call->index;
+    p_tracked->state = p_call->state;
+    p_tracked->isMT = p_call->isMT;
+    p_tracked->isMpty = p_call->isMpty;
+    p_tracked->isVoice = p_call->isVoice;
+    p_tracked->toa = p_call->toa;
+    strlcpy(p_tracked->number, p_call->number ? p_call->number : "",
+            sizeof(p_tracked->number));
+}
+
+/**
+ * parses an AT+CLCC answer into "calls"
+ * returns the number of calls, or -1 if there are more than "max"
+ */
+static int parseCallList(const ATResponse *p_response, TrackedCall *calls,
+                         int max)
+{
+    ATLine *p_cur;
+    RIL_Call call;
+    char number[CLCC_NUMBER_MAX];
+    int count = 0;
+
+    for (p_cur = p_response->p_intermediates
+            ; p_cur != NULL
+            ; p_cur = p_cur->p_next
+    ) {
+        memset(&call, 0, sizeof(call));
+
+        if (callFromCLCCLine(p_cur->line, &call, number) != 0) {
+            continue;
+        }
+
+        if (count == max) {
+            return -1;
+        }
+
+        trackCall(&calls[count++], &call);
+    }
+
+    return count;
+}
+
+/** returns the number of calls added, removed or changed from "old" */
+static int diffCalls(const TrackedCall *old, int oldCount,
+                     const TrackedCall *calls, int count)
+{
+    int changes = 0;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < oldCount && old[j].index != calls[i].index; j++);
+
+        if (j == oldCount) {
+            RLOGD("call %d added, state %d", calls[i].index, calls[i].state);
+            changes++;
+        } else if (memcmp(&old[j], &calls[i], sizeof(TrackedCall)) != 0) {
+            RLOGD("call %d changed, state %d -> %d", calls[i].index,
+                  old[j].state, calls[i].state);
+            changes++;
+        }
+    }
+
+    for (j = 0; j < oldCount; j++) {
+        for (i = 0; i < count && calls[i].index != old[j].index; i++);
+
+        if (i == count) {
+            RLOGD("call %d removed", old[j].index);
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+/** returns how long polls may back off to, or 0 if no poll is needed */
+static int callPollMaxMsec(const TrackedCall *calls, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (calls[i].state != RIL_CALL_ACTIVE
+            && calls[i].state != RIL_CALL_HOLDING
+        ) {
+            return CALL_POLL_MAX_MSEC;
+        }
+    }
+
+#ifdef POLL_CALL_STATE
+    // We don't seem to get a "NO CARRIER" message from
+    // smd, so we're forced to poll until the call ends.
+    if (count > 0) {
+        return CALL_POLL_STABLE_MAX_MSEC;
+    }
+#endif
+
+    return 0;
+}
+
+/** called with CallTracker.mutex held */
+static void scheduleCallPoll_locked()
+{
+    CallTracker *p_tracker = currentModem()->callTracker;
+    struct timeval tv;
+
+    if (p_tracker->pollPending) {
+        return;
+    }
+
+    /* the poll has to see the change, so don't answer it from cache */
+    cacheInvalidate(CACHE_CLCC);
+
+    tv.tv_sec = p_tracker->pollMsec / 1000;
+    tv.tv_usec = (p_tracker->pollMsec % 1000) * 1000;
+
+    p_tracker->pollPending = 1;
+    requestTimedCallback(pollCallState, NULL, &tv);
+}
+
+/**
+ * Records the call list handed to the framework, and starts polling
+ * if any of the calls are expected to change
+ */
+static void callTrackerReported(const RIL_Call *p_calls, int count)
+{
+    CallTracker *p_tracker = currentModem()->callTracker;
+    TrackedCall calls[MAX_TRACKED_CALLS];
+    int maxMsec;
+    int i;
+
+    if (count > MAX_TRACKED_CALLS) {
+        count = MAX_TRACKED_CALLS;
+    }
+
+    for (i = 0; i < count; i++) {
+        trackCall(&calls[i], &p_calls[i]);
+    }
+
+    pthread_mutex_lock(&p_tracker->mutex);
+
+    if (p_tracker->count < 0
+        || diffCalls(p_tracker->calls, p_tracker->count, calls, count)
+    ) {
+        /* start over at the fast rate after every change */
+        p_tracker->pollMsec =
+            TIMEVAL_CALLSTATEPOLL.tv_sec * 1000
+            + TIMEVAL_CALLSTATEPOLL.tv_usec / 1000;
+    }
+
+    memcpy(p_tracker->calls, calls, count * sizeof(TrackedCall));
+    p_tracker->count = count;
+
+    maxMsec = callPollMaxMsec(calls, count);
+    if (maxMsec > 0) {
+        scheduleCallPoll_locked();
+    }
+
+    pthread_mutex_unlock(&p_tracker->mutex);
+}
+
+static void pollCallState(void *param __unused)
+{
+    CallTracker *p_tracker = currentModem()->callTracker;
+    ATResponse *p_response = NULL;
+    TrackedCall calls[MAX_TRACKED_CALLS];
+    int count;
+    int changed;
+    int maxMsec;
+    int err;
+
+    pthread_mutex_lock(&p_tracker->mutex);
+    p_tracker->pollPending = 0;
+    pthread_mutex_unlock(&p_tracker->mutex);
+
+    if (currentModem()->radioState == RADIO_STATE_UNAVAILABLE) {
+        return;
+    }
+
+    err = at_send_command_multiline("AT+CLCC", "+CLCC:", &p_response);
+
+    if (err != 0 || p_response->success == 0) {
+        /* let the framework's own query find out what's going on */
+        at_response_free(p_response);
+        sendCallStateChanged(NULL);
+        return;
+    }
+
+    count = parseCallList(p_response, calls, MAX_TRACKED_CALLS);
+    at_response_free(p_response);
+
+    pthread_mutex_lock(&p_tracker->mutex);
+
+    changed = count < 0 || p_tracker->count < 0
+        || diffCalls(p_tracker->calls, p_tracker->count, calls, count);
+
+    if (!changed) {
+        maxMsec = callPollMaxMsec(calls, count);
+
+        if (maxMsec > 0) {
+            p_tracker->pollMsec *= 2;
+            if (p_tracker->pollMsec > maxMsec) {
+                p_tracker->pollMsec = maxMsec;
+            }
+            scheduleCallPoll_locked();
+        }
+    }
+
+    pthread_mutex_unlock(&p_tracker->mutex);
 
-static void sendCallStateChanged(void *param __unused)
-{
-    RIL_onUnsolicitedResponse (
-        RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
-        NULL, 0);
+    /* the framework fetches the new list, which polls again if needed */
+    if (changed) {
+        sendCallStateChanged(NULL);
+    }
 }
 
 static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused, RIL_Token t)
 {
+    RILModem *p_modem = currentModem();
     int err;
     ATResponse *p_response;
     ATLine *p_cur;
@@ -784,17 +1498,17 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
     int countValidCalls;
     RIL_Call *p_calls;
     RIL_Call **pp_calls;
+    char *numbers;
     int i;
-    int needRepoll = 0;
 
 #ifdef WORKAROUND_ERRONEOUS_ANSWER
     int prevIncomingOrWaitingLine;
 
-    prevIncomingOrWaitingLine = s_incomingOrWaitingLine;
-    s_incomingOrWaitingLine = -1;
+    prevIncomingOrWaitingLine = p_modem->incomingOrWaitingLine;
+    p_modem->incomingOrWaitingLine = -1;
 #endif /*WORKAROUND_ERRONEOUS_ANSWER*/
 
-    err = at_send_command_multiline ("AT+CLCC", "+CLCC:", &p_response);
+    err = sendCachedQuery(CACHE_CLCC, &p_response);
 
     if (err != 0 || p_response->success == 0) {
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
@@ -814,6 +1528,7 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
     pp_calls = (RIL_Call **)alloca(countCalls * sizeof(RIL_Call *));
     p_calls = (RIL_Call *)alloca(countCalls * sizeof(RIL_Call));
     memset (p_calls, 0, countCalls * sizeof(RIL_Call));
+    numbers = (char *)alloca(countCalls * CLCC_NUMBER_MAX);
 
     /* init the pointer array */
     for(i = 0; i < countCalls ; i++) {
@@ -824,7 +1539,8 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
             ; p_cur != NULL
             ; p_cur = p_cur->p_next
     ) {
-        err = callFromCLCCLine(p_cur->line, p_calls + countValidCalls);
+        err = callFromCLCCLine(p_cur->line, p_calls + countValidCalls,
+                               numbers + countValidCalls * CLCC_NUMBER_MAX);
 
         if (err != 0) {
             continue;
@@ -834,16 +1550,10 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
         if (p_calls[countValidCalls].state == RIL_CALL_INCOMING
             || p_calls[countValidCalls].state == RIL_CALL_WAITING
         ) {
-            s_incomingOrWaitingLine = p_calls[countValidCalls].index;
+            p_modem->incomingOrWaitingLine = p_calls[countValidCalls].index;
         }
 #endif /*WORKAROUND_ERRONEOUS_ANSWER*/
 
-        if (p_calls[countValidCalls].state != RIL_CALL_ACTIVE
-            && p_calls[countValidCalls].state != RIL_CALL_HOLDING
-        ) {
-            needRepoll = 1;
-        }
-
         countValidCalls++;
     }
 
@@ -856,45 +1566,39 @@ static void requestGetCurrentCalls(void *data __unused, size_t datalen __unused,
     // This is probably a bug, and the call will probably
     // disappear from the call list in the next poll
     if (prevIncomingOrWaitingLine >= 0
-            && s_incomingOrWaitingLine < 0
-            && s_expectAnswer == 0
+            && p_modem->incomingOrWaitingLine < 0
+            && p_modem->expectAnswer == 0
     ) {
         for (i = 0; i < countValidCalls ; i++) {
 
             if (p_calls[i].index == prevIncomingOrWaitingLine
                     && p_calls[i].state == RIL_CALL_ACTIVE
-                    && s_repollCallsCount < REPOLL_CALLS_COUNT_MAX
+                    && p_modem->repollCallsCount < REPOLL_CALLS_COUNT_MAX
             ) {
                 RLOGI(
                     "Hit WORKAROUND_ERRONOUS_ANSWER case."
-                    " Repoll count: %d\n", s_repollCallsCount);
-                s_repollCallsCount++;
+                    " Repoll count: %d\n", p_modem->repollCallsCount);
+                p_modem->repollCallsCount++;
                 goto error;
             }
         }
     }
 
-    s_expectAnswer = 0;
-    s_repollCallsCount = 0;
+    p_modem->expectAnswer = 0;
+    p_modem->repollCallsCount = 0;
 #endif /*WORKAROUND_ERRONEOUS_ANSWER*/
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, pp_calls,
             countValidCalls * sizeof (RIL_Call *));
 
-    at_response_free(p_response);
+    callTrackerReported(p_calls, countValidCalls);
 
-#ifdef POLL_CALL_STATE
-    if (countValidCalls) {  // We don't seem to get a "NO CARRIER" message from
-                            // smd, so we're forced to poll until the call ends.
-#else
-    if (needRepoll) {
-#endif
-        RIL_requestTimedCallback (sendCallStateChanged, NULL, &TIMEVAL_CALLSTATEPOLL);
-    }
+    at_response_free(p_response);
 
     return;
 #ifdef WORKAROUND_ERRONEOUS_ANSWER
 error:
+    cacheInvalidate(CACHE_CLCC);
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
     at_response_free(p_response);
 #endif
@@ -987,8 +1691,8 @@ static void requestHangup(void *data, size_t datalen __unused, RIL_Token t)
 static void requestSignalStrength(void *data __unused, size_t datalen __unused, RIL_Token t)
 {
     ATResponse *p_response = NULL;
+    ATTokError scanError;
     int err;
-    char *line;
     int count = 0;
     // Accept a response that is at least v6, and up to v10
     int minNumOfElements=sizeof(RIL_SignalStrength_v6)/sizeof(int);
@@ -997,21 +1701,28 @@ static void requestSignalStrength(void *data __unused, size_t datalen __unused,
 
     memset(response, 0, sizeof(response));
 
-    err = at_send_command_singleline("AT+CSQ", "+CSQ:", &p_response);
+    err = sendCachedQuery(CACHE_CSQ, &p_response);
 
     if (err < 0 || p_response->success == 0) {
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
         goto error;
     }
 
-    line = p_response->p_intermediates->line;
-
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
-
-    for (count = 0; count < maxNumOfElements; count++) {
-        err = at_tok_nextint(&line, &(response[count]));
-        if (err < 0 && count < minNumOfElements) goto error;
+    /* one %d per int in RIL_SignalStrength_v10, optional past v6 */
+    count = at_tok_scan(p_response->p_intermediates->line,
+                        "+CSQ: %d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d[,%d,%d]",
+                        &scanError,
+                        &response[0], &response[1], &response[2],
+                        &response[3], &response[4], &response[5],
+                        &response[6], &response[7], &response[8],
+                        &response[9], &response[10], &response[11],
+                        &response[12], &response[13]);
+    if (count < minNumOfElements) {
+        if (count < 0) {
+            RLOGE("invalid CSQ line: %s at field %d, offset %d",
+                  scanError.reason, scanError.field, scanError.offset);
+        }
+        goto error;
     }
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, response, sizeof(response));
@@ -1039,6 +1750,7 @@ static int networkModePossible(ModemInfo *mdm, int nm)
 static void requestSetPreferredNetworkType( int request __unused, void *data,
                                             size_t datalen __unused, RIL_Token t )
 {
+    RILModem *p_modem = currentModem();
     ATResponse *p_response = NULL;
     char *cmd = NULL;
     int value = *(int *)data;
@@ -1046,16 +1758,16 @@ static void requestSetPreferredNetworkType( int request __unused, void *data,
     int err;
     int32_t preferred = net2pmask[value];
 
-    RLOGD("requestSetPreferredNetworkType: current: %x. New: %x", PREFERRED_NETWORK(sMdmInfo), preferred);
-    if (!networkModePossible(sMdmInfo, value)) {
+    RLOGD("requestSetPreferredNetworkType: current: %x. New: %x", PREFERRED_NETWORK(p_modem->mdmInfo), preferred);
+    if (!networkModePossible(p_modem->mdmInfo, value)) {
         RIL_onRequestComplete(t, RIL_E_MODE_NOT_SUPPORTED, NULL, 0);
         return;
     }
-    if (query_ctec(sMdmInfo, &current, NULL) < 0) {
+    if (query_ctec(p_modem->mdmInfo, &current, NULL) < 0) {
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
         return;
     }
-    old = PREFERRED_NETWORK(sMdmInfo);
+    old = PREFERRED_NETWORK(p_modem->mdmInfo);
     RLOGD("old != preferred: %d", old != preferred);
     if (old != preferred) {
         asprintf(&cmd, "AT+CTEC=%d,\"%x\"", current, preferred);
@@ -1066,7 +1778,7 @@ static void requestSetPreferredNetworkType( int request __unused, void *data,
             RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
             return;
         }
-        PREFERRED_NETWORK(sMdmInfo) = value;
+        PREFERRED_NETWORK(p_modem->mdmInfo) = value;
         if (!strstr( p_response->p_intermediates->line, "DONE") ) {
             int current;
             int res = parse_technology_response(p_response->p_intermediates->line, &current, NULL);
@@ -1075,7 +1787,7 @@ static void requestSetPreferredNetworkType( int request __unused, void *data,
                     break;
                 case 1: // Only able to parse current
                 case 0: // Both current and preferred were parsed
-                    setRadioTechnology(sMdmInfo, current);
+                    setRadioTechnology(p_modem->mdmInfo, current);
                     break;
             }
         }
@@ -1089,7 +1801,7 @@ static void requestGetPreferredNetworkType(int request __unused, void *data __un
     int preferred;
     unsigned i;
 
-    switch ( query_ctec(sMdmInfo, NULL, &preferred) ) {
+    switch ( query_ctec(currentModem()->mdmInfo, NULL, &preferred) ) {
         case -1: // Error or unable to parse
         case 1: // Only able to parse current
             RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
@@ -1176,7 +1888,7 @@ static void requestDeviceIdentity(int request __unused, void *data __unused,
         RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
         return;
     } else {
-        if (TECH_BIT(sMdmInfo) == MDM_CDMA) {
+        if (TECH_BIT(currentModem()->mdmInfo) == MDM_CDMA) {
             responseStr[3] = p_response->p_intermediates->line;
         } else {
             responseStr[0] = p_response->p_intermediates->line;
@@ -1325,18 +2037,17 @@ error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
 }
 
-static int parseRegistrationState(char *str, int *type, int *items, int **response)
+static int parseRegistrationState(const char *str, int *type, int *items, int **response)
 {
-    int err;
-    char *line = str, *p;
+    RILModem *p_modem = currentModem();
+
+    ATTokError scanError;
+    const char *p;
     int *resp = NULL;
-    int skip;
     int count = 3;
     int commas;
 
     RLOGD("parseRegistrationState. Parsing: %s",str);
-    err = at_tok_start(&line);
-    if (err < 0) goto error;
 
     /* Ok you have to be careful here
      * The solicited version of the CREG response is
@@ -1361,7 +2072,7 @@ static int parseRegistrationState(char *str, int *type, int *items, int **respon
 
     /* count number of commas */
     commas = 0;
-    for (p = line ; *p != '\0' ;p++) {
+    for (p = str ; *p != '\0' ;p++) {
         if (*p == ',') commas++;
     }
 
@@ -1369,69 +2080,55 @@ static int parseRegistrationState(char *str, int *type, int *items, int **respon
     if (!resp) goto error;
     switch (commas) {
         case 0: /* +CREG: <stat> */
-            err = at_tok_nextint(&line, &resp[0]);
-            if (err < 0) goto error;
+            if (at_tok_scan(str, "%d", &scanError, &resp[0]) < 0) goto error;
             resp[1] = -1;
             resp[2] = -1;
         break;
 
         case 1: /* +CREG: <n>, <stat> */
-            err = at_tok_nextint(&line, &skip);
-            if (err < 0) goto error;
-            err = at_tok_nextint(&line, &resp[0]);
-            if (err < 0) goto error;
+            if (at_tok_scan(str, "%*d,%d", &scanError, &resp[0]) < 0) goto error;
             resp[1] = -1;
             resp[2] = -1;
-            if (err < 0) goto error;
         break;
 
         case 2: /* +CREG: <stat>, <lac>, <cid> */
-            err = at_tok_nextint(&line, &resp[0]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[1]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[2]);
-            if (err < 0) goto error;
+            if (at_tok_scan(str, "%d,%x,%x", &scanError,
+                            &resp[0], &resp[1], &resp[2]) < 0) goto error;
         break;
         case 3: /* +CREG: <n>, <stat>, <lac>, <cid> */
-            err = at_tok_nextint(&line, &skip);
-            if (err < 0) goto error;
-            err = at_tok_nextint(&line, &resp[0]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[1]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[2]);
-            if (err < 0) goto error;
+            if (at_tok_scan(str, "%*d,%d,%x,%x", &scanError,
+                            &resp[0], &resp[1], &resp[2]) < 0) goto error;
         break;
         /* special case for CGREG, there is a fourth parameter
          * that is the network type (unknown/gprs/edge/umts)
          */
         case 4: /* +CGREG: <n>, <stat>, <lac>, <cid>, <networkType> */
-            err = at_tok_nextint(&line, &skip);
-            if (err < 0) goto error;
-            err = at_tok_nextint(&line, &resp[0]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[1]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[2]);
-            if (err < 0) goto error;
-            err = at_tok_nexthexint(&line, &resp[3]);
-            if (err < 0) goto error;
+            if (at_tok_scan(str, "%*d,%d,%x,%x,%x", &scanError,
+                            &resp[0], &resp[1], &resp[2], &resp[3]) < 0) {
+                goto error;
+            }
             count = 4;
         break;
         default:
+            scanError.reason = "too many fields";
+            scanError.field = commas;
+            scanError.offset = 0;
             goto error;
     }
-    s_lac = resp[1];
-    s_cid = resp[2];
+    p_modem->lac = resp[1];
+    p_modem->cid = resp[2];
     if (response)
         *response = resp;
     if (items)
         *items = commas + 1;
     if (type)
-        *type = techFromModemType(TECH(sMdmInfo));
+        *type = techFromModemType(TECH(p_modem->mdmInfo));
     return 0;
 error:
+    if (resp != NULL) {
+        RLOGE("invalid registration state line: %s at field %d, offset %d",
+              scanError.reason, scanError.field, scanError.offset);
+    }
     free(resp);
     return -1;
 }
@@ -1445,8 +2142,7 @@ static void requestRegistrationState(int request, void *data __unused,
     int *registration;
     char **responseStr = NULL;
     ATResponse *p_response = NULL;
-    const char *cmd;
-    const char *prefix;
+    CacheEntryId cacheId;
     char *line;
     int i = 0, j, numElements = 0;
     int count = 3;
@@ -1454,19 +2150,17 @@ static void requestRegistrationState(int request, void *data __unused,
 
     RLOGD("requestRegistrationState");
     if (request == RIL_REQUEST_VOICE_REGISTRATION_STATE) {
-        cmd = "AT+CREG?";
-        prefix = "+CREG:";
+        cacheId = CACHE_CREG;
         numElements = REG_STATE_LEN;
     } else if (request == RIL_REQUEST_DATA_REGISTRATION_STATE) {
-        cmd = "AT+CGREG?";
-        prefix = "+CGREG:";
+        cacheId = CACHE_CGREG;
         numElements = REG_DATA_STATE_LEN;
     } else {
         assert(0);
         goto error;
     }
 
-    err = at_send_command_singleline(cmd, prefix, &p_response);
+    err = sendCachedQuery(cacheId, &p_response);
 
     if (err != 0) goto error;
 
@@ -1552,6 +2246,67 @@ error:
     at_response_free(p_response);
 }
 
+/**
+ * Splits a numeric operator ("310260" or "31026") into its mcc and mnc
+ * returns 0 on success, -1 if it isn't one
+ */
+static int parseMccMnc(const char *numeric, int *p_mcc, int *p_mnc)
+{
+    size_t len = strlen(numeric);
+    size_t i;
+
+    if (len != 5 && len != 6) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (numeric[i] < '0' || numeric[i] > '9') {
+            return -1;
+        }
+    }
+
+    return sscanf(numeric, "%3d%d", p_mcc, p_mnc) == 2 ? 0 : -1;
+}
+
+/**
+ * Brings p_modem->mcc and p_modem->mnc up to date from the operator cache
+ * returns 0 on success, -1 if the modem has no numeric operator
+ */
+static int updateMccMnc()
+{
+    RILModem *p_modem = currentModem();
+    ATResponse *p_response = NULL;
+    ATLine *p_cur;
+    int ret = -1;
+
+    if (sendCachedQuery(CACHE_COPS, &p_response) != 0
+        || p_response->success == 0
+    ) {
+        goto done;
+    }
+
+    for (p_cur = p_response->p_intermediates; p_cur != NULL;
+         p_cur = p_cur->p_next) {
+        ATTokSpan numeric;
+        char buf[8];
+        int format;
+
+        if (at_tok_scan(p_cur->line, "+COPS: %*d,%d,%s", NULL,
+                        &format, &numeric) == 3
+            && format == 2
+            && at_tok_span_copy(&numeric, buf, sizeof(buf)) == 0
+            && parseMccMnc(buf, &p_modem->mcc, &p_modem->mnc) == 0
+        ) {
+            ret = 0;
+            break;
+        }
+    }
+
+done:
+    at_response_free(p_response);
+    return ret;
+}
+
 static void requestOperator(void *data __unused, size_t datalen __unused, RIL_Token t)
 {
     int err;
@@ -1564,9 +2319,7 @@ static void requestOperator(void *data __unused, size_t datalen __unused, RIL_To
 
     ATResponse *p_response = NULL;
 
-    err = at_send_command_multiline(
-        "AT+COPS=3,0;+COPS?;+COPS=3,1;+COPS?;+COPS=3,2;+COPS?",
-        "+COPS:", &p_response);
+    err = sendCachedQuery(CACHE_COPS, &p_response);
 
     /* we expect 3 lines here:
      * +COPS: 0,0,"T - Mobile"
@@ -1606,11 +2359,9 @@ static void requestOperator(void *data __unused, size_t datalen __unused, RIL_To
 
         err = at_tok_nextstr(&line, &(response[i]));
         if (err < 0) goto error;
-        // Simple assumption that mcc and mnc are 3 digits each
-        if (strlen(response[i]) == 6) {
-            if (sscanf(response[i], "%3d%3d", &s_mcc, &s_mnc) != 2) {
-                RLOGE("requestOperator expected mccmnc to be 6 decimal digits");
-            }
+        if (i == 2 && parseMccMnc(response[i], &currentModem()->mcc,
+                                  &currentModem()->mnc) < 0) {
+            RLOGE("requestOperator expected mccmnc to be 5 or 6 decimal digits");
         }
     }
 
@@ -1686,8 +2437,8 @@ static void requestSendSMS(void *data, size_t datalen, RIL_Token t)
     memset(&response, 0, sizeof(response));
     RLOGD("requestSendSMS datalen =%zu", datalen);
 
-    if (s_ims_gsm_fail != 0) goto error;
-    if (s_ims_gsm_retry != 0) goto error2;
+    if (currentModem()->imsGsmFail != 0) goto error;
+    if (currentModem()->imsGsmRetry != 0) goto error2;
 
     smsc = ((const char **)data)[0];
     pdu = ((const char **)data)[1];
@@ -1730,6 +2481,8 @@ error2:
 
 static void requestImsSendSMS(void *data, size_t datalen, RIL_Token t)
 {
+    RILModem *p_modem = currentModem();
+
     RIL_IMS_SMS_Message *p_args;
     RIL_SMS_Response response;
 
@@ -1738,18 +2491,18 @@ static void requestImsSendSMS(void *data, size_t datalen, RIL_Token t)
     RLOGD("requestImsSendSMS: datalen=%zu, "
         "registered=%d, service=%d, format=%d, ims_perm_fail=%d, "
         "ims_retry=%d, gsm_fail=%d, gsm_retry=%d",
-        datalen, s_ims_registered, s_ims_services, s_ims_format,
-        s_ims_cause_perm_failure, s_ims_cause_retry, s_ims_gsm_fail,
-        s_ims_gsm_retry);
+        datalen, p_modem->imsRegistered, p_modem->imsServices, p_modem->imsFormat,
+        p_modem->imsCausePermFailure, p_modem->imsCauseRetry, p_modem->imsGsmFail,
+        p_modem->imsGsmRetry);
 
     // figure out if this is gsm/cdma format
     // then route it to requestSendSMS vs requestCdmaSendSMS respectively
     p_args = (RIL_IMS_SMS_Message *)data;
 
-    if (0 != s_ims_cause_perm_failure ) goto error;
+    if (0 != p_modem->imsCausePermFailure ) goto error;
 
     // want to fail over ims and this is first request over ims
-    if (0 != s_ims_cause_retry && 0 == p_args->retry) goto error2;
+    if (0 != p_modem->imsCauseRetry && 0 == p_args->retry) goto error2;
 
     if (RADIO_TECH_3GPP == p_args->tech) {
         return requestSendSMS(p_args->message.gsmMessage,
@@ -1850,6 +2603,9 @@ static void requestSimTransmitApduChannel(void *data,
     char *cmd;
     char *line;
     size_t cmd_size;
+    size_t data_len;
+    uint8_t header[5];
+    char header_hex[sizeof(header) * 2 + 1];
     RIL_SIM_IO_Response sim_response;
     RIL_SIM_APDU *apdu = (RIL_SIM_APDU *)data;
 
@@ -1858,10 +2614,23 @@ static void requestSimTransmitApduChannel(void *data,
         return;
     }
 
-    cmd_size = 10 + (apdu->data ? strlen(apdu->data) : 0);
-    asprintf(&cmd, "AT+CGLA=%d,%zu,%02x%02x%02x%02x%02x%s",
-             apdu->sessionid, cmd_size, apdu->cla, apdu->instruction,
-             apdu->p1, apdu->p2, apdu->p3, apdu->data ? apdu->data : "");
+    /* the data goes onto the command line as is */
+    data_len = apdu->data ? strlen(apdu->data) : 0;
+    if (data_len > 0 && !ril_hex_validate(apdu->data, data_len)) {
+        RIL_onRequestComplete(t, RIL_E_INVALID_ARGUMENTS, NULL, 0);
+        return;
+    }
+
+    header[0] = apdu->cla;
+    header[1] = apdu->instruction;
+    header[2] = apdu->p1;
+    header[3] = apdu->p2;
+    header[4] = apdu->p3;
+    ril_hex_encode(header, sizeof(header), header_hex, sizeof(header_hex));
+
+    cmd_size = 10 + data_len;
+    asprintf(&cmd, "AT+CGLA=%d,%zu,%s%s",
+             apdu->sessionid, cmd_size, header_hex, apdu->data ? apdu->data : "");
 
     err = at_send_command_singleline(cmd, "+CGLA", &p_response);
     free(cmd);
@@ -1886,12 +2655,287 @@ static void requestSimTransmitApduChannel(void *data,
     at_response_free(p_response);
 }
 
+/*
+ * Data call setup
+ *
+ * Requests are dispatched one at a time, and bringing a data call up can
+ * take seconds, so only the first step of a setup runs on the request
+ * thread. The rest runs on the main thread, one AT command per timed
+ * callback, each queueing the next when it completes, so SIM, call and
+ * cell info polls get their turn in between. Over /dev/qmi the setup
+ * waits for the device to become readable rather than polling it.
+ *
+ * Each setup claims a PDP context of its own, so that setups for
+ * different APNs don't overwrite each other's definitions. A context is
+ * given back when its setup fails, when it's deactivated, and when the
+ * radio leaves RADIO_STATE_ON, which takes every context down.
+ */
+#define MAX_DATA_CALLS 4    /* PDP contexts 1 to MAX_DATA_CALLS */
+
+static const struct timeval TIMEVAL_DATA_SETUP_QMI = {10,0};
+static const struct timeval TIMEVAL_QMI_POLL = {1,0};
+
+typedef enum {
+    DATA_SETUP_INTERFACE_UP,
+    DATA_SETUP_DEFINE_CONTEXT,
+    DATA_SETUP_QOS_REQUIRED,
+    DATA_SETUP_QOS_MINIMUM,
+    DATA_SETUP_EVENT_REPORTING,
+    DATA_SETUP_HANGUP,
+    DATA_SETUP_DIAL,
+    DATA_SETUP_NUM_STEPS
+} DataCallSetupStep;
+
+typedef struct {
+    RIL_Token t;
+    int fd;             /* /dev/qmi, or -1 when set up over AT */
+    uint64_t deadlineNs; /* qmi: give up on the device after this */
+    int cid;
+    unsigned cidEpoch;  /* RILModem.dataCidEpoch when cid was claimed */
+    DataCallSetupStep step;
+    char *apn;
+    char *pdpType;
+} DataCallSetup;
+
+/** returns the PDP context claimed, or -1 if they're all in use */
+static int claimDataCid(unsigned *p_epoch)
+{
+    RILModem *p_modem = currentModem();
+    int cid = -1;
+    int i;
+
+    pthread_mutex_lock(&p_modem->stateMutex);
+
+    for (i = 0; i < MAX_DATA_CALLS; i++) {
+        if ((p_modem->dataCids & (1u << i)) == 0) {
+            p_modem->dataCids |= 1u << i;
+            cid = i + 1;
+            break;
+        }
+    }
+    *p_epoch = p_modem->dataCidEpoch;
+
+    pthread_mutex_unlock(&p_modem->stateMutex);
+
+    return cid;
+}
+
+/**
+ * gives "cid" back, unless the radio has gone off since it was claimed
+ * in "*p_epoch" (and so it may be someone else's by now); NULL gives it
+ * back regardless
+ */
+static void releaseDataCid(int cid, const unsigned *p_epoch)
+{
+    RILModem *p_modem = currentModem();
+
+    if (cid < 1 || cid > MAX_DATA_CALLS) {
+        return;
+    }
+
+    pthread_mutex_lock(&p_modem->stateMutex);
+
+    if (p_epoch == NULL || *p_epoch == p_modem->dataCidEpoch) {
+        p_modem->dataCids &= ~(1u << (cid - 1));
+    }
+
+    pthread_mutex_unlock(&p_modem->stateMutex);
+}
+
+static void freeDataCallSetup(DataCallSetup *p_setup)
+{
+    if (p_setup->fd >= 0) {
+        close(p_setup->fd);
+    }
+    free(p_setup->apn);
+    free(p_setup->pdpType);
+    free(p_setup);
+}
+
+static void finishDataCallSetup(DataCallSetup *p_setup, int success)
+{
+    if (p_setup->fd >= 0) {
+        close(p_setup->fd);
+        p_setup->fd = -1;
+    }
+
+    if (success) {
+        requestOrSendDataCallList(&p_setup->t);
+    } else {
+        releaseDataCid(p_setup->cid, &p_setup->cidEpoch);
+        RIL_onRequestComplete(p_setup->t, RIL_E_GENERIC_FAILURE, NULL, 0);
+    }
+
+    freeDataCallSetup(p_setup);
+}
+
+static void onQmiDataCallReadable(int fd, int timedOut, void *param);
+
+/** reads /dev/qmi once a second, for a rild without RequestFdCallback */
+static void pollQmiDataCall(void *param)
+{
+    DataCallSetup *p_setup = (DataCallSetup *)param;
+
+    onQmiDataCallReadable(p_setup->fd, ril_nano_time() >= p_setup->deadlineNs,
+                          p_setup);
+}
+
+/** waits for /dev/qmi to say something, for what's left of the deadline */
+static void waitForQmiDataCall(DataCallSetup *p_setup)
+{
+    uint64_t now = ril_nano_time();
+    uint64_t leftNs;
+    struct timeval tv;
+
+    if (!s_hasFdCallback) {
+        requestTimedCallback(pollQmiDataCall, p_setup, &TIMEVAL_QMI_POLL);
+        return;
+    }
+
+    leftNs = (now < p_setup->deadlineNs) ? p_setup->deadlineNs - now : 0;
+
+    tv.tv_sec = leftNs / 1000000000;
+    tv.tv_usec = (leftNs % 1000000000) / 1000;
+
+    requestModemFdCallback(currentModem(), p_setup->fd,
+                           onQmiDataCallReadable, p_setup, &tv);
+}
+
+/** reads the qmi interface status each time there is one */
+static void onQmiDataCallReadable(int fd, int timedOut, void *param)
+{
+    DataCallSetup *p_setup = (DataCallSetup *)param;
+    char status[32];
+    ssize_t rlen;
+    int qmistatus;
+
+    if (timedOut) {
+        RLOGE("### Failed to get data connection up\n");
+        finishDataCallSetup(p_setup, 0);
+        return;
+    }
+
+    do {
+        rlen = read(fd, status, sizeof(status) - 1);
+    } while (rlen < 0 && errno == EINTR);
+
+    if (rlen == 0 || (rlen < 0 && errno != EAGAIN)) {
+        RLOGE("### ERROR reading from /dev/qmi");
+        finishDataCallSetup(p_setup, 0);
+        return;
+    }
+
+    if (rlen > 0) {
+        status[rlen] = '\0';
+        RLOGD("### status: %s", status);
+
+        if (!strncmp(status, "STATE=up", 8) || !strcmp(status, "online")) {
+            close(p_setup->fd);
+            p_setup->fd = -1;
+
+            qmistatus = system("netcfg rmnet0 dhcp");
+
+            RLOGD("netcfg rmnet0 dhcp: status %d\n", qmistatus);
+
+            finishDataCallSetup(p_setup, qmistatus >= 0);
+            return;
+        }
+    }
+
+    waitForQmiDataCall(p_setup);
+}
+
+/**
+ * brings the data call up over AT, for modems without /dev/qmi
+ * runs one step per call and queues the next
+ */
+static void atDataCallSetup(void *param)
+{
+    DataCallSetup *p_setup = (DataCallSetup *)param;
+    ATResponse *p_response = NULL;
+    char *cmd = NULL;
+    int mustSucceed = 0;
+    int err;
+
+    switch (p_setup->step) {
+        case DATA_SETUP_INTERFACE_UP:
+            if (setInterfaceState(s_deviceCaps.radioInterfaceName,
+                                  kInterfaceUp) != RIL_E_SUCCESS) {
+                finishDataCallSetup(p_setup, 0);
+                return;
+            }
+            break;
+
+        case DATA_SETUP_DEFINE_CONTEXT:
+            asprintf(&cmd, "AT+CGDCONT=%d,\"%s\",\"%s\",,0,0", p_setup->cid,
+                     p_setup->pdpType, p_setup->apn);
+            mustSucceed = 1;
+            break;
+
+        case DATA_SETUP_QOS_REQUIRED:
+            // Set required QoS params to default
+            asprintf(&cmd, "AT+CGQREQ=%d", p_setup->cid);
+            break;
+
+        case DATA_SETUP_QOS_MINIMUM:
+            // Set minimum QoS params to default
+            asprintf(&cmd, "AT+CGQMIN=%d", p_setup->cid);
+            break;
+
+        case DATA_SETUP_EVENT_REPORTING:
+            // packet-domain event reporting
+            cmd = strdup("AT+CGEREP=1,0");
+            break;
+
+        case DATA_SETUP_HANGUP:
+            // Hangup anything that's happening there now
+            asprintf(&cmd, "AT+CGACT=0,%d", p_setup->cid);
+            break;
+
+        case DATA_SETUP_DIAL:
+            // Start data on our PDP context
+            asprintf(&cmd, "ATD*99***%d#", p_setup->cid);
+            mustSucceed = 1;
+            break;
+
+        default:
+            finishDataCallSetup(p_setup, 0);
+            return;
+    }
+
+    if (p_setup->step != DATA_SETUP_INTERFACE_UP) {
+        if (cmd == NULL) {
+            RLOGE("Unable to build data call setup command");
+            finishDataCallSetup(p_setup, 0);
+            return;
+        }
+
+        err = at_send_command(cmd, &p_response);
+        free(cmd);
+
+        if (mustSucceed && (err < 0 || p_response->success == 0)) {
+            at_response_free(p_response);
+            finishDataCallSetup(p_setup, 0);
+            return;
+        }
+
+        at_response_free(p_response);
+    }
+
+    if (++p_setup->step == DATA_SETUP_NUM_STEPS) {
+        finishDataCallSetup(p_setup, 1);
+        return;
+    }
+
+    requestTimedCallback(atDataCallSetup, p_setup, &TIMEVAL_0);
+}
+
 static void requestSetupDataCall(void *data, size_t datalen, RIL_Token t)
 {
     const char *apn;
     char *cmd;
     int err;
-    ATResponse *p_response = NULL;
+    DataCallSetup *p_setup;
 
     apn = ((const char **)data)[2];
 
@@ -1903,122 +2947,92 @@ static void requestSetupDataCall(void *data, size_t datalen, RIL_Token t)
     err = at_send_command("AT%DATA=2,\"UART\",1,,\"SER\",\"UART\",0", NULL);
 #endif /* USE_TI_COMMANDS */
 
-    int fd, qmistatus;
     size_t cur = 0;
     size_t len;
-    ssize_t written, rlen;
-    char status[32] = {0};
-    int retry = 10;
+    ssize_t written;
     const char *pdp_type;
 
     RLOGD("requesting data connection to APN '%s'", apn);
 
-    fd = open ("/dev/qmi", O_RDWR);
-    if (fd >= 0) { /* the device doesn't exist on the emulator */
+    if (datalen > 6 * sizeof(char *)) {
+        pdp_type = ((const char **)data)[6];
+    } else {
+        pdp_type = "IP";
+    }
+
+    p_setup = calloc(1, sizeof(DataCallSetup));
+    if (p_setup == NULL) {
+        goto error;
+    }
+    p_setup->t = t;
+    p_setup->fd = -1;
+    p_setup->apn = strdup(apn);
+    p_setup->pdpType = strdup(pdp_type);
+
+    if (p_setup->apn == NULL || p_setup->pdpType == NULL) {
+        RLOGE("Unable to alloc memory for data call setup");
+        freeDataCallSetup(p_setup);
+        goto error;
+    }
+
+    p_setup->cid = claimDataCid(&p_setup->cidEpoch);
+    if (p_setup->cid < 0) {
+        RLOGE("no free PDP context for APN '%s'", apn);
+        freeDataCallSetup(p_setup);
+        goto error;
+    }
+
+    p_setup->fd = open ("/dev/qmi", O_RDWR);
+    if (p_setup->fd >= 0) { /* the device doesn't exist on the emulator */
 
         RLOGD("opened the qmi device\n");
-        asprintf(&cmd, "up:%s", apn);
+        if (asprintf(&cmd, "up:%s", apn) < 0) {
+            goto qmi_error;
+        }
         len = strlen(cmd);
 
         while (cur < len) {
             do {
-                written = write (fd, cmd + cur, len - cur);
+                written = write (p_setup->fd, cmd + cur, len - cur);
             } while (written < 0 && errno == EINTR);
 
             if (written < 0) {
                 RLOGE("### ERROR writing to /dev/qmi");
-                close(fd);
-                goto error;
+                free(cmd);
+                goto qmi_error;
             }
 
             cur += written;
         }
 
-        // wait for interface to come online
-
-        do {
-            sleep(1);
-            do {
-                rlen = read(fd, status, 31);
-            } while (rlen < 0 && errno == EINTR);
-
-            if (rlen < 0) {
-                RLOGE("### ERROR reading from /dev/qmi");
-                close(fd);
-                goto error;
-            } else {
-                status[rlen] = '\0';
-                RLOGD("### status: %s", status);
-            }
-        } while (strncmp(status, "STATE=up", 8) && strcmp(status, "online") && --retry);
-
-        close(fd);
-
-        if (retry == 0) {
-            RLOGE("### Failed to get data connection up\n");
-            goto error;
-        }
-
-        qmistatus = system("netcfg rmnet0 dhcp");
-
-        RLOGD("netcfg rmnet0 dhcp: status %d\n", qmistatus);
-
-        if (qmistatus < 0) goto error;
-
-    } else {
-        bool hasWifi = hasWifiCapability();
-        const char* radioInterfaceName = getRadioInterfaceName(hasWifi);
-        if (setInterfaceState(radioInterfaceName, kInterfaceUp) != RIL_E_SUCCESS) {
-            goto error;
-        }
-
-        if (datalen > 6 * sizeof(char *)) {
-            pdp_type = ((const char **)data)[6];
-        } else {
-            pdp_type = "IP";
-        }
-
-        asprintf(&cmd, "AT+CGDCONT=1,\"%s\",\"%s\",,0,0", pdp_type, apn);
-        //FIXME check for error here
-        err = at_send_command(cmd, NULL);
         free(cmd);
 
-        // Set required QoS params to default
-        err = at_send_command("AT+CGQREQ=1", NULL);
-
-        // Set minimum QoS params to default
-        err = at_send_command("AT+CGQMIN=1", NULL);
-
-        // packet-domain event reporting
-        err = at_send_command("AT+CGEREP=1,0", NULL);
-
-        // Hangup anything that's happening there now
-        err = at_send_command("AT+CGACT=1,0", NULL);
-
-        // Start data on PDP context 1
-        err = at_send_command("ATD*99***1#", &p_response);
-
-        if (err < 0 || p_response->success == 0) {
-            goto error;
-        }
+        // wait for interface to come online, without holding up requests
+        p_setup->deadlineNs = ril_nano_time()
+                + TIMEVAL_DATA_SETUP_QMI.tv_sec * 1000000000ULL;
+        waitForQmiDataCall(p_setup);
+    } else {
+        requestTimedCallback(atDataCallSetup, p_setup, &TIMEVAL_0);
     }
 
-    requestOrSendDataCallList(&t);
-
-    at_response_free(p_response);
-
     return;
+qmi_error:
+    releaseDataCid(p_setup->cid, &p_setup->cidEpoch);
+    freeDataCallSetup(p_setup);
 error:
     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
-    at_response_free(p_response);
-
 }
 
-static void requestDeactivateDataCall(RIL_Token t)
-{
-    bool hasWifi = hasWifiCapability();
-    const char* radioInterfaceName = getRadioInterfaceName(hasWifi);
-    RIL_Errno rilErrno = setInterfaceState(radioInterfaceName, kInterfaceDown);
+static void requestDeactivateDataCall(void *data, RIL_Token t)
+{
+    const char *cid = ((const char **)data)[0];
+    RIL_Errno rilErrno = setInterfaceState(s_deviceCaps.radioInterfaceName,
+                                           kInterfaceDown);
+
+    if (cid != NULL) {
+        releaseDataCid(atoi(cid), NULL);
+    }
+
     RIL_onRequestComplete(t, rilErrno, NULL, 0);
 }
 
@@ -2064,6 +3078,13 @@ static void  requestSIM_IO(void *data, size_t datalen __unused, RIL_Token t)
 
     /* FIXME handle pin2 */
 
+    /* the data goes onto the command line as is */
+    if (p_args->data != NULL
+            && !ril_hex_validate(p_args->data, strlen(p_args->data))) {
+        RIL_onRequestComplete(t, RIL_E_INVALID_ARGUMENTS, NULL, 0);
+        return;
+    }
+
     if (p_args->data == NULL) {
         asprintf(&cmd, "AT+CRSM=%d,%d,%d,%d,%d",
                     p_args->command, p_args->fileid,
@@ -2121,6 +3142,7 @@ error:
         RIL_onRequestComplete(t, RIL_E_PASSWORD_INCORRECT, NULL, 0);
     } else {
         RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
+        restartSIMState(0);
     }
     at_response_free(p_response);
 }
@@ -2178,46 +3200,297 @@ static int techFromModemType(int mdmtype)
     return ret;
 }
 
-static void requestGetCellInfoList(void *data __unused, size_t datalen __unused, RIL_Token t)
+/*
+ * Cell info
+ *
+ * The serving cell is put together from the registration, operator and
+ * signal strength answers, which the modem cache mostly holds already.
+ * RIL_UNSOL_CELL_INFO_LIST goes out at the rate the framework asked for,
+ * and only when the list differs from the last one sent. A rate of 0
+ * means "whenever it changes", which registration and signal strength
+ * lines tell us about; without AT+CREG=2 they don't say when the cell
+ * changes, so that is polled for every CELL_INFO_LOCATION_POLL_MSEC.
+ */
+#define MAX_CELL_INFOS 1
+#define CELL_INFO_LOCATION_POLL_MSEC 10000
+
+struct CellInfoState {
+    pthread_mutex_t mutex;
+    int rateMsec;           /* INT_MAX for never */
+    unsigned pollToken;     /* identifies the one poll chain that may run */
+    int checkPending;       /* a change-driven check is scheduled */
+    int lastCount;          /* -1 until a list has been sent */
+    RIL_CellInfo_v12 last[MAX_CELL_INFOS];
+};
+
+/**
+ * fills in "cells", which must hold MAX_CELL_INFOS entries
+ * returns the number of cells, or -1 on error
+ */
+static int getCellInfo(RIL_CellInfo_v12 *cells)
 {
-    uint64_t curTime = ril_nano_time();
-    RIL_CellInfo_v12 ci[1] =
-    {
-        { // ci[0]
-            1, // cellInfoType
-            1, // registered
-            RIL_TIMESTAMP_TYPE_MODEM,
-            curTime - 1000, // Fake some time in the past
-            { // union CellInfo
-                {  // RIL_CellInfoGsm gsm
-                    {  // gsm.cellIdneityGsm
-                        s_mcc, // mcc
-                        s_mnc, // mnc
-                        s_lac, // lac
-                        s_cid, // cid
-                        0, //arfcn unknown
-                        0xFF, // bsic unknown
-                    },
-                    {  // gsm.signalStrengthGsm
-                        10, // signalStrength
-                        0  // bitErrorRate
-                        , INT_MAX // timingAdvance invalid value
-                    }
-                }
-            }
+    RILModem *p_modem = currentModem();
+    ATResponse *p_response = NULL;
+    int *regState = NULL;
+    int registered;
+    int rssi = 99;  // unknown, see TS 27.007 8.5
+    int ber = 99;
+    int err;
+
+    /*
+     * Without AT+CREG=2 no unsolicited line says the cell moved, so the
+     * cached answer can't be trusted for the location
+     */
+    err = sendCachedQueryMaxAge(CACHE_CREG,
+                                p_modem->cregLocation
+                                    ? s_cacheQueries[CACHE_CREG].maxAgeMsec
+                                    : 0,
+                                &p_response);
+
+    if (err < 0 || p_response->success == 0) goto error;
+
+    /* also brings p_modem->lac and p_modem->cid up to date */
+    err = parseRegistrationState(p_response->p_intermediates->line,
+                                 NULL, NULL, &regState);
+    if (err < 0) goto error;
+
+    registered = (regState[0] == 1 || regState[0] == 5);
+    free(regState);
+    at_response_free(p_response);
+    p_response = NULL;
+
+    if (!registered) {
+        return 0;
+    }
+
+    /* the operator cache goes with the registration, so this is cheap */
+    if (updateMccMnc() < 0) {
+        RLOGW("no numeric operator for cell info, reporting the last one");
+    }
+
+    err = sendCachedQuery(CACHE_CSQ, &p_response);
+
+    if (err == 0 && p_response->success != 0) {
+        at_tok_scan(p_response->p_intermediates->line, "+CSQ: %d,%d", NULL,
+                    &rssi, &ber);
+    }
+
+    at_response_free(p_response);
+
+    /* cellInfoDiffers compares whole entries, padding and all */
+    memset(&cells[0], 0, sizeof(cells[0]));
+
+    cells[0].cellInfoType = RIL_CELL_INFO_TYPE_GSM;
+    cells[0].registered = 1;
+    cells[0].timeStampType = RIL_TIMESTAMP_TYPE_MODEM;
+    cells[0].timeStamp = ril_nano_time();
+    cells[0].CellInfo.gsm.cellIdentityGsm.mcc = p_modem->mcc;
+    cells[0].CellInfo.gsm.cellIdentityGsm.mnc = p_modem->mnc;
+    cells[0].CellInfo.gsm.cellIdentityGsm.lac = p_modem->lac;
+    cells[0].CellInfo.gsm.cellIdentityGsm.cid = p_modem->cid;
+    cells[0].CellInfo.gsm.cellIdentityGsm.arfcn = 0;      // unknown
+    cells[0].CellInfo.gsm.cellIdentityGsm.bsic = 0xFF;    // unknown
+    cells[0].CellInfo.gsm.signalStrengthGsm.signalStrength = rssi;
+    cells[0].CellInfo.gsm.signalStrengthGsm.bitErrorRate = ber;
+    cells[0].CellInfo.gsm.signalStrengthGsm.timingAdvance = INT_MAX;
+
+    return 1;
+
+error:
+    at_response_free(p_response);
+    return -1;
+}
+
+/** returns 1 if the lists differ in anything but their timestamps */
+static int cellInfoDiffers(const RIL_CellInfo_v12 *old, int oldCount,
+                           const RIL_CellInfo_v12 *cells, int count)
+{
+    RIL_CellInfo_v12 a, b;
+    int i;
+
+    if (oldCount != count) {
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        a = old[i];
+        b = cells[i];
+        a.timeStamp = b.timeStamp = 0;
+
+        if (memcmp(&a, &b, sizeof(a)) != 0) {
+            return 1;
         }
-    };
+    }
+
+    return 0;
+}
+
+/**
+ * called with CellInfoState.mutex held
+ * returns how often the cells are polled, or 0 if they aren't
+ */
+static int cellInfoPollMsec_locked()
+{
+    RILModem *p_modem = currentModem();
+    int rateMsec = p_modem->cellInfo->rateMsec;
+
+    if (rateMsec == 0 && !p_modem->cregLocation) {
+        return CELL_INFO_LOCATION_POLL_MSEC;
+    }
+
+    return (rateMsec != INT_MAX) ? rateMsec : 0;
+}
+
+/**
+ * called with CellInfoState.mutex held
+ * "periodic" checks carry the poll chain on, the others are one-offs for
+ * a change
+ */
+static void scheduleCellInfoCheck_locked(int delayMsec, int periodic)
+{
+    CellInfoState *p_cellInfo = currentModem()->cellInfo;
+    struct timeval tv;
+
+    tv.tv_sec = delayMsec / 1000;
+    tv.tv_usec = (delayMsec % 1000) * 1000;
+
+    requestTimedCallback(periodic ? checkCellInfo : checkCellInfoChange,
+                         (void *)(uintptr_t)p_cellInfo->pollToken, &tv);
+}
+
+/** sends RIL_UNSOL_CELL_INFO_LIST if the cells have changed */
+static void runCellInfoCheck(unsigned token, int periodic)
+{
+    CellInfoState *p_cellInfo = currentModem()->cellInfo;
+    RIL_CellInfo_v12 cells[MAX_CELL_INFOS];
+    int pollMsec;
+    int count = -1;
+    int changed = 0;
+
+    pthread_mutex_lock(&p_cellInfo->mutex);
+
+    if (token != p_cellInfo->pollToken || p_cellInfo->rateMsec == INT_MAX) {
+        // superseded, or no longer wanted
+        pthread_mutex_unlock(&p_cellInfo->mutex);
+        return;
+    }
+
+    if (!periodic) {
+        p_cellInfo->checkPending = 0;
+    }
+
+    pthread_mutex_unlock(&p_cellInfo->mutex);
+
+    if (currentModem()->radioState == RADIO_STATE_ON) {
+        count = getCellInfo(cells);
+    }
+
+    pthread_mutex_lock(&p_cellInfo->mutex);
+
+    if (token != p_cellInfo->pollToken) {
+        pthread_mutex_unlock(&p_cellInfo->mutex);
+        return;
+    }
+
+    if (count >= 0
+        && (p_cellInfo->lastCount < 0
+            || cellInfoDiffers(p_cellInfo->last, p_cellInfo->lastCount,
+                               cells, count))
+    ) {
+        memcpy(p_cellInfo->last, cells, count * sizeof(RIL_CellInfo_v12));
+        p_cellInfo->lastCount = count;
+        changed = 1;
+    }
+
+    pollMsec = cellInfoPollMsec_locked();
+
+    if (periodic && pollMsec > 0) {
+        scheduleCellInfoCheck_locked(pollMsec, 1);
+    }
+
+    pthread_mutex_unlock(&p_cellInfo->mutex);
+
+    if (changed) {
+        RIL_onUnsolicitedResponse(RIL_UNSOL_CELL_INFO_LIST,
+                                  count > 0 ? cells : NULL,
+                                  count * sizeof(RIL_CellInfo_v12));
+    }
+}
+
+static void checkCellInfo(void *param)
+{
+    runCellInfoCheck((unsigned)(uintptr_t)param, 1);
+}
+
+static void checkCellInfoChange(void *param)
+{
+    runCellInfoCheck((unsigned)(uintptr_t)param, 0);
+}
+
+/**
+ * Called on the reader thread after a line that may have changed the
+ * cells, once the modem cache has taken it in
+ */
+static void onCellInfoMayHaveChanged()
+{
+    CellInfoState *p_cellInfo = currentModem()->cellInfo;
+
+    pthread_mutex_lock(&p_cellInfo->mutex);
+
+    if (p_cellInfo->rateMsec == 0 && !p_cellInfo->checkPending) {
+        p_cellInfo->checkPending = 1;
+        /* can't issue AT commands here -- call on main thread */
+        scheduleCellInfoCheck_locked(0, 0);
+    }
+
+    pthread_mutex_unlock(&p_cellInfo->mutex);
+}
+
+static void requestGetCellInfoList(void *data __unused, size_t datalen __unused, RIL_Token t)
+{
+    RIL_CellInfo_v12 ci[MAX_CELL_INFOS];
+    int count;
+
+    count = getCellInfo(ci);
+
+    if (count < 0) {
+        RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
+        return;
+    }
 
-    RIL_onRequestComplete(t, RIL_E_SUCCESS, ci, sizeof(ci));
+    RIL_onRequestComplete(t, RIL_E_SUCCESS, count > 0 ? ci : NULL,
+                          count * sizeof(RIL_CellInfo_v12));
 }
 
 
 static void requestSetCellInfoListRate(void *data, size_t datalen __unused, RIL_Token t)
 {
-    // For now we'll save the rate but no RIL_UNSOL_CELL_INFO_LIST messages
-    // will be sent.
+    CellInfoState *p_cellInfo = currentModem()->cellInfo;
+
     assert (datalen == sizeof(int));
-    s_cell_info_rate_ms = ((int *)data)[0];
+
+    pthread_mutex_lock(&p_cellInfo->mutex);
+
+    p_cellInfo->rateMsec = ((int *)data)[0];
+
+    /* start a new chain, with a full list first */
+    p_cellInfo->pollToken++;
+    p_cellInfo->checkPending = 0;
+    p_cellInfo->lastCount = -1;
+
+    if (p_cellInfo->rateMsec == 0) {
+        p_cellInfo->checkPending = 1;
+        scheduleCellInfoCheck_locked(0, 0);
+
+        /* and poll for what no line will tell us about */
+        if (cellInfoPollMsec_locked() > 0) {
+            scheduleCellInfoCheck_locked(cellInfoPollMsec_locked(), 1);
+        }
+    } else if (p_cellInfo->rateMsec != INT_MAX) {
+        scheduleCellInfoCheck_locked(0, 1);
+    }
+
+    pthread_mutex_unlock(&p_cellInfo->mutex);
 
     RIL_onRequestComplete(t, RIL_E_SUCCESS, NULL, 0);
 }
@@ -2291,19 +3564,34 @@ static void requestGetMute(void *data, size_t datalen, RIL_Token t)
  * Because onRequest function could be called from multiple different thread,
  * we must ensure that the underlying at_send_command_* function
  * is atomic.
+ *
+ * With ANDROID_MULTI_SIM, "socket_id" picks the modem the request is for.
  */
+#if defined(ANDROID_MULTI_SIM)
+static void
+onRequest (int request, void *data, size_t datalen, RIL_Token t,
+           RIL_SOCKET_ID socket_id)
+#else
 static void
 onRequest (int request, void *data, size_t datalen, RIL_Token t)
+#endif
 {
+#if defined(ANDROID_MULTI_SIM)
+    RILModem *p_modem = &s_modems[socket_id];
+#else
+    RILModem *p_modem = &s_modems[0];
+#endif
     ATResponse *p_response;
     int err;
 
+    selectModem(p_modem);
+
     RLOGD("onRequest: %s", requestToString(request));
 
     /* Ignore all requests except RIL_REQUEST_GET_SIM_STATUS
      * when RADIO_STATE_UNAVAILABLE.
      */
-    if (sState == RADIO_STATE_UNAVAILABLE
+    if (p_modem->radioState == RADIO_STATE_UNAVAILABLE
         && request != RIL_REQUEST_GET_SIM_STATUS
     ) {
         RIL_onRequestComplete(t, RIL_E_RADIO_NOT_AVAILABLE, NULL, 0);
@@ -2313,7 +3601,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
     /* Ignore all non-power requests when RADIO_STATE_OFF
      * (except RIL_REQUEST_GET_SIM_STATUS)
      */
-    if (sState == RADIO_STATE_OFF) {
+    if (p_modem->radioState == RADIO_STATE_OFF) {
         switch(request) {
             case RIL_REQUEST_BASEBAND_VERSION:
             case RIL_REQUEST_CDMA_GET_SUBSCRIPTION_SOURCE:
@@ -2356,6 +3644,8 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
         }
     }
 
+    cacheInvalidateForRequest(request);
+
     switch (request) {
         case RIL_REQUEST_GET_SIM_STATUS: {
             RIL_CardStatus_v6 *p_card_status;
@@ -2394,7 +3684,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             at_send_command("ATA", NULL);
 
 #ifdef WORKAROUND_ERRONEOUS_ANSWER
-            s_expectAnswer = 1;
+            p_modem->expectAnswer = 1;
 #endif /* WORKAROUND_ERRONEOUS_ANSWER */
 
             if (getSIMStatus() != SIM_READY) {
@@ -2473,7 +3763,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             requestSetupDataCall(data, datalen, t);
             break;
         case RIL_REQUEST_DEACTIVATE_DATA_CALL:
-            requestDeactivateDataCall(t);
+            requestDeactivateDataCall(data, t);
             break;
         case RIL_REQUEST_SMS_ACKNOWLEDGE:
             requestSMSAcknowledge(data, datalen, t);
@@ -2600,13 +3890,13 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
         case RIL_REQUEST_IMS_REGISTRATION_STATE: {
             int reply[2];
             //0==unregistered, 1==registered
-            reply[0] = s_ims_registered;
+            reply[0] = p_modem->imsRegistered;
 
             //to be used when changed to include service supporated info
-            //reply[1] = s_ims_services;
+            //reply[1] = p_modem->imsServices;
 
             // FORMAT_3GPP(1) vs FORMAT_3GPP2(2);
-            reply[1] = s_ims_format;
+            reply[1] = p_modem->imsFormat;
 
             RLOGD("IMS_REGISTRATION=%d, format=%d ",
                     reply[0], reply[1]);
@@ -2620,7 +3910,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
 
         case RIL_REQUEST_VOICE_RADIO_TECH:
             {
-                int tech = techFromModemType(TECH(sMdmInfo));
+                int tech = techFromModemType(TECH(p_modem->mdmInfo));
                 if (tech < 0 )
                     RIL_onRequestComplete(t, RIL_E_GENERIC_FAILURE, NULL, 0);
                 else
@@ -2704,7 +3994,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_CDMA_QUERY_ROAMING_PREFERENCE:
-            if (TECH_BIT(sMdmInfo) == MDM_CDMA) {
+            if (TECH_BIT(p_modem->mdmInfo) == MDM_CDMA) {
                 requestCdmaGetRoamingPreference(request, data, datalen, t);
             } else {
                 RIL_onRequestComplete(t, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
@@ -2712,7 +4002,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_CDMA_SET_SUBSCRIPTION_SOURCE:
-            if (TECH_BIT(sMdmInfo) == MDM_CDMA) {
+            if (TECH_BIT(p_modem->mdmInfo) == MDM_CDMA) {
                 requestCdmaSetSubscriptionSource(request, data, datalen, t);
             } else {
                 // VTS tests expect us to silently do nothing
@@ -2721,7 +4011,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_CDMA_SET_ROAMING_PREFERENCE:
-            if (TECH_BIT(sMdmInfo) == MDM_CDMA) {
+            if (TECH_BIT(p_modem->mdmInfo) == MDM_CDMA) {
                 requestCdmaSetRoamingPreference(request, data, datalen, t);
             } else {
                 // VTS tests expect us to silently do nothing
@@ -2730,7 +4020,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         case RIL_REQUEST_EXIT_EMERGENCY_CALLBACK_MODE:
-            if (TECH_BIT(sMdmInfo) == MDM_CDMA) {
+            if (TECH_BIT(p_modem->mdmInfo) == MDM_CDMA) {
                 requestExitEmergencyMode(data, datalen, t);
             } else {
                 // VTS tests expect us to silently do nothing
@@ -2739,7 +4029,7 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
             break;
 
         default:
-            RLOGD("Request not supported. Tech: %d",TECH(sMdmInfo));
+            RLOGD("Request not supported. Tech: %d",TECH(p_modem->mdmInfo));
             RIL_onRequestComplete(t, RIL_E_REQUEST_NOT_SUPPORTED, NULL, 0);
             break;
     }
@@ -2749,11 +4039,19 @@ onRequest (int request, void *data, size_t datalen, RIL_Token t)
  * Synchronous call from the RIL to us to return current radio state.
  * RADIO_STATE_UNAVAILABLE should be the initial state.
  */
+#if defined(ANDROID_MULTI_SIM)
+static RIL_RadioState
+currentState(RIL_SOCKET_ID socket_id)
+{
+    return s_modems[socket_id].radioState;
+}
+#else
 static RIL_RadioState
 currentState()
 {
-    return sState;
+    return s_modems[0].radioState;
 }
+#endif
 /**
  * Call from RIL to us to find out whether a specific request code
  * is supported by this implementation.
@@ -2791,7 +4089,7 @@ setRadioTechnology(ModemInfo *mdm, int newtech)
         RLOGD("Tech change (%d => %d)", oldtech, newtech);
         TECH(mdm) = newtech;
         if (techFromModemType(newtech) != techFromModemType(oldtech)) {
-            int tech = techFromModemType(TECH(sMdmInfo));
+            int tech = techFromModemType(TECH(currentModem()->mdmInfo));
             if (tech > 0 ) {
                 RIL_onUnsolicitedResponse(RIL_UNSOL_VOICE_RADIO_TECH_CHANGED,
                                           &tech, sizeof(tech));
@@ -2803,14 +4101,16 @@ setRadioTechnology(ModemInfo *mdm, int newtech)
 static void
 setRadioState(RIL_RadioState newState)
 {
+    RILModem *p_modem = currentModem();
+
     RLOGD("setRadioState(%d)", newState);
     RIL_RadioState oldState;
 
-    pthread_mutex_lock(&s_state_mutex);
+    pthread_mutex_lock(&p_modem->stateMutex);
 
-    oldState = sState;
+    oldState = p_modem->radioState;
 
-    if (s_closed > 0) {
+    if (p_modem->closed > 0) {
         // If we're closed, the only reasonable state is
         // RADIO_STATE_UNAVAILABLE
         // This is here because things on the main thread
@@ -2819,17 +4119,25 @@ setRadioState(RIL_RadioState newState)
         newState = RADIO_STATE_UNAVAILABLE;
     }
 
-    if (sState != newState || s_closed > 0) {
-        sState = newState;
+    if (p_modem->radioState != newState || p_modem->closed > 0) {
+        p_modem->radioState = newState;
+
+        if (newState != RADIO_STATE_ON && p_modem->dataCids != 0) {
+            p_modem->dataCids = 0;
+            p_modem->dataCidEpoch++;
+        }
 
-        pthread_cond_broadcast (&s_state_cond);
+        pthread_cond_broadcast (&p_modem->stateCond);
     }
 
-    pthread_mutex_unlock(&s_state_mutex);
+    pthread_mutex_unlock(&p_modem->stateMutex);
 
 
     /* do these outside of the mutex */
-    if (sState != oldState) {
+    if (p_modem->radioState != oldState) {
+        cacheInvalidateAll();
+        invalidateSIMState();
+
         RIL_onUnsolicitedResponse (RIL_UNSOL_RESPONSE_RADIO_STATE_CHANGED,
                                     NULL, 0);
         // Sim state can change as result of radio state change
@@ -2841,7 +4149,7 @@ setRadioState(RIL_RadioState newState)
          * Currently, this doesn't happen, but if that changes then these
          * will need to be dispatched on the request thread
          */
-        if (sState == RADIO_STATE_ON) {
+        if (p_modem->radioState == RADIO_STATE_ON) {
             onRadioPowerOn();
         }
     }
@@ -2856,8 +4164,9 @@ getRUIMStatus()
     int ret;
     char *cpinLine;
     char *cpinResult;
+    RIL_RadioState radioState = currentModem()->radioState;
 
-    if (sState == RADIO_STATE_OFF || sState == RADIO_STATE_UNAVAILABLE) {
+    if (radioState == RADIO_STATE_OFF || radioState == RADIO_STATE_UNAVAILABLE) {
         ret = SIM_NOT_READY;
         goto done;
     }
@@ -2924,17 +4233,81 @@ done:
     return ret;
 }
 
+/*
+ * SIM state machine
+ *
+ * The SIM state is asked of the modem once and then kept here. AT+CPIN?
+ * is polled, backing off exponentially, until the SIM settles. After that
+ * a modem that has been seen to announce SIM changes with an unsolicited
+ * "+CPIN:" line keeps the state current by itself; for one that hasn't
+ * (the emulator never does) polling carries on every
+ * SIM_POLL_SETTLED_MSEC so that a removed or inserted SIM is noticed.
+ * A radio state change or a PIN entry throws the state away, along with
+ * the card status built from it.
+ */
+#define SIM_POLL_MIN_MSEC 250
+#define SIM_POLL_MAX_MSEC 8000
+#define SIM_POLL_SETTLED_MSEC 30000
+
+struct SIMState {
+    pthread_mutex_t mutex;
+    int status;             /* SIM_Status, or -1 if not known */
+    int reported;           /* last status the framework was told about */
+    unsigned generation;    /* bumped on every change to status */
+    unsigned pollToken;     /* identifies the one poll that may run */
+    int pollMsec;           /* delay before the next poll */
+    int unsolicited;        /* the modem has sent an unsolicited "+CPIN:" */
+    int cardStatusValid;
+    RIL_CardStatus_v6 cardStatus;
+};
+
+/**
+ * maps the answer in a "+CPIN:" line to a SIM_Status
+ * returns -1 if the line can't be parsed
+ */
+static int simStatusFromCPINLine(const char *line)
+{
+    static const struct {
+        const char *code;
+        SIM_Status status;
+    } codes[] = {
+        { "READY", SIM_READY },
+        { "SIM PIN", SIM_PIN },
+        { "SIM PUK", SIM_PUK },
+        { "PH-NET PIN", SIM_NETWORK_PERSONALIZATION },
+        { "NOT READY", SIM_NOT_READY },
+    };
+    ATTokSpan code;
+    size_t i;
+
+    if (at_tok_scan(line, "+CPIN: %s", NULL, &code) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < NUM_ELEMS(codes); i++) {
+        if (code.len == strlen(codes[i].code)
+            && memcmp(code.str, codes[i].code, code.len) == 0
+        ) {
+            if (codes[i].status == SIM_READY && currentModem()->radioState != RADIO_STATE_ON) {
+                return SIM_NOT_READY;
+            }
+            return codes[i].status;
+        }
+    }
+
+    /* we're treating unsupported lock types as "sim absent" */
+    return SIM_ABSENT;
+}
+
 /** Returns SIM_NOT_READY on error */
 static SIM_Status
-getSIMStatus()
+querySIMStatus()
 {
     ATResponse *p_response = NULL;
     int err;
     int ret;
-    char *cpinLine;
-    char *cpinResult;
 
-    RLOGD("getSIMStatus(). sState: %d",sState);
+    RLOGD("querySIMStatus(). radioState: %d",currentModem()->radioState);
     err = at_send_command_singleline("AT+CPIN?", "+CPIN:", &p_response);
 
     if (err != 0) {
@@ -2957,54 +4330,211 @@ getSIMStatus()
 
     /* CPIN? has succeeded, now look at the result */
 
-    cpinLine = p_response->p_intermediates->line;
-    err = at_tok_start (&cpinLine);
+    ret = simStatusFromCPINLine(p_response->p_intermediates->line);
 
-    if (err < 0) {
+    if (ret < 0) {
         ret = SIM_NOT_READY;
-        goto done;
     }
 
-    err = at_tok_nextstr(&cpinLine, &cpinResult);
+done:
+    at_response_free(p_response);
+    return ret;
+}
 
-    if (err < 0) {
-        ret = SIM_NOT_READY;
-        goto done;
+/** called with SIMState.mutex held */
+static void setSIMStatus_locked(int status)
+{
+    SIMState *p_sim = currentModem()->simState;
+
+    if (status != p_sim->status) {
+        p_sim->status = status;
+        p_sim->cardStatusValid = 0;
+    }
+    p_sim->generation++;
+}
+
+/** called with SIMState.mutex held */
+static void scheduleSIMPoll_locked(int delayMsec)
+{
+    SIMState *p_sim = currentModem()->simState;
+    struct timeval tv;
+
+    tv.tv_sec = delayMsec / 1000;
+    tv.tv_usec = (delayMsec % 1000) * 1000;
+
+    /* any poll already scheduled becomes stale */
+    p_sim->pollToken++;
+    requestTimedCallback(pollSIMState,
+                         (void *)(uintptr_t)p_sim->pollToken, &tv);
+}
+
+/**
+ * Called with SIMState.mutex held once the SIM has settled: keeps polling
+ * slowly unless the modem tells us about changes by itself
+ */
+static void scheduleSettledSIMPoll_locked()
+{
+    SIMState *p_sim = currentModem()->simState;
+
+    if (p_sim->unsolicited) {
+        /* nothing left to poll for */
+        p_sim->pollToken++;
+    } else {
+        scheduleSIMPoll_locked(SIM_POLL_SETTLED_MSEC);
+    }
+}
+
+/**
+ * Tells the framework about the SIM state, if it has settled on
+ * something new
+ * Must be called where AT commands may be issued
+ */
+static void reportSIMState(void *param __unused)
+{
+    SIMState *p_sim = currentModem()->simState;
+    int status;
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    status = p_sim->status;
+
+    if (status < 0 || status == SIM_NOT_READY
+        || status == p_sim->reported
+    ) {
+        pthread_mutex_unlock(&p_sim->mutex);
+        return;
+    }
+
+    p_sim->reported = status;
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    if (status == SIM_READY) {
+        RLOGI("SIM_READY");
+        onSIMReady();
+    } else {
+        RLOGI("SIM ABSENT or LOCKED");
+    }
+
+    RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
+}
+
+/**
+ * Throws the SIM state away and starts polling for it again
+ * "forget" also forgets what the framework was last told, so that it's
+ * told again (and onSIMReady() is redone) even if the state comes back
+ * the same
+ */
+static void restartSIMState(int forget)
+{
+    SIMState *p_sim = currentModem()->simState;
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    setSIMStatus_locked(-1);
+
+    if (forget) {
+        p_sim->reported = -1;
+    }
+
+    p_sim->pollMsec = SIM_POLL_MIN_MSEC;
+    scheduleSIMPoll_locked(0);
+
+    pthread_mutex_unlock(&p_sim->mutex);
+}
+
+/** Throws the SIM state away; it's asked for again when next needed */
+static void invalidateSIMState()
+{
+    SIMState *p_sim = currentModem()->simState;
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    setSIMStatus_locked(-1);
+    p_sim->reported = -1;
+
+    /* and stop polling for it */
+    p_sim->pollToken++;
+
+    pthread_mutex_unlock(&p_sim->mutex);
+}
+
+/** Called on the reader thread for an unsolicited "+CPIN:" line */
+static void onSIMStatusLine(const char *s)
+{
+    SIMState *p_sim = currentModem()->simState;
+    int status = simStatusFromCPINLine(s);
+
+    if (status < 0) {
+        RLOGE("invalid CPIN line %s\n", s);
+        return;
+    }
+
+    if (status == SIM_NOT_READY) {
+        restartSIMState(0);
+        return;
+    }
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    setSIMStatus_locked(status);
+
+    p_sim->unsolicited = 1;
+    scheduleSettledSIMPoll_locked();
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    /* can't issue AT commands here -- call on main thread */
+    requestTimedCallback(reportSIMState, NULL, &TIMEVAL_0);
+}
+
+/** Returns SIM_NOT_READY on error */
+static SIM_Status
+getSIMStatus()
+{
+    SIMState *p_sim = currentModem()->simState;
+    unsigned generation;
+    int status;
+    int report = 0;
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    status = p_sim->status;
+    generation = p_sim->generation;
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    if (status >= 0) {
+        return status;
+    }
+
+    status = querySIMStatus();
+
+    if (status == SIM_NOT_READY) {
+        /* not settled yet; the poll will keep asking */
+        return status;
     }
 
-    if (0 == strcmp (cpinResult, "SIM PIN")) {
-        ret = SIM_PIN;
-        goto done;
-    } else if (0 == strcmp (cpinResult, "SIM PUK")) {
-        ret = SIM_PUK;
-        goto done;
-    } else if (0 == strcmp (cpinResult, "PH-NET PIN")) {
-        return SIM_NETWORK_PERSONALIZATION;
-    } else if (0 != strcmp (cpinResult, "READY"))  {
-        /* we're treating unsupported lock types as "sim absent" */
-        ret = SIM_ABSENT;
-        goto done;
+    pthread_mutex_lock(&p_sim->mutex);
+
+    /* don't overwrite anything that happened while we were asking */
+    if (generation == p_sim->generation) {
+        setSIMStatus_locked(status);
+        scheduleSettledSIMPoll_locked();
+        report = (status != p_sim->reported);
     }
 
-    at_response_free(p_response);
-    p_response = NULL;
-    cpinResult = NULL;
+    pthread_mutex_unlock(&p_sim->mutex);
 
-    ret = (sState == RADIO_STATE_ON) ? SIM_READY : SIM_NOT_READY;
+    if (report) {
+        requestTimedCallback(reportSIMState, NULL, &TIMEVAL_0);
+    }
 
-done:
-    at_response_free(p_response);
-    return ret;
+    return status;
 }
 
-
-/**
- * Get the current card status.
- *
- * This must be freed using freeCardStatus.
- * @return: On success returns RIL_E_SUCCESS
- */
-static int getCardStatus(RIL_CardStatus_v6 **pp_card_status) {
+/** fills in "p_card_status" to reflect "sim_status" */
+static void buildCardStatus(int sim_status, RIL_CardStatus_v6 *p_card_status) {
     static RIL_AppStatus app_status_array[] = {
         // SIM_ABSENT = 0
         { RIL_APPTYPE_UNKNOWN, RIL_APPSTATE_UNKNOWN, RIL_PERSOSUBSTATE_UNKNOWN,
@@ -3065,7 +4595,6 @@ static int getCardStatus(RIL_CardStatus_v6 **pp_card_status) {
     RIL_CardState card_state;
     int num_apps;
 
-    int sim_status = getSIMStatus();
     if (sim_status == SIM_ABSENT) {
         card_state = RIL_CARDSTATE_ABSENT;
         num_apps = 0;
@@ -3074,8 +4603,7 @@ static int getCardStatus(RIL_CardStatus_v6 **pp_card_status) {
         num_apps = 3;
     }
 
-    // Allocate and initialize base card status.
-    RIL_CardStatus_v6 *p_card_status = malloc(sizeof(RIL_CardStatus_v6));
+    // Initialize base card status.
     p_card_status->card_state = card_state;
     p_card_status->universal_pin_state = RIL_PINSTATE_UNKNOWN;
     p_card_status->gsm_umts_subscription_app_index = -1;
@@ -3102,6 +4630,44 @@ static int getCardStatus(RIL_CardStatus_v6 **pp_card_status) {
         p_card_status->applications[1] = app_status_array[sim_status + RUIM_ABSENT];
         p_card_status->applications[2] = app_status_array[sim_status + ISIM_ABSENT];
     }
+}
+
+/**
+ * Get the current card status.
+ *
+ * This must be freed using freeCardStatus.
+ * @return: On success returns RIL_E_SUCCESS
+ */
+static int getCardStatus(RIL_CardStatus_v6 **pp_card_status) {
+    SIMState *p_sim = currentModem()->simState;
+
+    RIL_CardStatus_v6 *p_card_status = malloc(sizeof(RIL_CardStatus_v6));
+    int sim_status;
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    if (p_sim->cardStatusValid) {
+        *p_card_status = p_sim->cardStatus;
+        pthread_mutex_unlock(&p_sim->mutex);
+
+        *pp_card_status = p_card_status;
+        return RIL_E_SUCCESS;
+    }
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    sim_status = getSIMStatus();
+    buildCardStatus(sim_status, p_card_status);
+
+    pthread_mutex_lock(&p_sim->mutex);
+
+    /* only worth keeping while the status it reflects is current */
+    if (sim_status == p_sim->status) {
+        p_sim->cardStatus = *p_card_status;
+        p_sim->cardStatusValid = 1;
+    }
+
+    pthread_mutex_unlock(&p_sim->mutex);
 
     *pp_card_status = p_card_status;
     return RIL_E_SUCCESS;
@@ -3120,36 +4686,58 @@ static void freeCardStatus(RIL_CardStatus_v6 *p_card_status) {
  *  (all SMS-related commands)
  */
 
-static void pollSIMState (void *param __unused)
+static void pollSIMState (void *param)
 {
-    ATResponse *p_response;
-    int ret;
+    SIMState *p_sim = currentModem()->simState;
+    unsigned token = (unsigned)(uintptr_t)param;
+    unsigned generation;
+    int status;
 
-    if (sState != RADIO_STATE_UNAVAILABLE) {
-        // no longer valid to poll
+    pthread_mutex_lock(&p_sim->mutex);
+
+    if (token != p_sim->pollToken) {
+        // superseded, or no longer needed
+        pthread_mutex_unlock(&p_sim->mutex);
         return;
     }
 
-    switch(getSIMStatus()) {
-        case SIM_ABSENT:
-        case SIM_PIN:
-        case SIM_PUK:
-        case SIM_NETWORK_PERSONALIZATION:
-        default:
-            RLOGI("SIM ABSENT or LOCKED");
-            RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
+    generation = p_sim->generation;
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    if (currentModem()->radioState != RADIO_STATE_ON) {
+        // no longer valid to poll
         return;
+    }
+
+    status = querySIMStatus();
 
-        case SIM_NOT_READY:
-            RIL_requestTimedCallback (pollSIMState, NULL, &TIMEVAL_SIMPOLL);
+    pthread_mutex_lock(&p_sim->mutex);
+
+    if (token != p_sim->pollToken || generation != p_sim->generation) {
+        // the state was set or thrown away while we were asking
+        pthread_mutex_unlock(&p_sim->mutex);
         return;
+    }
 
-        case SIM_READY:
-            RLOGI("SIM_READY");
-            onSIMReady();
-            RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_SIM_STATUS_CHANGED, NULL, 0);
+    if (status == SIM_NOT_READY) {
+        scheduleSIMPoll_locked(p_sim->pollMsec);
+
+        p_sim->pollMsec *= 2;
+        if (p_sim->pollMsec > SIM_POLL_MAX_MSEC) {
+            p_sim->pollMsec = SIM_POLL_MAX_MSEC;
+        }
+
+        pthread_mutex_unlock(&p_sim->mutex);
         return;
     }
+
+    setSIMStatus_locked(status);
+    scheduleSettledSIMPoll_locked();
+
+    pthread_mutex_unlock(&p_sim->mutex);
+
+    reportSIMState(NULL);
 }
 
 /** returns 1 if on, 0 if off, and -1 on error */
@@ -3322,6 +4910,7 @@ static void probeForModemMode(ModemInfo *info)
     // Try that first
 
     if (is_multimode_modem(info)) {
+        info->isMultimode = 1;
         RLOGI("Found Multimode Modem. Supported techs mask: %8.8x. Current tech: %d",
             info->supportedTechs, info->currentTech);
         return;
@@ -3347,82 +4936,173 @@ static void probeForModemMode(ModemInfo *info)
     RLOGI("Found GSM Modem");
 }
 
-/**
- * Initialize everything that can be configured while we're still in
- * AT+CFUN=0
- */
-static void initializeCallback(void *param __unused)
-{
-    ATResponse *p_response = NULL;
-    int err;
-
-    setRadioState (RADIO_STATE_OFF);
-
-    at_handshake();
-
-    probeForModemMode(sMdmInfo);
-    /* note: we don't check errors here. Everything important will
-       be handled in onATTimeout and onATReaderClosed */
-
+/* settings only, so atchannel can concatenate them into one line */
+static const char * const s_initCommands[] = {
     /*  atchannel is tolerant of echo but it must */
     /*  have verbose result codes */
-    at_send_command("ATE0Q0V1", NULL);
+    "ATE0Q0V1",
 
     /*  No auto-answer */
-    at_send_command("ATS0=0", NULL);
+    "ATS0=0",
 
-    /*  Extended errors */
-    at_send_command("AT+CMEE=1", NULL);
+    /*  Extended errors; also tells a reconnect whether the modem was reset,
+        see modemKeptSettings() */
+    "AT+CMEE=1",
 
     /*  Network registration events */
-    err = at_send_command("AT+CREG=2", &p_response);
-
-    /* some handsets -- in tethered mode -- don't support CREG=2 */
-    if (err < 0 || p_response->success == 0) {
-        at_send_command("AT+CREG=1", NULL);
-    }
-
-    at_response_free(p_response);
+    "AT+CREG=2",
 
     /*  GPRS registration events */
-    at_send_command("AT+CGREG=1", NULL);
+    "AT+CGREG=1",
 
     /*  Call Waiting notifications */
-    at_send_command("AT+CCWA=1", NULL);
+    "AT+CCWA=1",
 
     /*  Alternating voice/data off */
-    at_send_command("AT+CMOD=0", NULL);
+    "AT+CMOD=0",
 
     /*  Not muted */
-    at_send_command("AT+CMUT=0", NULL);
+    "AT+CMUT=0",
 
     /*  +CSSU unsolicited supp service notifications */
-    at_send_command("AT+CSSN=0,1", NULL);
+    "AT+CSSN=0,1",
 
     /*  no connected line identification */
-    at_send_command("AT+COLP=0", NULL);
+    "AT+COLP=0",
 
     /*  HEX character set */
-    at_send_command("AT+CSCS=\"HEX\"", NULL);
+    "AT+CSCS=\"HEX\"",
 
     /*  USSD unsolicited */
-    at_send_command("AT+CUSD=1", NULL);
+    "AT+CUSD=1",
 
     /*  Enable +CGEV GPRS event notifications, but don't buffer */
-    at_send_command("AT+CGEREP=1,0", NULL);
+    "AT+CGEREP=1,0",
 
     /*  SMS PDU mode */
-    at_send_command("AT+CMGF=0", NULL);
+    "AT+CMGF=0",
 
 #ifdef USE_TI_COMMANDS
 
-    at_send_command("AT%CPI=3", NULL);
+    "AT%CPI=3",
 
     /*  TI specific -- notifications when SMS is ready (currently ignored) */
-    at_send_command("AT%CSTAT=1", NULL);
+    "AT%CSTAT=1",
 
 #endif /* USE_TI_COMMANDS */
+};
+
+static void sendInitCommands()
+{
+    int results[NUM_ELEMS(s_initCommands)];
+    size_t i;
+
+    at_send_command_batch(s_initCommands, NUM_ELEMS(s_initCommands), results);
+
+    currentModem()->cregLocation = 1;
+
+    for (i = 0 ; i < NUM_ELEMS(s_initCommands) ; i++) {
+        /* some handsets -- in tethered mode -- don't support CREG=2 */
+        if (results[i] <= 0 && strcmp(s_initCommands[i], "AT+CREG=2") == 0) {
+            at_send_command("AT+CREG=1", NULL);
+            currentModem()->cregLocation = 0;
+        }
+    }
+}
+
+/**
+ * returns 1 if the modem still has the settings of s_initCommands, which
+ * it keeps unless it was reset: AT+CMEE goes back to 0 on a reset
+ */
+static int modemKeptSettings()
+{
+    ATResponse *p_response = NULL;
+    int err;
+    int mode = 0;
+    char *line;
+
+    err = at_send_command_singleline("AT+CMEE?", "+CMEE:", &p_response);
+
+    if (err == 0 && p_response->success) {
+        line = p_response->p_intermediates->line;
+
+        if (at_tok_start(&line) < 0 || at_tok_nextint(&line, &mode) < 0) {
+            mode = 0;
+        }
+    }
+
+    at_response_free(p_response);
+
+    return mode == 1;
+}
+
+/**
+ * The capabilities in "mdm" came from an earlier connection, but the
+ * technology in use may have changed while the channel was down
+ */
+static void refreshModemMode(ModemInfo *mdm)
+{
+    int current;
+
+    if (IS_MULTIMODE(mdm) && query_ctec(mdm, &current, NULL) >= 0) {
+        setRadioTechnology(mdm, current);
+    }
+}
+
+/**
+ * Initialize everything that can be configured while we're still in
+ * AT+CFUN=0
+ *
+ * "param" is the connection this was scheduled for; a callback left over
+ * from an earlier connection does nothing.
+ *
+ * On a reconnect the modem capabilities are taken from the last probe,
+ * and the settings are only sent again if the modem lost them; the radio
+ * then goes straight to the state the modem is in.
+ */
+static void initializeCallback(void *param)
+{
+    RILModem *p_modem = currentModem();
+    unsigned connection = (unsigned)(uintptr_t)param;
+    int stale;
+    int err;
+
+    pthread_mutex_lock(&p_modem->stateMutex);
+    stale = (connection != p_modem->connection);
+    pthread_mutex_unlock(&p_modem->stateMutex);
 
+    if (stale) {
+        return;
+    }
+
+    if (p_modem->mdmInfoProbed) {
+        err = at_handshake();
+
+        if (err == 0 && modemKeptSettings()) {
+            RLOGI("Modem kept its settings, not sending them again");
+            refreshModemMode(p_modem->mdmInfo);
+
+            /* assume radio is off on error */
+            setRadioState(isRadioOn() > 0 ? RADIO_STATE_ON : RADIO_STATE_OFF);
+            return;
+        }
+
+        setRadioState (RADIO_STATE_OFF);
+        refreshModemMode(p_modem->mdmInfo);
+    } else {
+        setRadioState (RADIO_STATE_OFF);
+
+        err = at_handshake();
+
+        probeForModemMode(p_modem->mdmInfo);
+        /* note: we don't check errors here. Everything important will
+           be handled in onATTimeout and onATReaderClosed */
+
+        /* only a modem that answered could be probed */
+        p_modem->mdmInfoProbed = (err == 0);
+    }
+
+    sendInitCommands();
 
     /* assume radio is off on error */
     if (isRadioOn() > 0) {
@@ -3432,27 +5112,34 @@ static void initializeCallback(void *param __unused)
 
 static void waitForClose()
 {
-    pthread_mutex_lock(&s_state_mutex);
+    RILModem *p_modem = currentModem();
 
-    while (s_closed == 0) {
-        pthread_cond_wait(&s_state_cond, &s_state_mutex);
+    pthread_mutex_lock(&p_modem->stateMutex);
+
+    while (p_modem->closed == 0) {
+        pthread_cond_wait(&p_modem->stateCond, &p_modem->stateMutex);
     }
 
-    pthread_mutex_unlock(&s_state_mutex);
+    pthread_mutex_unlock(&p_modem->stateMutex);
 }
 
 static void sendUnsolImsNetworkStateChanged()
 {
+    RILModem *p_modem = currentModem();
+
 #if 0 // to be used when unsol is changed to return data.
     int reply[2];
-    reply[0] = s_ims_registered;
-    reply[1] = s_ims_services;
-    reply[1] = s_ims_format;
+    reply[0] = p_modem->imsRegistered;
+    reply[1] = p_modem->imsServices;
+    reply[1] = p_modem->imsFormat;
 #endif
     RIL_onUnsolicitedResponse(RIL_UNSOL_RESPONSE_IMS_NETWORK_STATE_CHANGED,
             NULL, 0);
 }
 
+/* a cell broadcast page is at most 88 octets (GSM) or 1252 octets (UMTS) */
+#define MAX_CBM_PDU 1252
+
 /**
  * Called by atchannel when an unsolicited line appears
  * This is called on atchannel's reader thread. AT commands may
@@ -3460,13 +5147,14 @@ static void sendUnsolImsNetworkStateChanged()
  */
 static void onUnsolicited (const char *s, const char *sms_pdu)
 {
+    RILModem *p_modem = currentModem();
     char *line = NULL, *p;
     int err;
 
     /* Ignore unsolicited responses until we're initialized.
      * This is OK because the RIL library will poll for initial state
      */
-    if (sState == RADIO_STATE_UNAVAILABLE) {
+    if (p_modem->radioState == RADIO_STATE_UNAVAILABLE) {
         return;
     }
 
@@ -3492,21 +5180,37 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
                 || strStartsWith(s,"NO CARRIER")
                 || strStartsWith(s,"+CCWA")
     ) {
+        cacheInvalidate(CACHE_CLCC);
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
             NULL, 0);
 #ifdef WORKAROUND_FAKE_CGEV
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL); //TODO use new function
+        /* interface changes are reported for real while if_monitor runs */
+        if (!if_monitor_running()) {
+            requestTimedCallback(onDataCallListChanged, NULL, NULL); //TODO use new function
+        }
 #endif /* WORKAROUND_FAKE_CGEV */
     } else if (strStartsWith(s,"+CREG:")
                 || strStartsWith(s,"+CGREG:")
     ) {
+        cacheUpdateRegistration(
+                strStartsWith(s, "+CREG:") ? CACHE_CREG : CACHE_CGREG, s);
+        cacheInvalidate(CACHE_COPS);
+        onCellInfoMayHaveChanged();
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_VOICE_NETWORK_STATE_CHANGED,
             NULL, 0);
 #ifdef WORKAROUND_FAKE_CGEV
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        if (!if_monitor_running()) {
+            requestTimedCallback(onDataCallListChanged, NULL, NULL);
+        }
 #endif /* WORKAROUND_FAKE_CGEV */
+    } else if (strStartsWith(s, "+CPIN:")) {
+        onSIMStatusLine(s);
+    } else if (strStartsWith(s, "+CSQ:")) {
+        /* same format as the answer to AT+CSQ */
+        cacheSetLine(CACHE_CSQ, s);
+        onCellInfoMayHaveChanged();
     } else if (strStartsWith(s, "+CMT:")) {
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_NEW_SMS,
@@ -3515,16 +5219,30 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
         RIL_onUnsolicitedResponse (
             RIL_UNSOL_RESPONSE_NEW_SMS_STATUS_REPORT,
             sms_pdu, strlen(sms_pdu));
+    } else if (strStartsWith(s, "+CBM:")) {
+        /* RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS takes the raw octets;
+         * decoded on the stack so that a burst of emergency broadcasts
+         * does not allocate per page */
+        uint8_t pdu[MAX_CBM_PDU];
+        ssize_t len = ril_hex_decode(sms_pdu, strlen(sms_pdu), pdu, sizeof(pdu));
+
+        if (len <= 0) {
+            RLOGE("invalid cell broadcast PDU for %s\n", s);
+        } else {
+            RIL_onUnsolicitedResponse (
+                RIL_UNSOL_RESPONSE_NEW_BROADCAST_SMS,
+                pdu, len);
+        }
     } else if (strStartsWith(s, "+CGEV:")) {
         /* Really, we can ignore NW CLASS and ME CLASS events here,
          * but right now we don't since extranous
          * RIL_UNSOL_DATA_CALL_LIST_CHANGED calls are tolerated
          */
         /* can't issue AT commands here -- call on main thread */
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        requestTimedCallback(onDataCallListChanged, NULL, NULL);
 #ifdef WORKAROUND_FAKE_CGEV
     } else if (strStartsWith(s, "+CME ERROR: 150")) {
-        RIL_requestTimedCallback (onDataCallListChanged, NULL, NULL);
+        requestTimedCallback(onDataCallListChanged, NULL, NULL);
 #endif /* WORKAROUND_FAKE_CGEV */
     } else if (strStartsWith(s, "+CTEC: ")) {
         int tech, mask;
@@ -3540,7 +5258,7 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
                      mask != MDM_WCDMA && mask != MDM_LTE) {
                     RLOGE("Unknown technology %d\n", tech);
                 } else {
-                    setRadioTechnology(sMdmInfo, tech);
+                    setRadioTechnology(p_modem->mdmInfo, tech);
                 }
                 break;
         }
@@ -3560,7 +5278,7 @@ static void onUnsolicited (const char *s, const char *sms_pdu)
             free(line);
             return;
         }
-        SSOURCE(sMdmInfo) = source;
+        SSOURCE(p_modem->mdmInfo) = source;
         RIL_onUnsolicitedResponse(RIL_UNSOL_CDMA_SUBSCRIPTION_SOURCE_CHANGED,
                                   &source, sizeof(source));
     } else if (strStartsWith(s, "+WSOS: ")) {
@@ -3616,18 +5334,18 @@ static void onATReaderClosed()
 {
     RLOGI("AT channel closed\n");
     at_close();
-    s_closed = 1;
+    currentModem()->closed = 1;
 
     setRadioState (RADIO_STATE_UNAVAILABLE);
 }
 
-/* Called on command thread */
+/* Called on command thread, once the channel no longer answers a handshake */
 static void onATTimeout()
 {
-    RLOGI("AT channel timeout; closing\n");
+    RLOGI("AT channel unresponsive; closing\n");
     at_close();
 
-    s_closed = 1;
+    currentModem()->closed = 1;
 
     /* FIXME cause a radio reset here */
 
@@ -3646,50 +5364,197 @@ static void usage(char *s __unused)
 {
 #ifdef RIL_SHLIB
     fprintf(stderr, "reference-ril requires: -p <tcp port> or -d /dev/tty_device\n");
+    fprintf(stderr, "  repeat -p, -d or -s for the modem of each further SIM slot\n");
+    fprintf(stderr, "  optional: -t <file> to capture AT traffic for at-replay\n");
 #else
-    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device]\n", s);
+    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device] [-t <capture file>]\n", s);
     exit(-1);
 #endif
 }
 
+/**
+ * Sets up the modem of SIM slot "socketId"; nothing is opened until its
+ * mainLoop runs
+ * returns 0 on success, -1 on error
+ */
+static int initModem(RILModem *p_modem, RIL_SOCKET_ID socketId)
+{
+    p_modem->socketId = socketId;
+    p_modem->port = -1;
+    p_modem->radioState = RADIO_STATE_UNAVAILABLE;
+    pthread_mutex_init(&p_modem->stateMutex, NULL);
+    pthread_cond_init(&p_modem->stateCond, NULL);
+    pthread_mutex_init(&p_modem->cache.mutex, NULL);
+
+    p_modem->imsServices = 1;
+    p_modem->imsFormat = 1;
+#ifdef WORKAROUND_ERRONEOUS_ANSWER
+    p_modem->incomingOrWaitingLine = -1;
+#endif /* WORKAROUND_ERRONEOUS_ANSWER */
+
+    p_modem->channel = at_channel_new(p_modem);
+    p_modem->mdmInfo = calloc(1, sizeof(ModemInfo));
+    p_modem->callTracker = calloc(1, sizeof(CallTracker));
+    p_modem->cellInfo = calloc(1, sizeof(CellInfoState));
+    p_modem->simState = calloc(1, sizeof(SIMState));
+
+    if (p_modem->channel == NULL || p_modem->mdmInfo == NULL
+        || p_modem->callTracker == NULL || p_modem->cellInfo == NULL
+        || p_modem->simState == NULL
+    ) {
+        RLOGE("Unable to alloc memory for modem %d", socketId);
+        return -1;
+    }
+
+    pthread_mutex_init(&p_modem->callTracker->mutex, NULL);
+    p_modem->callTracker->count = -1;
+
+    pthread_mutex_init(&p_modem->cellInfo->mutex, NULL);
+    p_modem->cellInfo->rateMsec = INT_MAX;
+    p_modem->cellInfo->lastCount = -1;
+
+    pthread_mutex_init(&p_modem->simState->mutex, NULL);
+    p_modem->simState->status = -1;
+    p_modem->simState->reported = -1;
+    p_modem->simState->pollMsec = SIM_POLL_MIN_MSEC;
+
+    return 0;
+}
+
+/**
+ * Each -p, -d or -s option gives the modem of the next SIM slot
+ * returns 0 on success, -1 on error
+ */
+static int parseModemOption(int opt, const char *arg)
+{
+    RILModem *p_modem;
+
+    if (s_modemCount >= SIM_COUNT) {
+        RLOGE("More modems given than the %d SIM slot(s)", SIM_COUNT);
+        return -1;
+    }
+
+    p_modem = &s_modems[s_modemCount];
+
+    switch (opt) {
+        case 'p':
+            p_modem->port = atoi(arg);
+            if (p_modem->port == 0) {
+                return -1;
+            }
+            RLOGI("Opening loopback port %d\n", p_modem->port);
+        break;
+
+        case 'd':
+            p_modem->devicePath = arg;
+            RLOGI("Opening tty device %s\n", p_modem->devicePath);
+        break;
+
+        case 's':
+            p_modem->devicePath = arg;
+            p_modem->deviceSocket = 1;
+            RLOGI("Opening socket %s\n", p_modem->devicePath);
+        break;
+
+        default:
+            return -1;
+    }
+
+    s_modemCount++;
+
+    return 0;
+}
+
+/*
+ * Reopening the AT channel: the first attempt after a connection that
+ * stayed up is immediate, after that the delay doubles up to the maximum,
+ * so a modem that is only resetting is back in milliseconds
+ */
+#define RECONNECT_MIN_MSEC 50
+#define RECONNECT_MAX_MSEC (10 * 1000)
+
+static long long nextReconnectDelay(long long delayMsec)
+{
+    if (delayMsec < RECONNECT_MIN_MSEC) {
+        return RECONNECT_MIN_MSEC;
+    }
+
+    return delayMsec * 2 < RECONNECT_MAX_MSEC ? delayMsec * 2
+                                              : RECONNECT_MAX_MSEC;
+}
+
+static void sleepMsec(long long msec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000;
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+        /* sleep out the rest */
+    }
+}
+
+/** makes one attempt, returns the fd or -1 */
+static int openModem(RILModem *p_modem)
+{
+    int fd = -1;
+
+    if (p_modem->port > 0) {
+        fd = socket_network_client("localhost", p_modem->port, SOCK_STREAM);
+    } else if (p_modem->deviceSocket) {
+        fd = socket_local_client(p_modem->devicePath,
+                                 ANDROID_SOCKET_NAMESPACE_FILESYSTEM,
+                                 SOCK_STREAM);
+    } else if (p_modem->devicePath != NULL) {
+        fd = open (p_modem->devicePath, O_RDWR);
+        if ( fd >= 0 && !memcmp( p_modem->devicePath, "/dev/ttyS", 9 ) ) {
+            /* disable echo on serial ports */
+            struct termios  ios;
+            tcgetattr( fd, &ios );
+            ios.c_lflag = 0;  /* disable ECHO, ICANON, etc... */
+            tcsetattr( fd, TCSANOW, &ios );
+        }
+    }
+
+    return fd;
+}
+
 static void *
-mainLoop(void *param __unused)
+mainLoop(void *param)
 {
+    RILModem *p_modem = (RILModem *) param;
     int fd;
     int ret;
+    unsigned connection;
+    long long delayMsec = 0;
+    uint64_t openedNs;
+
+    selectModem(p_modem);
 
     AT_DUMP("== ", "entering mainLoop()", -1 );
     at_set_on_reader_closed(onATReaderClosed);
     at_set_on_timeout(onATTimeout);
 
     for (;;) {
-        fd = -1;
-        while  (fd < 0) {
-            if (s_port > 0) {
-                fd = socket_network_client("localhost", s_port, SOCK_STREAM);
-            } else if (s_device_socket) {
-                fd = socket_local_client(s_device_path,
-                                         ANDROID_SOCKET_NAMESPACE_FILESYSTEM,
-                                         SOCK_STREAM);
-            } else if (s_device_path != NULL) {
-                fd = open (s_device_path, O_RDWR);
-                if ( fd >= 0 && !memcmp( s_device_path, "/dev/ttyS", 9 ) ) {
-                    /* disable echo on serial ports */
-                    struct termios  ios;
-                    tcgetattr( fd, &ios );
-                    ios.c_lflag = 0;  /* disable ECHO, ICANON, etc... */
-                    tcsetattr( fd, TCSANOW, &ios );
-                }
-            }
+        if (delayMsec > 0) {
+            sleepMsec(delayMsec);
+        }
 
-            if (fd < 0) {
-                perror ("opening AT interface. retrying...");
-                sleep(10);
-                /* never returns */
-            }
+        fd = openModem(p_modem);
+
+        if (fd < 0) {
+            delayMsec = nextReconnectDelay(delayMsec);
+            RLOGW("opening AT interface failed (%s), retrying in %lld ms",
+                  strerror(errno), delayMsec);
+            continue;
         }
 
-        s_closed = 0;
+        pthread_mutex_lock(&p_modem->stateMutex);
+        p_modem->closed = 0;
+        connection = ++p_modem->connection;
+        pthread_mutex_unlock(&p_modem->stateMutex);
+
         ret = at_open(fd, onUnsolicited);
 
         if (ret < 0) {
@@ -3697,75 +5562,89 @@ mainLoop(void *param __unused)
             return 0;
         }
 
-        RIL_requestTimedCallback(initializeCallback, NULL, &TIMEVAL_0);
+        /* if the channel closes first, the callback finds itself stale */
+        requestTimedCallback(initializeCallback,
+                             (void *)(uintptr_t)connection, &TIMEVAL_0);
 
-        // Give initializeCallback a chance to dispatched, since
-        // we don't presently have a cancellation mechanism
-        sleep(1);
+        openedNs = ril_nano_time();
 
         waitForClose();
+
+        if (ril_nano_time() - openedNs
+                >= (uint64_t)RECONNECT_MAX_MSEC * 1000000) {
+            delayMsec = 0;
+        } else {
+            /* don't spin on a modem that hangs up right away */
+            delayMsec = nextReconnectDelay(delayMsec);
+        }
+
         RLOGI("Re-opening after close");
     }
 }
 
 #ifdef RIL_SHLIB
 
-pthread_t s_tid_mainloop;
-
 const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **argv)
 {
     int ret;
     int fd = -1;
     int opt;
+    int i;
     pthread_attr_t attr;
 
     s_rilenv = env;
+    s_hasFdCallback = dlsym(RTLD_DEFAULT, "RIL_requestFdCallback") != NULL
+            && env->RequestFdCallback != NULL;
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:"))) {
+    for (i = 0 ; i < SIM_COUNT ; i++) {
+        if (initModem(&s_modems[i], (RIL_SOCKET_ID) i) < 0) {
+            return NULL;
+        }
+    }
+
+    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:t:"))) {
         switch (opt) {
             case 'p':
-                s_port = atoi(optarg);
-                if (s_port == 0) {
+            case 'd':
+            case 's':
+                if (parseModemOption(opt, optarg) < 0) {
                     usage(argv[0]);
                     return NULL;
                 }
-                RLOGI("Opening loopback port %d\n", s_port);
-            break;
-
-            case 'd':
-                s_device_path = optarg;
-                RLOGI("Opening tty device %s\n", s_device_path);
-            break;
-
-            case 's':
-                s_device_path   = optarg;
-                s_device_socket = 1;
-                RLOGI("Opening socket %s\n", s_device_path);
             break;
 
             case 'c':
                 RLOGI("Client id received %s\n", optarg);
             break;
 
+            case 't':
+                RLOGI("Capturing AT traffic to %s\n", optarg);
+                at_trace_open(optarg);
+            break;
+
             default:
                 usage(argv[0]);
                 return NULL;
         }
     }
 
-    if (s_port < 0 && s_device_path == NULL) {
+    if (s_modemCount == 0) {
         usage(argv[0]);
         return NULL;
     }
 
-    sMdmInfo = calloc(1, sizeof(ModemInfo));
-    if (!sMdmInfo) {
-        RLOGE("Unable to alloc memory for ModemInfo");
-        return NULL;
+    initDeviceCapabilities();
+
+    if (if_monitor_start(onInterfaceChanged) < 0) {
+        RLOGW("Not monitoring network interfaces; data call changes will be polled");
     }
+
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    ret = pthread_create(&s_tid_mainloop, &attr, mainLoop, NULL);
+    for (i = 0 ; i < s_modemCount ; i++) {
+        ret = pthread_create(&s_modems[i].tid_mainloop, &attr, mainLoop,
+                             &s_modems[i]);
+    }
 
     return &s_callbacks;
 }
@@ -3775,26 +5654,27 @@ int main (int argc, char **argv)
     int ret;
     int fd = -1;
     int opt;
+    int i;
+
+    for (i = 0 ; i < SIM_COUNT ; i++) {
+        if (initModem(&s_modems[i], (RIL_SOCKET_ID) i) < 0) {
+            exit(-1);
+        }
+    }
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:"))) {
+    while ( -1 != (opt = getopt(argc, argv, "p:d:t:"))) {
         switch (opt) {
             case 'p':
-                s_port = atoi(optarg);
-                if (s_port == 0) {
+            case 'd':
+            case 's':
+                if (parseModemOption(opt, optarg) < 0) {
                     usage(argv[0]);
                 }
-                RLOGI("Opening loopback port %d\n", s_port);
-            break;
-
-            case 'd':
-                s_device_path = optarg;
-                RLOGI("Opening tty device %s\n", s_device_path);
             break;
 
-            case 's':
-                s_device_path   = optarg;
-                s_device_socket = 1;
-                RLOGI("Opening socket %s\n", s_device_path);
+            case 't':
+                RLOGI("Capturing AT traffic to %s\n", optarg);
+                at_trace_open(optarg);
             break;
 
             default:
@@ -3802,13 +5682,24 @@ int main (int argc, char **argv)
         }
     }
 
-    if (s_port < 0 && s_device_path == NULL) {
+    if (s_modemCount == 0) {
         usage(argv[0]);
     }
 
+    initDeviceCapabilities();
+
+    if (if_monitor_start(onInterfaceChanged) < 0) {
+        RLOGW("Not monitoring network interfaces; data call changes will be polled");
+    }
+
     RIL_register(&s_callbacks);
 
-    mainLoop(NULL);
+    for (i = 1 ; i < s_modemCount ; i++) {
+        ret = pthread_create(&s_modems[i].tid_mainloop, NULL, mainLoop,
+                             &s_modems[i]);
+    }
+
+    mainLoop(&s_modems[0]);
 
     return 0;
 }
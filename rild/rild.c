@@ -74,12 +74,16 @@ extern void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
 extern void RIL_requestTimedCallback (RIL_TimedCallback callback,
         void *param, const struct timeval *relativeTime);
 
+extern void RIL_requestFdCallback (int fd, RIL_FdCallback callback,
+        void *param, const struct timeval *timeout);
+
 
 static struct RIL_Env s_rilEnv = {
     RIL_onRequestComplete,
     RIL_onUnsolicitedResponse,
     RIL_requestTimedCallback,
-    RIL_onRequestAck
+    RIL_onRequestAck,
+    RIL_requestFdCallback
 };
 
 extern void RIL_startEventLoop();